@@ -27,7 +27,7 @@
 CLICK_DECLS
 
 
-CTXCRC::CTXCRC() : _add(true)
+CTXCRC::CTXCRC() : _algo(algo_sum)
 {
 }
 
@@ -37,6 +37,21 @@ CTXCRC::~CTXCRC() {
 int
 CTXCRC::configure(Vector<String> &conf, ErrorHandler *errh)
 {
+    String algo = "SUM";
+    if (Args(conf, this, errh)
+        .read("ALGO", WordArg(), algo)
+        .complete() < 0)
+        return -1;
+
+    algo = algo.upper();
+    if (algo == "SUM")
+        _algo = algo_sum;
+    else if (algo == "CRC32")
+        _algo = algo_crc32;
+    else if (algo == "CRC32C")
+        _algo = algo_crc32c;
+    else
+        return errh->error("ALGO must be SUM, CRC32 or CRC32C");
     return 0;
 }
 
@@ -49,7 +64,7 @@ CTXCRC::process_data(fcb_crc* fcb, FlowBufferChunkIter& iterator) {
     unsigned remainder = fcb->remainder;
     while (iterator) {
         auto chunk = *iterator;
-        if (_add) {
+        if (_algo == algo_sum) {
             unsigned* b;
             int l =  chunk.length;
             if (remain) {
@@ -75,8 +90,10 @@ CTXCRC::process_data(fcb_crc* fcb, FlowBufferChunkIter& iterator) {
             for (i = 0; i < remain; i++) {
                 remainder += *b << 8;
             }
-        } else {
+        } else if (_algo == algo_crc32) {
             crc = update_crc(crc, (char *) chunk.bytes, chunk.length);
+        } else {
+            crc = update_crc32c(crc, (char *) chunk.bytes, chunk.length);
         }
         ++iterator;
     }
@@ -12,6 +12,28 @@ struct fcb_crc {
     unsigned int remainder = 0;
 };
 
+/*
+=c
+
+CTXCRC([I<keywords> ALGO])
+
+=s middlebox
+
+computes a checksum of the payload of each flow
+
+=d
+
+Computes a checksum over the payload of each flow, fed chunk by chunk as
+packets arrive, without buffering them.
+
+=item ALGO
+
+Checksum to compute. SUM adds the payload as 32-bit words, CRC32 is the
+Ethernet CRC and CRC32C the Castagnoli CRC used by iSCSI and SCTP. Both
+CRCs use hardware instructions when the CPU supports them. Default is SUM.
+
+=a CheckCRC32, SetCRC32 */
+
 class CTXCRC : public StackChunkBufferElement<CTXCRC,fcb_crc> { //Use CTRP to avoid virtual
     public:
 
@@ -40,7 +62,7 @@ class CTXCRC : public StackChunkBufferElement<CTXCRC,fcb_crc> { //Use CTRP to av
     private:
         static String read_handler(Element *, void *) CLICK_COLD;
         static int write_handler(const String&, Element*, void*, ErrorHandler*) CLICK_COLD;
-        bool _add;
+        enum {algo_sum, algo_crc32, algo_crc32c} _algo;
 };
 
 CLICK_ENDDECLS
@@ -42,7 +42,7 @@ CTXDispatcher::configure(Vector<String> &conf, ErrorHandler *errh)
                 click_chatter("Line : %s",s.c_str());
             }
 
-            rules[i] = FlowClassificationTable::parse(this, s, _verbose, true);
+            rules[i] = FlowClassificationTable::parse(this, s, _verbose, true, true);
             if (rules[i].output == INT_MAX) { // No output is given
                 rules[i].output = ++defaultOutput; //-> take the last seen output + 1
                 if (rules[i].output >= noutputs()) {
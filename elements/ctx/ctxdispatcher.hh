@@ -26,6 +26,11 @@ CLICK_DECLS
  * as TCP packets are IP packets, it is impossible. You can use FlowContextDispatcher to have rules added in a "cascading else" fashion, i.e.
  * if packets are not TCP but still IP packets, go to port 1. This is the default behavior of the context link (~>).
  *
+ * The fields of each rule are tested by increasing offset, whatever the order they are written in, so rules
+ * on the same fields share their levels once combined. Each level then finds the value in a single balanced
+ * node (array, heap or hash) instead of trying the rules one after the other. A network such as
+ * "dst net 10.0.0.0/8" is matched as a masked value, reading only the bytes of the prefix.
+ *
  *
  */
 class CTXDispatcher: public FlowSpaceElement<int> {
@@ -59,6 +59,54 @@ CTXIDSMatcher::configure(Vector<String> &conf, ErrorHandler *errh)
 
 
 
+/**
+ * Without STALL, packets need not be buffered: the automaton runs over the
+ * content of each packet as it comes, starting from the state left by the
+ * previous one.
+ */
+void
+CTXIDSMatcher::push_flow(int port, BufferData<fcb_CTXIDSMatcher>* fcb_data, PacketBatch* flow)
+{
+    if (_stall) {
+        StackBufferElement<CTXIDSMatcher,fcb_CTXIDSMatcher>::push_flow(port, fcb_data, flow);
+        return;
+    }
+
+    SimpleDFA::state_t state = fcb_data->userdata.state;
+    if (unlikely(state == SimpleDFA::MATCHED)) {
+        closeConnection(flow->first(), true);
+        flow->fast_kill();
+        return;
+    }
+
+    Packet* last = 0;
+    int count = 0;
+    FOR_EACH_PACKET(flow, p) {
+        if (!p->isPacketContentEmpty()) {
+            const unsigned char* content = p->getPacketContent();
+            _program.next_chunk(content, p->getPacketContentSize(), state);
+            if (unlikely(state == SimpleDFA::MATCHED)) {
+                _matched++;
+                fcb_data->userdata.state = state;
+                //Packets before the match were clean, let them pass
+                if (last) {
+                    PacketBatch* rest;
+                    flow->cut(last, count, rest);
+                    output_push_batch(0, flow);
+                    flow = rest;
+                }
+                closeConnection(p, true);
+                checked_output_push_batch(1, flow);
+                return;
+            }
+        }
+        last = p;
+        count++;
+    }
+    fcb_data->userdata.state = state;
+    output_push_batch(0, flow);
+}
+
 int CTXIDSMatcher::process_data(fcb_CTXIDSMatcher* fcb_data, FlowBufferContentIter& iterator) {
     SimpleDFA::state_t state = fcb_data->state;
     if (state == SimpleDFA::MATCHED)
@@ -14,14 +14,34 @@ struct fcb_CTXIDSMatcher
 
 /*
 =c
-CTXIDSMatcher(PATTERN_1, ..., PATTERN_N)
+CTXIDSMatcher(PATTERN_1, ..., PATTERN_N [, I<keywords> STALL])
 
 =s
 Block packets matching the content
 
 =d
 
+Looks for the patterns in the content of the flows. The state of the
+automaton is kept in the flow, so a pattern split across packets is found
+without holding back any packet: the scan resumes where the previous packet
+of the flow ended. The packets of the batch before the one completing a
+match go on to output 0. That packet and the rest of its batch are pushed to
+output 1 if it is connected and the connection is closed. Later packets of
+the flow are dropped.
 
+=item STALL
+
+Boolean. Hold back the packets after the last position where no pattern was
+started, so the data of a partial match is not forwarded before it is known
+to be harmless. This needs the packets to be buffered. Default is false.
+
+=h matched read-only
+
+Number of flows in which a pattern was found.
+
+=h stalled read-only
+
+Number of times packets were held back.
 
 =a RegexClassifier */
 class CTXIDSMatcher : public StackBufferElement<CTXIDSMatcher,fcb_CTXIDSMatcher> { //Use CTRP to avoid virtual
@@ -35,6 +55,7 @@ class CTXIDSMatcher : public StackBufferElement<CTXIDSMatcher,fcb_CTXIDSMatcher>
 
 		int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
 		void add_handlers() CLICK_COLD;
+		void push_flow(int port, BufferData<fcb_CTXIDSMatcher>* fcb_data, PacketBatch* flow);
 		int process_data(fcb_CTXIDSMatcher*, FlowBufferContentIter&);
 
         virtual int maxModificationLevel(Element* stop) override {
@@ -5,6 +5,7 @@
 #include <click/config.h>
 #include <click/glue.hh>
 #include <click/args.hh>
+#include <click/straccum.hh>
 #include <click/routervisitor.hh>
 #include "ctxmanager.hh"
 #include "ctxdispatcher.hh"
@@ -26,6 +27,8 @@ CTXManager::CTXManager(): _aggcache(false), _cache(0),_cache_size(4096), _cache_
     _verbose = 0;
     _size_verbose = 0;
 #endif
+    for (unsigned i = 0; i < _batch_stats.weight(); i++)
+        _batch_stats.set_value(i, FlowBatchStats());
 }
 
 CTXManager::~CTXManager() {
@@ -37,6 +40,8 @@ CTXManager::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     int reserve = 0;
     String context = "ETHER";
+    bool arena = false;
+    String hugepages = "none";
 
     if (Args(conf, this, errh)
             .read_p("AGGCACHE",_aggcache)
@@ -55,6 +60,8 @@ CTXManager::configure(Vector<String> &conf, ErrorHandler *errh)
             .read("ORDERED", _ordered) //Enforce FCB order of access
             .read("NOCUT", _nocut)
             .read("OPTIMIZE", _optimize)
+            .read("ARENA", arena)
+            .read("HUGEPAGES", hugepages)
 #if HAVE_FLOW_DYNAMIC
             .read_or_set("RELEASE", _do_release, true)
 #endif
@@ -82,6 +89,20 @@ CTXManager::configure(Vector<String> &conf, ErrorHandler *errh)
     } else
         return errh->error("Invalid context %s !",context.c_str());
 
+    size_t page_size;
+    hugepages = hugepages.upper();
+    if (hugepages == "NONE" || hugepages == "0") {
+        page_size = 0;
+    } else if (hugepages == "2M" || hugepages == "2MB") {
+        page_size = 2UL * 1024 * 1024;
+    } else if (hugepages == "1G" || hugepages == "1GB") {
+        page_size = 1UL * 1024 * 1024 * 1024;
+    } else
+        return errh->error("Invalid HUGEPAGES %s, must be NONE, 2M or 1G !",hugepages.c_str());
+    if (page_size && !arena)
+        return errh->error("HUGEPAGES needs ARENA !");
+    _table.get_pool()->set_arena(arena, page_size);
+
     return 0;
 }
 
@@ -430,8 +451,11 @@ void CTXManager::cleanup(CleanupStage stage) {
         }
         pool_allocator_mt_base::set_dying(previous);
     if (_table.get_root()) {
-        _table.get_root()->traverse_all_leaves([this](FlowNodePtr* ptr) {
-            _table.get_pool()->release(ptr->leaf);
+        //Default leaves may be shared by multiple paths, give each back once
+        std::set<FlowControlBlock*> leaves;
+        _table.get_root()->traverse_all_leaves([this,&leaves](FlowNodePtr* ptr) {
+            if (ptr->leaf && leaves.insert(ptr->leaf).second)
+                _table.get_pool()->release(ptr->leaf);
             ptr->leaf = 0;
         }, true, true);
     }
@@ -613,7 +637,8 @@ void CTXManager::push_batch(int, PacketBatch* batch) {
 //#endif
 }
 
-enum {h_leaves_count, h_active_count, h_print, h_timeout_count};
+enum {h_leaves_count, h_active_count, h_print, h_timeout_count, h_fcb_in_use, h_fcb_reserved, h_fcb_pool,
+      h_flow_batches, h_flow_batch_avg, h_ring_full};
 String CTXManager::read_handler(Element* e, void* thunk) {
     CTXManager* fc = static_cast<CTXManager*>(e);
 
@@ -639,6 +664,37 @@ String CTXManager::read_handler(Element* e, void* thunk) {
         case h_timeout_count:
             return String(fc->_table.old_flows->count());
 #endif
+        case h_fcb_in_use:
+            return String(fc->_table.get_pool()->stats().in_use);
+        case h_fcb_reserved:
+            return String(fc->_table.get_pool()->stats().reserved);
+        case h_fcb_pool: {
+            FCBPool::Stats st = fc->_table.get_pool()->stats();
+            StringAccum acc;
+            acc << "in_use " << st.in_use << "\n"
+                << "reserved " << st.reserved << "\n"
+                << "slabs " << st.slabs << "\n"
+                << "huge_slabs " << st.huge_slabs << "\n"
+                << "memory " << st.memory << "\n"
+                << fc->_table.get_pool()->thread_stats();
+            return acc.take_string();
+        }
+        case h_flow_batches:
+        case h_flow_batch_avg:
+        case h_ring_full: {
+            FlowBatchStats total = FlowBatchStats();
+            for (unsigned i = 0; i < fc->_batch_stats.weight(); i++) {
+                const FlowBatchStats &st = fc->_batch_stats.get_value(i);
+                total.flow_batches += st.flow_batches;
+                total.packets += st.packets;
+                total.ring_full += st.ring_full;
+            }
+            if ((intptr_t)thunk == h_flow_batches)
+                return String(total.flow_batches);
+            if ((intptr_t)thunk == h_ring_full)
+                return String(total.ring_full);
+            return String(total.flow_batches ? (double)total.packets / total.flow_batches : 0.);
+        }
         default:
             return String("<unknown>");
     }
@@ -652,6 +708,12 @@ void CTXManager::add_handlers() {
     add_read_handler("leaves_nondefault_count", CTXManager::read_handler, h_active_count);
     add_read_handler("print_tree", CTXManager::read_handler, h_print);
     add_read_handler("timeout_count", CTXManager::read_handler, h_timeout_count);
+    add_read_handler("fcb_in_use", CTXManager::read_handler, h_fcb_in_use);
+    add_read_handler("fcb_reserved", CTXManager::read_handler, h_fcb_reserved);
+    add_read_handler("fcb_pool", CTXManager::read_handler, h_fcb_pool);
+    add_read_handler("flow_batches", CTXManager::read_handler, h_flow_batches);
+    add_read_handler("flow_batch_avg", CTXManager::read_handler, h_flow_batch_avg);
+    add_read_handler("ring_full", CTXManager::read_handler, h_ring_full);
 }
 
 //int FlowBufferVisitor::shared_position[NR_SHARED_FLOW] = {-1};
@@ -18,11 +18,81 @@ typedef struct {
     FlowControlBlock* fcb;
 } FlowBatch;
 
+/**
+ * Batches of packets of the same flow pushed by a CTXManager
+ */
+struct FlowBatchStats {
+    uint64_t flow_batches;
+    uint64_t packets;
+    uint64_t ring_full;
+};
+
 typedef struct FlowCache_t{
     uint32_t agg;
     FlowControlBlock* fcb;
 } FlowCache;
 
+/*
+=c
+
+CTXManager([I<keywords> BUILDER, AGGCACHE, CACHESIZE, CONTEXT, VERBOSE, ...])
+
+=s middlebox
+
+classifies packets into flows for the CTX elements that follow
+
+=d
+
+Builds the flow classification tree from the CTXDispatcher elements
+downstream, classifies each packet and pushes the packets of each flow as a
+batch, with the flow control block of the flow set.
+
+=item BUILDER
+
+Integer. If not 0, regroup the packets of a batch by flow before pushing them, keeping
+the order of the packets of each flow, so interleaved flows still give
+batches of more than one packet to the CTX elements. Up to 32 flows are
+regrouped at once. If 0, a new batch is pushed each time the flow changes.
+Default is 1.
+
+=item ARENA
+
+Boolean. If true, take the flow control blocks from per-thread slabs
+instead of the general allocator. Default is false.
+
+=item HUGEPAGES
+
+NONE, 2M or 1G. Size of the explicit huge pages to map the ARENA slabs
+from. If they cannot be mapped, normal pages with a transparent huge page
+hint are used. Requires ARENA. Default is NONE.
+
+=h fcb_in_use read-only
+
+Number of flow control blocks in use. Only counted with ARENA.
+
+=h fcb_reserved read-only
+
+Number of flow control blocks carved from the ARENA slabs so far, in use or
+cached for reuse.
+
+=h fcb_pool read-only
+
+Statistics of the ARENA: blocks in use and reserved, number of slabs and of
+huge page slabs, memory mapped, then one line per thread.
+
+=h flow_batches read-only
+
+Number of flow batches pushed.
+
+=h flow_batch_avg read-only
+
+Average number of packets per flow batch.
+
+=h ring_full read-only
+
+Number of flow batches pushed early by the builder because more flows than
+it can regroup were in the same batch.
+*/
 class CTXManager: public VirtualFlowManager, public Router::InitFuture  {
 protected:
     FlowClassificationTable _table;
@@ -54,6 +124,13 @@ protected:
     bool _nocut;
 
     per_thread<FlowBatch*> _builder_batch;
+    per_thread<FlowBatchStats> _batch_stats;
+
+    inline void count_flow_batch(int count) {
+        FlowBatchStats &st = *_batch_stats;
+        st.flow_batches++;
+        st.packets += count;
+    }
 
 
     void build_fcb();
@@ -120,7 +197,12 @@ protected:
 inline void flush_simple(Packet* &last, PacketBatch* awaiting_batch, int &count, const Timestamp &now);
 inline void handle_simple(Packet* &p, Packet* &last, FlowControlBlock* &fcb, PacketBatch* &awaiting_batch, int &count, const Timestamp &now);
 
-#define BUILDER_RING_SIZE 16
+/*
+ * Flows regrouped at once by the builder. When a batch has more flows, the
+ * oldest flow batch is pushed early, so this should be at least the usual
+ * batch size.
+ */
+#define BUILDER_RING_SIZE 32
 
 struct Builder {
     FlowBatch batches[BUILDER_RING_SIZE];
@@ -216,6 +298,7 @@ inline void CTXManager::handle_simple(Packet* &p, Packet* &last, FlowControlBloc
                 awaiting_batch->set_tail(last);
                 awaiting_batch->set_count(count);
                 fcb_stack->lastseen = now;
+                count_flow_batch(count);
                 output_push_batch(0, awaiting_batch);
                 awaiting_batch = PacketBatch::start_head(p);
                 fcb_stack = fcb;
@@ -235,6 +318,7 @@ inline void CTXManager::flush_simple(Packet* &last, PacketBatch* awaiting_batch,
         last->set_next(0);
         awaiting_batch->set_tail(last);
         awaiting_batch->set_count(count);
+        count_flow_batch(count);
         output_push_batch(0,awaiting_batch);
         fcb_stack = 0;
     }
@@ -262,8 +346,8 @@ inline void CTXManager::handle_builder(Packet* &p, Packet* &last, FlowControlBlo
                     builder.batches[builder.curbatch].batch->set_tail(last);
                 }
 
-                //Find a potential match
-                for (int i = builder.tail; i < builder.head; i++) {
+                //Find a potential match, the most recent flows are the most likely
+                for (int i = builder.head - 1; i >= builder.tail; i--) {
                     if (builder.batches[i % BUILDER_RING_SIZE].fcb == fcb) { //Flow already in list, append
                         //click_chatter("Flow already in list");
                         builder.curbatch = i % BUILDER_RING_SIZE;
@@ -283,6 +367,8 @@ inline void CTXManager::handle_builder(Packet* &p, Packet* &last, FlowControlBlo
                         click_chatter("WARNING (unoptimized) Ring full with batch of %d packets, processing now !", b.batch->count());
                     }
                     //Ring full, process batch NOW
+                    _batch_stats->ring_full++;
+                    count_flow_batch(b.batch->count());
                     fcb_stack = b.fcb;
 #if HAVE_FLOW_DYNAMIC
                     fcb_stack->acquire(b.batch->count());
@@ -323,6 +409,7 @@ inline void CTXManager::flush_builder(Packet* &last, Builder &builder, const Tim
         fcb_stack->acquire(b.batch->count());
 #endif
         fcb_stack->lastseen = now;
+        count_flow_batch(b.batch->count());
         //click_chatter("EPush %d of %d packets",tail % BUILDER_RING_SIZE,batches[tail % BUILDER_RING_SIZE].batch->count());
         output_push_batch(0,b.batch);
 
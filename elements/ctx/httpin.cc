@@ -63,6 +63,7 @@ void
 HTTPIn::requestTerminated() {
     auto fcb = fcb_data();
     fcb->headerFound = false;
+    fcb->fieldsValid = false;
     fcb->contentSeen = 0;
     fcb->contentRemoved = 0;
 }
@@ -73,6 +74,7 @@ HTTPIn::maxModificationLevel(Element* stop)
         int r = CTXSpaceElement<fcb_httpin>::maxModificationLevel(stop);
         if (_set10 || _remove_encoding)
             return r | MODIFICATION_RESIZE;
+        return r;
 }
 
 int constexpr length(const char* str)
@@ -82,6 +84,12 @@ int constexpr length(const char* str)
 
 void HTTPIn::push_flow(int port, fcb_httpin* fcb, PacketBatch* flow)
 {
+    //The parser may keep a line split across packets until the end of the connection
+    if (unlikely(!fcb->registered)) {
+        if (registerConnectionClose(fcb, &release_fnt, this))
+            fcb->registered = true;
+    }
+
     auto fnt = [this,fcb](Packet* &p) -> bool {
         // Check that the packet contains HTTP content
         if(p->isPacketContentEmpty())
@@ -93,57 +101,47 @@ void HTTPIn::push_flow(int port, fcb_httpin* fcb, PacketBatch* flow)
 
         WritablePacket* packet = p->uniqueify();
         p = packet;
-        if(!fcb->headerFound)
-        {
-            // Search the end of the first line
-            char* current = (char*)memchr(packet->getPacketContent(), '\r', getPayloadLength(packet));
-            if(current == NULL) {
-                    click_chatter("Probable attack : no method in HTTP");
-                    closeConnection(packet, false); //Todo : support inter-packet header
-                    return false;
-            }
 
-            int endOfMethod = current - (char*)packet->getPacketContent();
+        const unsigned char* data = packet->getPacketContent();
+        unsigned length = packet->getPacketContentSize();
+        unsigned pos = 0;
+        int headerEnd = -1;
+        bool last = false;
+        bool startInHeaders = fcb->parser.in_headers();
+        HTTPLine line;
+
+        //Only the fields of the packet ending the header block are kept
+        if (startInHeaders) {
+            fcb->fieldCount = 0;
+            fcb->fieldsValid = false;
+        }
 
-            if (_set10) {
-                packet = setHTTP10(fcb, packet, endOfMethod);
-                current = (char*)(packet->getPacketContent() + endOfMethod);
-            }
-            current += 2;
-            StringRef method((char*)packet->getPacketContent(), (char*)current);
-            //click_chatter("Method : %s", method.c_str());
-
-//            fcb->isRequest = true;
-            // Compute the offset of the HTML payload
-            //Hashmap<Header> headers;
-
-            int left = packet->getPacketContentSize() - endOfMethod;
-            do {
-                char* end = (char*)memchr(current, '\r',left);
-                if (end == 0) {
-                    click_chatter("Probable attack : no end of header in HTTP");
-                    closeConnection(packet, false); //Todo : support inter-packet header
-                    return false;
-                }
-                if (end-current == 0) {
-                    break; //Found the double termination
+        while (true) {
+            HTTPParser::Event ev = fcb->parser.parse(data, length, pos, line);
+            if (ev == HTTPParser::NEED_MORE)
+                break;
+            switch (ev) {
+            case HTTPParser::START_LINE:
+                fcb->isRequest = !fcb->parser.is_response();
+                fcb->fieldCount = 0;
+                fcb->fieldsValid = false;
+                fcb->CLRemoved = false;
+                fcb->KARemoved = false;
+                if (_set10 && line.position >= 0) {
+                    int end = line.position + line.length;
+                    int prev = end;
+                    packet = setHTTP10(packet, line.position, end);
+                    p = packet;
+                    pos += end - prev;
+                    data = packet->getPacketContent();
+                    length = packet->getPacketContentSize();
                 }
-                //Header header;
-                char* split = (char*)memchr(current, ':', end-current);
-                if (split == NULL) {
-                    click_chatter("Malformed HTTP header %s",String(current,end-current).c_str());
-                    closeConnection(packet, false);
-                    return false;
-                }
-                StringRef header = StringRef(current, split);
-                StringRef value = StringRef(split + 2, end);
-                int pos = current - (char*)packet->getPacketContent();
-
+                break;
+            case HTTPParser::FIELD: {
                 bool remove = false;
-                if (_remove_encoding && header == "Accept-Encoding") {
+                if (_remove_encoding && http_name_equals(line.name, line.name_length, "accept-encoding", 15)) {
                     remove = true;
-                } else if (header == "Content-Length") {
-                    fcb->contentLength = (uint64_t)atol(value.data());
+                } else if (http_name_equals(line.name, line.name_length, "content-length", 14)) {
                     if (_buffer == 0 && _resize) {
                         if (_fill == RESIZE_CHUNKED || _set10) {
                             fcb->CLRemoved = true;
@@ -153,55 +151,74 @@ void HTTPIn::push_flow(int port, fcb_httpin* fcb, PacketBatch* flow)
 
                         }
                     }
-                } else if (header == "Connection") {
+                } else if (http_name_equals(line.name, line.name_length, "connection", 10)) {
                     if ((_fill == RESIZE_CHUNKED || _set10) && (_buffer == 0 && _resize)) {
-                        if (value == "keep-alive") {
+                        if (StringRef(line.value, line.value_length) == "keep-alive") {
                             remove = true;
                             fcb->KARemoved = true;
                         }
                     }
                 }
 
-                //click_chatter("header %s, value %s", header.header.c_str(), header.value.c_str());
-                //headers.insert(header);
-                //
-                if (remove) {
-                    click_chatter("Removing");
-                    CTXElement::removeBytes(packet, pos, end - current + 2);
-                    current = (char*)packet->getPacketContent() + pos;
-                } else {
-                    current = end + 2;
+                if (line.position < 0) {
+                    //The line started in a previous packet, it cannot be
+                    //removed nor pointed to
+                    if (remove && _verbose)
+                        click_chatter("Header split across packets, not removed");
+                } else if (remove) {
+                    if (unlikely(_verbose))
+                        click_chatter("Removing %s", String(line.name, line.name_length).c_str());
+                    CTXElement::removeBytes(packet, line.position, pos - line.position);
+                    pos = line.position;
+                    data = packet->getPacketContent();
+                    length = packet->getPacketContentSize();
+                } else if (fcb->fieldCount < HTTP_MAX_FIELDS) {
+                    const char* base = (const char*)packet->network_header();
+                    HTTPField &f = fcb->fields[fcb->fieldCount++];
+                    f.name = line.name - base;
+                    f.nameLength = line.name_length;
+                    f.value = line.value - base;
+                    f.valueLength = line.value_length;
                 }
-            } while(true);
-            current += 2;
-
-
-            if (!_set10 && fcb->CLRemoved) {
-                //TODO : add chunked encoding
+                break;
             }
-
-            if(current != NULL)
-            {
-                int offset = (int)(current - (char*)packet->data());
-                int headerSize =  offset;
-                packet->setContentOffset(headerSize);
-                fcb->headerFound = headerSize;
-                if (unlikely(_verbose))
-                    click_chatter("Header size %d. First two bytes : %x%x", headerSize, packet->getPacketContent()[0], packet->getPacketContent()[1]);
+            case HTTPParser::HEADERS_DONE:
+                fcb->headerFound = true;
+                fcb->fieldsValid = true;
+                fcb->fieldsSeq = getSequenceNumber(packet);
+                fcb->contentLength = fcb->parser.content_length();
+                fcb->contentSeen = 0;
+                if (headerEnd < 0)
+                    headerEnd = pos;
+                break;
+            case HTTPParser::MESSAGE_DONE:
+                last = true;
+                break;
+            default:
+                click_chatter("Probable attack : malformed HTTP message");
+                closeConnection(packet, false);
+                return false;
             }
+        }
 
-
+        if (headerEnd >= 0) {
+            int offset = packet->getContentOffset() + headerEnd;
+            packet->setContentOffset(offset);
+            if (unlikely(_verbose))
+                click_chatter("Header size %d", offset);
+        } else if (startInHeaders && fcb->parser.in_headers()) {
+            //Only headers in this packet
+            packet->setContentOffset(packet->length());
         }
 
         // Add the size of the HTTP content to the counter
         uint16_t currentContent = packet->getPacketContentSize();
         fcb->contentSeen += currentContent;
 
-        // Check if we have seen all the HTTP content
         if (_verbose)
             click_chatter("Seen %d (current %d), removed %d, length %d", fcb->contentSeen, currentContent, fcb->contentRemoved, fcb->contentLength);
 
-        if(fcb->contentSeen >= fcb->contentLength) {
+        if (last) {
             if (_verbose)
                 click_chatter("Last usefull packet !");
             setAnnotationLastUseful(packet, true);
@@ -212,6 +229,37 @@ void HTTPIn::push_flow(int port, fcb_httpin* fcb, PacketBatch* flow)
     if (flow)
 	    output(0).push_batch(flow);
 }
+
+StringRef
+HTTPIn::getHeader(Packet* packet, const StringRef &name)
+{
+    fcb_httpin* fcb = fcb_data();
+    if (!fcb->fieldsValid || fcb->fieldsSeq != getSequenceNumber(packet))
+        return StringRef();
+    const char* base = (const char*)packet->network_header();
+    unsigned size = packet->end_data() - packet->network_header();
+    for (int i = 0; i < fcb->fieldCount; i++) {
+        const HTTPField &f = fcb->fields[i];
+        if ((unsigned)f.value + f.valueLength > size)
+            break;
+        if (http_name_equals(base + f.name, f.nameLength, name.data(), name.length()))
+            return StringRef(base + f.value, f.valueLength);
+    }
+    return StringRef();
+}
+
+void
+HTTPIn::release_fnt(FlowControlBlock* fcb, void* thunk)
+{
+    HTTPIn* e = static_cast<HTTPIn*>(thunk);
+    fcb_httpin* fcb_in = e->fcb_data_for(fcb);
+    fcb_in->parser.release();
+    fcb_in->parser.reset();
+    fcb_in->registered = false;
+    if (fcb_in->previous_fnt)
+        fcb_in->previous_fnt(fcb, fcb_in->previous_thunk);
+}
+
 /*
 void HTTPIn::setHeader(WritablePacket*, const char* header, String value) {
 
@@ -291,32 +339,34 @@ bool HTTPIn::getHeaderContent(struct fcb_httpin *fcb, WritablePacket* packet, co
     return true;
 }
 
-WritablePacket* HTTPIn::setHTTP10(struct fcb_httpin *fcb, WritablePacket *packet, int &endFirstLine)
+WritablePacket* HTTPIn::setHTTP10(WritablePacket *packet, int startOfLine, int &endOfLine)
 {
-    unsigned char* source = getPayload(packet);
+    unsigned char* source = packet->getPacketContent();
 
     // Search the HTTP version
-    unsigned char* beginning = (unsigned char*)searchInContent((char*)source, "HTTP/",
-        endFirstLine);
+    unsigned char* beginning = (unsigned char*)searchInContent((char*)source + startOfLine, "HTTP/",
+        endOfLine - startOfLine);
 
     if(beginning == NULL)
         return packet;
 
-    uint32_t lengthLeft = getPayloadLength(packet) - (beginning - source);
+    uint32_t lengthLeft = endOfLine - (beginning - source);
 
     unsigned char* endVersion = (unsigned char*)searchInContent((char*)beginning, " ", lengthLeft);
-    if(endVersion == NULL || endVersion > source + endFirstLine)
-        endVersion = source + endFirstLine;
+    if(endVersion == NULL || endVersion > source + endOfLine)
+        endVersion = source + endOfLine;
 
     // Ensure that the line has the right length
+    int position = beginning - source;
     int offset = endVersion - beginning - 8; // 8 is the length of "HTTP/1.1"
     if(offset > 0)
-        CTXElement::removeBytes(packet, beginning - source + 8, offset);
-    else
-        packet = CTXElement::insertBytes(packet , beginning - source + 5, -offset);
+        CTXElement::removeBytes(packet, position + 8, offset);
+    else if (offset < 0)
+        packet = CTXElement::insertBytes(packet, position + 5, -offset);
 
-    endFirstLine -= offset;
+    endOfLine -= offset;
 
+    beginning = packet->getPacketContent() + position;
     beginning[5] = '1';
     beginning[6] = '.';
     beginning[7] = '0';
@@ -3,14 +3,33 @@
 #include <click/element.hh>
 #include "ctxelement.hh"
 #include <click/tcphelper.hh>
+#include "httpparser.hh"
 
 CLICK_DECLS
 
+/**
+ * Maximal number of header fields of a message that HTTPIn remembers
+ */
+#define HTTP_MAX_FIELDS 16
+
+/**
+ * Position of a header field, as offsets from the network header of the
+ * packet that carried it
+ */
+struct HTTPField {
+    uint16_t name;
+    uint16_t nameLength;
+    uint16_t value;
+    uint16_t valueLength;
+};
+
 /**
  * Structure used by the HTTPIn element
  */
-struct fcb_httpin
+struct fcb_httpin : public StackReleaseChain
 {
+    HTTPParser parser;
+    bool registered;
     bool headerFound;
 //    char url[2048];
 //    char method[16];
@@ -20,9 +39,16 @@ struct fcb_httpin
     bool CLRemoved;
     bool KARemoved;
     bool isRequest;
+    uint8_t fieldCount;
+    bool fieldsValid;
+    tcp_seq_t fieldsSeq; //Sequence number of the packet carrying the fields
+    HTTPField fields[HTTP_MAX_FIELDS];
 
     fcb_httpin()
     {
+        registered = false;
+        fieldCount = 0;
+        fieldsValid = false;
         headerFound = false;
         contentSeen = 0;
         contentLength = 0;
@@ -39,7 +65,7 @@ enum fill_method{RESIZE_FILL_END, RESIZE_FILL, RESIZE_CHUNKED, RESIZE_HTTP10};
 /*
 =c
 
-HTPPIn()
+HTPPIn([I<keywords> HTTP10, NOENC, BUFFER, RESIZE_METHOD, VERBOSE])
 
 =s middlebox
 
@@ -51,6 +77,41 @@ This element is the entry point of an HTTP path in the stack of the middlebox by
 HTTP packets must go before their HTTP content is processed. Each path containing an HTTPIn element
 must also contain an HTTPOut element
 
+Messages are parsed incrementally as packets arrive, so headers may span
+multiple packets. Bodies are delimited by their Content-Length or chunked
+encoding, and the content offset of each packet is set after the header
+block it carries. Successive messages of a persistent connection are
+followed, including pipelined ones. Malformed messages, and messages with a
+line longer than 8192 bytes, close the connection.
+
+The fields of the last header block are remembered as positions in the
+packet that carried them, so elements after HTTPIn can read them with
+HTTPIn::getHeader without searching the packet again. Only the fields in the
+packet ending the header block are remembered, up to 16.
+
+=item HTTP10
+
+Boolean. Rewrite the version of requests to HTTP/1.0. Default is false.
+
+=item NOENC
+
+Boolean. Remove the Accept-Encoding header so the content is not compressed.
+Default is false.
+
+=item BUFFER
+
+Size of the buffer used by HTTPOut to keep the content until it can rewrite
+Content-Length. Default is 65536.
+
+=item RESIZE_METHOD
+
+How to handle the content length when the content is resized without being
+buffered. "fill_end" or "fill".
+
+=item VERBOSE
+
+Boolean. Default is false.
+
 =a HTTPOut */
 
 class HTTPIn : public CTXSpaceElement<fcb_httpin>, TCPHelper
@@ -74,6 +135,15 @@ public:
     //Called by OUT when the request is finished to reset buffer for a new request (HTTP connections can be re-used)
     void requestTerminated();
 
+    /** @brief Return the value of a header field of the current message
+     * @param packet Packet that carried the end of the header block
+     * @param name Name of the field, case-insensitive
+     * @return The value, pointing in the packet, or an empty reference if
+     * the field was not seen in that packet or the packet is not the last
+     * one that ended a header block
+     */
+    StringRef getHeader(Packet* packet, const StringRef &name);
+
     bool _set10;
     bool _remove_encoding;
     int _buffer;
@@ -89,6 +159,8 @@ protected:
 private:
     bool _verbose;
 
+    static void release_fnt(FlowControlBlock* fcb, void* thunk);
+
     /** @brief Remove an HTTP header from a request or a response
      * @param fcb Pointer to the FCB of the flow
      * @param packet Packet in which the header is located
@@ -115,11 +187,12 @@ private:
     void setRequestParameters(struct fcb_httpin *fcb, WritablePacket *packet);
 
     /** @brief Modify the HTTP version in the header to set it to 1.0
-     * @param fcb Pointer to the FCB of the flow
      * @param packet Packet in which the headers are located
+     * @param startOfLine Position of the first line in the content
+     * @param endOfLine Position of the end of the first line, updated
      * @return The packet with the HTTP version modified
      */
-    WritablePacket* setHTTP10(struct fcb_httpin *fcb, WritablePacket *packet, int &endOfMethod) CLICK_WARN_UNUSED_RESULT;
+    WritablePacket* setHTTP10(WritablePacket *packet, int startOfLine, int &endOfLine) CLICK_WARN_UNUSED_RESULT;
 };
 
 CLICK_ENDDECLS
@@ -186,23 +186,33 @@ WritablePacket* HTTPOut::setHeaderContent(struct fcb_httpout *fcb, WritablePacke
     uint16_t offsetTcp = getPayloadOffset(packet);
     packet->setContentOffset(offsetTcp);
 
-    unsigned char* beginning = (unsigned char*)searchInContent((char*)source, headerName,
-        getPayloadLength(packet));
+    unsigned char* beginning;
+    unsigned char* end;
 
-    if(beginning == NULL)
-        return packet;
+    // Use the position found by HTTPIn if this packet carried the header block
+    StringRef current = _in->getHeader(packet, headerName);
+    if (current.data()) {
+        beginning = (unsigned char*)current.data();
+        end = beginning + current.length();
+    } else {
+        beginning = (unsigned char*)searchInContent((char*)source, headerName,
+            getPayloadLength(packet));
 
-    beginning += headerName.length() + 1;
+        if(beginning == NULL)
+            return packet;
 
-    uint32_t lengthLeft = getPayloadLength(packet) - (beginning - source);
+        beginning += headerName.length() + 1;
 
-    unsigned char* end = (unsigned char*)searchInContent((char*)beginning, "\r\n", lengthLeft);
-    if(end == NULL)
-        return packet;
+        uint32_t lengthLeft = getPayloadLength(packet) - (beginning - source);
 
-    // Skip spaces at the beginning of the string
-    while(beginning < end && beginning[0] == ' ')
-        beginning++;
+        end = (unsigned char*)searchInContent((char*)beginning, "\r\n", lengthLeft);
+        if(end == NULL)
+            return packet;
+
+        // Skip spaces at the beginning of the string
+        while(beginning < end && beginning[0] == ' ')
+            beginning++;
+    }
 
     uint32_t startPos = beginning - source;
     uint32_t newSize = content.length();
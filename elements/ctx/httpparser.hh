@@ -0,0 +1,430 @@
+/*
+ * httpparser.hh - Incremental HTTP/1.x message parser used by HTTPIn
+ */
+
+#ifndef MIDDLEBOX_HTTPPARSER_HH
+#define MIDDLEBOX_HTTPPARSER_HH
+
+#include <click/config.h>
+#include <click/glue.hh>
+#ifdef HAVE_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+CLICK_DECLS
+
+/**
+ * Maximal length of a line of a message. Messages with longer lines are
+ * refused, as most servers do.
+ */
+#define HTTP_MAX_LINE 8192
+
+/**
+ * Find the first line feed in [s, end), or return NULL
+ */
+inline const unsigned char*
+http_find_lf(const unsigned char* s, const unsigned char* end)
+{
+#ifdef HAVE_AVX2
+    const __m256i lf = _mm256_set1_epi8('\n');
+    while (end - s >= 32) {
+        unsigned m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s)), lf));
+        if (m)
+            return s + __builtin_ctz(m);
+        s += 32;
+    }
+#elif defined(__SSE2__)
+    const __m128i lf = _mm_set1_epi8('\n');
+    while (end - s >= 16) {
+        unsigned m = _mm_movemask_epi8(_mm_cmpeq_epi8(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(s)), lf));
+        if (m)
+            return s + __builtin_ctz(m);
+        s += 16;
+    }
+#endif
+    if (s >= end)
+        return 0;
+    return (const unsigned char*)memchr(s, '\n', end - s);
+}
+
+/**
+ * Case-insensitive comparison of field names
+ */
+inline bool
+http_name_equals(const char* s, unsigned len, const char* name, unsigned name_len)
+{
+    if (len != name_len)
+        return false;
+    for (unsigned i = 0; i < len; i++)
+        if ((s[i] | 0x20) != (name[i] | 0x20))
+            return false;
+    return true;
+}
+
+/**
+ * A line returned by the parser. When the line was split across packets,
+ * data points to the parser's own copy, valid until the next call to the
+ * parser, and position is -1. Otherwise data points in the parsed buffer at
+ * offset position.
+ */
+struct HTTPLine {
+    const char* data;
+    unsigned length; //Without the line terminator
+    int position;
+    //Set for header fields
+    const char* name;
+    unsigned name_length;
+    const char* value;
+    unsigned value_length;
+};
+
+/**
+ * Resumable HTTP/1.x parser, meant to be kept in the FCB
+ *
+ * The parser is fed the payload of each packet of one direction in order,
+ * and stops on each event of interest, so the caller can act on the current
+ * line (e.g. remove it) before resuming. Body framing is followed from
+ * Content-Length and chunked Transfer-Encoding, so successive messages of a
+ * persistent connection, pipelined or not, are found wherever they start.
+ * Bodies are skipped without being looked at.
+ *
+ * Messages without a length are requests without a body, or responses that
+ * end with the connection. Responses to HEAD are not recognized, as the
+ * parser does not see the requests.
+ *
+ * Lines split across packets are copied in a buffer allocated while they are
+ * incomplete. release() must be called when the flow is released.
+ */
+class HTTPParser { public:
+
+    HTTPParser() : _carry(0) {
+        reset();
+    }
+
+    enum Event {
+        NEED_MORE, //All the data was consumed
+        START_LINE, //Request or status line
+        FIELD, //Header field
+        HEADERS_DONE, //End of the header block, the body follows
+        MESSAGE_DONE, //End of the body
+        ERROR
+    };
+
+    enum State {
+        S_START_LINE = 0,
+        S_HEADERS,
+        S_BODY,
+        S_BODY_UNTIL_CLOSE,
+        S_CHUNK_SIZE,
+        S_CHUNK_DATA,
+        S_CHUNK_DATA_END,
+        S_TRAILERS,
+        S_DONE
+    };
+
+    inline void reset() {
+        _state = S_START_LINE;
+        _carry_length = 0;
+        _carried = false;
+        _remaining = 0;
+        _content_length = 0;
+        _has_length = false;
+        _chunked = false;
+        _response = false;
+        _no_body = false;
+    }
+
+    /**
+     * Free the buffer of a line split across packets, if any
+     */
+    inline void release() {
+        delete[] _carry;
+        _carry = 0;
+        _carry_length = 0;
+        _carried = false;
+    }
+
+    /**
+     * Parse data from pos until the next event, advancing pos past what was
+     * consumed. For START_LINE and FIELD, line is set to the line. Lines
+     * longer than HTTP_MAX_LINE give an ERROR.
+     */
+    inline Event parse(const unsigned char* data, unsigned length, unsigned &pos, HTTPLine &line);
+
+    inline State state() const {
+        return (State)_state;
+    }
+
+    inline bool in_headers() const {
+        return _state == S_START_LINE || _state == S_HEADERS;
+    }
+
+    inline bool is_response() const {
+        return _response;
+    }
+
+    inline bool is_chunked() const {
+        return _chunked;
+    }
+
+    /**
+     * Content-Length of the current message, 0 if it has none
+     */
+    inline uint64_t content_length() const {
+        return _content_length;
+    }
+
+  private:
+    uint64_t _remaining;
+    uint64_t _content_length;
+    char* _carry;
+    uint16_t _carry_length;
+    uint8_t _state;
+    bool _carried;
+    bool _has_length;
+    bool _chunked;
+    bool _response;
+    bool _no_body;
+
+    inline int next_line(const unsigned char* data, unsigned length, unsigned &pos, HTTPLine &line);
+    inline bool carry(const unsigned char* s, unsigned n);
+    inline bool parse_field(HTTPLine &line);
+    inline bool parse_chunk_size(const HTTPLine &line);
+    inline void end_headers();
+};
+
+/**
+ * Append to the line split across packets, return false if it is too long
+ */
+inline bool
+HTTPParser::carry(const unsigned char* s, unsigned n)
+{
+    if (n > HTTP_MAX_LINE - (unsigned)_carry_length)
+        return false;
+    if (!_carry)
+        _carry = new char[HTTP_MAX_LINE];
+    memcpy(_carry + _carry_length, s, n);
+    _carry_length += n;
+    return true;
+}
+
+/**
+ * Get the next complete line. If the line is not complete, its start is kept
+ * and all the data is consumed. Return 1 if a line was found, 0 if more data
+ * is needed, and -1 if the line is too long.
+ */
+inline int
+HTTPParser::next_line(const unsigned char* data, unsigned length, unsigned &pos, HTTPLine &line)
+{
+    //The last line split across packets was used by the caller
+    if (unlikely(_carry != 0) && !_carried)
+        release();
+    const unsigned char* lf = http_find_lf(data + pos, data + length);
+    if (!lf) {
+        if (!carry(data + pos, length - pos))
+            return -1;
+        _carried = true;
+        pos = length;
+        return 0;
+    }
+    unsigned end = lf - data;
+    if (unlikely(_carried)) {
+        if (!carry(data + pos, end - pos))
+            return -1;
+        line.data = _carry;
+        line.length = _carry_length;
+        line.position = -1;
+        _carried = false;
+        _carry_length = 0;
+    } else {
+        line.data = (const char*)data + pos;
+        line.length = end - pos;
+        line.position = pos;
+        if (line.length > HTTP_MAX_LINE)
+            return -1;
+    }
+    if (line.length && line.data[line.length - 1] == '\r')
+        line.length--;
+    pos = end + 1;
+    return 1;
+}
+
+/**
+ * Split a header field and look at the ones defining the body length
+ */
+inline bool
+HTTPParser::parse_field(HTTPLine &line)
+{
+    const char* colon = (const char*)memchr(line.data, ':', line.length);
+    //Obsolete line folding is refused, as RFC 7230 allows
+    if (!colon || colon == line.data || line.data[0] == ' ' || line.data[0] == '\t')
+        return false;
+    const char* end = line.data + line.length;
+    const char* value = colon + 1;
+    while (value < end && (*value == ' ' || *value == '\t'))
+        value++;
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t'))
+        end--;
+    line.name = line.data;
+    line.name_length = colon - line.data;
+    line.value = value;
+    line.value_length = end - value;
+
+    if (http_name_equals(line.name, line.name_length, "content-length", 14)) {
+        if (value == end)
+            return false;
+        uint64_t l = 0;
+        for (const char* c = value; c < end; c++) {
+            if (*c < '0' || *c > '9' || l > (UINT64_MAX - 9) / 10)
+                return false;
+            l = l * 10 + (*c - '0');
+        }
+        //Differing lengths are a request smuggling attempt
+        if (_has_length && l != _content_length)
+            return false;
+        _content_length = l;
+        _has_length = true;
+    } else if (http_name_equals(line.name, line.name_length, "transfer-encoding", 17)) {
+        //Chunked must be the last coding
+        _chunked = line.value_length >= 7 && http_name_equals(end - 7, 7, "chunked", 7);
+    }
+    return true;
+}
+
+inline bool
+HTTPParser::parse_chunk_size(const HTTPLine &line)
+{
+    uint64_t size = 0;
+    unsigned i;
+    for (i = 0; i < line.length; i++) {
+        char c = line.data[i];
+        int v;
+        if (c >= '0' && c <= '9')
+            v = c - '0';
+        else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+            v = (c | 0x20) - 'a' + 10;
+        else
+            break;
+        if (size >> 60)
+            return false;
+        size = (size << 4) | v;
+    }
+    //Anything after the size must be an extension
+    if (i == 0 || (i < line.length && line.data[i] != ';' && line.data[i] != ' ' && line.data[i] != '\t'))
+        return false;
+    if (size == 0) {
+        _state = S_TRAILERS;
+    } else {
+        _remaining = size;
+        _state = S_CHUNK_DATA;
+    }
+    return true;
+}
+
+/**
+ * Choose how the body is delimited
+ */
+inline void
+HTTPParser::end_headers()
+{
+    if (_no_body) {
+        _state = S_DONE;
+    } else if (_chunked) {
+        //Transfer-Encoding overrides Content-Length
+        _content_length = 0;
+        _state = S_CHUNK_SIZE;
+    } else if (_has_length) {
+        _remaining = _content_length;
+        _state = _remaining ? S_BODY : S_DONE;
+    } else if (_response) {
+        _state = S_BODY_UNTIL_CLOSE;
+    } else {
+        _state = S_DONE;
+    }
+}
+
+inline HTTPParser::Event
+HTTPParser::parse(const unsigned char* data, unsigned length, unsigned &pos, HTTPLine &line)
+{
+    while (true) {
+        switch (_state) {
+        case S_DONE:
+            _state = S_START_LINE;
+            return MESSAGE_DONE;
+        case S_BODY:
+        case S_CHUNK_DATA: {
+            if (pos >= length)
+                return NEED_MORE;
+            uint64_t n = length - pos;
+            if (n > _remaining)
+                n = _remaining;
+            pos += n;
+            _remaining -= n;
+            if (_remaining == 0)
+                _state = (_state == S_BODY ? S_DONE : S_CHUNK_DATA_END);
+            continue;
+        }
+        case S_BODY_UNTIL_CLOSE:
+            pos = length;
+            return NEED_MORE;
+        default:
+            break;
+        }
+
+        if (pos >= length)
+            return NEED_MORE;
+        int r = next_line(data, length, pos, line);
+        if (r <= 0)
+            return r < 0 ? ERROR : NEED_MORE;
+
+        switch (_state) {
+        case S_START_LINE:
+            //Empty lines before a message must be ignored
+            if (line.length == 0)
+                continue;
+            _has_length = false;
+            _chunked = false;
+            _content_length = 0;
+            _response = line.length >= 12 && memcmp(line.data, "HTTP/", 5) == 0;
+            if (_response) {
+                const char* status = (const char*)memchr(line.data, ' ', line.length);
+                if (!status || status + 4 > line.data + line.length)
+                    return ERROR;
+                _no_body = status[1] == '1' || memcmp(status + 1, "204", 3) == 0 || memcmp(status + 1, "304", 3) == 0;
+            } else {
+                _no_body = false;
+            }
+            _state = S_HEADERS;
+            return START_LINE;
+        case S_HEADERS:
+            if (line.length == 0) {
+                end_headers();
+                return HEADERS_DONE;
+            }
+            if (!parse_field(line))
+                return ERROR;
+            return FIELD;
+        case S_CHUNK_SIZE:
+            if (!parse_chunk_size(line))
+                return ERROR;
+            continue;
+        case S_CHUNK_DATA_END:
+            if (line.length != 0)
+                return ERROR;
+            _state = S_CHUNK_SIZE;
+            continue;
+        case S_TRAILERS:
+            if (line.length == 0)
+                _state = S_DONE;
+            continue;
+        }
+    }
+}
+
+CLICK_ENDDECLS
+
+#endif
@@ -8,7 +8,7 @@
 
 CLICK_DECLS
 
-SimpleTCPReorder::SimpleTCPReorder() : _verbose(false)
+SimpleTCPReorder::SimpleTCPReorder() : _flow_capacity(1024), _thread_capacity(65536), _timeout(2000), _verbose(false)
 {
 }
 
@@ -21,16 +21,23 @@ SimpleTCPReorder::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     if(Args(conf, this, errh)
     .read_p("VERBOSE",_verbose)
+    .read("FLOW_CAPACITY", _flow_capacity)
+    .read("THREAD_CAPACITY", _thread_capacity)
+    .read("TIMEOUT", _timeout)
     .complete() < 0)
         return -1;
 
+    if (_flow_capacity == 0 || _flow_capacity > UINT16_MAX)
+        return errh->error("FLOW_CAPACITY must be between 1 and %d", UINT16_MAX);
+
     return 0;
 }
 
 
 int
 SimpleTCPReorder::initialize(ErrorHandler *errh) {
-
+    //Waiting packets give up their reference, the release function flushes them
+    _buffer.initialize(_flow_capacity, _thread_capacity);
     return 0;
 }
 
@@ -45,7 +52,7 @@ void SimpleTCPReorder::push_flow(int port, fcb_simpletcpreorder* tcpreorder, Pac
     if (!checkFirstPacket(tcpreorder, batch)) {
     }
 
-    bool had_awaiting = tcpreorder->packetList != 0;
+    bool had_awaiting = !tcpreorder->list.empty();
 
     //Fast path, if no waiting packets and send everything which is in order
     if (likely(!had_awaiting)) {
@@ -84,26 +91,31 @@ void SimpleTCPReorder::push_flow(int port, fcb_simpletcpreorder* tcpreorder, Pac
     if (unlikely(_verbose))
         click_chatter("Flow is now unordered... Awaiting %lu, have %lu", tcpreorder->expectedPacketSeq, getSequenceNumber(batch->first()));
 
-    int num = batch->count();
-    // Complexity: O(k) (k elements in the batch)
+    int num = 0; //Packets entering the list, they give up their reference
     FOR_EACH_PACKET_SAFE(batch, packet)
     {
-        if (!putPacketInList(tcpreorder, packet)) {
-            num--;
+        tcp_seq_t seq = getSequenceNumber(packet);
+        if (SEQ_LT(seq, tcpreorder->expectedPacketSeq)) { //Retransmission
+            if (noutputs() == 2)
+                output_push_batch(1, PacketBatch::make_from_packet(packet));
+            else
+                packet->kill();
             continue;
         }
+        switch (_buffer.insert(&tcpreorder->list, packet, seq, getNextSequenceNumber(packet), seq == tcpreorder->expectedPacketSeq)) {
+            case TCPReorderBuffer::INSERTED:
+                num++;
+                break;
+            case TCPReorderBuffer::KILLED:
+                break;
+            default:
+                packet->kill();
+                break;
+        }
     }
 
-
-    tcpreorder->packetListLength += num;
-    int before = tcpreorder->packetListLength;
-
     PacketBatch* inorderBatch = sendEligiblePackets(tcpreorder,had_awaiting);
-
-    if (tcpreorder->packetList) {
-        assert(tcpreorder->packetListLength);
-        //TODO add timer
-    }
+    fcb_update((inorderBatch ? (int)inorderBatch->count() : 0) - num);
     if (inorderBatch) {
         //click_chatter("Hole is filled, flushing %d", inorderBatch->count() );
         output_push_batch(0,inorderBatch);
@@ -111,116 +123,34 @@ void SimpleTCPReorder::push_flow(int port, fcb_simpletcpreorder* tcpreorder, Pac
 }
 
 /**
- * @pre packetListLength is correct
- * @post it is still correct
+ * Release the run of packets that became in order, if any
  */
 PacketBatch* SimpleTCPReorder::sendEligiblePackets(struct fcb_simpletcpreorder *tcpreorder, bool had_awaiting)
 {
-    Packet* packet = tcpreorder->packetList;
-    Packet* last = 0;
-    PacketBatch* batch = NULL;
-    int count = 0;
-    while(packet != NULL)
-    {
-        tcp_seq_t currentSeq = getSequenceNumber(packet);
-
-        // We check if the current packet is the expected one (if not, there is a gap)
-/*        if(currentSeq > tcpreorder->expectedPacketSeq)
-        {
-            if (_verbose)
-                click_chatter("Not the expected packet, have %d expected %d, last sent is %d. Count is %d. Uc %d",currentSeq,tcpreorder->expectedPacketSeq,tcpreorder->lastSent, count,fcb_stack->count());
-            //The packet 
-//            if (getNextSequenceNumber(
-            tcpreorder->packetList = packet;
-            // Check before exiting that we did not have a batch to send
-            // TODO : Send pro-active retransmit if option
-            goto send_batch;
+    PacketBatch* batch = _buffer.pop(&tcpreorder->list, tcpreorder->expectedPacketSeq);
+    if (batch) {
+        Packet* last = batch->tail();
+        tcpreorder->lastSent = getSequenceNumber(last);
+        if (unlikely(tcpreorder->list.empty() && _timeout)) { //End of flow, stop keeping it alive
+            if (last->tcp_header()->th_flags & (TH_FIN | TH_RST))
+                fcb_release_timeout();
         }
-*/
-        // Compute the sequence number of the next packet
-        tcpreorder->expectedPacketSeq = getNextSequenceNumber(packet);
-
-        // Store the sequence number of the last packet sent
-        tcpreorder->lastSent = currentSeq;
-
-        // Send packet
-        if(batch == NULL)
-            batch = PacketBatch::start_head(packet);
-        count++;
-
-        // Free memory and remove node from the list
-        last = packet;
-        packet = packet->next();
-    }
-    tcpreorder->packetList = 0;
-
-
-  send_batch:
-  if (!tcpreorder->packetList && had_awaiting) {
-      //We don't have awaiting packets anymore, remove the fct
-      //click_chatter("We are now in order, removing release fct");
-  } else if (tcpreorder->packetList && !had_awaiting) {
-      //Set release fnt
-      if (_verbose)
-          click_chatter("Out of order, setting release fct");
-  }
-    tcpreorder->packetList = packet;
-    tcpreorder->packetListLength -= count;
-    // We now send the batch we just built
-    if(batch != NULL) {
-        assert(count > 0);
-        batch->set_count(count);
-        batch->set_tail(last);
-        last->set_next(0);
-        flow_assert(batch->first()->find_count() == count);
-
-        return batch;
-    }
-    return 0;
-}
-
-bool SimpleTCPReorder::putPacketInList(struct fcb_simpletcpreorder* tcpreorder, Packet* packetToAdd)
-{
-    Packet* last = NULL;
-    Packet* packetNode = tcpreorder->packetList;
-    auto pSeq = getSequenceNumber(packetToAdd);
-    // Browse the list until we find a packet with a greater sequence number than the
-    // packet to add in the list
-    while(packetNode != NULL
-        && (SEQ_LT(getSequenceNumber(packetNode), pSeq)))
-    {
-        last = packetNode;
-        packetNode = packetNode->next();
     }
 
-    if (packetNode && (getSequenceNumber(packetNode) == pSeq)) {
-        click_chatter("Identical");
-        packetToAdd -> kill();
-        return false;
+    if (tcpreorder->list.empty() && had_awaiting) {
+        fcb_remove_release_fnt(tcpreorder, &fcb_release_fnt);
+    } else if (!tcpreorder->list.empty() && !had_awaiting) {
+        if (unlikely(_verbose))
+            click_chatter("Flow is now out of order, %d packets waiting", tcpreorder->list.count);
+        fcb_set_release_fnt(static_cast<FlowReleaseChain*>(tcpreorder), &fcb_release_fnt);
     }
-
-    //SEQ_LT(getAckNumber(packetNode), getAckNumber(packetToAdd)))
-
-    // Check if we need to add the node as the head of the list
-    if(last == NULL)
-        tcpreorder->packetList = packetToAdd; // If so, the list points to the node to add
-    else
-        last->set_next(packetToAdd); // If not, the previous node in the list now points to the node to add
-
-     // The node to add points to the first node with a greater sequence number
-    packetToAdd->set_next(packetNode);
-    return true;
+    return batch;
 }
 
 void SimpleTCPReorder::killList(struct fcb_simpletcpreorder* tcpreorder) {
-        SFCB_STACK( //Packet in the list have no reference
-            FOR_EACH_PACKET_LL_SAFE(tcpreorder->packetList,p) {
-                click_chatter("WARNING : Non-free SimpleTCPReorder flow bucket");
-                p->kill();
-            }
-        );
-        tcpreorder->packetList = 0;
-        tcpreorder->packetListLength = 0;
+    if (!tcpreorder->list.empty())
+        click_chatter("WARNING : Non-free SimpleTCPReorder flow bucket");
+    _buffer.flush(&tcpreorder->list);
 }
 
 bool SimpleTCPReorder::checkFirstPacket(struct fcb_simpletcpreorder* tcpreorder, PacketBatch* batch)
@@ -230,12 +160,44 @@ bool SimpleTCPReorder::checkFirstPacket(struct fcb_simpletcpreorder* tcpreorder,
     uint8_t flags = tcph->th_flags;
 
     // Update the expected sequence number
-    if (!tcpreorder->expectedPacketSeq)
-        tcpreorder->expectedPacketSeq = getNextSequenceNumber(packet);
+    if (!tcpreorder->expectedPacketSeq) {
+        tcpreorder->expectedPacketSeq = getSequenceNumber(packet);
+        //Waiting packets do not hold the flow, keep it alive ourself
+        if (_timeout)
+            fcb_acquire_timeout(_timeout);
+    }
 
     return true;
 }
 
+void SimpleTCPReorder::fcb_release_fnt(FlowControlBlock* fcb, void* thunk) {
+    SimpleTCPReorder* tr = static_cast<SimpleTCPReorder*>(thunk);
+    fcb_simpletcpreorder* tcpreorder = reinterpret_cast<fcb_simpletcpreorder*>(&fcb->data[tr->_flow_data_offset]);
+    if (unlikely(tr->_verbose))
+        click_chatter("%p{element}: flow released with %d packets waiting", tr, tcpreorder->list.count);
+    tr->_buffer.flush(&tcpreorder->list);
+    if (tcpreorder->previous_fnt)
+        tcpreorder->previous_fnt(fcb, tcpreorder->previous_thunk);
+}
+
+
+enum { h_waiting };
+
+String SimpleTCPReorder::read_handler(Element* e, void* thunk)
+{
+    SimpleTCPReorder* tr = static_cast<SimpleTCPReorder*>(e);
+    switch ((intptr_t)thunk) {
+        case h_waiting:
+            return String(tr->_buffer.waiting());
+        default:
+            return "<error>";
+    }
+}
+
+void SimpleTCPReorder::add_handlers()
+{
+    add_read_handler("waiting", read_handler, h_waiting);
+}
 
 CLICK_ENDDECLS
 EXPORT_ELEMENT(SimpleTCPReorder)
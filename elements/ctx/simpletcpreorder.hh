@@ -7,6 +7,7 @@
 #include <clicknet/ip.h>
 #include <click/multithread.hh>
 #include "../flow/batchfcb.hh"
+#include "../flow/tcpreorderbuffer.hh"
 #include <click/packetbatch.hh>
 #include <click/tcphelper.hh>
 #include <click/flow/flowelement.hh>
@@ -17,10 +18,9 @@
 /**
  * Structure used by the SimpleTCPReorder element
  */
-struct fcb_simpletcpreorder
+struct fcb_simpletcpreorder : public FlowReleaseChain
 {
-    Packet* packetList;
-    uint16_t packetListLength;
+    TCPReorderList list;
     tcp_seq_t expectedPacketSeq;
     tcp_seq_t lastSent;
 
@@ -34,19 +34,6 @@ struct fcb_simpletcpreorder
 
     ~fcb_simpletcpreorder()
     {
-        //TODO : call this on release
-        /*Packet* next = NULL;
-
-        while(packetList != NULL)
-        {
-            next = packetList->next();
-
-            // Kill packet
-            packetList->kill();
-
-            // Put back node in memory pool
-            packetList = next;
-        }*/
     }
 };
 
@@ -56,7 +43,7 @@ CLICK_DECLS
 /*
 =c
 
-SimpleTCPReorder(FLOWDIRECTION [, MERGESORT])
+SimpleTCPReorder([VERBOSE, I<keywords> FLOW_CAPACITY, THREAD_CAPACITY, TIMEOUT])
 
 =s middlebox
 
@@ -76,22 +63,30 @@ This element reorders TCP packets before sending them on its first output. It ca
 of the stack of the middlebox. The second output is optional and is used to push retransmitted
 packets. If the second output is not used, retransmitted packets are dropped.
 
-=item FLOWDIRECTION
+Out-of-order packets are kept in the same buffer as TCPReorder, as runs of
+contiguous sequence ranges released as one batch once the hole before them is
+filled. Overlapping retransmissions are trimmed to the data not already
+waiting.
+
+=item FLOW_CAPACITY
 
-ID of the path for the connection (0 or 1). The return path must have the other ID.
-Thus, each direction of a TCP connection has a different ID.
+Maximal number of packets waiting per flow. Default is 1024.
 
-=item MERGESORT
+=item THREAD_CAPACITY
 
-Only used with batching. Adds each packet of the batch at the beginning of the list and reorders
-the list using merge sort instead of adding each packet of the batch directly to the right position.
+Maximal number of packets waiting in all flows handled by a thread. Default
+is 65536.
 
-Complexity to process a batch with this option: O((n + k) * log (n + k))
-Complexity to process a batch without this option: O(k * (n + k))
+=item TIMEOUT
 
-Where k is the number of packets in the batch and n is the number of packets in the waiting list
+Time in milliseconds the flow is kept alive after its last packet, when no
+other element keeps it longer. Packets still waiting when the flow is released
+are dropped. 0 leaves the lifetime of the flow to other elements. Default is
+2000.
 
-Default value: true.
+=h waiting read-only
+
+Number of out-of-order packets waiting.
 
 =a TCPIn, TCPOut, TCPRetransmitter */
 
@@ -115,19 +110,16 @@ public:
 
     void* cast(const char *n) override;
 
+    //The waiting packets are per TCP flow
+    FLOW_ELEMENT_DEFINE_SESSION_CONTEXT("12/0/ffffffff 16/0/ffffffff 20/0/ffff 22/0/ffff", FLOW_TCP);
+
     int configure(Vector<String>&, ErrorHandler*) CLICK_COLD;
     int initialize(ErrorHandler *errh);
+    void add_handlers() override CLICK_COLD;
 
     void push_flow(int, fcb_simpletcpreorder* fcb, PacketBatch *batch) override;
 
 private:
-    /**
-     * @brief Put a packet in the list of waiting packets
-     * @param fcb A pointer to the FCB of the flow
-     * @param packet The packet to add
-     */
-    bool putPacketInList(struct fcb_simpletcpreorder *fcb, Packet* packet);
-
     void killList(struct fcb_simpletcpreorder* tcpreorder);
 
     /**
@@ -145,23 +137,17 @@ private:
      */
     bool checkFirstPacket(struct fcb_simpletcpreorder *fcb, PacketBatch* batch);
 
-    /**
-     * @brief Flush the list of waiting packets
-     * @param fcb A pointer to the FCB of the flow
-     */
-    void flushList(struct fcb_simpletcpreorder *fcb);
+    static String read_handler(Element* e, void* thunk) CLICK_COLD;
 
     /**
-     * @brief Flush the list of waiting packets after a given packet
-     * @param fcb A pointer to the FCB of the flow
-     * @param toKeep Pointer to the last element that will be kept in the list
-     * @param toRemove Pointer to the first element that will be removed
+     * @brief Flush the waiting packets of a released flow
      */
-    void flushListFrom(struct fcb_simpletcpreorder *fcb, Packet *toKeep,
-        Packet *toRemove);
-
-   private:
+    static void fcb_release_fnt(FlowControlBlock* fcb, void* thunk);
 
+    TCPReorderBuffer _buffer;
+    uint32_t _flow_capacity;
+    uint32_t _thread_capacity;
+    uint32_t _timeout;
     bool _verbose;
 };
 
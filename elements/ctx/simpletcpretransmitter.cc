@@ -14,9 +14,9 @@
 #include "simpletcpretransmitter.hh"
 
 
-SimpleTCPRetransmitter::SimpleTCPRetransmitter() : _verbose(false), _proack(false), _resize(false), _readonly(false)
+SimpleTCPRetransmitter::SimpleTCPRetransmitter() : _capacity(0), _verbose(false), _proack(false), _resize(false), _readonly(false)
 {
-
+    _overflows = 0;
 }
 
 SimpleTCPRetransmitter::~SimpleTCPRetransmitter()
@@ -25,7 +25,7 @@ SimpleTCPRetransmitter::~SimpleTCPRetransmitter()
 }
 void*
 SimpleTCPRetransmitter::cast(const char * name) {
-    if (strcmp("TCPRetransmitter", name)) {
+    if (strcmp("TCPRetransmitter", name) == 0) {
         return this;
     }
     return CTXStateElement<SimpleTCPRetransmitter,fcb_transmit_buffer>::cast(name);
@@ -37,6 +37,7 @@ int SimpleTCPRetransmitter::configure(Vector<String> &conf, ErrorHandler *errh)
             .read("PROACK", _proack)
             .read("VERBOSE", _verbose)
             .read("READONLY", _readonly)
+            .read("CAPACITY", _capacity)
             .complete() < 0)
         return -1;
 
@@ -70,9 +71,13 @@ void
 SimpleTCPRetransmitter::release_flow(fcb_transmit_buffer* fcb) {
     if (fcb->first_unacked) {
         //click_chatter("SimpleTCPRetransmitter :: Releasing %d transmit buffers", fcb->first_unacked->count());
-        fcb->first_unacked->fast_kill();
+        //Kept packets are clones, they hold no reference to the FCB
+        SFCB_STACK(
+            fcb->first_unacked->fast_kill();
+        );
         fcb->first_unacked = 0;
     }
+    fcb->bytes = 0;
     return;
 }
 
@@ -84,24 +89,35 @@ SimpleTCPRetransmitter::forward_packets(fcb_transmit_buffer* fcb, PacketBatch* b
     prune(fcb);
 
     FOR_EACH_PACKET_SAFE(batch,packet) {
-        if (getPayloadLength(packet) == 0)
+        unsigned length = getPayloadLength(packet);
+        if (length == 0)
             continue;
 
         Packet* clone = packet->clone(true); //Fast clone. If using DPDK, we only hold a buffer reference
         flow_assert(clone->buffer() == packet->buffer());
-        /*click_chatter("%p %p %p",clone->mac_header(),packet->mac_header());
-        clone->set_mac_header(packet->mac_header());
-        clone->set_network_header(packet->network_header());
-        clone->set_transport_header(packet->transport_header());*/
 
         //Actually add the packet in the FCB
+        tcp_seq_t seq = getSequenceNumber(packet);
         if (fcb->first_unacked) {
             fcb->first_unacked->append_packet(clone);
             clone->set_next(0);
         } else {
             fcb->first_unacked = PacketBatch::make_from_packet(clone);
-            fcb->first_unacked_seq = getSequenceNumber(packet);
+            fcb->first_unacked_seq = seq;
+            fcb->bytes = 0;
         }
+        fcb->bytes += length;
+        fcb->next_seq = seq + length;
+    }
+
+    if (unlikely(_capacity && fcb->bytes > _capacity)) {
+        if (unlikely(_verbose))
+            click_chatter("%p{element}: %u bytes unacknowledged, resetting the flow", this, fcb->bytes);
+        _overflows++;
+        release_flow(fcb);
+        closeConnection(batch->first(), false);
+        batch->fast_kill();
+        return;
     }
 
     //Send the original batch
@@ -155,13 +171,14 @@ SimpleTCPRetransmitter::push_flow(int port, fcb_transmit_buffer* fcb, PacketBatc
         Packet* lastretransmit = 0;
 
         unsigned int flowDirection = determineFlowDirection();
-        ByteStreamMaintainer &maintainer = fcb_in->common->maintainers[flowDirection];
+        ByteStreamMaintainer &maintainer = fcb_in->common->half[flowDirection].maintainer;
+        unsigned seqHint = 0;
 
         FOR_EACH_PACKET_SAFE(batch, packet) {
             uint32_t seq = getSequenceNumber(packet);
             uint32_t mappedSeq;
             if (_resize) {
-                mappedSeq = maintainer.mapSeq(seq);
+                mappedSeq = maintainer.mapSeq(seq, seqHint);
             } else {
                 mappedSeq = seq;
             }
@@ -185,7 +202,9 @@ SimpleTCPRetransmitter::push_flow(int port, fcb_transmit_buffer* fcb, PacketBatc
             } else {
                 //Seq is bigger than last ack, (the original of) this packet was lost before the dest reached it (or we never received the ack)
                 FOR_EACH_PACKET_SAFE(fcb->first_unacked, pr) {
-                    if (getSequenceNumber(pr) == mappedSeq) {
+                    tcp_seq_t prSeq = getSequenceNumber(pr);
+                    //The sender may have split its data differently
+                    if (SEQ_LEQ(prSeq, mappedSeq) && SEQ_LT(mappedSeq, prSeq + getPayloadLength(pr))) {
                         if (lastretransmit == pr) { //Avoid double retransmission
                             //TODO : do we always want to do that?
                             if (_verbose)
@@ -219,42 +238,67 @@ SimpleTCPRetransmitter::push_flow(int port, fcb_transmit_buffer* fcb, PacketBatc
 
 inline void SimpleTCPRetransmitter::prune(fcb_transmit_buffer* fcb)
 {
-    if (!_in->fcb_data()->common->lastAckReceivedSet())
+    if (!fcb->first_unacked || !_in->fcb_data()->common->lastAckReceivedSet())
         return;
     tcp_seq_t seq = _in->fcb_data()->common->getLastAckReceived(_in->getOppositeFlowDirection());
-    tcp_seq_t next_seq = fcb->first_unacked_seq;
-    Packet* next = fcb->first_unacked->first();
-    if (!next || SEQ_GEQ(next_seq,seq))
+    if (SEQ_GEQ(fcb->first_unacked_seq, seq))
+        return;
+
+    //Everything is acknowledged, no need to look at the packets
+    if (SEQ_GEQ(seq, fcb->next_seq)) {
+        SFCB_STACK(
+            fcb->first_unacked->fast_kill();
+        );
+        fcb->first_unacked = 0;
+        fcb->bytes = 0;
         return;
+    }
+
+    Packet* next = fcb->first_unacked->first();
     Packet* last = 0;
     int count = 0;
-//    tcp_seq_t lastSeq = 0;
+    uint32_t bytes = 0;
     while (next && (SEQ_LT(getSequenceNumber(next),seq))) {
-/*        if (lastSeq) {
-        if (!SEQ_GT(getSequenceNumber(next), lastSeq)) {
-            click_chatter("new %lu <= %lu",getSequenceNumber(next), lastSeq);
-            assert(false);
-        }
-        }
-        lastSeq=getSequenceNumber(next);*/
+        bytes += getPayloadLength(next);
         last = next;
         count++;
         next = next->next();
     }
     if (count) {
         PacketBatch* second = 0;
-        //click_chatter("Pruning %d (last received %lu, last was %lu)",count,_in->fcb_data()->common->getLastAckReceived(_in->getOppositeFlowDirection()),getSequenceNumber(last));
         if (next)
             fcb->first_unacked->cut(last, count, second);
         SFCB_STACK(
             fcb->first_unacked->fast_kill();
         );
         fcb->first_unacked = second;
+        fcb->bytes -= bytes;
         if (second)
             fcb->first_unacked_seq = getSequenceNumber(second->first());
     }
 }
 
+enum {
+    h_overflows
+};
+
+String
+SimpleTCPRetransmitter::read_handler(Element *e, void *thunk)
+{
+    SimpleTCPRetransmitter *r = static_cast<SimpleTCPRetransmitter *>(e);
+    switch ((intptr_t)thunk) {
+      case h_overflows:
+        return String(r->_overflows);
+      default:
+        return "<error>";
+    }
+}
+
+void
+SimpleTCPRetransmitter::add_handlers()
+{
+    add_read_handler("overflows", read_handler, h_overflows);
+}
 
 EXPORT_ELEMENT(SimpleTCPRetransmitter)
 ELEMENT_MT_SAFE(SimpleTCPRetransmitter)
@@ -18,12 +18,14 @@ CLICK_DECLS
 struct fcb_transmit_buffer {
     PacketBatch* first_unacked;
     tcp_seq_t first_unacked_seq;
+    tcp_seq_t next_seq; //End of the last packet kept
+    uint32_t bytes; //Payload kept
 };
 
 /*
 =c
 
-SimpleTCPRetransmitter([INITIALBUFFERSIZE])
+SimpleTCPRetransmitter([I<keywords> CAPACITY, PROACK, READONLY, VERBOSE])
 
 =s middlebox
 
@@ -37,6 +39,28 @@ completely lets both sides manage the retransmission and timings. If
 you don't care, then simply push the retransmissions directly, without this
 element (eg fine for a NAT, LB, ... packet besed fct).
 
+Packets are kept as clones of the sent ones, so they share their buffer and
+no payload is copied. They are freed as a batch once a cumulative ACK covers
+them.
+
+=item CAPACITY
+
+Maximal number of unacknowledged payload bytes kept per flow. A flow going
+above it is reset. Default is 0, meaning no limit.
+
+=item PROACK
+
+Boolean. Acknowledge retransmissions of data the destination already
+acknowledged, instead of retransmitting it. Default is false.
+
+=item READONLY
+
+Boolean. Fail if elements of the stack may resize packets. Default is false.
+
+=h overflows read-only
+
+Number of flows reset because they went above CAPACITY.
+
 =a TCPIn, TCPOut, TCPReorder, TCPRetransmitter */
 
 
@@ -62,6 +86,7 @@ public:
 
     int configure(Vector<String> &, ErrorHandler *) override CLICK_COLD;
     int retransmitter_initialize(ErrorHandler *) CLICK_COLD;
+    void add_handlers() override CLICK_COLD;
 
     void push_flow(int port, fcb_transmit_buffer*, PacketBatch *batch);
 
@@ -93,6 +118,10 @@ protected:
      */
     Packet* processPacketRetransmission(Packet *packet);
 
+    static String read_handler(Element *e, void *thunk) CLICK_COLD;
+
+    uint32_t _capacity;
+    atomic_uint32_t _overflows;
     bool _verbose;
     bool _proack;
     TCPIn* _in;
@@ -236,11 +236,12 @@ bool TCPIn::putPacketInList(struct fcb_tcpin* tcpreorder, Packet* packetToAdd)
 
 /**
  * Update state and stuffs for a packet in order
+ * @param ackHint Hint to map the ACKs of the batch, see ByteStreamMap
  * @return The same or a different (because of uniqueify) packet
  *         Null if the connection was closed
  */
 Packet*
-TCPIn::processOrderedTCP(fcb_tcpin* fcb_in, Packet* p) {
+TCPIn::processOrderedTCP(fcb_tcpin* fcb_in, Packet* p, unsigned &ackHint) {
     if(checkConnectionClosed(p))
     {
         if (unlikely(_verbose))
@@ -263,10 +264,16 @@ TCPIn::processOrderedTCP(fcb_tcpin* fcb_in, Packet* p) {
         uint16_t offset = getPayloadOffset(packet);
         packet->setContentOffset(offset);
 
-        //TODO : fine-grain this lock
-        fcb_in->common->lock.acquire();
-        ByteStreamMaintainer &maintainer = fcb_in->common->maintainers[getFlowDirection()];
-        ByteStreamMaintainer &otherMaintainer = fcb_in->common->maintainers[getOppositeFlowDirection()];
+        // We only write our half, and read what the other half published
+        tcp_common* common = fcb_in->common;
+        tcp_half &half = common->half[getFlowDirection()];
+        ByteStreamMaintainer &maintainer = half.maintainer;
+        tcp_half &otherHalf = common->half[getOppositeFlowDirection()];
+
+        // Prune our maps with the ACKs the other side received, and take
+        // the ACKs it forged for us
+        common->pruneAcked(getFlowDirection());
+        half.absorbForged();
 
         // Update the window size
         uint16_t prevWindowSize = maintainer.getWindowSize();
@@ -274,10 +281,9 @@ TCPIn::processOrderedTCP(fcb_tcpin* fcb_in, Packet* p) {
         maintainer.setWindowSize(newWindowSize);
 
 
-        if(otherMaintainer.isLastAckSentSet())
+        tcp_seq_t lastAckSentOtherSide = 0;
+        if(otherHalf.lastAckSent(lastAckSentOtherSide))
         {
-            tcp_seq_t lastAckSentOtherSide = otherMaintainer.getLastAckSent();
-
             if(!isSyn(packet) && SEQ_LT(currentSeq, lastAckSentOtherSide))
             {
                 if (unlikely(_verbose)) {
@@ -289,7 +295,6 @@ TCPIn::processOrderedTCP(fcb_tcpin* fcb_in, Packet* p) {
                 // In this case, we re-ACK the content and we discard it
                 ackPacket(packet);
                 packet->kill();
-                fcb_in->common->lock.release();
                 return NULL;
             }
         }
@@ -302,7 +307,7 @@ TCPIn::processOrderedTCP(fcb_tcpin* fcb_in, Packet* p) {
         {
             // Map the ack number according to the ByteStreamMaintainer of the other direction
             ackNumber = getAckNumber(packet);
-            newAckNumber = otherMaintainer.mapAck(ackNumber);
+            newAckNumber = otherHalf.mapAck(ackNumber, ackHint);
 
 
             if (unlikely(_verbose))
@@ -318,30 +323,16 @@ TCPIn::processOrderedTCP(fcb_tcpin* fcb_in, Packet* p) {
             // Check if we acknowledged new data
             if(lastAckReceivedSet && SEQ_GT(ackNumber, prevLastAckReceived))
             {
-                // Increase congestion window
-                uint64_t cwnd = otherMaintainer.getCongestionWindowSize();
-                uint64_t ssthresh = otherMaintainer.getSsthresh();
-                // Sender segment size
-                uint16_t mss = otherMaintainer.getMSS();
-                uint64_t increase = 0;
-
-                // Check if we are in slow start mode
-                if(cwnd <= ssthresh)
-                    increase = mss;
-                else
-                    increase = mss * mss / cwnd;
-
-                otherMaintainer.setCongestionWindowSize(cwnd + increase);
+                // The other side increases its congestion window with it
+                half.newAcks = half.newAcks + 1;
 
                 maintainer.setDupAcks(0);
             }
 
-            // Update the value of the last ACK received
+            // Publish the last ACK received. The other side will prune its
+            // ByteStreamMaintainer with it
             fcb_in->common->setLastAckReceived(getFlowDirection(),getAckNumber(p));
 
-            // Prune the ByteStreamMaintainer of the other side
-            otherMaintainer.prune(ackNumber);
-
             // Update the statistics about the RTT
             // And potentially update the retransmission timer
             /*fcb_in->common->lock.release();
@@ -387,7 +378,6 @@ TCPIn::processOrderedTCP(fcb_tcpin* fcb_in, Packet* p) {
                         click_chatter("Meaningless ack");
                     }
                     packet->kill();
-                    fcb_in->common->lock.release();
                     return NULL;
                 }
             }
@@ -396,7 +386,6 @@ TCPIn::processOrderedTCP(fcb_tcpin* fcb_in, Packet* p) {
             if(ackNumber != newAckNumber)
                 setAckNumber(packet, newAckNumber);
         }
-        fcb_in->common->lock.release();
 
         return packet;
     } else { //Resize not allowed
@@ -416,7 +405,8 @@ void TCPIn::push_flow(int port, fcb_tcpin* fcb_in, PacketBatch* flow)
 {
     // Assign the tcp_common structure if not already done
     //click_chatter("Fcb in : %p, Common : %p, Batch : %p, State %d", fcb_in, fcb_in->common,flow,(fcb_in->common?fcb_in->common->state:-1));
-    auto fnt = [this,fcb_in](Packet* p) -> Packet* {
+    unsigned ackHint = 0;
+    auto fnt = [this,fcb_in,&ackHint](Packet* p) -> Packet* {
         bool keep_fct = false;
         if(fcb_in->common == NULL)
         {
@@ -466,7 +456,7 @@ void TCPIn::push_flow(int port, fcb_tcpin* fcb_in, PacketBatch* flow)
             p = packet;
 
             if (isAck(p) && fcb_in->common->state < TCPState::OPEN) {
-                fcb_in->common->lastAckReceived[getFlowDirection()] = getAckNumber(p); //We need to do it now before the GT check for the OPEN state
+                fcb_in->common->setLastAckReceived(getFlowDirection(), getAckNumber(p)); //We need to do it now before the GT check for the OPEN state
                 //TODO check the side of the ack with ESTABLISHING 1, or an attacker may create ressource sending himself the synack
                 fcb_in->common->state = TCPState::OPEN;
             }
@@ -614,11 +604,9 @@ reinitforward:
                     // to which we add the size of the payload in order to acknowledge it
                     tcp_seq_t ackOf = getSequenceNumber(packet) + getPayloadLength(packet) + 1;
 
-                    fcb_in->common->lock.acquire();
                     // Craft and send the ack
-                    Packet* forged = outElement->forgeAck(fcb_in->common->maintainers[getOppositeFlowDirection()], saddr, daddr,
+                    Packet* forged = outElement->forgeAck(fcb_in->common->half[getOppositeFlowDirection()], saddr, daddr,
                             sport, dport, ackNumber, ackOf, true);
-                    fcb_in->common->lock.release();
                     if (forged)
                         outElement->sendOpposite(forged);
                 }
@@ -627,12 +615,8 @@ reinitforward:
 
                 // Map the ack number according to the ByteStreamMaintainer of the other direction
                 if (allowResize()) {
-                    fcb_in->common->lock.acquire();
-                    ByteStreamMaintainer &maintainer = fcb_in->common->maintainers[getFlowDirection()];
-                    ByteStreamMaintainer &otherMaintainer = fcb_in->common->maintainers[getOppositeFlowDirection()];
-                    ackNumber = otherMaintainer.mapAck(ackNumber);
-                    seqNumber = maintainer.mapSeq(seqNumber);
-                    fcb_in->common->lock.release();
+                    ackNumber = fcb_in->common->half[getOppositeFlowDirection()].mapAck(ackNumber);
+                    seqNumber = fcb_in->common->half[getFlowDirection()].maintainer.mapSeq(seqNumber);
                 }
 
                 setAckNumber(packet, ackNumber);
@@ -667,7 +651,7 @@ reinitforward:
             if (_proactive_dup) {
                 //This needs more enginnering, not retransmit too much, and only after processing all of the input maybe
                 tcp_seq_t ack = fcb_in->expectedPacketSeq;
-                /*                tcp_seq_t last_ack = fcb_in->common->maintainers[getOppositeFlowDirection()].getLastAckSent();
+                /*                tcp_seq_t last_ack = fcb_in->common->half[getOppositeFlowDirection()].maintainer.getLastAckSent();
                 if (SEQ_GT(ack, last_ack))
                     ack = last_ack;*/
                 if (unlikely(_verbose))
@@ -687,12 +671,10 @@ reinitforward:
                     seq = getAckNumber(p);
                 }
 
-                fcb_in->common->lock.acquire();
                 // Craft and send the ack
                 click_chatter("Forging ack for proactive dup");
-                Packet* forged = outElement->forgeAck(fcb_in->common->maintainers[getOppositeFlowDirection()], saddr, daddr,
+                Packet* forged = outElement->forgeAck(fcb_in->common->half[getOppositeFlowDirection()], saddr, daddr,
                         sport, dport, seq, ack, true); //We force the sending as we want DUP ack on purpose
-                fcb_in->common->lock.release();
                 if (forged)
                     outElement->sendOpposite(forged);
             }
@@ -701,7 +683,7 @@ reinitforward:
             return 0;
         }
         force_process_packet:
-        return processOrderedTCP(fcb_in, p);
+        return processOrderedTCP(fcb_in, p, ackHint);
     };
 
     EXECUTE_FOR_EACH_PACKET_DROPPABLE(fnt, flow, (void));
@@ -727,7 +709,7 @@ reinitforward:
             if (unlikely(_verbose > 1))
                 click_chatter("Now order : %p %d",nowOrderBatch,nowOrderBatch->count());
             fcb_acquire(nowOrderBatch->count());
-            auto refnt = [this,fcb_in](Packet* p){return processOrderedTCP(fcb_in,p);};
+            auto refnt = [this,fcb_in,&ackHint](Packet* p){return processOrderedTCP(fcb_in,p,ackHint);};
             EXECUTE_FOR_EACH_PACKET_DROPPABLE(refnt, nowOrderBatch, (void));
             if (flow && nowOrderBatch) {
 #if DEBUG_TCP
@@ -886,7 +868,7 @@ void TCPIn::closeConnection(Packet *packet, bool graceful)
         uint16_t sport = getSourcePort(packet);
 
         // Craft and send the ack
-        outElement->sendClosingPacket(fcb_in->common->maintainers[getFlowDirection()],
+        outElement->sendClosingPacket(fcb_in->common->half[getFlowDirection()],
                 saddr, daddr, sport, dport, graceful);
     } else {
         //Send RST to other side
@@ -898,10 +880,10 @@ void TCPIn::closeConnection(Packet *packet, bool graceful)
         uint16_t dport = getSourcePort(packet);
 
         // Craft and send the RST
-        outElement->sendClosingPacket(fcb_in->common->maintainers[getFlowDirection()],
+        outElement->sendClosingPacket(fcb_in->common->half[getFlowDirection()],
                 daddr, saddr, dport, sport, graceful);
         // Craft and send the RST
-        returnElement->outElement->sendClosingPacket(fcb_in->common->maintainers[getOppositeFlowDirection()],
+        returnElement->outElement->sendClosingPacket(fcb_in->common->half[getOppositeFlowDirection()],
                 saddr, daddr, sport, dport, graceful);
         click_chatter("Ungracefull close, releasing FCB state");
         releaseFCBState();
@@ -1032,12 +1014,9 @@ void TCPIn::ackPacket(Packet* packet, bool force)
     if(isFin(packet) || isSyn(packet))
         ack++;
 
-    fcb_in->common->lock.acquire();
-    ByteStreamMaintainer &maintainer = fcb_in->common->maintainers[getOppositeFlowDirection()];
     // Craft and send the ack
-    Packet* forged = outElement->forgeAck(maintainer, saddr, daddr,
+    Packet* forged = outElement->forgeAck(fcb_in->common->half[getOppositeFlowDirection()], saddr, daddr,
             sport, dport, seq, ack, force);
-    fcb_in->common->lock.release();
     if (forged)
         outElement->sendOpposite(forged);
 }
@@ -1156,13 +1135,15 @@ inline void TCPIn::initializeFcbSide(fcb_tcpin* fcb_in, Packet* packet, bool kee
     fcb_in->fin_seen = false;
 
     if (allowResize() || returnElement->allowResize()) {
-        // Initialize the RBT with the RBTManager
         if (_verbose > 2)
             click_chatter("Initialize direction %d for SYN/ACK",getFlowDirection());
         // The data in the flow will start at current sequence number
         uint32_t flowStart = getSequenceNumber(packet);
 
-        fcb_in->common->maintainers[getFlowDirection()].initialize(&(*rbtManager), flowStart);
+        tcp_half &half = fcb_in->common->half[getFlowDirection()];
+        half.seqlock.write_begin();
+        half.maintainer.initialize(flowStart);
+        half.seqlock.write_end();
     }
 
     fcb_in->expectedPacketSeq = getSequenceNumber(packet); //Not next because this one will be checked just after
@@ -1173,10 +1154,10 @@ inline void TCPIn::initializeFcbSide(fcb_tcpin* fcb_in, Packet* packet, bool kee
     }
 
     // Set information about the flow
-    fcb_in->common->maintainers[getFlowDirection()].setIpSrc(getSourceAddress(packet));
-    fcb_in->common->maintainers[getFlowDirection()].setIpDst(getDestinationAddress(packet));
-    fcb_in->common->maintainers[getFlowDirection()].setPortSrc(getSourcePort(packet));
-    fcb_in->common->maintainers[getFlowDirection()].setPortDst(getDestinationPort(packet));
+    fcb_in->common->half[getFlowDirection()].maintainer.setIpSrc(getSourceAddress(packet));
+    fcb_in->common->half[getFlowDirection()].maintainer.setIpDst(getDestinationAddress(packet));
+    fcb_in->common->half[getFlowDirection()].maintainer.setPortSrc(getSourcePort(packet));
+    fcb_in->common->half[getFlowDirection()].maintainer.setPortDst(getDestinationPort(packet));
 }
 
 
@@ -1285,8 +1266,8 @@ bool TCPIn::assignTCPCommon(Packet *packet, bool keep_fct)
         // We are the initiator, so we need to allocate memory
         fcb_in->common = poolFcbTcpCommon.allocate();
         //click_chatter("Alloc %p", allocated);
-        //assert(!allocated->maintainers[0].initialized);
-        //assert(!allocated->maintainers[1].initialized);
+        //assert(!allocated->half[0].maintainer.initialized);
+        //assert(!allocated->half[1].maintainer.initialized);
 
         fcb_in->common->use_count = 2; //One for us, one for the table
 
@@ -1422,8 +1403,8 @@ void TCPIn::manageOptions(WritablePacket *packet)
                 if(winScale >= 1)
                     winScale = 2 << (winScale - 1);
 
-                fcb_in->common->maintainers[flowDirection].setWindowScale(winScale);
-                fcb_in->common->maintainers[flowDirection].setUseWindowScale(true);
+                fcb_in->common->half[flowDirection].maintainer.setWindowScale(winScale);
+                fcb_in->common->half[flowDirection].maintainer.setUseWindowScale(true);
 
                 //click_chatter("Window scaling set to %u for flow %u", winScale, flowDirection);
 
@@ -1433,9 +1414,9 @@ void TCPIn::manageOptions(WritablePacket *packet)
                     // It means that we know if the other side of the flow
                     // has the option enabled
                     // if this is not the case, we disable it for this side as well
-                    if(!fcb_in->common->maintainers[getOppositeFlowDirection()].getUseWindowScale())
+                    if(!fcb_in->common->half[getOppositeFlowDirection()].maintainer.getUseWindowScale())
                     {
-                        fcb_in->common->maintainers[flowDirection].setUseWindowScale(false);
+                        fcb_in->common->half[flowDirection].maintainer.setUseWindowScale(false);
                         //click_chatter("Window scaling disabled");
                     }
                 }
@@ -1447,10 +1428,10 @@ void TCPIn::manageOptions(WritablePacket *packet)
 
             if (allowResize()) {
                 uint16_t mss = (optStart[2] << 8) | optStart[3];
-                fcb_in->common->maintainers[flowDirection].setMSS(mss);
+                fcb_in->common->half[flowDirection].maintainer.setMSS(mss);
 
                 //click_chatter("MSS for flow %u: %u", flowDirection, mss);
-                fcb_in->common->maintainers[flowDirection].setCongestionWindowSize(mss);
+                fcb_in->common->half[flowDirection].maintainer.setCongestionWindowSize(mss);
             }
 
             optStart += optStart[1];
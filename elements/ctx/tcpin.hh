@@ -26,26 +26,174 @@ typedef HashTable<tcp_seq_t, ModificationList*> ModificationTracker;
  * This file is used to simulate the FCB provided by Middleclick
  */
 
+/**
+ * State of one direction of a TCP connection. Only the thread handling that
+ * direction writes its maintainer. It publishes what the other direction
+ * needs to forge packets for it, and protects the maps of the maintainer with
+ * a SeqLock so the other direction can map its ACKs without locking.
+ *
+ * The fields marked as forged are only written by the other direction, when
+ * it sends an ACK on behalf of this one. The owner raises its own last ACK
+ * sent with them.
+ */
+class tcp_half
+{
+public:
+    // Maintainer of the data sent in this direction
+    ByteStreamMaintainer maintainer;
+    // Protects the maps of the maintainer, read by the other direction to map its ACKs
+    SeqLock seqlock;
+    // Last ACK received in this direction, published for the other direction
+    volatile tcp_seq_t lastAckReceived;
+    // Number of ACKs of new data received in this direction, published for
+    // the other direction to grow its congestion window
+    volatile uint32_t newAcks;
+    // Last ACK of the other direction applied to the maps of the maintainer
+    tcp_seq_t lastAckPruned;
+    // Number of ACKs of new data of the other direction applied to the
+    // congestion window of the maintainer
+    uint32_t newAcksApplied;
+
+    // Copy of the maintainer published for the other direction
+    volatile bool ackSentSet;
+    volatile bool seqSentSet;
+    volatile tcp_seq_t ackSent;
+    volatile tcp_seq_t seqSent;
+    volatile tcp_seq_t seqNext; // Sequence number after the last packet sent
+    volatile uint16_t windowSent;
+
+    // Last ACK forged on behalf of this direction
+    volatile bool ackForgedSet;
+    volatile tcp_seq_t ackForged;
+
+    tcp_half() : lastAckReceived(0), newAcks(0), lastAckPruned(0),
+        newAcksApplied(0), ackSentSet(false), seqSentSet(false), ackSent(0),
+        seqSent(0), seqNext(0), windowSent(maintainer.getWindowSize()), ackForgedSet(false),
+        ackForged(0)
+    {
+    }
+
+    inline void reinit() {
+        seqlock.write_begin();
+        maintainer.reinit();
+        seqlock.write_end();
+        lastAckReceived = 0;
+        newAcks = 0;
+        lastAckPruned = 0;
+        newAcksApplied = 0;
+        ackSentSet = false;
+        seqSentSet = false;
+        ackForgedSet = false;
+        windowSent = maintainer.getWindowSize();
+    }
+
+    /**
+     * Map an ACK sent by the other direction, may be called by the other
+     * direction
+     */
+    inline tcp_seq_t mapAck(tcp_seq_t ack, unsigned &hint) {
+        uint32_t v;
+        tcp_seq_t mapped;
+        do {
+            v = seqlock.read_begin();
+            mapped = maintainer.mapAck(ack, hint);
+        } while (seqlock.read_retry(v));
+        return mapped;
+    }
+
+    inline tcp_seq_t mapAck(tcp_seq_t ack) {
+        unsigned hint = 0;
+        return mapAck(ack, hint);
+    }
+
+    /**
+     * Raise the last ACK sent of the maintainer with the ACKs forged by the
+     * other direction. Called by the owner.
+     */
+    inline void absorbForged() {
+        if (ackForgedSet) {
+            click_read_fence();
+            maintainer.setLastAckSent(ackForged);
+        }
+    }
+
+    /**
+     * Publish the values of the maintainer the other direction reads. Called
+     * by the owner after it sent a packet.
+     */
+    inline void publish() {
+        if (maintainer.isLastAckSentSet()) {
+            ackSent = maintainer.getLastAckSent();
+            click_write_fence();
+            ackSentSet = true;
+        }
+        if (maintainer.isLastSeqSentSet()) {
+            seqSent = maintainer.getLastSeqSent();
+            seqNext = maintainer.getLastSeqSent() + maintainer.getLastPayloadLength();
+            click_write_fence();
+            seqSentSet = true;
+        }
+        windowSent = maintainer.getWindowSize();
+    }
+
+    /**
+     * Last ACK sent in this direction, by its owner or forged by the other
+     * direction. May be called by both directions.
+     * @return false if no ACK was sent yet
+     */
+    inline bool lastAckSent(tcp_seq_t &ack) {
+        bool set = false;
+        if (ackSentSet) {
+            click_read_fence();
+            ack = ackSent;
+            set = true;
+        }
+        if (ackForgedSet) {
+            click_read_fence();
+            tcp_seq_t forged = ackForged;
+            if (!set || SEQ_GT(forged, ack))
+                ack = forged;
+            set = true;
+        }
+        return set;
+    }
+
+    /**
+     * Record an ACK forged on behalf of this direction. Called by the other
+     * direction only.
+     */
+    inline void setAckForged(tcp_seq_t ack) {
+        if (ackForgedSet && !SEQ_GT(ack, ackForged))
+            return;
+        ackForged = ack;
+        click_write_fence();
+        ackForgedSet = true;
+    }
+} CLICK_CACHE_ALIGN;
+
 /**
  * Common structure accessed by both sides of a TCP connection.
- * The lock must be acquired before accessing the members of the structure
+ *
+ * Each direction writes only its own half, except for the forged ACK of the
+ * other half. ACKs received by one direction are published in its half, and
+ * the other direction prunes its own maps and grows its congestion window
+ * with them when it processes its next packet. The lock is only needed for
+ * state transitions and for the setup, reuse and release of the structure.
  */
 class tcp_common
 {
 public:
-    // One maintainer for each direction of the connection
-    ByteStreamMaintainer maintainers[2];
+    // One half for each direction of the connection
+    tcp_half half[2];
     // One retransmission manager for each direction of the connection, deprectaed, now we let end host handle this
     // RetransmissionTiming retransmissionTimings[2];
     // State of the connection
     TCPState::Value state;
-    // Lock to ensure that only one side of the flow (one thread) at a time
-    // accesses the common structure
+    // Lock to serialize state transitions and the release of the structure
     Spinlock lock; //Needs to be reentrant
     int use_count;
-    tcp_seq_t lastAckReceived[2] = {0,0};
 
-    tcp_common() : lastAckReceived() //This is indeed called as it is not part of the FCBs
+    tcp_common() //This is indeed called as it is not part of the FCBs
     {
         //state = TCPState::ESTABLISHING_1; //always overwritten
         //use_count = 0; //always overwriten
@@ -57,8 +205,8 @@ public:
     }
 
     inline void reinit() {
-	maintainers[0].reinit();
-	maintainers[1].reinit();
+	half[0].reinit();
+	half[1].reinit();
 	/*
 	retransmissionTimings[0].reinit();
 	retransmissionTimings[1].reinit();*/
@@ -66,8 +214,6 @@ public:
 	//State is handled by caller
 	//Lock is handled by caller
 	//Use_count is handled by caller
-	lastAckReceived[0] = 0;
-	lastAckReceived[1] = 0;
     }
 
     inline bool lastAckReceivedSet() {
@@ -76,15 +222,52 @@ public:
 
     inline void setLastAckReceived(int direction, tcp_seq_t ackNumber)
     {
-        lastAckReceived[direction] = ackNumber;
+        half[direction].lastAckReceived = ackNumber;
     }
 
 
     tcp_seq_t getLastAckReceived(int direction)
     {
-        return lastAckReceived[direction];
+        return half[direction].lastAckReceived;
     }
 
+    /**
+     * Apply the ACKs received by the other direction since the last call to
+     * the half of the given direction. Must be called by the thread handling
+     * that direction.
+     */
+    inline void pruneAcked(int direction)
+    {
+        tcp_half &h = half[direction];
+        tcp_half &other = half[1 - direction];
+
+        // Increase the congestion window of the sender of this direction
+        // once per ACK of new data
+        uint32_t acks = other.newAcks;
+        if (acks != h.newAcksApplied) {
+            uint64_t cwnd = h.maintainer.getCongestionWindowSize();
+            uint64_t ssthresh = h.maintainer.getSsthresh();
+            uint16_t mss = h.maintainer.getMSS();
+            for (; h.newAcksApplied != acks; h.newAcksApplied++) {
+                if (cwnd <= ssthresh)
+                    cwnd += mss;
+                else
+                    cwnd += mss * mss / cwnd;
+            }
+            h.maintainer.setCongestionWindowSize(cwnd);
+        }
+
+        if (!lastAckReceivedSet() || !h.maintainer.isInitialized())
+            return;
+        tcp_seq_t ack = other.lastAckReceived;
+        if (ack == h.lastAckPruned)
+            return;
+
+        h.seqlock.write_begin();
+        h.maintainer.prune(ack);
+        h.seqlock.write_end();
+        h.lastAckPruned = ack;
+    }
 };
 
 
@@ -257,7 +440,7 @@ private:
 
     bool checkRetransmission(struct fcb_tcpin *tcpreorder, Packet* packet, bool always_retransmit);
 
-    Packet* processOrderedTCP(struct fcb_tcpin *, Packet* p);
+    Packet* processOrderedTCP(struct fcb_tcpin *, Packet* p, unsigned &ackHint);
     bool putPacketInList(struct fcb_tcpin* tcpreorder, Packet* packetToAdd);
 
     /**
@@ -307,7 +490,6 @@ private:
 
     per_thread<MemoryPool<struct ModificationNode>> poolModificationNodes;
     per_thread<MemoryPool<struct ModificationList>> poolModificationLists;
-    per_thread<RBTManager> rbtManager;
 
     HashTableMP<IPFlowID, tcp_common*> tableFcbTcpCommon;
     static pool_allocator_mt<tcp_common,true,TCPCOMMON_POOL_SIZE> poolFcbTcpCommon;
@@ -45,7 +45,10 @@ TCPOut::tcp_initialize(ErrorHandler *errh) {
 void TCPOut::push_batch(int port, PacketBatch* flow)
 {
     auto fcb_in = inElement->fcb_data();
-    auto fnt = [this,fcb_in](Packet* p) -> Packet* {
+    // Packets of the batch have increasing sequence numbers, the hint avoids
+    // searching the map for each of them
+    unsigned seqHint = 0;
+    auto fnt = [this,fcb_in,&seqHint](Packet* p) -> Packet* {
         if (_allow_resize) {
             WritablePacket *packet = p->uniqueify();
 
@@ -54,10 +57,10 @@ void TCPOut::push_batch(int port, PacketBatch* flow)
                 packet->kill();
                 return NULL;
             }
-            fcb_in->common->lock.acquire();
             bool hasModificationList = inElement->hasModificationList(packet);
 
-            ByteStreamMaintainer &byteStreamMaintainer = fcb_in->common->maintainers[getFlowDirection()];
+            tcp_half &half = fcb_in->common->half[getFlowDirection()];
+            ByteStreamMaintainer &byteStreamMaintainer = half.maintainer;
             ModificationList *modList = NULL;
 
             if(hasModificationList)
@@ -65,7 +68,7 @@ void TCPOut::push_batch(int port, PacketBatch* flow)
 
             // Update the sequence number (according to the modifications made on previous packets)
             tcp_seq_t prevSeq = getSequenceNumber(packet);
-            tcp_seq_t newSeq =  byteStreamMaintainer.mapSeq(prevSeq);
+            tcp_seq_t newSeq =  byteStreamMaintainer.mapSeq(prevSeq, seqHint);
             if (inElement->_verbose)
                 click_chatter("Map SEQ %lu -> %lu", prevSeq, newSeq);
             bool seqModified = false;
@@ -74,6 +77,8 @@ void TCPOut::push_batch(int port, PacketBatch* flow)
             tcp_seq_t prevLastAck = 0;
             bool prevLastAckSet = false;
 
+            // The other side may have forged ACKs for us
+            half.absorbForged();
             if(byteStreamMaintainer.isLastAckSentSet())
             {
                 prevLastAck = byteStreamMaintainer.getLastAckSent();
@@ -124,8 +129,15 @@ void TCPOut::push_batch(int port, PacketBatch* flow)
             if(hasModificationList)
             {
                 // We know that the packet has been modified and its size has changed
-                modList->commit(fcb_in->common->maintainers[getFlowDirection()]);
+                // The other side may be mapping its ACKs with our maps
+                half.seqlock.write_begin();
+                modList->commit(byteStreamMaintainer);
+                half.seqlock.write_end();
+            }
+            half.publish();
 
+            if(hasModificationList)
+            {
                 // Check if the full content of the packet has been removed
                 if(getPayloadLength(packet) == 0) //Some rightfull ack get here TODO
                 {
@@ -145,10 +157,9 @@ void TCPOut::push_batch(int port, PacketBatch* flow)
                         ack++;
 
                     // Craft and send the ack
-                    Packet* forged = forgeAck(fcb_in->common->maintainers[getOppositeFlowDirection()], saddr, daddr,
+                    Packet* forged = forgeAck(fcb_in->common->half[getOppositeFlowDirection()], saddr, daddr,
                         sport, dport, seq, ack);
 
-                    fcb_in->common->lock.release();
                     if (forged)
                         sendOpposite(forged);
 
@@ -168,11 +179,8 @@ void TCPOut::push_batch(int port, PacketBatch* flow)
                             return NULL;
                         }
                     }
-                } else
-
-                    fcb_in->common->lock.release();
-            } else
-                fcb_in->common->lock.release();
+                }
+            }
 
 /*                if(prevLastAckSet && SEQ_LEQ(prevAck, prevLastAck)) {
                             click_chatter("ACK lower than already sent");
@@ -188,12 +196,11 @@ void TCPOut::push_batch(int port, PacketBatch* flow)
             tcp_seq_t seq = getSequenceNumber(p);
             tcp_seq_t ack = getAckNumber(p);
             uint16_t winSize = getWindowSize(p);
-            //No need to lock, this is our side
-            //fcb_in->common->lock.acquire();
 
             // Update the last sequence number seen
             // This number is used when crafting ACKs
-            ByteStreamMaintainer &byteStreamMaintainer = fcb_in->common->maintainers[getFlowDirection()];
+            tcp_half &half = fcb_in->common->half[getFlowDirection()];
+            ByteStreamMaintainer &byteStreamMaintainer = half.maintainer;
             byteStreamMaintainer.setLastSeqSent(seq);
             byteStreamMaintainer.setLastPayloadLength(getPayloadLength(p));
 
@@ -205,7 +212,7 @@ void TCPOut::push_batch(int port, PacketBatch* flow)
             {
                 byteStreamMaintainer.setLastAckSent(ack);
             }
-            //fcb_in->common->lock.release();
+            half.publish();
 
             if (!_readonly) {
                 // Recompute the checksum
@@ -225,7 +232,7 @@ void TCPOut::push_batch(int port, PacketBatch* flow)
 }
 
 Packet*
-TCPOut::forgeAck(ByteStreamMaintainer &maintainer, uint32_t saddr, uint32_t daddr,
+TCPOut::forgeAck(tcp_half &half, uint32_t saddr, uint32_t daddr,
     uint16_t sport, uint16_t dport, tcp_seq_t seq, tcp_seq_t ack, bool force)
 {
     //click_chatter("Gen ack");
@@ -237,21 +244,27 @@ TCPOut::forgeAck(ByteStreamMaintainer &maintainer, uint32_t saddr, uint32_t dadd
 
 
     // Check if the ACK does not bring any additional information
-    if(!force && maintainer.isLastAckSentSet() && SEQ_LEQ(ack, maintainer.getLastAckSent())) {
+    tcp_seq_t lastAck;
+    if(!force && half.lastAckSent(lastAck) && SEQ_LEQ(ack, lastAck)) {
         if (inElement->_verbose)
             click_chatter("Ack not sent, no new knowledge");
         return 0;
     }
 
-    // Update the number of the last ack sent for the other side
-    maintainer.setLastAckSent(ack);
+    // Update the number of the last ack sent for the other side, it will
+    // raise its own with it
+    half.setAckForged(ack);
 
     // Ensure that the sequence number of the packet is not below
     // a sequence number sent before by the other side
-    if(maintainer.isLastSeqSentSet() && SEQ_LT(seq, maintainer.getLastSeqSent()))
-        seq = maintainer.getLastSeqSent();
+    if(half.seqSentSet) {
+        click_read_fence();
+        tcp_seq_t lastSeq = half.seqSent;
+        if (SEQ_LT(seq, lastSeq))
+            seq = lastSeq;
+    }
 
-    uint16_t winSize = maintainer.getWindowSize();
+    uint16_t winSize = half.windowSent;
 
     // The packet is now empty, we discard it and send an ACK directly to the source
 
@@ -266,7 +279,7 @@ void TCPOut::sendOpposite(Packet* p) {
     output_push_batch(1, batch);
 }
 
-void TCPOut::sendClosingPacket(ByteStreamMaintainer &maintainer, uint32_t saddr, uint32_t daddr,
+void TCPOut::sendClosingPacket(tcp_half &half, uint32_t saddr, uint32_t daddr,
     uint16_t sport, uint16_t dport, int graceful)
 {
     /*if(noutputs() < 2)
@@ -279,16 +292,18 @@ void TCPOut::sendClosingPacket(ByteStreamMaintainer &maintainer, uint32_t saddr,
     //maintainer.setLastAckSent(ack);
 
 
+    // The half may be the one of the other direction, we only read what it
+    // published
     tcp_seq_t seq, ack;
-    if(maintainer.isLastSeqSentSet() && maintainer.isLastAckSentSet()) {
-        seq = maintainer.getLastSeqSent() + maintainer.getLastPayloadLength();
-        ack = maintainer.getLastAckSent();
+    if(half.seqSentSet && half.lastAckSent(ack)) {
+        click_read_fence();
+        seq = half.seqNext;
     } else {
         click_chatter("Cannot close a connection that never had a packet out");
         return;
     }
 
-    uint16_t winSize = maintainer.getWindowSize();
+    uint16_t winSize = half.windowSent;
 
     uint8_t flag = TH_ACK;
 
@@ -296,9 +311,11 @@ void TCPOut::sendClosingPacket(ByteStreamMaintainer &maintainer, uint32_t saddr,
     {
         flag = flag | TH_FIN;
         // Ensure that further packets will have seq + 1 (for the FIN flag) as a
-        // sequence number
+        // sequence number. Only the thread of this half closes it gracefully
+        ByteStreamMaintainer &maintainer = half.maintainer;
         maintainer.setLastSeqSent(seq + 1);
         maintainer.setLastPayloadLength(0);
+        half.publish();
     }
     else if (graceful == 0) {
         flag = flag | TH_RST;
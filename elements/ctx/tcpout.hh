@@ -7,6 +7,7 @@
 
 // Forward declaration
 class TCPIn;
+class tcp_half;
 
 CLICK_DECLS
 
@@ -50,8 +51,8 @@ public:
 
     /**
      * @brief Send an ACK packet on the second output
-     * @param maintainer ByteStreamMaintainer of the other side of the connection (used to get
-     * information such as the window size)
+     * @param half Half of the other side of the connection (its maintainer is used to get
+     * information such as the window size, as published by its owner)
      * @param saddr IP source address
      * @param daddr IP destination address
      * @param sport Source port
@@ -61,14 +62,14 @@ public:
      * @param force Boolean used to force the sending of the ACK even if a previous ACK for the same
      * data has already been sent
      */
-    Packet* forgeAck(ByteStreamMaintainer &maintainer, uint32_t saddr, uint32_t daddr, uint16_t sport,
+    Packet* forgeAck(tcp_half &half, uint32_t saddr, uint32_t daddr, uint16_t sport,
          uint16_t dport, tcp_seq_t seq, tcp_seq_t ack, bool force = false);
 
     void sendOpposite(Packet* p);
      /**
       * @brief Send a packet to close the connection on the second output
-      * @param maintainer ByteStreamMaintainer of the other side of the connection (used to get
-      * information such as the window size)
+      * @param half Half of the other side of the connection (its maintainer is used to get
+      * information such as the window size, as published by its owner)
       * @param saddr IP source address
       * @param daddr IP destination address
       * @param sport Source port
@@ -78,7 +79,7 @@ public:
       * @param graceful Boolean indicating if the connection must be closed gracefully (via a FIN
       * packet) or ungracefully (via a RST packet)
       */
-    void sendClosingPacket(ByteStreamMaintainer &maintainer, uint32_t saddr, uint32_t daddr,
+    void sendClosingPacket(tcp_half &half, uint32_t saddr, uint32_t daddr,
         uint16_t sport, uint16_t dport, int graceful);
 
     void sendModifiedPacket(WritablePacket* packet) {
@@ -25,15 +25,32 @@ int
 TCPStateIN::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     Element* e;
+    uint32_t timeouts[TCP_TIMEOUT_CLASSES];
+    for (int i = 0; i < TCP_TIMEOUT_CLASSES; i++)
+        timeouts[i] = TCP_STATE_FLOW_TIMEOUT;
     if (Args(conf, this, errh)
                 .read_mp("RETURNNAME",e)
                 .read_or_set("ACCEPT_NONSYN", _accept_nonsyn, true)
+                .read("SYN_TIMEOUT", SecondsArg(3), timeouts[TCP_TIMEOUT_SYN])
+                .read("TIMEOUT", SecondsArg(3), timeouts[TCP_TIMEOUT_ESTABLISHED])
+                .read("CLOSING_TIMEOUT", SecondsArg(3), timeouts[TCP_TIMEOUT_CLOSING])
 				.read_or_set("VERBOSE", _verbose, 0)
                 .complete() < 0)
         return -1;
 
     _return = reinterpret_cast<TCPStateIN*>(e);
 
+    for (int i = 0; i < TCP_TIMEOUT_CLASSES; i++) {
+        if (timeouts[i] == 0)
+            return errh->error("Timeouts must be positive");
+#if HAVE_FLOW_RELEASE_SLOPPY_TIMEOUT
+        //The timeout is kept in the upper bits of the FCB flags
+        if (timeouts[i] > (UINT32_MAX >> FLOW_TIMEOUT_SHIFT))
+            return errh->error("Timeouts must be at most %u msec", UINT32_MAX >> FLOW_TIMEOUT_SHIFT);
+#endif
+        _timeouts[i] = timeouts[i];
+    }
+
     return 0;
 }
 
@@ -86,6 +103,8 @@ bool TCPStateIN::new_flow(TCPStateEntry* fcb, Packet* p) {
 		auto th = p->tcp_header();
 		fcb->common = common;
 		fcb->fin_seen = false;
+		fcb->timeout_class = TCP_TIMEOUT_NONE;
+		fcb->side = 1;
 //we keep the reference from the table
 //            ++fcb->common->use_count;
 		if (fcb->common->use_count == 1) { //Connection was reset, we have the only ref
@@ -94,6 +113,10 @@ bool TCPStateIN::new_flow(TCPStateEntry* fcb, Packet* p) {
 			fcb->common = 0;
 			return false;
 		}
+		common->lock.acquire();
+		common->fcb[1] = fcb_stack;
+		common->lock.release();
+		common->established = true;
 		_established ++;
 		return true;
 	}
@@ -106,7 +129,11 @@ bool TCPStateIN::new_flow(TCPStateEntry* fcb, Packet* p) {
     fcb->common = _pool.allocate();
     fcb->common->use_count = 2; //us and the table
     fcb->common->closing = false;
+    fcb->common->established = false;
     fcb->fin_seen = false;
+    fcb->timeout_class = TCP_TIMEOUT_NONE;
+    fcb->side = 0;
+    fcb->common->fcb[0] = fcb_stack;
 
     _map.find_insert(IPFlowID(p).reverse(), fcb->common);
     if (_verbose)
@@ -119,6 +146,9 @@ void TCPStateIN::release_flow(TCPStateEntry* fcb) {
         click_chatter("Release entry!");
     if (fcb->common)
     {
+        fcb->common->lock.acquire();
+        fcb->common->fcb[fcb->side] = 0;
+        fcb->common->lock.release();
         if (fcb->common->use_count.dec_and_test()) {
 		_established --;
             _pool.release(fcb->common);
@@ -129,6 +159,52 @@ void TCPStateIN::release_flow(TCPStateEntry* fcb) {
     }
 }
 
+/**
+ * Move a flow to the timeout class c. A longer timeout is acquired, a
+ * shorter one only replaces the timeout we set, so a longer one acquired by
+ * another element is kept. The flags are changed with a CAS, as the other
+ * side may change them while this side runs.
+ */
+void TCPStateIN::move_timeout(FlowControlBlock* fcb, TCPStateEntry* e, uint8_t c) {
+    uint8_t prev = e->timeout_class;
+    e->timeout_class = c;
+#if HAVE_FLOW_RELEASE_SLOPPY_TIMEOUT
+    uint32_t to = _timeouts[c];
+    uint32_t ours = prev == TCP_TIMEOUT_NONE ? timeout : _timeouts[prev];
+    while (true) {
+        uint32_t flags = fcb->flags;
+        if (!(flags & FLOW_TIMEOUT))
+            return;
+        uint32_t cur = flags >> FLOW_TIMEOUT_SHIFT;
+        if (to == cur || (to < cur && cur != ours))
+            return;
+        uint32_t nflags = (to << FLOW_TIMEOUT_SHIFT) | (flags & FLOW_TIMEOUT_MASK);
+        if (__sync_bool_compare_and_swap(&fcb->flags, flags, nflags))
+            return;
+    }
+#else
+    (void)fcb;
+    (void)prev;
+#endif
+}
+
+/**
+ * This side sent a FIN or a RST : the other side may never send a packet
+ * again, so move it to the closing timeout now.
+ */
+void TCPStateIN::close_other_side(TCPStateEntry* e) {
+    TCPStateCommon* common = e->common;
+    common->closing = true;
+    common->lock.acquire();
+    FlowControlBlock* other = common->fcb[e->side ^ 1];
+    if (other) {
+        TCPStateEntry* o = _return->fcb_data_for(other);
+        if (o->common == common && o->timeout_class != TCP_TIMEOUT_CLOSING)
+            _return->move_timeout(other, o, TCP_TIMEOUT_CLOSING);
+    }
+    common->lock.release();
+}
+
 void TCPStateIN::push_flow(int port, TCPStateEntry* flowdata, PacketBatch* batch) {
     auto fnt = [this,flowdata](Packet* p) -> Packet*{
         if (!flowdata->common) {
@@ -137,6 +213,7 @@ void TCPStateIN::push_flow(int port, TCPStateEntry* flowdata, PacketBatch* batch
         }
 
         if (unlikely(p->tcp_header()->th_flags & TH_RST)) { //RST, this side will never see any useful packet
+            close_other_side(flowdata);
             close_flow();
             release_flow(flowdata);
             return p;
@@ -150,7 +227,8 @@ void TCPStateIN::push_flow(int port, TCPStateEntry* flowdata, PacketBatch* batch
                     close_flow();
                     release_flow(flowdata);
                 } else {
-                    flowdata->common->closing = true; //This is the first fin, this side will send the final ACK
+                    //This is the first fin, this side will send the final ACK
+                    close_other_side(flowdata);
                 }
             }
         } else if (unlikely(flowdata->common->closing && p->tcp_header()->th_flags & TH_ACK && flowdata->fin_seen)) {
@@ -161,7 +239,16 @@ void TCPStateIN::push_flow(int port, TCPStateEntry* flowdata, PacketBatch* batch
     };
     EXECUTE_FOR_EACH_PACKET_DROP_LIST(fnt, batch, drop);
 
-    output_push_batch(0, batch);
+    //Move the flow to the timeout class of its new state
+    if (flowdata->common) {
+        uint8_t c = flowdata->common->closing ? TCP_TIMEOUT_CLOSING :
+            (flowdata->common->established ? TCP_TIMEOUT_ESTABLISHED : TCP_TIMEOUT_SYN);
+        if (c != flowdata->timeout_class)
+            move_timeout(fcb_stack, flowdata, c);
+    }
+
+    if (batch)
+        output_push_batch(0, batch);
 
     if (drop) {
         checked_output_push_batch(1, drop);
@@ -15,12 +15,28 @@ CLICK_DECLS
 CLICK_DECLS
 
 struct TCPStateCommon {
-    TCPStateCommon() : closing(false) {
+    TCPStateCommon() : closing(false), established(false) {
         use_count = 0;
+        fcb[0] = 0;
+        fcb[1] = 0;
     }
     atomic_uint32_t use_count; //Reference count
     bool closing; //Has one side started to close?
+    bool established; //Has the other side answered?
     uint32_t _pad[2];
+    SimpleSpinlock lock; //Protects fcb
+    FlowControlBlock* fcb[2]; //FCB of each side, 0 once released
+};
+
+/**
+ * Timeout classes of a side, following the TCP state
+ */
+enum {
+    TCP_TIMEOUT_SYN = 0, //Only this side has been seen
+    TCP_TIMEOUT_ESTABLISHED,
+    TCP_TIMEOUT_CLOSING, //One side sent a FIN
+    TCP_TIMEOUT_CLASSES,
+    TCP_TIMEOUT_NONE = TCP_TIMEOUT_CLASSES
 };
 
 
@@ -31,17 +47,71 @@ struct TCPStateCommon {
 struct TCPStateEntry {
     TCPStateCommon* common;
     bool fin_seen;
+    uint8_t timeout_class;
+    uint8_t side; //Index of this side in common->fcb
 };
 
 typedef HashTableMP<IPFlowID,TCPStateCommon*> TCPStateHashtable; //Table used to pass the mapping from the mapper to the reverse
 
 #define TCP_STATE_FLOW_TIMEOUT 16 * 1000 //Flow timeout
 
-/**
- * Efficient MiddleClick-based TCP State machine
- *
- * Working is similar to FLowIPNat
- */
+/*
+=c
+
+TCPStateIN(RETURNNAME [, I<keywords> ACCEPT_NONSYN, SYN_TIMEOUT, TIMEOUT, CLOSING_TIMEOUT, VERBOSE])
+
+=s flow
+
+efficient MiddleClick-based TCP state machine
+
+=d
+
+Tracks the opening and closing of TCP connections, one element per side.
+RETURNNAME is the element handling the other side. Working is similar to
+FlowIPNAT.
+
+The idle timeout of a flow follows its state, so half-open and closing
+connections do not hold their FCB as long as established ones. Under a SYN
+flood, a short SYN_TIMEOUT reclaims the table space of connections that never
+get an answer. Flows are moved between timeout classes when a packet of the
+side is seen. A FIN or a RST also moves the other side to the closing
+timeout, even if it does not send anything anymore. A timeout is only
+lowered if it is the one set by TCPStateIN, so a longer timeout needed by
+another element of the flow is kept.
+
+Keyword arguments are:
+
+=over 8
+
+=item ACCEPT_NONSYN
+
+Boolean. Accept flows that do not start with a SYN. Default is true.
+
+=item SYN_TIMEOUT
+
+Time. Idle timeout of connections until the other side answers. Default is
+16s.
+
+=item TIMEOUT
+
+Time. Idle timeout of established connections. Default is 16s.
+
+=item CLOSING_TIMEOUT
+
+Time. Idle timeout of connections once a side sent a FIN. Default is 16s.
+
+=back
+
+=h map_size read-only
+
+Number of connections waiting for the other side.
+
+=h established read-only
+
+Number of established connections.
+
+=a FlowIPNAT, CTXManager, FlowIPManager
+*/
 class TCPStateIN : public FlowStateElement<TCPStateIN,TCPStateEntry> {
 
 public:
@@ -73,6 +143,9 @@ public:
     void add_handlers();
 private:
 
+    void move_timeout(FlowControlBlock* fcb, TCPStateEntry* e, uint8_t c);
+    void close_other_side(TCPStateEntry* e);
+
     //Needs to be static to  prevent having one side releasing to another, hence having a pool only allocating and the other only cleaning
     static pool_allocator_mt<TCPStateCommon,false,16384> _pool;
 
@@ -81,6 +154,7 @@ private:
     TCPStateIN* _return;
     int _verbose;
     atomic_uint32_t _established;
+    int _timeouts[TCP_TIMEOUT_CLASSES]; //In msec
 };
 
 CLICK_ENDDECLS
@@ -0,0 +1,310 @@
+/*
+ * tlssni.{cc,hh} -- extracts the SNI and ALPN of TLS connections
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/router.hh>
+#include <click/args.hh>
+#include <click/error.hh>
+#include "tlssni.hh"
+
+CLICK_DECLS
+
+TLSSNI::TLSSNI() : _hello(0), _verbose(false)
+{
+    _found = 0;
+    _not_found = 0;
+}
+
+TLSSNI::~TLSSNI()
+{
+    for (unsigned i = 0; i < _hello.weight(); i++)
+        delete[] _hello.get_value(i);
+}
+
+int
+TLSSNI::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    if (Args(conf, this, errh)
+        .read("VERBOSE", _verbose)
+        .complete() < 0)
+        return -1;
+    return 0;
+}
+
+int
+TLSSNI::maxModificationLevel(Element* stop)
+{
+    return CTXStateElement<TLSSNI, fcb_tlssni>::maxModificationLevel(stop) | MODIFICATION_STALL;
+}
+
+/**
+ * Parse a ClientHello handshake message
+ */
+int
+TLSSNI::parseHello(fcb_tlssni* fcb, const unsigned char* data, unsigned length)
+{
+#define TLS_NEED(n) if (q > end || (unsigned)(end - q) < (unsigned)(n)) return TLS_NOT_FOUND
+    const unsigned char* q = data;
+    const unsigned char* end = data + length;
+    TLS_NEED(4);
+    if (q[0] != 1) //client_hello
+        return TLS_NOT_FOUND;
+    unsigned hello_length = (q[1] << 16) | (q[2] << 8) | q[3];
+    q += 4;
+    TLS_NEED(hello_length);
+    end = q + hello_length;
+
+    TLS_NEED(2 + 32 + 1); //Version, random, session id
+    q += 34;
+    q += 1 + q[0];
+    TLS_NEED(2);
+    q += 2 + ((q[0] << 8) | q[1]); //Cipher suites
+    TLS_NEED(1);
+    q += 1 + q[0]; //Compression methods
+    if (q == end) //No extensions
+        return TLS_FOUND;
+    TLS_NEED(2);
+    unsigned ext_length = (q[0] << 8) | q[1];
+    q += 2;
+    TLS_NEED(ext_length);
+    end = q + ext_length;
+
+    while (q < end) {
+        TLS_NEED(4);
+        unsigned type = (q[0] << 8) | q[1];
+        unsigned l = (q[2] << 8) | q[3];
+        q += 4;
+        TLS_NEED(l);
+        const unsigned char* e = q;
+        if (type == 0 && l >= 5 && e[2] == 0) { //server_name, host_name
+            unsigned n = (e[3] << 8) | e[4];
+            if (5 + n > l)
+                return TLS_NOT_FOUND;
+            if (n > TLS_SNI_MAX - 1)
+                n = TLS_SNI_MAX - 1;
+            for (unsigned i = 0; i < n; i++) {
+                char c = e[5 + i];
+                fcb->sni[i] = (c >= 'A' && c <= 'Z') ? c | 0x20 : c;
+            }
+            fcb->sni[n] = '\0';
+            fcb->sniLength = n;
+        } else if (type == 16 && l >= 3) { //application_layer_protocol_negotiation
+            unsigned n = e[2];
+            if (3 + n > l)
+                return TLS_NOT_FOUND;
+            if (n > TLS_ALPN_MAX - 1)
+                n = TLS_ALPN_MAX - 1;
+            memcpy(fcb->alpn, e + 3, n);
+            fcb->alpn[n] = '\0';
+            fcb->alpnLength = n;
+        }
+        q += l;
+    }
+    return TLS_FOUND;
+#undef TLS_NEED
+}
+
+/**
+ * Return the length of the payload of a handshake record, or -1
+ */
+static inline int
+tls_record_length(const unsigned char* h)
+{
+    //Handshake record, any TLS version
+    if (h[0] != 22 || h[1] != 3)
+        return -1;
+    int l = (h[3] << 8) | h[4];
+    if (l == 0 || l > TLS_RECORD_MAX)
+        return -1;
+    return l;
+}
+
+/**
+ * Return the length of a handshake message with its header
+ */
+static inline unsigned
+tls_handshake_length(const unsigned char* h)
+{
+    return 4 + ((h[1] << 16) | (h[2] << 8) | h[3]);
+}
+
+/**
+ * Look for a complete ClientHello in the buffer. It is parsed in place if
+ * the first packet holds it in one record, else the handshake message is
+ * reassembled from the records in the per-thread buffer.
+ */
+int
+TLSSNI::inspect(fcb_tlssni* fcb)
+{
+    FlowBufferChunkIter it(&fcb->flowBuffer, *fcb->flowBuffer.begin());
+    if (it) {
+        Chunk c = *it;
+        if (c.length >= 9) {
+            int l = tls_record_length(c.bytes);
+            if (l < 0)
+                return TLS_NOT_FOUND;
+            if (c.length >= 5 + (unsigned)l && l >= 4 && tls_handshake_length(c.bytes + 5) <= (unsigned)l)
+                return parseHello(fcb, c.bytes + 5, l);
+        }
+    }
+
+    unsigned char* hello = *_hello;
+    if (!hello)
+        hello = *_hello = new unsigned char[TLS_HELLO_MAX];
+    unsigned char header[5];
+    unsigned header_have = 0;
+    unsigned record_left = 0;
+    unsigned have = 0;
+    unsigned need = 4;
+
+    for (; it; ++it) {
+        Chunk c = *it;
+        const unsigned char* s = c.bytes;
+        unsigned left = c.length;
+        while (left > 0) {
+            unsigned n;
+            if (record_left == 0) {
+                n = 5 - header_have;
+                if (n > left)
+                    n = left;
+                memcpy(header + header_have, s, n);
+                header_have += n;
+                s += n;
+                left -= n;
+                if (header_have == 5) {
+                    int l = tls_record_length(header);
+                    if (l < 0)
+                        return TLS_NOT_FOUND;
+                    record_left = l;
+                    header_have = 0;
+                }
+                continue;
+            }
+            n = need - have;
+            if (n > record_left)
+                n = record_left;
+            if (n > left)
+                n = left;
+            memcpy(hello + have, s, n);
+            have += n;
+            record_left -= n;
+            s += n;
+            left -= n;
+            if (have == 4 && need == 4) {
+                need = tls_handshake_length(hello);
+                if (hello[0] != 1 || need == 4 || need > TLS_HELLO_MAX)
+                    return TLS_NOT_FOUND;
+            }
+            if (have == need)
+                return parseHello(fcb, hello, have);
+        }
+    }
+    return TLS_INSPECTING;
+}
+
+void
+TLSSNI::push_flow(int, fcb_tlssni* fcb, PacketBatch* flow)
+{
+    if (likely(fcb->state != TLS_INSPECTING)) {
+        checked_output_push_batch(fcb->state == TLS_FOUND ? 0 : 1, flow);
+        return;
+    }
+
+    //Packets of the TCP handshake come before any data
+    if (!fcb->buffered) {
+        unsigned n = 0;
+        FOR_EACH_PACKET(flow, p) {
+            if (!p->isPacketContentEmpty())
+                break;
+            n++;
+        }
+        if (n == flow->count()) {
+            output_push_batch(0, flow);
+            return;
+        }
+        if (n > 0) {
+            PacketBatch* rest;
+            flow->split(n, rest, true);
+            output_push_batch(0, flow);
+            flow = rest;
+        }
+        fcb->buffered = true;
+    }
+
+    Packet* tail = flow->tail();
+    fcb->flowBuffer.enqueueAll(flow);
+    int state = inspect(fcb);
+    if (state == TLS_INSPECTING) {
+        if (!isLastUsefulPacket(tail)) {
+            requestMorePackets(tail, false);
+            return;
+        }
+        state = TLS_NOT_FOUND;
+    }
+
+    fcb->state = state;
+    fcb->buffered = false;
+    if (state == TLS_FOUND) {
+        _found++;
+        if (unlikely(_verbose))
+            click_chatter("%p{element}: SNI '%s', ALPN '%s'", this, fcb->sni, fcb->alpn);
+    } else {
+        _not_found++;
+    }
+    checked_output_push_batch(state == TLS_FOUND ? 0 : 1, fcb->flowBuffer.dequeueAll());
+}
+
+void
+TLSSNI::release_flow(fcb_tlssni* fcb)
+{
+    if (fcb->buffered) {
+        PacketBatch* batch = fcb->flowBuffer.dequeueAll();
+        if (batch)
+            batch->fast_kill();
+    }
+    fcb->state = TLS_INSPECTING;
+    fcb->buffered = false;
+    fcb->sniLength = 0;
+    fcb->alpnLength = 0;
+}
+
+enum {
+    h_found,
+    h_not_found
+};
+
+String
+TLSSNI::read_handler(Element *e, void *thunk)
+{
+    TLSSNI *t = static_cast<TLSSNI *>(e);
+    switch ((intptr_t)thunk) {
+      case h_found:
+        return String(t->_found);
+      case h_not_found:
+        return String(t->_not_found);
+      default:
+        return "<error>";
+    }
+}
+
+void
+TLSSNI::add_handlers()
+{
+    add_read_handler("found", read_handler, h_found);
+    add_read_handler("not_found", read_handler, h_not_found);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(TLSSNI)
+ELEMENT_MT_SAFE(TLSSNI)
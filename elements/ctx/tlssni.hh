@@ -0,0 +1,120 @@
+#ifndef MIDDLEBOX_TLSSNI_HH
+#define MIDDLEBOX_TLSSNI_HH
+#include <click/element.hh>
+#include <click/flowbuffer.hh>
+#include "ctxelement.hh"
+
+CLICK_DECLS
+
+#define TLS_SNI_MAX 128
+#define TLS_ALPN_MAX 32
+//Maximal payload of a TLS record
+#define TLS_RECORD_MAX 16384
+//Maximal size of a ClientHello handshake message, with its header
+#define TLS_HELLO_MAX 16384
+
+enum TLSHelloState {TLS_INSPECTING, TLS_FOUND, TLS_NOT_FOUND};
+
+/**
+ * Structure used by the TLSSNI element
+ */
+struct fcb_tlssni
+{
+    FlowBuffer flowBuffer;
+    uint8_t state;
+    bool buffered;
+    uint8_t sniLength;
+    uint8_t alpnLength;
+    char sni[TLS_SNI_MAX];
+    char alpn[TLS_ALPN_MAX];
+};
+
+/*
+=c
+
+TLSSNI([I<keywords> VERBOSE])
+
+=s middlebox
+
+extracts the SNI and ALPN of TLS connections
+
+=d
+
+Buffers the first bytes sent by a TLS client until the ClientHello is
+complete, then extracts the server name (SNI) and the first offered
+application protocol (ALPN) into the flow state. Once the ClientHello is
+parsed, the flow is not inspected anymore and its packets go through
+without being looked at.
+
+Elements after TLSSNI, such as a load balancer choosing a backend, can read
+the values of the current flow with TLSSNI::sni() and TLSSNI::alpn(). The
+server name is lower-cased and truncated to 127 bytes.
+
+The ClientHello may be split across packets and across handshake records.
+Flows that do not start with a ClientHello, or whose ClientHello is
+malformed or larger than 16KB, are pushed to output 1 if it is connected,
+output 0 otherwise.
+TLSSNI must be placed in the direction from the client, after TCPIn.
+
+=item VERBOSE
+
+Boolean. Print the server name of each flow. Default is false.
+
+=h found read-only
+
+Number of flows for which a ClientHello was parsed.
+
+=h not_found read-only
+
+Number of flows that did not start with a valid ClientHello.
+
+=a HTTPIn, CTXIPLoadBalancer */
+
+class TLSSNI : public CTXStateElement<TLSSNI, fcb_tlssni>
+{
+public:
+    TLSSNI() CLICK_COLD;
+    ~TLSSNI() CLICK_COLD;
+
+    const char *class_name() const        { return "TLSSNI"; }
+    const char *port_count() const        { return PORTS_1_1X2; }
+    const char *processing() const        { return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) override CLICK_COLD;
+    void add_handlers() override CLICK_COLD;
+
+    void push_flow(int port, fcb_tlssni* fcb, PacketBatch*);
+    void release_flow(fcb_tlssni* fcb);
+
+    virtual int maxModificationLevel(Element* stop) override;
+
+    /**
+     * Server name of the current flow, empty until the ClientHello is parsed
+     */
+    inline StringRef sni() {
+        fcb_tlssni* fcb = fcb_data();
+        return StringRef(fcb->sni, fcb->sniLength);
+    }
+
+    /**
+     * First protocol offered by the client of the current flow
+     */
+    inline StringRef alpn() {
+        fcb_tlssni* fcb = fcb_data();
+        return StringRef(fcb->alpn, fcb->alpnLength);
+    }
+
+private:
+    int inspect(fcb_tlssni* fcb);
+    int parseHello(fcb_tlssni* fcb, const unsigned char* data, unsigned length);
+    static String read_handler(Element *e, void *thunk) CLICK_COLD;
+
+    //Buffer to reassemble a ClientHello that is not in one packet
+    per_thread<unsigned char*> _hello;
+    atomic_uint32_t _found;
+    atomic_uint32_t _not_found;
+    bool _verbose;
+};
+
+CLICK_ENDDECLS
+#endif
@@ -301,6 +301,16 @@ ARPQuerier::handle_ip(Packet *p, bool response)
     } else
 	q->ether_header()->ether_type = htons(ETHERTYPE_IP);
 
+    return resolve(q);
+}
+
+/*
+ * Set the destination of q, which already has an Ethernet header, and
+ * return it, or save it in the ARP table and return null.
+ */
+Packet*
+ARPQuerier::resolve(WritablePacket *q)
+{
     IPAddress dst_ip = q->dst_ip_anno();
     EtherAddress *dst_eth = reinterpret_cast<EtherAddress *>(q->ether_header()->ether_dhost);
 
@@ -312,7 +322,7 @@ ARPQuerier::handle_ip(Packet *p, bool response)
             goto found;
         }
     }
-    // Easy case: requires only read lock
+    // Easy case: requires no lock, or only the read lock
   retry_read_lock:
     r = _arpt->lookup(dst_ip, dst_eth, _poll_timeout_j);
     if (r >= 0) {
@@ -438,13 +448,64 @@ ARPQuerier::push(int port, Packet *p)
 }
 
 #if HAVE_BATCH
+/*
+ * Resolve the whole batch against one snapshot of the published ARP table,
+ * after the per-thread cache. Hits in the snapshot fill the cache, like
+ * resolve() does. Packets that miss both are resolved after the snapshot is
+ * released, as they may write the table.
+ */
 void
 ARPQuerier::push_batch(int port, PacketBatch *batch)
 {
     if (port == 0) {
-        EXECUTE_FOR_EACH_PACKET_DROPPABLE(handle_ip,batch,[](Packet*){});
-        if (batch)
-            output(0).push_batch(batch);
+        if (!_my_ip) {
+            _drops += batch->count();
+            batch->kill();
+            return;
+        }
+
+        BATCH_CREATE_INIT(out);
+        BATCH_CREATE_INIT(slow);
+        click_jiffies_t now = click_jiffies();
+        int flags;
+        const ARPTable::Snapshot &snap = _arpt->snapshot_begin(flags);
+        FOR_EACH_PACKET_SAFE(batch, p) {
+            WritablePacket *q = p->push_mac_header(sizeof(click_ether));
+            if (!q) {
+                ++_drops;
+                continue;
+            }
+            click_ether *ethh = q->ether_header();
+            ethh->ether_type = htons(ETHERTYPE_IP);
+            IPAddress dst_ip = q->dst_ip_anno();
+            EtherAddress *dst_eth = reinterpret_cast<EtherAddress *>(ethh->ether_dhost);
+            bool hit = _have_cache && _cache->find(dst_ip, now, *dst_eth, false);
+            if (!hit && _arpt->lookup(snap, dst_ip, dst_eth, now, _poll_timeout_j)) {
+                hit = true;
+                if (_have_cache)
+                    _cache->insert(dst_ip, now, *dst_eth);
+            }
+            if (hit) {
+                memcpy(&ethh->ether_shost, _my_en.data(), 6);
+                BATCH_CREATE_APPEND(out, q);
+            } else {
+                BATCH_CREATE_APPEND(slow, q);
+            }
+        }
+        _arpt->snapshot_end(flags);
+        BATCH_CREATE_FINISH(slow);
+
+        if (slow) {
+            FOR_EACH_PACKET_SAFE(slow, p) {
+                Packet *q = resolve(static_cast<WritablePacket *>(p));
+                if (q) {
+                    BATCH_CREATE_APPEND(out, q);
+                }
+            }
+        }
+        BATCH_CREATE_FINISH(out);
+        if (out)
+            output(0).push_batch(out);
     } else {
         FOR_EACH_PACKET_SAFE(batch,p) {
             handle_response(p);
@@ -235,6 +235,7 @@ class ARPQuerier : public FlowElement { public:
     void send_query_for(const Packet *p, bool ether_dhost_valid);
 
     Packet* handle_ip(Packet *p, bool response = false);
+    Packet* resolve(WritablePacket *q);
     void handle_response(Packet *p);
 
     static void expire_hook(Timer *, void *);
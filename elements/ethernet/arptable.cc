@@ -30,8 +30,11 @@
 #include <click/glue.hh>
 CLICK_DECLS
 
+// Time between publications of refreshed entries, in jiffies
+#define ARPTABLE_PUBLISH_INTERVAL CLICK_HZ
+
 ARPTable::ARPTable()
-    : _entry_capacity(0), _packet_capacity(2048), _entry_packet_capacity(0), _capacity_slim_factor(2), _expire_timer(this), _need_lock(true)
+    : _entry_capacity(0), _packet_capacity(2048), _entry_packet_capacity(0), _capacity_slim_factor(2), _expire_timer(this), _publish_timer(this), _need_lock(true), _published_at_j(0), _refresh_pending(false)
 {
     _entry_count = _packet_count = _drops = 0;
 }
@@ -66,6 +69,7 @@ int
 ARPTable::initialize(ErrorHandler *errh) {
     if (get_passing_threads().weight() <= 1)
         _need_lock = false;
+    _publish_timer.initialize(this);
     return 0;
 }
 
@@ -90,6 +94,7 @@ ARPTable::clear()
     }
     _entry_count = _packet_count = 0;
     _age.__clear();
+    publish_all();
 }
 
 void
@@ -112,12 +117,54 @@ ARPTable::take_state(Element *e, ErrorHandler *errh)
 
     arpt->_entry_count = 0;
     arpt->_packet_count = 0;
+    publish_all();
+    arpt->publish_all();
+}
+
+/*
+ * The published table is only written under the write lock, or when there
+ * is no packet, so the writers of _published never wait for each other.
+ * Each publication copies the table, so it is done once per change of the
+ * mappings, and refreshes are batched by publish_refreshed().
+ */
+void
+ARPTable::publish_all()
+{
+    int flags;
+    Snapshot &snap = _published.write_begin(flags);
+    snap.clear();
+    for (Table::iterator it = _table.begin(); it; ++it)
+	if (it->_known)
+	    snap.set(it->_ip, Published(it->_eth, it->_live_at_j));
+    _published.write_commit(flags);
+    _published_at_j = click_jiffies();
+    _refresh_pending = false;
+}
+
+/*
+ * Publish the entries refreshed without a change of mapping, at most every
+ * ARPTABLE_PUBLISH_INTERVAL. Until then, lookups of an entry whose published
+ * copy is too old to be used fall back to the locked table. If it is too
+ * early, the publish timer does it at the end of the interval, so refreshes
+ * are published even if no other reply comes.
+ */
+void
+ARPTable::publish_refreshed(click_jiffies_t now)
+{
+    if (!_refresh_pending)
+	return;
+    click_jiffies_t at_j = _published_at_j + ARPTABLE_PUBLISH_INTERVAL;
+    if (!click_jiffies_less(now, at_j))
+	publish_all();
+    else if (!_publish_timer.scheduled())
+	_publish_timer.schedule_after(Timestamp::make_jiffies(at_j - now));
 }
 
 void
 ARPTable::slim(click_jiffies_t now)
 {
     ARPEntry *ae;
+    bool unpublished = false;
 
     // Delete old entries.
     while ((ae = _age.front())
@@ -125,6 +172,7 @@ ARPTable::slim(click_jiffies_t now)
 	       || (_entry_capacity && _entry_count > _entry_capacity))) {
 	_table.erase(ae->_ip);
 	_age.pop_front();
+	unpublished |= ae->_known;
 
 	while (Packet *p = ae->_head) {
 	    ae->_head = p->next();
@@ -136,6 +184,8 @@ ARPTable::slim(click_jiffies_t now)
 	_alloc.deallocate(ae);
 	--_entry_count;
     }
+    if (unpublished)
+	publish_all();
 
     // Delete packets to make space.
     if (_packet_capacity && _packet_count > _packet_capacity) {
@@ -160,10 +210,19 @@ ARPTable::slim(click_jiffies_t now)
 void
 ARPTable::run_timer(Timer *timer)
 {
+    if (timer == &_publish_timer) {
+	_lock.acquire_write();
+	publish_refreshed(click_jiffies());
+	_lock.release_write();
+	return;
+    }
+
     // Expire any old entries, and make sure there's room for at least one
     // packet.
     _lock.acquire_write();
-    slim(click_jiffies());
+    click_jiffies_t now = click_jiffies();
+    slim(now);
+    publish_refreshed(now);
     _lock.release_write();
     if (_timeout_j)
 	timer->schedule_after_sec(_timeout_j / CLICK_HZ + 1);
@@ -203,6 +262,8 @@ ARPTable::insert(IPAddress ip, const EtherAddress &eth, Packet **head)
     if (!ae)
 	return -ENOMEM;
 
+    bool was_known = ae->_known;
+    bool changed = ae->_eth != eth;
     ae->_eth = eth;
     ae->_known = !eth.is_broadcast();
 
@@ -210,6 +271,13 @@ ARPTable::insert(IPAddress ip, const EtherAddress &eth, Packet **head)
     ae->_num_polls_since_reply = 0;
     ae->_polled_at_j = ae->_live_at_j - CLICK_HZ;
 
+    if (ae->_known != was_known || (ae->_known && changed))
+	publish_all();
+    else if (ae->_known) {
+	_refresh_pending = true;
+	publish_refreshed(now);
+    }
+
     if (ae->_age_link.next()) {
 	_age.erase(ae);
 	_age.push_back(ae);
@@ -4,7 +4,9 @@
 #include <click/etheraddress.hh>
 #include <click/hashcontainer.hh>
 #include <click/hashallocator.hh>
+#include <click/hashtable.hh>
 #include <click/sync.hh>
+#include <click/multithread.hh>
 #include <click/timer.hh>
 #include <click/list.hh>
 CLICK_DECLS
@@ -57,6 +59,18 @@ service attack.
 Time value.  The amount of time after which an ARP entry will expire.  Default
 is 5 minutes.  Zero means ARP entries never expire.
 
+=back
+
+The known entries are also published in a read-only copy of the table, which
+lookups read without taking any lock.  The copy is replaced through RCU when
+a mapping is learned, changes, or is removed, which costs a copy of the known
+entries.  Replies that only refresh a mapping are published together, at
+most once per second and at most a second late; until then a refreshed
+entry whose published copy
+looks too old is looked up in the locked table.  Lookups needing an ARP
+poll, unknown addresses, and the packets waiting for an answer also use the
+locked table.
+
 =h table r
 
 Return a table of the ARP entries.  The returned string has four
@@ -107,6 +121,30 @@ class ARPTable : public Element { public:
     void add_handlers() CLICK_COLD;
     void cleanup(CleanupStage) CLICK_COLD;
 
+    struct Published {
+	EtherAddress eth;
+	click_jiffies_t live_at_j;
+	Published() : live_at_j(0) {
+	}
+	Published(const EtherAddress &e, click_jiffies_t live)
+	    : eth(e), live_at_j(live) {
+	}
+    };
+    typedef HashTable<IPAddress, Published> Snapshot;
+
+    /** @brief Start reading the published table, ended by snapshot_end().
+     *
+     * No write to the table may be done by this thread before
+     * snapshot_end(). */
+    inline const Snapshot &snapshot_begin(int &flags) {
+	return _published.read_begin(flags);
+    }
+    inline void snapshot_end(int &flags) {
+	_published.read_end(flags);
+    }
+    inline bool lookup(const Snapshot &snap, IPAddress ip, EtherAddress *eth,
+		       click_jiffies_t now, uint32_t poll_timeout_j) const;
+
     int lookup(IPAddress ip, EtherAddress *eth, uint32_t poll_timeout_j);
     EtherAddress lookup(IPAddress ip);
     IPAddress reverse_lookup(const EtherAddress &eth);
@@ -226,20 +264,49 @@ class ARPTable : public Element { public:
     atomic_uint32_t _drops;
     SizedHashAllocator<sizeof(ARPEntry)> _alloc;
     Timer _expire_timer;
+    Timer _publish_timer;
+    fast_rcu<Snapshot> _published;
+    click_jiffies_t _published_at_j;
+    bool _refresh_pending;
 
     ARPEntry *ensure(IPAddress ip, click_jiffies_t now);
     void slim(click_jiffies_t now);
+    void publish_all();
+    void publish_refreshed(click_jiffies_t now);
 
 };
 
+/** @brief Look for ip in the published table snap.
+ *
+ * Returns true and sets *eth if ip is known and does not need to be polled.
+ * Otherwise the locked lookup must be used. */
+inline bool
+ARPTable::lookup(const Snapshot &snap, IPAddress ip, EtherAddress *eth,
+		 click_jiffies_t now, uint32_t poll_timeout_j) const
+{
+    const Published *pub = snap.get_pointer(ip);
+    if (!pub
+	|| (_timeout_j && click_jiffies_less(pub->live_at_j + _timeout_j, now))
+	|| (poll_timeout_j && !click_jiffies_less(now, pub->live_at_j + poll_timeout_j)))
+	return false;
+    *eth = pub->eth;
+    return true;
+}
+
 inline int
 ARPTable::lookup(IPAddress ip, EtherAddress *eth, uint32_t poll_timeout_j)
 {
+    click_jiffies_t now = click_jiffies();
+    int flags;
+    bool found = lookup(snapshot_begin(flags), ip, eth, now, poll_timeout_j);
+    snapshot_end(flags);
+    if (found)
+	return 0;
+
     if (_need_lock)
         _lock.acquire_read();
     int r = -1;
     if (Table::iterator it = _table.find(ip)) {
-	click_jiffies_t now = click_jiffies();
 	if (it->known(now, _timeout_j)) {
 	    *eth = it->_eth;
 	    if (poll_timeout_j
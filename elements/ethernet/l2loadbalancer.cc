@@ -59,19 +59,23 @@ int L2LoadBalancer::initialize(ErrorHandler *errh)
 
 void L2LoadBalancer::push_batch(int, PacketBatch* batch)
 {
-    auto fnt = [this](Packet*&p) -> bool {
+    auto fnt = [this](Packet* p) -> Packet* {
         WritablePacket* q =p->uniqueify();
-        p = q;
-
-        int server = pick_server(p);
+        if (unlikely(!q))
+            return 0;
 
+        int server = pick_server(q);
+        if (unlikely(server == no_server)) {
+            q->kill();
+            return 0;
+        }
 
         EtherAddress srv = _dsts[server];
 
         memcpy(&q->ether_header()->ether_dhost, srv.data(), sizeof(EtherAddress));
-        return true;
+        return q;
     };
-    EXECUTE_FOR_EACH_PACKET_UNTIL_DROP(fnt, batch);
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(fnt, batch, [](Packet*){});
 
     if (batch)
         checked_output_push_batch(0, batch);
@@ -25,26 +25,39 @@
 #include <click/error.hh>
 #include <click/confparse.hh>
 #include <click/string.hh>
+#include <click/algorithm.hh>
 CLICK_DECLS
 
 EtherSwitch::EtherSwitch()
-    : _table(AddrInfo(-1, Timestamp())), _timeout(300)
+    : _table(0), _nsets(0), _timeout(300)
 {
 }
 
 EtherSwitch::~EtherSwitch()
 {
-    _table.clear();
+    delete[] _table;
 }
 
 int
 EtherSwitch::configure(Vector<String> &conf, ErrorHandler *errh)
 {
+    uint32_t capacity = 4096;
     if (Args(conf, this, errh)
 	.read("TIMEOUT", SecondsArg(), _timeout)
+	.read("CAPACITY", capacity)
 	.complete() < 0)
         return errh->error("bad timeout");
 
+    if (capacity == 0)
+        return errh->error("CAPACITY must be positive");
+    _nsets = next_pow2((capacity + SET_SIZE - 1) / SET_SIZE);
+    delete[] _table;
+    _table = new MACEntry[_nsets * SET_SIZE];
+    for (uint32_t i = 0; i < _nsets * SET_SIZE; i++) {
+        _table[i].entry = 0;
+        _table[i].stamp = 0;
+    }
+
     int n = noutputs();
     _pfrs.resize(n);
     for (int i = 0; i < n; i++)
@@ -68,6 +81,66 @@ EtherSwitch::broadcast(int source, Packet *p)
   }
 }
 
+#if HAVE_BATCH
+void
+EtherSwitch::broadcast_batch(int source, PacketBatch *batch)
+{
+  PortForwardRule &pfr = _pfrs[source];
+  int n = pfr.bv.size();
+  int w = pfr.w;
+  if (w == 0) {
+    batch->kill();
+    return;
+  }
+  for (int i = 0; i < n && w > 0; i++) {
+    if (pfr.bv[i]) {
+      PacketBatch *pp = (w > 1 ? batch->clone_batch() : batch);
+      output_push_batch(i, pp);
+      w--;
+    }
+  }
+}
+#endif
+
+/**
+ * Learn that the address of key is on its port, under the lock, and return
+ * the index of its entry. Only called when the table has no fresh entry for
+ * it. An address that moves or is evicted changes its entry, which is enough
+ * to drop it from the caches of the threads.
+ */
+uint32_t
+EtherSwitch::learn(uint64_t key, uint32_t now, uint32_t lifetime)
+{
+    uint64_t mac = key & ~0xFFFFULL;
+    MACEntry* set = &_table[(hash(key >> 16) & (_nsets - 1)) * SET_SIZE];
+    _lock.acquire();
+    MACEntry* slot = 0;
+    for (int i = 0; i < SET_SIZE; i++) {
+        if ((set[i].entry.value() & ~0xFFFFULL) == mac) {
+            slot = &set[i];
+            break;
+        }
+    }
+    if (!slot) {
+        // Take an empty or expired entry, or the least recently refreshed one
+        slot = &set[0];
+        for (int i = 0; i < SET_SIZE; i++) {
+            if (set[i].entry.value() == 0 || now - set[i].stamp.value() >= lifetime) {
+                slot = &set[i];
+                break;
+            }
+            if ((int32_t) (set[i].stamp.value() - slot->stamp.value()) < 0)
+                slot = &set[i];
+        }
+    }
+    slot->seq.write_begin();
+    slot->stamp = now;
+    slot->entry = key;
+    slot->seq.write_end();
+    _lock.release();
+    return slot - _table;
+}
+
 int
 EtherSwitch::remove_port_forwarding(String portmaps, ErrorHandler *errh)
 {
@@ -108,25 +181,11 @@ EtherSwitch::reset_port_forwarding()
 void
 EtherSwitch::push(int source, Packet *p)
 {
-    click_ether* e = (click_ether*) p->data();
     int outport = -1;		// Broadcast
 
     // 0 timeout means dumb switch
-    if (_timeout != 0) {
-	_table.set(EtherAddress(e->ether_shost), AddrInfo(source, p->timestamp_anno()));
-
-	// Set outport if dst is unicast, we have info about it, and the
-	// info is still valid.
-	EtherAddress dst(e->ether_dhost);
-	if (!dst.is_group()) {
-	    if (Table::iterator dst_info = _table.find(dst)) {
-		if (p->timestamp_anno() < dst_info.value().stamp + Timestamp(_timeout, 0))
-		    outport = dst_info.value().port;
-		else
-		    _table.erase(dst_info);
-	    }
-	}
-    }
+    if (_timeout != 0)
+	outport = lookup(source, p, *_cache, click_jiffies(), _timeout * CLICK_HZ);
 
   if (outport < 0)
     broadcast(source, p);
@@ -136,6 +195,42 @@ EtherSwitch::push(int source, Packet *p)
       p->kill();
 }
 
+#if HAVE_BATCH
+void
+EtherSwitch::push_batch(int source, PacketBatch *batch)
+{
+    int n = noutputs();
+    uint32_t timeout = _timeout;
+    if (timeout == 0) {
+        broadcast_batch(source, batch);
+        return;
+    }
+
+    MACCache &cache = *_cache;
+    uint32_t now = click_jiffies();
+    uint32_t lifetime = timeout * CLICK_HZ;
+    const Bitvector &bv = _pfrs[source].bv;
+    // Output n broadcasts, output n + 1 drops
+    auto fnt = [this, source, &cache, now, lifetime, &bv, n](Packet *p) -> int {
+        int outport = lookup(source, p, cache, now, lifetime);
+        if (outport < 0)
+            return n;
+        if (!bv[outport])
+            return n + 1;
+        return outport;
+    };
+    auto on_finish = [this, source, n](int o, PacketBatch *b) {
+        if (o < n)
+            output_push_batch(o, b);
+        else if (o == n)
+            broadcast_batch(source, b);
+        else
+            b->kill();
+    };
+    CLASSIFY_EACH_PACKET(n + 2, fnt, batch, on_finish);
+}
+#endif
+
 String
 EtherSwitch::reader(Element* f, void *thunk)
 {
@@ -143,8 +238,19 @@ EtherSwitch::reader(Element* f, void *thunk)
     switch ((intptr_t) thunk) {
     case 0: {
 	StringAccum sa;
-	for (Table::iterator iter = sw->_table.begin(); iter.live(); iter++)
-	    sa << iter.key() << ' ' << iter.value().port << '\n';
+	uint32_t now = click_jiffies();
+	uint32_t lifetime = sw->_timeout * CLICK_HZ;
+	for (uint32_t i = 0; i < sw->_nsets * SET_SIZE; i++) {
+	    uint64_t entry;
+	    uint32_t stamp;
+	    read_entry(sw->_table[i], entry, stamp);
+	    if (entry == 0 || now - stamp >= lifetime)
+		continue;
+	    unsigned char mac[6];
+	    for (int j = 0; j < 6; j++)
+		mac[j] = entry >> (56 - 8 * j);
+	    sa << EtherAddress(mac) << ' ' << (int) (entry & 0xFFFF) - 1 << '\n';
+	}
 	return sa.take_string();
     }
     case 1:
@@ -201,4 +307,5 @@ EtherSwitch::add_handlers()
 }
 
 EXPORT_ELEMENT(EtherSwitch)
+ELEMENT_MT_SAFE(EtherSwitch)
 CLICK_ENDDECLS
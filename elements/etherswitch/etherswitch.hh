@@ -1,16 +1,18 @@
 #ifndef CLICK_ETHERSWITCH_HH
 #define CLICK_ETHERSWITCH_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
 #include <click/etheraddress.hh>
-#include <click/hashtable.hh>
 #include <click/bitvector.hh>
 #include <click/vector.hh>
+#include <click/sync.hh>
+#include <click/atomic.hh>
+#include <clicknet/ether.h>
 CLICK_DECLS
 
 /*
 =c
 
-EtherSwitch([I<keywords> TIMEOUT])
+EtherSwitch([I<keywords> TIMEOUT, CAPACITY])
 
 =s ethernet
 
@@ -31,6 +33,15 @@ the one corresponding to the packet's input port.  The TIMEOUT parameter
 affects how long port associations last.  If it is 0, then the element does
 not learn addresses, and acts like a dumb hub.
 
+EtherSwitch can be used by multiple threads at once. The MAC table is shared
+by all the threads and is read without locks. It is only written, under a
+lock, when an address is learned, moves to another port, or when its entry
+is refreshed, which happens at most once per second per address for TIMEOUTs
+of 8 seconds or more. Each thread also keeps a small cache of the addresses
+it saw recently. A cached address is checked against its table entry, so
+only the addresses that move or are evicted leave the caches. Ages are
+measured with the system clock, not the timestamp annotation of the packets.
+
 Keyword arguments are:
 
 =over 8
@@ -41,12 +52,14 @@ The timeout for port associations, in seconds.  Any port mapping (i.e.,
 binding between an address and a port number) is dropped after TIMEOUT seconds
 of inactivity.  If 0, the element acts like a dumb hub.  Default is 300.
 
-=back
+=item CAPACITY
 
-=n
+The number of addresses the table can hold, rounded up to a multiple of 4.
+The table is split in sets of 4 entries chosen by hashing the address. When
+a set is full, its least recently refreshed entry is replaced.  Default is
+4096.
 
-The EtherSwitch element has no limit on the memory consumed by cached Ethernet
-addresses.
+=back
 
 =h table read-only
 
@@ -61,7 +74,7 @@ Returns or sets the TIMEOUT argument.
 ListenEtherSwitch, EtherSpanTree
 */
 
-class EtherSwitch : public Element { public:
+class EtherSwitch : public BatchElement { public:
 
   EtherSwitch() CLICK_COLD;
   ~EtherSwitch() CLICK_COLD;
@@ -75,17 +88,46 @@ class EtherSwitch : public Element { public:
     void add_handlers() CLICK_COLD;
 
   void push(int port, Packet* p);
+#if HAVE_BATCH
+    void push_batch(int port, PacketBatch* batch);
+#endif
+
+  protected:
+
+    /**
+     * An entry of the table is the address in the 48 high bits and the port
+     * plus one in the 16 low bits, 0 if the entry is empty. Readers that
+     * need the stamp with the entry read both under the sequence lock, so
+     * they never see the stamp of another address.
+     */
+    struct MACEntry {
+	atomic_uint64_t entry;
+	atomic_uint32_t stamp;	// Jiffies of the last refresh
+	SeqLock seq;		// Written under _lock
+    };
+
+    enum { SET_SIZE = 4, CACHE_SIZE = 256 };
 
-    struct AddrInfo {
-	int port;
-	Timestamp stamp;
-	inline AddrInfo(int p, const Timestamp &t);
+    /**
+     * A cached entry is valid as long as its table entry still holds it
+     */
+    struct MACCacheEntry {
+	uint64_t entry;
+	uint32_t stamp;
+	uint32_t index;	// In _table
     };
 
-  private:
+    struct MACCache {
+	MACCacheEntry e[CACHE_SIZE];
+	MACCache() {
+	    memset(e, 0, sizeof(e));
+	}
+    };
 
-    typedef HashTable<EtherAddress, AddrInfo> Table;
-    Table _table;
+    MACEntry* _table;
+    uint32_t _nsets;	// Power of two
+    Spinlock _lock;	// Taken by writers of the table
+    per_thread<MACCache> _cache;
     uint32_t _timeout;
     struct PortForwardRule {
         Bitvector bv; /* Each bit is a port used in determining forwarding to of packets */
@@ -104,7 +146,36 @@ class EtherSwitch : public Element { public:
     };
     Vector<PortForwardRule> _pfrs;
 
+    static inline uint64_t mac_key(const uint8_t* mac) {
+	return ((uint64_t) mac[0] << 56) | ((uint64_t) mac[1] << 48)
+	    | ((uint64_t) mac[2] << 40) | ((uint64_t) mac[3] << 32)
+	    | ((uint64_t) mac[4] << 24) | ((uint64_t) mac[5] << 16);
+    }
+
+    inline uint32_t hash(uint64_t key) const {
+	return (key * 0x9E3779B97F4A7C15ULL) >> 32;
+    }
+
+    static inline void read_entry(const MACEntry& m, uint64_t& entry, uint32_t& stamp) {
+	uint32_t v;
+	do {
+	    v = m.seq.read_begin();
+	    entry = m.entry.value();
+	    stamp = m.stamp.value();
+	} while (m.seq.read_retry(v));
+    }
+
+    inline bool cached(const MACCacheEntry& c) const {
+	return c.entry && _table[c.index].entry.value() == c.entry;
+    }
+
+    inline int lookup(int source, Packet* p, MACCache& cache, uint32_t now, uint32_t lifetime);
+    uint32_t learn(uint64_t key, uint32_t now, uint32_t lifetime);
+
     void broadcast(int source, Packet*);
+#if HAVE_BATCH
+    void broadcast_batch(int source, PacketBatch*);
+#endif
     int remove_port_forwarding(String portmaps, ErrorHandler *errh);
     void reset_port_forwarding();
 
@@ -114,10 +185,61 @@ class EtherSwitch : public Element { public:
 
 };
 
-inline
-EtherSwitch::AddrInfo::AddrInfo(int p, const Timestamp& s)
-    : port(p), stamp(s)
+/**
+ * Learn the source of p, which was received on source, and return the output
+ * of its destination, or -1 to broadcast it
+ */
+inline int
+EtherSwitch::lookup(int source, Packet* p, MACCache& cache, uint32_t now, uint32_t lifetime)
 {
+    const click_ether* e = (const click_ether*) p->data();
+    // Refresh entries once per second at most, more often for short timeouts
+    uint32_t refresh = lifetime / 8 < CLICK_HZ ? lifetime / 8 : CLICK_HZ;
+
+    uint64_t src = mac_key(e->ether_shost) | (uint16_t) (source + 1);
+    MACCacheEntry& sc = cache.e[hash(src >> 16) & (CACHE_SIZE - 1)];
+    if (sc.entry != src || now - sc.stamp >= refresh || !cached(sc)) {
+	uint32_t base = (hash(src >> 16) & (_nsets - 1)) * SET_SIZE;
+	int i;
+	uint64_t entry = 0;
+	uint32_t stamp = 0;
+	for (i = 0; i < SET_SIZE; i++) {
+	    read_entry(_table[base + i], entry, stamp);
+	    if (entry == src)
+		break;
+	}
+	if (i == SET_SIZE || now - stamp >= refresh) {
+	    sc.index = learn(src, now, lifetime);
+	    sc.stamp = now;
+	} else {
+	    sc.index = base + i;
+	    sc.stamp = stamp;
+	}
+	sc.entry = src;
+    }
+
+    if (e->ether_dhost[0] & 1) // Group address
+	return -1;
+    uint64_t dst = mac_key(e->ether_dhost);
+    uint32_t h = hash(dst >> 16);
+    MACCacheEntry& dc = cache.e[h & (CACHE_SIZE - 1)];
+    if ((dc.entry & ~0xFFFFULL) == dst && now - dc.stamp < lifetime && cached(dc))
+	return (int) (dc.entry & 0xFFFF) - 1;
+    uint32_t base = (h & (_nsets - 1)) * SET_SIZE;
+    for (int i = 0; i < SET_SIZE; i++) {
+	uint64_t entry;
+	uint32_t stamp;
+	read_entry(_table[base + i], entry, stamp);
+	if ((entry & ~0xFFFFULL) == dst) {
+	    if (now - stamp >= lifetime)
+		return -1;
+	    dc.entry = entry;
+	    dc.stamp = stamp;
+	    dc.index = base + i;
+	    return (int) (entry & 0xFFFF) - 1;
+	}
+    }
+    return -1;
 }
 
 CLICK_ENDDECLS
@@ -223,18 +223,59 @@ FlowHyperScan::configure(Vector<String> &conf, ErrorHandler *errh)
     return 0;
 }
 
+/*
+ * Memory of the streams is recycled in a per-thread cache. All the streams of
+ * a database have the same size, so a freed block is most of the time reused
+ * as is by the next flow.
+ */
+#define HS_STREAM_CACHE 4096
+
+struct HSStreamBlock {
+    HSStreamBlock* next;
+    size_t size;
+} __attribute__((aligned(16)));
+
+static __thread HSStreamBlock* hs_stream_cache = 0;
+static __thread unsigned hs_stream_cached = 0;
+
+static void* hs_stream_alloc(size_t size)
+{
+    HSStreamBlock* b = hs_stream_cache;
+    if (b && b->size == size) {
+        hs_stream_cache = b->next;
+        hs_stream_cached--;
+        return b + 1;
+    }
+    b = (HSStreamBlock*)malloc(sizeof(HSStreamBlock) + size);
+    if (!b)
+        return 0;
+    b->size = size;
+    return b + 1;
+}
+
+static void hs_stream_free(void* p)
+{
+    if (!p)
+        return;
+    HSStreamBlock* b = (HSStreamBlock*)p - 1;
+    if (hs_stream_cached >= HS_STREAM_CACHE) {
+        free(b);
+        return;
+    }
+    b->next = hs_stream_cache;
+    hs_stream_cache = b;
+    hs_stream_cached++;
+}
+
 int FlowHyperScan::initialize(ErrorHandler *errh)
 {
-/*    hs_error_t err = hs_alloc_scratch(db_streaming, &_scratch);
+    hs_error_t err = hs_set_stream_allocator(hs_stream_alloc, hs_stream_free);
     if (err != HS_SUCCESS) {
-        return errh->error("ERROR: could not allocate scratch space. Error %d",err);
-    }*/
+        return errh->error("ERROR: could not set the stream allocator. Error %d",err);
+    }
     for (int i =0; i < _state.weight();i ++) {
-//        _state.get_value(i).scratch = _scratch;
-        // Allocate enough scratch space to handle either streaming or block
-        // mode, so we only need the one scratch region.
         _state.get_value(i).scratch = 0;
-        hs_error_t err = hs_alloc_scratch(db_streaming, &_state.get_value(i).scratch);
+        err = hs_alloc_scratch(db_streaming, &_state.get_value(i).scratch);
         if (err != HS_SUCCESS) {
             return errh->error("ERROR: could not allocate scratch space. Error %d",err);
         }
@@ -244,6 +285,10 @@ int FlowHyperScan::initialize(ErrorHandler *errh)
 }
 
 void FlowHyperScan::cleanup(CleanupStage) {
+    for (int i =0; i < _state.weight();i ++) {
+        if (_state.get_value(i).scratch)
+            hs_free_scratch(_state.get_value(i).scratch);
+    }
     if (db_streaming)
         hs_free_database(db_streaming);
 }
@@ -259,16 +304,31 @@ int onMatch(unsigned int id, unsigned long long from, unsigned long long to,
     return 0; // continue matching
 }
 
+bool FlowHyperScan::new_flow(FlowHyperScanState* flowdata, Packet*)
+{
+    flowdata->found = false;
+    hs_error_t err = hs_open_stream(db_streaming, 0, &flowdata->stream);
+    if (err != HS_SUCCESS) {
+        click_chatter("Cannot alloc stream!");
+        flowdata->stream = 0;
+        return false;
+    }
+    return true;
+}
+
+void FlowHyperScan::release_flow(FlowHyperScanState* flowdata)
+{
+    if (flowdata->stream) {
+        //Matches at the end of the stream are not reported
+        hs_close_stream(flowdata->stream, 0, 0, 0);
+        flowdata->stream = 0;
+    }
+}
+
 void FlowHyperScan::push_flow(int port, FlowHyperScanState* flowdata, PacketBatch* batch)
 {
-    if (!flowdata->stream) {
-        hs_error_t err = hs_open_stream(db_streaming, 0, &flowdata->stream);
-        if (err) {
-            click_chatter("Cannot alloc stream!");
-            goto err;
-        }
-    } else if (unlikely(flowdata->found)) {
-        if (kill)
+    if (unlikely(flowdata->found)) {
+        if (_kill)
             goto err;
         output_push_batch(0, batch);
         return;
@@ -282,23 +342,20 @@ void FlowHyperScan::push_flow(int port, FlowHyperScanState* flowdata, PacketBatc
         reinterpret_cast<const char*>(p->data()), p->length(), 0,
         _state->scratch, onMatch, &matchCount);
         if (unlikely(err != HS_SUCCESS)) {
-            if (err == HS_SCAN_TERMINATED) {
-                flowdata->found = true;
-                goto m;
-            }
             click_chatter("Matching error");
             hs_reset_stream(flowdata->stream, 0, _state->scratch, 0, 0);
-
         }
-    m:
         if (matchCount > 0) {
             if (_verbose)
                 click_chatter("MATCHED");
             _state->matches++;
+            if (!flowdata->found) {
+                flowdata->found = true;
+                _state->matched++;
+            }
+            if (_kill)
+                goto err;
         }
-        if (_kill)
-            goto err;
-
     }
     output_push_batch(0, batch);
 
@@ -308,6 +365,32 @@ void FlowHyperScan::push_flow(int port, FlowHyperScanState* flowdata, PacketBatc
 
 }
 
+enum {
+    h_matched,
+    h_matches
+};
+
+String
+FlowHyperScan::read_handler(Element *e, void *thunk)
+{
+    FlowHyperScan *fh = static_cast<FlowHyperScan *>(e);
+    unsigned total = 0;
+    for (int i = 0; i < fh->_state.weight(); i++) {
+        if ((intptr_t)thunk == h_matched)
+            total += fh->_state.get_value(i).matched;
+        else
+            total += fh->_state.get_value(i).matches;
+    }
+    return String(total);
+}
+
+void
+FlowHyperScan::add_handlers()
+{
+    add_read_handler("matched", read_handler, h_matched);
+    add_read_handler("matches", read_handler, h_matches);
+}
+
 
 CLICK_ENDDECLS
 
@@ -35,9 +35,31 @@ struct FlowHyperScanState {
  * is not subject to eviction by splitting the stream of attack at the right
  * place as it keeps a per-flow record of the DFA.
  *
+ * The state of the Hyperscan stream is kept in the flow control block, so
+ * matching resumes with the next packet of the flow and no packet is held
+ * back. Packets must therefore come in order, e.g. after a TCP reordering
+ * element. The stream is closed when the flow is released. Memory of the
+ * streams is recycled in per-thread pools instead of being allocated for each
+ * new flow, and the scratch space is per-thread.
  *
+ * =item KILL
+ *
+ * Boolean. Drop the packets of a flow from the packet completing a match on.
+ * Default is false.
+ *
+ * =item VERBOSE
+ *
+ * Boolean. Print a message for each match. Default is false.
+ *
+ * =h matched read-only
+ *
+ * Number of flows in which a pattern was found.
+ *
+ * =h matches read-only
+ *
+ * Number of packets completing a match.
  */
-class FlowHyperScan : public FlowSpaceElement<FlowHyperScanState> {
+class FlowHyperScan : public FlowStateElement<FlowHyperScan, FlowHyperScanState> {
     public:
         FlowHyperScan() CLICK_COLD;
         ~FlowHyperScan() CLICK_COLD;
@@ -49,8 +71,13 @@ class FlowHyperScan : public FlowSpaceElement<FlowHyperScanState> {
         int configure(Vector<String> &, ErrorHandler *) override CLICK_COLD;
         int initialize(ErrorHandler *errh) override CLICK_COLD;
         void cleanup(CleanupStage) CLICK_COLD;
+        void add_handlers() override CLICK_COLD;
 
+        static const int timeout = 15000;
+
+        bool new_flow(FlowHyperScanState*, Packet*);
         void push_flow(int, FlowHyperScanState*, PacketBatch *);
+        void release_flow(FlowHyperScanState*);
 
         bool is_valid_patterns(Vector<String> &patterns, ErrorHandler *errh);
 
@@ -61,13 +88,16 @@ class FlowHyperScan : public FlowSpaceElement<FlowHyperScanState> {
         bool _verbose;
         bool _kill;
         struct FlowHyperScanThreadState {
-            FlowHyperScanThreadState() : scratch(0), matches(0) {
+            FlowHyperScanThreadState() : scratch(0), matches(0), matched(0) {
             }
             hs_scratch* scratch;
             unsigned matches;
+            unsigned matched;
         };
         per_thread<FlowHyperScanThreadState> _state;
         hs_scratch* _scratch;
+
+        static String read_handler(Element *, void *) CLICK_COLD;
 };
 
 CLICK_ENDDECLS
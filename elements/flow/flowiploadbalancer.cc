@@ -69,6 +69,8 @@ bool FlowIPLoadBalancer::new_flow(IPLBEntry* flowdata, Packet* p)
             return false;
     }
     int server = pick_server(p);
+    if (unlikely(server == no_server))
+        return false;
 
     flowdata->chosen_server = server;
 
@@ -161,6 +163,7 @@ void FlowIPLoadBalancerReverse::push_batch(int, PacketBatch* batch)
     auto fnt = [this](Packet* &p) -> bool {
         WritablePacket* q =p->uniqueify();
         p = q;
+        _lb->track_latency(q);
         q->ip_header()->ip_src = _lb->_vip;
         return true;
     };
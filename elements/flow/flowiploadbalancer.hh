@@ -54,8 +54,53 @@ IP Address. Can be repeated multiple times, once per destination.
 =item VIP
 IP Address of this load-balancer.
 
+=item LB_MODE
+
+Load balancing mode: rr, wrr, awrr, pow2, hash, chash, hash_ip, hash_agg,
+cst_hash_agg, least, table or maglev. Default is rr.
+
+maglev maps the hash of the 5-tuple to a destination using a Maglev lookup
+table. When a destination is added or removed, only the flows of the
+destinations losing table entries move, and the others keep their destination
+without any per-flow state, so stateless instances sharing the same
+configuration agree on it.
+
+=item WEIGHTS
+
+Space-separated list of integers, one per destination, giving the share of
+the maglev table each destination receives. Default is 1 for all. A
+destination of weight 0 gets no new flows, but the weights may not all be
+zero. The "weights" write handler changes them at runtime. Packets are
+dropped while no destination is active.
+
+=item MAGLEV_SIZE
+
+Prime integer. Number of entries of the maglev table, which should be much
+larger than the number of destinations. Default is 65537.
+
+=item LST_MODE
+
+Load metric used by the load-based modes (pow2, least, awrr): conn, packets,
+bytes, cpu or latency. Default is conn.
+
+latency uses the time between the SYN of a connection and the SYN-ACK of the
+server, seen by the reverse element, as a moving average per destination.
+Each thread keeps its own measures, so the SYN-ACK must come back on the
+thread that sent the SYN, as with symmetric RSS. Destinations without a
+measure yet count as the average of the measured ones.
+A SYN without SYN-ACK after a second, or whose probe is replaced by a newer
+SYN, counts as a sample of its elapsed time when it is above the average, so
+unresponsive destinations are avoided. As the average only changes when
+SYN-ACKs come back, least sends every new connection to the same destination
+in the meantime: pow2 is advised with latency.
+
 =back
 
+=h load_latency read-only
+
+Average handshake latency of each destination over the threads that
+measured it, in microseconds, or 0 if it was not measured yet.
+
 =e
     FlowIPLoadBalancer(VIP 10.220.0.1, DST 10.221.0.1, DST 10.221.0.2, DST 10.221.0.3)
 
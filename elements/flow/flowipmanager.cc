@@ -20,6 +20,7 @@
 #include <click/ipflowid.hh>
 #include <click/routervisitor.hh>
 #include <click/error.hh>
+#include <click/flowsnapshot.hh>
 #include "flowipmanager.hh"
 #include <rte_hash.h>
 #include <click/dpdk_glue.hh>
@@ -27,7 +28,7 @@
 
 CLICK_DECLS
 
-FlowIPManager::FlowIPManager() : _verbose(1), _flags(0), _timer(this), _task(this), _cache(true), Router::InitFuture(this)
+FlowIPManager::FlowIPManager() : _verbose(1), _flags(0), _timer(this), _task(this), _cache(true), _state_timeout(false), _table_epoch(0), _table_frozen(false), Router::InitFuture(this)
 {
 }
 
@@ -48,10 +49,18 @@ FlowIPManager::configure(Vector<String> &conf, ErrorHandler *errh)
         .read_or_set("LF", lf, false)
 #endif
         .read_or_set("CACHE", _cache, true)
+        .read_or_set("STATE_TIMEOUT", _state_timeout, false)
         .read_or_set("VERBOSE", _verbose, 1)
         .complete() < 0)
         return -1;
 
+#if !HAVE_FLOW_RELEASE_SLOPPY_TIMEOUT
+    if (_state_timeout) {
+        errh->warning("STATE_TIMEOUT needs sloppy flow timeouts, it will be ignored");
+        _state_timeout = false;
+    }
+#endif
+
     find_children(_verbose);
 
     router()->get_root_init_future()->postOnce(&_fcb_builded_init_future);
@@ -123,23 +132,104 @@ static const auto setter = [](FlowControlBlock* prev, FlowControlBlock* next)
     *fcb_next_ptr(prev) = next;
 };
 
+/**
+ * Timeout of a flow in seconds. With STATE_TIMEOUT, the timeout set in the
+ * FCB by elements such as TCPStateIN may shorten the one of the table.
+ */
+inline int FlowIPManager::flow_timeout(FlowControlBlock* fcb)
+{
+#if HAVE_FLOW_RELEASE_SLOPPY_TIMEOUT
+    if (_state_timeout && (fcb->flags & FLOW_TIMEOUT)) {
+        int t = ((fcb->flags >> FLOW_TIMEOUT_SHIFT) + 999) / 1000;
+        if (t < 1)
+            t = 1;
+        if (t < _timeout)
+            return t;
+    }
+#endif
+    return _timeout;
+}
+
+inline void FlowIPManager::schedule(FlowControlBlock* fcb, int timeout)
+{
+    if (_flags) {
+        _timer_wheel.schedule_after_mp(fcb, timeout, setter);
+    } else {
+        _timer_wheel.schedule_after(fcb, timeout, setter);
+    }
+}
+
+/**
+ * Mark the calling thread as using the table, waiting first if a snapshot
+ * or a restore is in progress. The epoch of the thread is odd while it uses
+ * the table, so table_freeze() knows which threads to wait for.
+ */
+inline void FlowIPManager::table_enter()
+{
+    volatile uint32_t &epoch = *_table_epoch;
+    while (true) {
+        epoch = epoch + 1;
+        click_fence();
+        if (likely(!_table_frozen))
+            return;
+        epoch = epoch + 1;
+        while (_table_frozen)
+            click_compiler_fence();
+    }
+}
+
+inline void FlowIPManager::table_leave()
+{
+    volatile uint32_t &epoch = *_table_epoch;
+    click_write_fence();
+    epoch = epoch + 1;
+}
+
+/**
+ * Stop the data threads from using the table, and wait for those using it
+ * to leave.
+ */
+void FlowIPManager::table_freeze()
+{
+    _table_frozen = true;
+    click_fence();
+    for (unsigned i = 0; i < _table_epoch.weight(); i++) {
+        volatile uint32_t &epoch = _table_epoch.get_value(i);
+        uint32_t e = epoch;
+        if (e & 1)
+            while (epoch == e)
+                click_compiler_fence();
+    }
+    click_fence();
+}
+
+void FlowIPManager::table_thaw()
+{
+    click_fence();
+    _table_frozen = false;
+}
+
 bool FlowIPManager::run_task(Task* t)
 {
     Timestamp recent = Timestamp::recent_steady();
+    table_enter();
     _timer_wheel.run_timers([this,recent](FlowControlBlock* prev) -> FlowControlBlock*{
         FlowControlBlock* next = *fcb_next_ptr(prev);
         int old = (recent - prev->lastseen).sec();
-        if (old > _timeout) {
+        int timeout = flow_timeout(prev);
+        if (old > timeout) {
             if (unlikely(_verbose > 1))
                 click_chatter("Release %p as it is expired since %d", prev, old);
             //expire
             rte_hash_del_key(hash, (IPFlow5ID*)&prev->data_32[0]);
         } else {
-            //No need for lock as we'll be the only one to enqueue there
-            _timer_wheel.schedule_after(prev, _timeout - (recent - prev->lastseen).sec(),setter);
+            //No need for lock as we'll be the only one to enqueue there.
+            //Never enqueue in the bucket being run, it is cleared after.
+            _timer_wheel.schedule_after(prev, timeout > old ? timeout - old : 1, setter);
         }
         return next;
     });
+    table_leave();
     return true;
 }
 
@@ -155,6 +245,41 @@ void FlowIPManager::cleanup(CleanupStage stage)
         rte_hash_free(hash);
 }
 
+#if HAVE_FLOW_RELEASE_SLOPPY_TIMEOUT
+/**
+ * Mark the flow as in the timer wheel, returning false if it already was.
+ * With a shared table, other threads may set the flags of the same flow,
+ * so only the thread that sets the mark schedules it.
+ */
+inline bool FlowIPManager::set_inlist(FlowControlBlock* fcb)
+{
+    if (!_flags) {
+        if (fcb->flags & FLOW_TIMEOUT_INLIST)
+            return false;
+        fcb->flags |= FLOW_TIMEOUT_INLIST;
+        return true;
+    }
+    uint32_t flags;
+    do {
+        flags = fcb->flags;
+        if (flags & FLOW_TIMEOUT_INLIST)
+            return false;
+    } while (!atomic_uint32_t::compare_and_swap(fcb->flags, flags, flags | FLOW_TIMEOUT_INLIST));
+    return true;
+}
+#endif
+
+inline void FlowIPManager::flush(PacketBatch* batch, const Timestamp& recent)
+{
+    FlowControlBlock* fcb = fcb_stack;
+    fcb->lastseen = recent;
+    output_push_batch(0, batch);
+#if HAVE_FLOW_RELEASE_SLOPPY_TIMEOUT
+    if (_state_timeout && _timeout && set_inlist(fcb))
+        schedule(fcb, flow_timeout(fcb));
+#endif
+}
+
 void FlowIPManager::process(Packet* p, BatchBuilder& b, const Timestamp& recent)
 {
     IPFlow5ID fid = IPFlow5ID(p);
@@ -182,12 +307,11 @@ void FlowIPManager::process(Packet* p, BatchBuilder& b, const Timestamp& recent)
         fcb = (FlowControlBlock*)((unsigned char*)fcbs + (_flow_state_size_full * ret));
         //Remember ID for deletion
         *((IPFlow5ID*)&fcb->data_32[0]) = fid;
-        if (_timeout) {
-            if (_flags) {
-                _timer_wheel.schedule_after_mp(fcb, _timeout, setter);
-            } else {
-                _timer_wheel.schedule_after(fcb, _timeout, setter);
-            }
+        fcb->flags = 0;
+        //With STATE_TIMEOUT, the flow is scheduled once its first packets
+        //went through the elements, that may have set a shorter timeout
+        if (_timeout && !_state_timeout) {
+            schedule(fcb, _timeout);
         }
     } else { //existing flow
         if (unlikely(_verbose > 1))
@@ -200,10 +324,8 @@ void FlowIPManager::process(Packet* p, BatchBuilder& b, const Timestamp& recent)
     } else {
         PacketBatch* batch;
         batch = b.finish();
-        if (batch) {
-            fcb_stack->lastseen = recent;
-            output_push_batch(0, batch);
-        }
+        if (batch)
+            flush(batch, recent);
         fcb_stack = fcb;
         b.init();
         b.append(p);
@@ -218,18 +340,110 @@ void FlowIPManager::push_batch(int, PacketBatch* batch)
 {
     BatchBuilder b;
     Timestamp recent = Timestamp::recent_steady();
+    table_enter();
     FOR_EACH_PACKET_SAFE(batch, p) {
         process(p, b, recent);
     }
 
     batch = b.finish();
-    if (batch) {
-        fcb_stack->lastseen = recent;
-        output_push_batch(0, batch);
+    if (batch)
+        flush(batch, recent);
+    table_leave();
+}
+
+int FlowIPManager::snapshot(const String &path, ErrorHandler *errh)
+{
+    if (fcb_snapshot_check(errh) < 0)
+        return -1;
+    FlowSnapshotWriter w;
+    uint32_t size = sizeof(FlowSnapshotRecord) + sizeof(IPFlow5ID) + fcb_snapshot_size();
+    if (w.open(path, class_name(), size, fcb_snapshot_layout(), errh) < 0)
+        return -1;
+
+    Timestamp recent = Timestamp::recent_steady();
+    const void* key;
+    void* data;
+    uint32_t next = 0;
+    int ret;
+    //Data threads add and remove keys and change their FCBs, stop them
+    table_freeze();
+    while ((ret = rte_hash_iterate(hash, &key, &data, &next)) >= 0) {
+        FlowControlBlock* fcb = (FlowControlBlock*)((unsigned char*)fcbs + (_flow_state_size_full * ret));
+        uint32_t left = UINT32_MAX;
+        if (_timeout > 0) {
+            int64_t l = (int64_t)flow_timeout(fcb) * 1000 - (recent - fcb->lastseen).msecval();
+            if (l <= 0) //Expired but not yet collected
+                continue;
+            left = l;
+        }
+        FlowSnapshotRecord* r = w.append();
+        r->expiry_msec = left;
+        memcpy(r->data(), key, sizeof(IPFlow5ID));
+        fcb_snapshot(fcb, r->data() + sizeof(IPFlow5ID));
+    }
+    table_thaw();
+
+    if (w.commit(errh) < 0)
+        return -1;
+    if (_verbose)
+        click_chatter("%p{element}: saved %llu flows", this, (unsigned long long)w.count());
+    return 0;
+}
+
+int FlowIPManager::restore(const String &path, ErrorHandler *errh)
+{
+    if (fcb_snapshot_check(errh) < 0)
+        return -1;
+    FlowSnapshotReader r;
+    uint32_t size = sizeof(FlowSnapshotRecord) + sizeof(IPFlow5ID) + fcb_snapshot_size();
+    if (r.open(path, class_name(), size, fcb_snapshot_layout(), errh) < 0)
+        return -1;
+
+    Timestamp recent = Timestamp::recent_steady();
+    uint64_t restored = 0;
+    table_freeze();
+    for (uint64_t i = 0; i < r.count(); i++) {
+        const FlowSnapshotRecord* rec = r.record(i);
+        uint32_t left = r.remaining_msec(rec);
+        if (_timeout > 0 && left == 0)
+            continue;
+        const IPFlow5ID* fid = reinterpret_cast<const IPFlow5ID*>(rec->data());
+        //Keep existing flows, they are more recent than the snapshot
+        if (rte_hash_lookup(hash, fid) >= 0)
+            continue;
+        int ret = rte_hash_add_key(hash, fid);
+        if (ret < 0) {
+            errh->warning("Table is full, %llu flows not restored", (unsigned long long)(r.count() - i));
+            break;
+        }
+        FlowControlBlock* fcb = (FlowControlBlock*)((unsigned char*)fcbs + (_flow_state_size_full * ret));
+        *((IPFlow5ID*)&fcb->data_32[0]) = *fid;
+        fcb->lastseen = recent;
+#if HAVE_FLOW_RELEASE_SLOPPY_TIMEOUT
+        fcb->flags = _state_timeout && _timeout > 0 ? FLOW_TIMEOUT_INLIST : 0;
+#else
+        fcb->flags = 0;
+#endif
+        //Restore first, the state of the elements may shorten the timeout
+        fcb_restore(fcb, rec->data() + sizeof(IPFlow5ID), left);
+        if (_timeout > 0) {
+            int timeout = flow_timeout(fcb);
+            if (left > (uint32_t)timeout * 1000)
+                left = timeout * 1000;
+            fcb->lastseen = recent - Timestamp::make_msec(timeout * 1000 - left);
+            schedule(fcb, (left + 999) / 1000);
+        }
+        restored++;
     }
+    fcb_restore_done();
+    table_thaw();
+
+    if (_verbose)
+        click_chatter("%p{element}: restored %llu flows", this, (unsigned long long)restored);
+    return 0;
 }
 
-enum {h_count};
+enum {h_count, h_snapshot, h_restore};
 String FlowIPManager::read_handler(Element* e, void* thunk)
 {
     FlowIPManager* fc = static_cast<FlowIPManager*>(e);
@@ -243,9 +457,30 @@ String FlowIPManager::read_handler(Element* e, void* thunk)
     }
 };
 
+int FlowIPManager::write_handler(const String &s, Element* e, void* thunk, ErrorHandler* errh)
+{
+    FlowIPManager* fc = static_cast<FlowIPManager*>(e);
+    String path;
+    if (Args(e, errh).push_back_words(s)
+        .read_mp("FILE", FilenameArg(), path)
+        .complete() < 0)
+        return -1;
+
+    switch ((intptr_t)thunk) {
+    case h_snapshot:
+        return fc->snapshot(path, errh);
+    case h_restore:
+        return fc->restore(path, errh);
+    default:
+        return -1;
+    }
+}
+
 void FlowIPManager::add_handlers()
 {
     add_read_handler("count", read_handler, h_count);
+    add_write_handler("snapshot", write_handler, h_snapshot);
+    add_write_handler("restore", write_handler, h_restore);
 }
 
 CLICK_ENDDECLS
@@ -16,7 +16,7 @@ struct rte_hash;
 
 
 /**
- * FlowIPManager(CAPACITY [, RESERVE])
+ * FlowIPManager(CAPACITY [, RESERVE, TIMEOUT, STATE_TIMEOUT])
  *
  * =s flow
  *  FCB packet classifier - cuckoo shared-by-all-threads
@@ -30,6 +30,23 @@ struct rte_hash;
  * neither set the offsets for placement in the FCB automatically. Look at
  * the middleclick branch for alternatives.
  *
+ * Flows idle for TIMEOUT seconds are removed. With STATE_TIMEOUT, elements
+ * tracking the state of flows may shorten it, e.g. TCPStateIN to reclaim
+ * half-open connections quickly under a SYN flood.
+ *
+ * =h count read-only
+ * Number of flows in the table.
+ *
+ * =h snapshot write-only
+ * Write the flow table, with the FCB content of all elements and the
+ * remaining timeouts, to the given file. Packets wait while the table is
+ * written. Refused if an element keeping state in the FCB does not support
+ * snapshots.
+ *
+ * =h restore write-only
+ * Load flows from a snapshot taken by the same configuration. Meant to be
+ * used at startup, before traffic flows.
+ *
  * =a FlowIPManger
  *
  */
@@ -72,10 +89,28 @@ class FlowIPManager: public VirtualFlowManager, public Router::InitFuture {
         Task _task;
 
         bool _cache;
+        bool _state_timeout;
 
         static String read_handler(Element* e, void* thunk);
+        static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+        int snapshot(const String &path, ErrorHandler *errh) CLICK_COLD;
+        int restore(const String &path, ErrorHandler *errh) CLICK_COLD;
         inline void process(Packet* p, BatchBuilder& b, const Timestamp& recent);
+        inline void flush(PacketBatch* batch, const Timestamp& recent);
+#if HAVE_FLOW_RELEASE_SLOPPY_TIMEOUT
+        inline bool set_inlist(FlowControlBlock* fcb);
+#endif
+        inline int flow_timeout(FlowControlBlock* fcb);
+        inline void schedule(FlowControlBlock* fcb, int timeout);
         TimerWheel<FlowControlBlock> _timer_wheel;
+        //Odd while a thread is in the data path or the timer wheel
+        per_thread<uint32_t> _table_epoch;
+        //Set during snapshot and restore, the data threads wait meanwhile
+        volatile bool _table_frozen;
+        inline void table_enter();
+        inline void table_leave();
+        void table_freeze() CLICK_COLD;
+        void table_thaw() CLICK_COLD;
 };
 
 CLICK_ENDDECLS
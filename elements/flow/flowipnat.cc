@@ -24,7 +24,17 @@
 
 CLICK_DECLS
 
-FlowIPNAT::FlowIPNAT() : _sip(), _map(65536), _accept_nonsyn(true), _own_state(false)
+//Default key of most NICs, also used by DPDK
+static const uint8_t default_rss_key[NAT_RSS_KEY_SIZE] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+    0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+    0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+    0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+    0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa
+};
+
+FlowIPNAT::FlowIPNAT() : _sip(), _accept_nonsyn(true), _own_state(false),
+    _bitmap(false), _rss(false), _rss_queues(1), _rss_reta_size(128), _map(65536)
 {
 }
 
@@ -35,16 +45,78 @@ FlowIPNAT::~FlowIPNAT()
 int
 FlowIPNAT::configure(Vector<String> &conf, ErrorHandler *errh)
 {
+    String key;
     if (Args(conf, this, errh)
        .read_mp("SIP",_sip)
        .read_or_set("ACCEPT_NONSYN", _accept_nonsyn, true)
        .read_or_set("STATE", _own_state, false)
+       .read_or_set("BITMAP", _bitmap, false)
+       .read_or_set("RSS", _rss, false)
+       .read("RSS_KEY", key)
+       .read_or_set("RSS_RETA_SIZE", _rss_reta_size, 128)
        .complete() < 0)
         return -1;
 
+    if (_rss)
+        _bitmap = true;
+
+    if (_rss_reta_size == 0 || (_rss_reta_size & (_rss_reta_size - 1)))
+        return errh->error("RSS_RETA_SIZE must be a power of 2");
+
+    memcpy(_rss_key, default_rss_key, NAT_RSS_KEY_SIZE);
+    if (key) {
+        if (key.length() != NAT_RSS_KEY_SIZE * 2)
+            return errh->error("RSS_KEY must be %d hexadecimal bytes", NAT_RSS_KEY_SIZE);
+        for (int i = 0; i < key.length(); i++) {
+            char c = key[i];
+            int v;
+            if (c >= '0' && c <= '9')
+                v = c - '0';
+            else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+                v = (c | 0x20) - 'a' + 10;
+            else
+                return errh->error("RSS_KEY must be %d hexadecimal bytes", NAT_RSS_KEY_SIZE);
+            if (i % 2 == 0)
+                _rss_key[i / 2] = v << 4;
+            else
+                _rss_key[i / 2] |= v;
+        }
+    }
+
+    //The hash is linear, so the part of the destination port is precomputed
+    uint8_t data[12];
+    memset(data, 0, sizeof(data));
+    for (int i = 0; i < 2; i++) {
+        for (int v = 0; v < 256; v++) {
+            data[10 + i] = v;
+            _rss_port[i][v] = rss_hash(data, sizeof(data));
+        }
+        data[10 + i] = 0;
+    }
+
     return 0;
 }
 
+/**
+ * Toeplitz hash of data with the RSS key
+ */
+uint32_t
+FlowIPNAT::rss_hash(const uint8_t* data, int len) const
+{
+    uint32_t h = 0;
+    uint32_t v = (_rss_key[0] << 24) | (_rss_key[1] << 16) | (_rss_key[2] << 8) | _rss_key[3];
+    for (int i = 0; i < len; i++) {
+        for (int b = 7; b >= 0; b--) {
+            if (data[i] & (1 << b))
+                h ^= v;
+            v <<= 1;
+            if (_rss_key[i + 4] & (1 << b))
+                v |= 1;
+        }
+    }
+    return h;
+}
+
 
 int FlowIPNAT::initialize(ErrorHandler *errh) {
     /* Get "touching" threads. That is threads passing by us and touching
@@ -75,26 +147,62 @@ int FlowIPNAT::initialize(ErrorHandler *errh) {
     int total_ports = 65536 - 1024;
     int ports_per_thread = total_ports / passing.weight();
     int n = 0;
+    _ports.resize(65536, 0);
+    _rss_queues = passing.weight();
     for (int i = 0; i < passing.size(); i++) {
         if (!passing[i])
             continue;
         state &s = _state.get_value_for_thread(i);
         int min_port = 1024 + (n*ports_per_thread);
         int max_port = min_port + ports_per_thread;
-        String rn = name() + "-t#" + String(i);
-        s.available_ports.initialize(ports_per_thread, rn.c_str());
-        for (int port = min_port; port < max_port; port++) {
-            NATCommon* ref = new NATCommon(htons(port), &s.available_ports);
-            assert(ref->ref == 0);
-            s.available_ports.insert(ref);
+        s.queue = n;
+        if (_bitmap) {
+            s.used_ports.initialize(min_port, ports_per_thread, i);
+            for (int port = min_port; port < max_port; port++)
+                _ports[port] = new NATCommon(htons(port), &s.used_ports);
+        } else {
+            String rn = name() + "-t#" + String(i);
+            s.available_ports.initialize(ports_per_thread, rn.c_str());
+            for (int port = min_port; port < max_port; port++) {
+                NATCommon* ref = new NATCommon(htons(port), &s.available_ports);
+                assert(ref->ref == 0);
+                s.available_ports.insert(ref);
+                _ports[port] = ref;
+            }
         }
         n++;
     }
     return 0;
 }
 
-NATCommon* FlowIPNAT::pick_port()
+NATCommon* FlowIPNAT::pick_port(Packet* p)
 {
+    if (_bitmap) {
+        NATPortBitmap &bitmap = _state->used_ports;
+        int port = -1;
+        if (_rss) {
+            //Hash of the reply, without its destination port
+            uint8_t data[12];
+            memcpy(data, &p->ip_header()->ip_dst, 4);
+            memcpy(data + 4, _sip.data(), 4);
+            memcpy(data + 8, &p->tcp_header()->th_dport, 2);
+            memset(data + 10, 0, 2);
+            uint32_t base = rss_hash(data, sizeof(data));
+            unsigned queue = _state->queue;
+            port = bitmap.alloc([this, base, queue](uint16_t port) {
+                uint32_t h = base ^ _rss_port[0][port >> 8] ^ _rss_port[1][port & 0xff];
+                return (h & (_rss_reta_size - 1)) % _rss_queues == queue;
+            });
+        }
+        if (port < 0)
+            port = bitmap.alloc();
+        if (port < 0) {
+            click_chatter("%p{element} : Not even a used port available", this);
+            return 0;
+        }
+        return _ports[port];
+    }
+
     int i = 0;
     NATCommon* ref = 0;
     if (_state->available_ports.is_empty()) {
@@ -133,7 +241,7 @@ bool FlowIPNAT::new_flow(NATEntryIN* fcb, Packet* p)
     }
     IPAddress osip = IPAddress(p->ip_header()->ip_src);
     uint16_t oport = p->tcp_header()->th_sport;
-    fcb->ref = pick_port();
+    fcb->ref = pick_port(p);
     if (!fcb->ref) {
         click_chatter("ERROR %p{element} : no more ports available !",this);
         return false;
@@ -143,6 +251,7 @@ bool FlowIPNAT::new_flow(NATEntryIN* fcb, Packet* p)
     fcb->ref->closing = false;
     fcb->fin_seen = false;
 #endif
+    fcb->ref->orig = IPPort(osip,oport);
     //click_chatter("NEW osip %s osport %d, new port %d",osip.unparse().c_str(),htons(oport),ntohs(fcb->ref->port));
     NATEntryOUT out(IPPort(osip,oport),fcb->ref);
     _map.insert(fcb->ref->port, out,[this](NATEntryOUT& replaced){
@@ -162,6 +271,79 @@ void FlowIPNAT::release_flow(NATEntryIN* fcb)
 #endif
 }
 
+void FlowIPNAT::snapshot_state(NATEntryIN* fcb, uint8_t* out)
+{
+    NATSnapshot s;
+    memset(&s, 0, sizeof(s));
+    if (fcb->ref) {
+        s.orig_ip = fcb->ref->orig.ip.addr();
+        s.orig_port = fcb->ref->orig.port;
+        s.port = fcb->ref->port;
+        s.fin_seen = fcb->fin_seen;
+        s.closing = fcb->ref->closing;
+        s.shared = fcb->ref->ref.value() > 1;
+    }
+    memcpy(out, &s, sizeof(s));
+}
+
+/**
+ * Claim the port of a saved mapping. If the reverse side had the mapping,
+ * it is put back in the table so the reverse side will find it on the next
+ * packet. Ports are removed from the free lists in flow_restore_done().
+ */
+bool FlowIPNAT::restore_state(NATEntryIN* fcb, const uint8_t* in)
+{
+    NATSnapshot s;
+    memcpy(&s, in, sizeof(s));
+    NATCommon* ref = s.port ? _ports[ntohs(s.port)] : 0;
+    if (!ref || ref->ref.value() != 0) {
+        fcb->ref = 0;
+        return false;
+    }
+    ref->orig = IPPort(IPAddress(s.orig_ip), s.orig_port);
+    ref->closing = s.closing;
+    fcb->fin_seen = s.fin_seen;
+    fcb->ref = ref;
+    if (s.shared) {
+        ref->ref = 2;
+        NATEntryOUT out(ref->orig, ref);
+        _map.insert(ref->port, out, [this](NATEntryOUT& replaced){
+            release_ref(replaced.ref, _own_state);
+        });
+    } else
+        ref->ref = 1;
+    return true;
+}
+
+void FlowIPNAT::flow_restore_done()
+{
+    int claimed = 0;
+    for (unsigned i = 0; i < _state.weight(); i++) {
+        if (_bitmap) {
+            NATPortBitmap &bitmap = _state.get_value(i).used_ports;
+            for (unsigned j = 0; j < bitmap.nports(); j++) {
+                uint16_t port = bitmap.min_port() + j;
+                if (_ports[port] && _ports[port]->ref.value() != 0) {
+                    bitmap.claim(port);
+                    claimed++;
+                }
+            }
+            continue;
+        }
+        MPSCDynamicRing<NATCommon*> &ring = _state.get_value(i).available_ports;
+        Vector<NATCommon*> ports;
+        while (!ring.is_empty())
+            ports.push_back(ring.extract());
+        for (int j = 0; j < ports.size(); j++) {
+            if (ports[j]->ref.value() == 0)
+                ring.insert(ports[j]);
+            else
+                claimed++;
+        }
+    }
+    nat_info_chatter("%p{element}: %d ports restored", this, claimed);
+    (void)claimed;
+}
 
 void FlowIPNAT::push_flow(int port, NATEntryIN* flowdata, PacketBatch* batch)
 {
@@ -39,16 +39,141 @@ CLICK_DECLS
 
 CLICK_DECLS
 
+/**
+ * Range of ports owned by one thread, as a bitmap of the ports in use.
+ *
+ * Only the owner allocates, so setting a bit never races. Other threads
+ * release with an atomic clear of the bit. Releases done by the owner itself
+ * are coalesced per word, and applied at once before the next allocation.
+ */
+class NATPortBitmap { public:
+    NATPortBitmap() : _used(0), _words(0), _min_port(0), _nports(0), _cursor(0),
+                      _owner(-1), _pending_word(-1), _pending_mask(0) {
+    }
+
+    ~NATPortBitmap() {
+        delete[] _used;
+    }
+
+    void initialize(uint16_t min_port, unsigned nports, int owner) {
+        _words = (nports + 31) / 32;
+        _used = new atomic_uint32_t[_words];
+        for (unsigned i = 0; i < _words; i++)
+            _used[i] = 0;
+        //Bits past the last port are never free
+        if (nports % 32)
+            _used[_words - 1] = ~((1U << (nports % 32)) - 1);
+        _min_port = min_port;
+        _nports = nports;
+        _owner = owner;
+    }
+
+    inline bool contains(uint16_t port) const {
+        return port >= _min_port && port < _min_port + _nports;
+    }
+
+    /**
+     * Allocate the first free port accepted by accept(port), starting at the
+     * word of the last allocation. Return the port in host order, or -1.
+     */
+    template <typename F>
+    inline int alloc(F accept) {
+        flush();
+        for (unsigned n = 0; n < _words; n++) {
+            unsigned w = _cursor + n;
+            if (w >= _words)
+                w -= _words;
+            uint32_t free = ~_used[w].value();
+            while (free) {
+                int b = __builtin_ctz(free);
+                free &= free - 1;
+                uint16_t port = _min_port + w * 32 + b;
+                if (accept(port)) {
+                    _used[w] |= 1U << b;
+                    _cursor = w;
+                    return port;
+                }
+            }
+        }
+        return -1;
+    }
+
+    inline int alloc() {
+        return alloc([](uint16_t) { return true; });
+    }
+
+    /**
+     * Free a port, in host order
+     */
+    inline void release(uint16_t port) {
+        unsigned i = port - _min_port;
+        int w = i / 32;
+        uint32_t bit = 1U << (i % 32);
+        if ((int)click_current_cpu_id() != _owner) {
+            _used[w] &= ~bit;
+            return;
+        }
+        if (w != _pending_word) {
+            flush();
+            _pending_word = w;
+        }
+        _pending_mask |= bit;
+    }
+
+    /**
+     * Mark a port as used without allocating it, for restores
+     */
+    inline void claim(uint16_t port) {
+        unsigned i = port - _min_port;
+        _used[i / 32] |= 1U << (i % 32);
+    }
+
+    /**
+     * Apply the releases coalesced by the owner
+     */
+    inline void flush() {
+        if (_pending_mask) {
+            _used[_pending_word] &= ~_pending_mask;
+            _pending_mask = 0;
+        }
+        _pending_word = -1;
+    }
+
+    inline uint16_t min_port() const {
+        return _min_port;
+    }
+
+    inline unsigned nports() const {
+        return _nports;
+    }
+
+  private:
+    atomic_uint32_t* _used;
+    unsigned _words;
+    uint16_t _min_port;
+    unsigned _nports;
+    unsigned _cursor; // Word of the last allocation
+    int _owner;
+    int _pending_word;
+    uint32_t _pending_mask;
+};
+
 #if HAVE_NAT_NEVER_REUSE
 struct NATCommon {
     NATCommon(uint16_t _port, MPSCDynamicRing<NATCommon*>* _ring) :
-                port(_port), closing(0), ring(_ring) {
+                port(_port), closing(0), ring(_ring), bitmap(0), orig(IPAddress(), 0) {
+        ref = 0;
+    }
+    NATCommon(uint16_t _port, NATPortBitmap* _bitmap) :
+                port(_port), closing(0), ring(0), bitmap(_bitmap), orig(IPAddress(), 0) {
         ref = 0;
     }
     uint16_t port; // Port
     atomic_uint32_t ref; // Reference count
     uint8_t closing; // Has one side started to close?
-    MPSCDynamicRing<NATCommon*>* ring;
+    MPSCDynamicRing<NATCommon*>* ring; // Free list of the port, or
+    NATPortBitmap* bitmap; // bitmap of the port
+    IPPort orig; // Original endpoint, kept for snapshots
 };
 #endif
 
@@ -76,7 +201,7 @@ class NATEntryIN : public NATState {
  */
 class NATEntryOUT: public NATState {
     public:
-        NATEntryOUT(IPPort _map, NATCommon* _ref) : map(_map), NATState(_ref) {}
+        NATEntryOUT(IPPort _map, NATCommon* _ref) : NATState(_ref), map(_map) {}
         IPPort map;
 };
 
@@ -85,6 +210,20 @@ typedef HashTableMP<uint16_t,NATEntryOUT> NATHashtable;
 
 #define NAT_FLOW_TIMEOUT 2 * 1000 //Flow timeout
 
+#define NAT_RSS_KEY_SIZE 40
+
+/**
+ * Serialized mapping, for flow table snapshots
+ */
+struct NATSnapshot {
+    uint32_t orig_ip;
+    uint16_t orig_port;
+    uint16_t port;
+    uint8_t fin_seen;
+    uint8_t closing;
+    uint8_t shared; // The mapping is also held by the reverse side
+};
+
 /**
  * Efficient FCB-based NAT
  *
@@ -95,6 +234,18 @@ typedef HashTableMP<uint16_t,NATEntryOUT> NATHashtable;
  * the 1024-65530 range into then number of threads that will pass by. Nothing
  * prevents using multiple ips, different ranges, etc. It's just not done yet.
  *
+ * With BITMAP, each thread uses a bitmap of its range instead of the queue
+ * (see NATPortBitmap). A port released by another thread is just an atomic
+ * bit clear instead of an insertion in the queue of the owner.
+ *
+ * With RSS (which implies BITMAP), the port is chosen so the Toeplitz hash
+ * of the reply, with RSS_KEY, falls in a redirection table entry of the
+ * queue of the thread. It assumes thread number N of the passing threads
+ * reads queue N, and a default redirection table of RSS_RETA_SIZE entries
+ * spreading the queues round-robin, which is what DPDK sets up. Replies are
+ * then received by the thread owning the flow. If no free port of the thread
+ * matches, any free port of the thread is used.
+ *
  * The mapper (this element) pass mappings to the reverse using a thread safe
  * hash-table when a new mapping is done. Afterwards the FCB scratchpad
  * is set and the hash-table is never used again.
@@ -121,21 +272,38 @@ class FlowIPNAT : public FlowStateElement<FlowIPNAT,NATEntryIN> , TCPHelper {
         FLOW_ELEMENT_DEFINE_SESSION_CONTEXT("12/0/ffffffff:HASH-3 16/0/ffffffff:HASH-3 22/0/ffff 20/0/ffff:ARRAY", FLOW_TCP);
 
         static const int timeout = NAT_FLOW_TIMEOUT;
-        NATCommon* pick_port();
+        NATCommon* pick_port(Packet*);
         bool new_flow(NATEntryIN*, Packet*);
         void release_flow(NATEntryIN*);
 
         void push_flow(int, NATEntryIN*, PacketBatch *);
 
+        static const bool snapshot_supported = true;
+        size_t state_snapshot_size() const { return sizeof(NATSnapshot); }
+        void snapshot_state(NATEntryIN*, uint8_t*);
+        bool restore_state(NATEntryIN*, const uint8_t*);
+        void flow_restore_done() override CLICK_COLD;
+
     private:
         struct state {
             MPSCDynamicRing<NATCommon*> available_ports;
+            NATPortBitmap used_ports;
+            unsigned queue; // RSS queue read by the thread
         };
         per_thread<state> _state;
+        Vector<NATCommon*> _ports; // By port in host order, for restores
 
         IPAddress _sip;
         bool _accept_nonsyn;
         bool _own_state;
+        bool _bitmap;
+        bool _rss;
+        unsigned _rss_queues;
+        unsigned _rss_reta_size;
+        uint8_t _rss_key[NAT_RSS_KEY_SIZE];
+        uint32_t _rss_port[2][256]; // Hash of each byte of the reply destination port
+
+        uint32_t rss_hash(const uint8_t* data, int len) const;
         NATHashtable _map;
         friend class FlowIPNATReverse;
 };
@@ -161,6 +329,15 @@ class FlowIPNATReverse : public FlowStateElement<FlowIPNATReverse,NATEntryOUT>,
 
         void push_flow(int, NATEntryOUT*, PacketBatch *);
 
+        /*
+         * The reverse side is not saved : after a restore the mapping is
+         * found again in the table of FlowIPNAT, as for a new flow.
+         */
+        static const bool snapshot_supported = true;
+        size_t state_snapshot_size() const { return 0; }
+        void snapshot_state(NATEntryOUT*, uint8_t*) {}
+        bool restore_state(NATEntryOUT*, const uint8_t*) { return false; }
+
     private:
         FlowIPNAT* _in;
 };
@@ -238,7 +415,9 @@ inline void release_ref(NATCommon* &ref, const bool &own_state)
         nat_debug_chatter("Recycling %d !", ntohs(ref->port));
 
         assert(ref->ref == 0);
-        if (!ref->ring->insert(ref)) {
+        if (ref->bitmap)
+            ref->bitmap->release(ntohs(ref->port));
+        else if (!ref->ring->insert(ref)) {
             click_chatter("Double free");
             abort();
         }
@@ -63,6 +63,8 @@ int FlowL2LoadBalancer::initialize(ErrorHandler *errh)
 bool FlowL2LoadBalancer::new_flow(L2LBEntry* flowdata, Packet* p)
 {
     int server = pick_server(p);
+    if (unlikely(server == no_server))
+        return false;
 
     flowdata->chosen_server = server;
 
@@ -64,6 +64,8 @@ int FlowSwitch::initialize(ErrorHandler *errh)
 bool FlowSwitch::new_flow(FlowSwitchEntry* flowdata, Packet* p)
 {
     int server = pick_server(p);
+    if (unlikely(server == no_server))
+        return false;
 
     flowdata->chosen_server = server;
 
@@ -0,0 +1,412 @@
+// -*- c-basic-offset: 4; related-file-name: "heavyhitters.hh" -*-
+/*
+ * heavyhitters.{cc,hh} -- detects heavy flows with per-thread sketches
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/glue.hh>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/hashtable.hh>
+#include <click/ipaddress.hh>
+#include <clicknet/ip.h>
+#include <clicknet/udp.h>
+#include <algorithm>
+#include "heavyhitters.hh"
+
+CLICK_DECLS
+
+HeavyHitters::HeavyHitters()
+    : _gen(0), _last(0), _retiring(false), _threshold(0), _candidate_threshold(0),
+      _key(key_flow), _width(4096), _depth(4), _k(16), _bytes(false),
+      _timer(this)
+{
+}
+
+HeavyHitters::~HeavyHitters()
+{
+}
+
+int
+HeavyHitters::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String key = "FLOW";
+    _interval = Timestamp::make_sec(1);
+
+    if (Args(conf, this, errh)
+        .read_mp("THRESHOLD", _threshold)
+        .read("KEY", WordArg(), key)
+        .read("WIDTH", _width)
+        .read("DEPTH", _depth)
+        .read("K", _k)
+        .read("INTERVAL", _interval)
+        .read("BYTES", _bytes)
+        .complete() < 0)
+        return -1;
+
+    key = key.upper();
+    if (key == "FLOW")
+        _key = key_flow;
+    else if (key == "SRC")
+        _key = key_src;
+    else if (key == "DST")
+        _key = key_dst;
+    else if (key == "PAIR")
+        _key = key_pair;
+    else
+        return errh->error("Invalid KEY %s, must be FLOW, SRC, DST or PAIR", key.c_str());
+
+    if (_threshold == 0)
+        return errh->error("THRESHOLD must be positive");
+    if (_depth == 0 || _depth > 16)
+        return errh->error("DEPTH must be between 1 and 16");
+    if (_width < 16)
+        _width = 16;
+    if (!is_pow2(_width))
+        _width = next_pow2(_width);
+    if (_k <= 0)
+        return errh->error("K must be positive");
+    if (!_interval)
+        return errh->error("INTERVAL must be positive");
+
+    return 0;
+}
+
+int
+HeavyHitters::initialize(ErrorHandler *)
+{
+    //A flow spread over n threads only needs to reach threshold / n on one
+    //of them to be considered when merging
+    unsigned n = get_passing_threads().weight();
+    _candidate_threshold = _threshold / (n ? n : 1);
+    if (_candidate_threshold == 0)
+        _candidate_threshold = 1;
+
+    for (unsigned i = 0; i < _state.weight(); i++) {
+        ThreadState &s = _state.get_value(i);
+        for (int e = 0; e < 2; e++) {
+            s.sketch[e].initialize(_depth, _width);
+            s.candidates[e].reserve(_k * 4);
+        }
+    }
+    for (int e = 0; e < 2; e++)
+        _merged[e].initialize(_depth, _width);
+
+    _timer.initialize(this);
+    _timer.schedule_after(_interval);
+    return 0;
+}
+
+void
+HeavyHitters::cleanup(CleanupStage)
+{
+    for (unsigned i = 0; i < _state.weight(); i++) {
+        ThreadState &s = _state.get_value(i);
+        for (int e = 0; e < 2; e++)
+            s.sketch[e].release();
+    }
+    for (int e = 0; e < 2; e++)
+        _merged[e].release();
+}
+
+inline HeavyHitters::Key
+HeavyHitters::make_key(Packet *p) const
+{
+    const click_ip *iph = p->ip_header();
+    Key k;
+    memset(&k, 0, sizeof(k));
+    switch (_key) {
+    case key_src:
+        k.saddr = iph->ip_src.s_addr;
+        break;
+    case key_dst:
+        k.daddr = iph->ip_dst.s_addr;
+        break;
+    case key_pair:
+        k.saddr = iph->ip_src.s_addr;
+        k.daddr = iph->ip_dst.s_addr;
+        break;
+    default:
+        k.saddr = iph->ip_src.s_addr;
+        k.daddr = iph->ip_dst.s_addr;
+        k.proto = iph->ip_p;
+        if ((k.proto == IP_PROTO_TCP || k.proto == IP_PROTO_UDP)
+            && IP_FIRSTFRAG(iph) && p->transport_length() >= 4) {
+            const click_udp *udph = p->udp_header();
+            k.sport = udph->uh_sport;
+            k.dport = udph->uh_dport;
+        }
+        break;
+    }
+    return k;
+}
+
+inline uint64_t
+HeavyHitters::hash(const Key &k)
+{
+    auto mix = [](uint64_t h) -> uint64_t {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    };
+    uint64_t a = ((uint64_t) k.saddr << 32) | k.daddr;
+    uint64_t b = ((uint64_t) k.sport << 32) | ((uint64_t) k.dport << 16) | k.proto;
+    return mix(a ^ mix(b));
+}
+
+/**
+ * Start using the sketches. The thread announces the generation it works on
+ * before checking it is still the current one, so merge() either sees it
+ * or the thread sees the new generation.
+ */
+inline HeavyHitters::Window
+HeavyHitters::enter()
+{
+    Window w;
+    w.s = &*_state;
+    uint32_t g;
+    do {
+        g = _gen;
+        w.s->active = (g << 1) | 1;
+        click_fence();
+    } while (g != _gen);
+    w.e = g & 1;
+    w.merged = &_merged[_last];
+    return w;
+}
+
+inline void
+HeavyHitters::leave(const Window &w)
+{
+    click_fence();
+    w.s->active = 0;
+}
+
+inline int
+HeavyHitters::process(Packet *p, const Window &w)
+{
+    ThreadState &s = *w.s;
+    unsigned e = w.e;
+    Key k = make_key(p);
+    uint64_t h = hash(k);
+    uint32_t v = _bytes ? p->length() : 1;
+
+    uint32_t est = s.sketch[e].add(h, v);
+    //The estimate of a key only grows, so it crosses the threshold once
+    if (est >= _candidate_threshold && est - v < _candidate_threshold
+        && s.candidates[e].size() < s.candidates[e].capacity())
+        s.candidates[e].push_back(k);
+
+    s.count++;
+    if (est >= _threshold || w.merged->estimate(h) >= _threshold) {
+        s.heavy++;
+        return noutputs() - 1;
+    }
+    return 0;
+}
+
+void
+HeavyHitters::push(int, Packet *p)
+{
+    Window w = enter();
+    int o = process(p, w);
+    leave(w);
+    output(o).push(p);
+}
+
+#if HAVE_BATCH
+void
+HeavyHitters::push_batch(int, PacketBatch *batch)
+{
+    Window w = enter();
+    if (noutputs() == 1) {
+        FOR_EACH_PACKET(batch, p)
+            process(p, w);
+        leave(w);
+        output_push_batch(0, batch);
+        return;
+    }
+    auto fnt = [this, &w](Packet *p) { return process(p, w); };
+    CLASSIFY_EACH_PACKET(2, fnt, batch, output_push_batch);
+    leave(w);
+}
+#endif
+
+/**
+ * Close the current interval : threads switch to the other sketch, and once
+ * none of them still uses the one they filled, it is summed into the merged
+ * sketch of the interval, which gives the count of each candidate over all
+ * threads. Returns false if some thread was still processing a batch with
+ * the old sketch, merge() must then be called again later.
+ */
+bool
+HeavyHitters::merge()
+{
+    _lock.acquire();
+    if (!_retiring) {
+        _gen = _gen + 1;
+        _retiring = true;
+        click_fence();
+    }
+    uint32_t g = _gen;
+    for (unsigned i = 0; i < _state.weight(); i++) {
+        uint32_t a = _state.get_value(i).active;
+        if (a && a != ((g << 1) | 1)) {
+            _lock.release();
+            return false;
+        }
+    }
+    unsigned e = (g - 1) & 1;
+
+    //No thread reads _merged[_last ^ 1] anymore : they all entered after the
+    //last merge changed _last
+    Sketch &m = _merged[_last ^ 1];
+    m.clear();
+    for (unsigned i = 0; i < _state.weight(); i++)
+        m.merge(_state.get_value(i).sketch[e]);
+
+    HashTable<Key, uint32_t> seen;
+    Vector<Pair<Key, uint32_t> > top;
+    for (unsigned i = 0; i < _state.weight(); i++) {
+        ThreadState &s = _state.get_value(i);
+        for (int j = 0; j < s.candidates[e].size(); j++) {
+            const Key &k = s.candidates[e][j];
+            if (seen.find(k) != seen.end())
+                continue;
+            uint32_t est = m.estimate(hash(k));
+            seen.set(k, est);
+            top.push_back(Pair<Key, uint32_t>(k, est));
+        }
+        s.candidates[e].clear();
+        s.sketch[e].clear();
+    }
+    std::sort(top.begin(), top.end(), [](const Pair<Key, uint32_t> &a, const Pair<Key, uint32_t> &b) {
+        return a.second > b.second;
+    });
+    if (top.size() > _k)
+        top.resize(_k);
+
+    click_fence();
+    _last = _last ^ 1;
+    _retiring = false;
+    _top.swap(top);
+    _lock.release();
+    return true;
+}
+
+void
+HeavyHitters::run_timer(Timer *t)
+{
+    //Give the threads still using the old sketch the time to finish their batch
+    if (!merge())
+        t->reschedule_after_msec(1);
+    else
+        t->reschedule_after(_interval);
+}
+
+String
+HeavyHitters::unparse(const Key &k) const
+{
+    StringAccum sa;
+    switch (_key) {
+    case key_src:
+        sa << IPAddress(k.saddr);
+        break;
+    case key_dst:
+        sa << IPAddress(k.daddr);
+        break;
+    case key_pair:
+        sa << IPAddress(k.saddr) << ' ' << IPAddress(k.daddr);
+        break;
+    default:
+        sa << IPAddress(k.saddr) << ' ' << ntohs(k.sport) << ' '
+           << IPAddress(k.daddr) << ' ' << ntohs(k.dport) << ' ' << (int) k.proto;
+        break;
+    }
+    return sa.take_string();
+}
+
+enum { h_top, h_count, h_heavy_count, h_threshold, h_merge };
+
+String
+HeavyHitters::read_handler(Element *e, void *thunk)
+{
+    HeavyHitters *hh = static_cast<HeavyHitters *>(e);
+    switch ((intptr_t) thunk) {
+    case h_top: {
+        StringAccum sa;
+        hh->_lock.acquire();
+        for (int i = 0; i < hh->_top.size(); i++)
+            sa << hh->unparse(hh->_top[i].first) << ' ' << hh->_top[i].second << '\n';
+        hh->_lock.release();
+        return sa.take_string();
+    }
+    case h_count: {
+        PER_THREAD_MEMBER_SUM(uint64_t, count, hh->_state, count);
+        return String(count);
+    }
+    case h_heavy_count: {
+        PER_THREAD_MEMBER_SUM(uint64_t, heavy, hh->_state, heavy);
+        return String(heavy);
+    }
+    case h_threshold:
+        return String(hh->_threshold);
+    default:
+        return "<error>";
+    }
+}
+
+int
+HeavyHitters::write_handler(const String &s, Element *e, void *thunk, ErrorHandler *errh)
+{
+    HeavyHitters *hh = static_cast<HeavyHitters *>(e);
+    switch ((intptr_t) thunk) {
+    case h_threshold: {
+        uint32_t threshold;
+        if (!IntArg().parse(s, threshold) || threshold == 0)
+            return errh->error("threshold must be a positive integer");
+        unsigned n = hh->get_passing_threads().weight();
+        hh->_candidate_threshold = threshold / (n ? n : 1);
+        if (hh->_candidate_threshold == 0)
+            hh->_candidate_threshold = 1;
+        hh->_threshold = threshold;
+        return 0;
+    }
+    case h_merge:
+        while (!hh->merge())
+            click_relax_fence();
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+void
+HeavyHitters::add_handlers()
+{
+    add_read_handler("top", read_handler, h_top);
+    add_read_handler("count", read_handler, h_count);
+    add_read_handler("heavy_count", read_handler, h_heavy_count);
+    add_read_handler("threshold", read_handler, h_threshold);
+    add_write_handler("threshold", write_handler, h_threshold);
+    add_write_handler("merge", write_handler, h_merge);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(flow)
+EXPORT_ELEMENT(HeavyHitters)
+ELEMENT_MT_SAFE(HeavyHitters)
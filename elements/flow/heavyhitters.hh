@@ -0,0 +1,250 @@
+#ifndef CLICK_HEAVYHITTERS_HH
+#define CLICK_HEAVYHITTERS_HH
+#include <click/batchelement.hh>
+#include <click/multithread.hh>
+#include <click/timer.hh>
+#include <click/sync.hh>
+#include <click/vector.hh>
+#include <click/pair.hh>
+CLICK_DECLS
+
+/*
+=c
+
+HeavyHitters(THRESHOLD [, I<keywords> KEY, WIDTH, DEPTH, K, INTERVAL, BYTES])
+
+=s flow
+
+detects heavy flows with a sketch, without per-flow state
+
+=d
+
+Counts packets (or bytes) per flow in a Count-Min sketch and sends packets of
+flows that went over THRESHOLD during the last or current INTERVAL to output
+1. Other packets are sent to output 0. If there is only one output, all
+packets go to output 0 and the element only reports heavy hitters.
+
+Each thread updates its own sketch, so the element is lock-free on the data
+path. A timer merges the sketches of all threads every INTERVAL, keeping the
+K largest flows for the top handler. Flows spread over multiple threads are
+diverted once their merged count of the last interval goes over THRESHOLD.
+The sketch of an interval is merged once no thread is still processing a
+batch that started during it, so a merge may be delayed by one batch.
+
+Placed in front of a flow manager, it allows to give an FCB, a rate limiter or
+a deeper inspection only to heavy flows.
+
+Keyword arguments are:
+
+=over 8
+
+=item THRESHOLD
+
+Integer. Number of packets (or bytes) per INTERVAL above which a flow is heavy.
+
+=item KEY
+
+What is a flow : FLOW (the 5-tuple), SRC or DST (an IP address) or PAIR (the
+source and destination addresses). Default is FLOW.
+
+=item WIDTH
+
+Integer. Number of counters per row, rounded up to a power of 2. Default is
+4096.
+
+=item DEPTH
+
+Integer. Number of rows, each with a different hash function. Default is 4.
+
+=item K
+
+Integer. Number of heavy hitters kept for the top handler. Default is 16.
+
+=item INTERVAL
+
+Time. Measurement interval. Default is 1s.
+
+=item BYTES
+
+Boolean. Count bytes instead of packets. Default is false.
+
+=back
+
+=h top read-only
+
+Heavy hitters of the last interval, one per line with their estimated count,
+the largest first.
+
+=h count read-only
+
+Number of packets seen.
+
+=h heavy_count read-only
+
+Number of packets of heavy flows.
+
+=h threshold read/write
+
+The threshold.
+
+=h merge write-only
+
+End the current interval now.
+
+=e
+
+  FromDPDKDevice(0)
+    -> Strip(14)
+    -> CheckIPHeader
+    -> hh :: HeavyHitters(10000, KEY SRC);
+  hh[0] -> ...;
+  hh[1] -> FlowIPManager -> ...;
+
+=a FlowCounter, AggregateCounter
+*/
+
+class HeavyHitters : public BatchElement { public:
+
+    HeavyHitters() CLICK_COLD;
+    ~HeavyHitters() CLICK_COLD;
+
+    const char *class_name() const override { return "HeavyHitters"; }
+    const char *port_count() const override { return "1/1-2"; }
+    const char *processing() const override { return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) override CLICK_COLD;
+    int initialize(ErrorHandler *) override CLICK_COLD;
+    void cleanup(CleanupStage) override CLICK_COLD;
+    void add_handlers() override CLICK_COLD;
+
+    void push(int, Packet *) override;
+#if HAVE_BATCH
+    void push_batch(int, PacketBatch *) override;
+#endif
+    void run_timer(Timer *) override;
+
+  private:
+
+    struct Key {
+        uint32_t saddr;
+        uint32_t daddr;
+        uint16_t sport;
+        uint16_t dport;
+        uint8_t proto;
+
+        inline bool operator==(const Key &o) const {
+            return saddr == o.saddr && daddr == o.daddr && sport == o.sport
+                && dport == o.dport && proto == o.proto;
+        }
+        inline hashcode_t hashcode() const {
+            return saddr ^ (daddr * 31) ^ (((uint32_t)sport << 16) | dport) ^ proto;
+        }
+    };
+
+    /**
+     * Count-Min sketch with conservative update : only the smallest counters
+     * of a key are increased, which lowers the overestimation.
+     */
+    class Sketch { public:
+        Sketch() : _counters(0), _depth(0), _mask(0) {
+        }
+        void initialize(unsigned depth, unsigned width) {
+            _depth = depth;
+            _mask = width - 1;
+            _counters = new uint32_t[depth * width];
+            clear();
+        }
+        void release() {
+            delete[] _counters;
+            _counters = 0;
+        }
+        void clear() {
+            memset(_counters, 0, sizeof(uint32_t) * _depth * (_mask + 1));
+        }
+        void merge(const Sketch &s) {
+            for (unsigned i = 0; i < _depth * (_mask + 1); i++)
+                _counters[i] += s._counters[i];
+        }
+        inline uint32_t *counter(uint64_t h, unsigned row) const {
+            uint32_t h1 = h, h2 = (h >> 32) | 1;
+            return &_counters[(row * (_mask + 1)) + ((h1 + row * h2) & _mask)];
+        }
+        inline uint32_t estimate(uint64_t h) const {
+            uint32_t min = UINT32_MAX;
+            for (unsigned i = 0; i < _depth; i++) {
+                uint32_t c = *counter(h, i);
+                if (c < min)
+                    min = c;
+            }
+            return min;
+        }
+        inline uint32_t add(uint64_t h, uint32_t v) {
+            uint32_t est = estimate(h) + v;
+            for (unsigned i = 0; i < _depth; i++) {
+                uint32_t *c = counter(h, i);
+                if (*c < est)
+                    *c = est;
+            }
+            return est;
+        }
+      private:
+        uint32_t *_counters;
+        unsigned _depth;
+        unsigned _mask;
+    };
+
+    struct ThreadState {
+        ThreadState() : count(0), heavy(0), active(0) {
+        }
+        Sketch sketch[2];
+        Vector<Key> candidates[2];
+        uint64_t count;
+        uint64_t heavy;
+        // (generation << 1) | 1 while the thread processes packets, 0 when
+        // it holds no reference to the sketches
+        volatile uint32_t active;
+    };
+
+    /**
+     * Sketches used by a thread for a batch, taken once when it starts.
+     */
+    struct Window {
+        ThreadState *s;
+        unsigned e;
+        const Sketch *merged;
+    };
+
+    enum { key_flow, key_src, key_dst, key_pair };
+
+    per_thread<ThreadState> _state;
+    Sketch _merged[2];
+    volatile uint32_t _gen; // Interval being filled, its sketch is _gen & 1
+    volatile unsigned _last; // Merged sketch of the last interval
+    bool _retiring; // The sketch of _gen - 1 is not merged yet
+    Vector<Pair<Key, uint32_t> > _top;
+    Spinlock _lock;
+
+    uint32_t _threshold;
+    uint32_t _candidate_threshold;
+    int _key;
+    unsigned _width;
+    unsigned _depth;
+    int _k;
+    Timestamp _interval;
+    bool _bytes;
+    Timer _timer;
+
+    inline Key make_key(Packet *p) const;
+    static inline uint64_t hash(const Key &k);
+    inline Window enter();
+    inline void leave(const Window &w);
+    inline int process(Packet *p, const Window &w);
+    bool merge();
+    String unparse(const Key &k) const;
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+};
+
+CLICK_ENDDECLS
+#endif
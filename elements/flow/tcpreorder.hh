@@ -7,6 +7,7 @@
 #include <clicknet/ip.h>
 #include <click/multithread.hh>
 #include "batchfcb.hh"
+#include "tcpreorderbuffer.hh"
 #include <click/tcphelper.hh>
 #include <click/flow/flowelement.hh>
 
@@ -18,8 +19,7 @@
  */
 struct fcb_tcpreorder : public FlowReleaseChain
 {
-    Packet* packetList;
-    uint16_t packetListLength;
+    TCPReorderList list;
     tcp_seq_t expectedPacketSeq;
     tcp_seq_t lastSent;
 
@@ -33,19 +33,6 @@ struct fcb_tcpreorder : public FlowReleaseChain
 
     ~fcb_tcpreorder()
     {
-        //TODO : call this on release
-        /*Packet* next = NULL;
-
-        while(packetList != NULL)
-        {
-            next = packetList->next();
-
-            // Kill packet
-            packetList->kill();
-
-            // Put back node in memory pool
-            packetList = next;
-        }*/
     }
 };
 
@@ -55,7 +42,7 @@ CLICK_DECLS
 /*
 =c
 
-TCPReorder(FLOWDIRECTION [, MERGESORT])
+TCPReorder([I<keywords> FLOW_CAPACITY, THREAD_CAPACITY, NOTIMEOUT, VERBOSE])
 
 =s middlebox
 
@@ -75,22 +62,27 @@ This element reorders TCP packets before sending them on its first output. It ca
 of the stack of the middlebox. The second output is optional and is used to push retransmitted
 packets. If the second output is not used, retransmitted packets are dropped.
 
-=item FLOWDIRECTION
+Out-of-order packets are kept as runs of contiguous sequence ranges, one per
+hole in the flow. Adding a packet only walks the holes, and filling a hole
+releases the whole run that follows as one batch.
 
-ID of the path for the connection (0 or 1). The return path must have the other ID.
-Thus, each direction of a TCP connection has a different ID.
+=item FLOW_CAPACITY
 
-=item MERGESORT
+Maximal number of packets waiting per flow. Packets above it are dropped and
+will be retransmitted. Default is 1024.
+
+=item THREAD_CAPACITY
+
+Maximal number of packets waiting in all flows handled by a thread. Default
+is 65536.
 
-Only used with batching. Adds each packet of the batch at the beginning of the list and reorders
-the list using merge sort instead of adding each packet of the batch directly to the right position.
+=item MERGESORT
 
-Complexity to process a batch with this option: O((n + k) * log (n + k))
-Complexity to process a batch without this option: O(k * (n + k))
+Deprecated, packets are always kept sorted.
 
-Where k is the number of packets in the batch and n is the number of packets in the waiting list
+=h waiting read-only
 
-Default value: true.
+Number of out-of-order packets waiting.
 
 =a TCPIn, TCPOut, TCPRetransmitter */
 
@@ -119,19 +111,13 @@ public:
 
     int configure(Vector<String>&, ErrorHandler*) override CLICK_COLD;
     int reorder_initialize(ErrorHandler *errh) CLICK_COLD;
+    void add_handlers() override CLICK_COLD;
 
     void push_flow(int, fcb_tcpreorder* fcb, PacketBatch *batch) override;
 
     static void fcb_release_fnt(FlowControlBlock* fcb, void* thunk);
 
 private:
-    /**
-     * @brief Put a packet in the list of waiting packets
-     * @param fcb A pointer to the FCB of the flow
-     * @param packet The packet to add
-     */
-    bool putPacketInList(struct fcb_tcpreorder *fcb, Packet* packet);
-
     void killList(struct fcb_tcpreorder* tcpreorder);
 
     /**
@@ -149,21 +135,6 @@ private:
      */
     bool checkFirstPacket(struct fcb_tcpreorder *fcb, PacketBatch* batch);
 
-    /**
-     * @brief Flush the list of waiting packets
-     * @param fcb A pointer to the FCB of the flow
-     */
-    void flushList(struct fcb_tcpreorder *fcb);
-
-    /**
-     * @brief Flush the list of waiting packets after a given packet
-     * @param fcb A pointer to the FCB of the flow
-     * @param toKeep Pointer to the last element that will be kept in the list
-     * @param toRemove Pointer to the first element that will be removed
-     */
-    void flushListFrom(struct fcb_tcpreorder *fcb, Packet *toKeep,
-        Packet *toRemove);
-
     /**
      * @brief Check if a given packet is a retransmission
      * @param fcb A pointer to the FCB of the flow
@@ -172,17 +143,11 @@ private:
      */
     bool checkRetransmission(struct fcb_tcpreorder *fcb, Packet* packet, bool always_retransmit);
 
-public:
-
-    /**
-     * @brief Sort the list of waiting packets using merge sort
-     * @param list A pointer to the head of the list of waiting packets
-     * @return A pointer to the new head of the list of waiting packets
-     */
-    static Packet* sortList(Packet *list);
-private:
+    static String read_handler(Element* e, void* thunk) CLICK_COLD;
 
-    bool _mergeSort;
+    TCPReorderBuffer _buffer;
+    uint32_t _flow_capacity;
+    uint32_t _thread_capacity;
     bool _notimeout;
     bool _verbose;
 };
@@ -0,0 +1,290 @@
+/*
+ * tcpreorderbuffer.hh - Buffer of out-of-order TCP packets shared by the
+ * reordering elements
+ */
+
+#ifndef MIDDLEBOX_TCPREORDERBUFFER_HH
+#define MIDDLEBOX_TCPREORDERBUFFER_HH
+
+#include <click/config.h>
+#include <click/packet.hh>
+#include <click/packetbatch.hh>
+#include <click/allocator.hh>
+#include <click/multithread.hh>
+#include <click/flow/common.hh>
+#include <click/tcphelper.hh>
+#include <clicknet/tcp.h>
+
+CLICK_DECLS
+
+/**
+ * Contiguous packets waiting in a TCPReorderBuffer, covering the sequence
+ * range [start, end)
+ */
+struct TCPReorderRun {
+    TCPReorderRun* next;
+    Packet* head;
+    Packet* tail;
+    tcp_seq_t start;
+    tcp_seq_t end;
+    unsigned count;
+};
+
+/**
+ * Per-flow part of the buffer, to be kept in the FCB
+ */
+struct TCPReorderList {
+    TCPReorderRun* runs;
+    uint16_t count;
+
+    inline void init() {
+        runs = 0;
+        count = 0;
+    }
+
+    inline bool empty() const {
+        return runs == 0;
+    }
+};
+
+/**
+ * Reorder buffer shared by the TCP reordering elements
+ *
+ * Waiting packets are kept as runs of contiguous sequence ranges, sorted by
+ * sequence number. Adjacent runs are merged, so a flow has one run per hole.
+ * Finding where a packet goes only walks the holes, then the packet is
+ * appended or prepended to its run in O(1). Once the first hole is filled,
+ * the whole first run is released as one PacketBatch.
+ *
+ * The number of waiting packets is capped per flow and per thread, packets
+ * above the caps are refused and will be retransmitted by the sender.
+ *
+ * Packets in the buffer do not hold a reference to their FCB, the element
+ * gives it up when inserting and takes it back when releasing them. It must
+ * flush the buffer from the release function of the flow.
+ */
+class TCPReorderBuffer { public:
+
+    enum Result {
+        INSERTED,
+        DUPLICATE, //Data is already waiting, or before what is expected
+        FULL,
+        KILLED //The packet could not be trimmed and was freed
+    };
+
+    TCPReorderBuffer() : _flow_capacity(1024), _thread_capacity(65536) {
+    }
+
+    void initialize(unsigned flow_capacity, unsigned thread_capacity) {
+        _flow_capacity = flow_capacity;
+        _thread_capacity = thread_capacity;
+        _pool.static_initialize();
+        for (unsigned i = 0; i < _waiting.weight(); i++)
+            _waiting.set_value(i, 0);
+    }
+
+    /**
+     * Add a packet covering [seq, next_seq) to the list. The packet is not
+     * killed if it is not inserted. The caps do not apply to a packet that
+     * fills the first hole, as it releases packets right after.
+     *
+     * A packet overlapping the start of a waiting run means the sender split
+     * its data differently after a loss. The packet is kept and the runs it
+     * overlaps are dropped, as they will be retransmitted aligned with it.
+     * A packet overlapping the end of a run has its head trimmed, and only
+     * the new data is kept, so @a p may change.
+     */
+    inline Result insert(TCPReorderList* l, Packet*& p, tcp_seq_t seq, tcp_seq_t next_seq, bool fills_hole = false);
+
+    /**
+     * Release the first run if it starts at expected, and advance expected
+     * past it.
+     */
+    inline PacketBatch* pop(TCPReorderList* l, tcp_seq_t& expected);
+
+    /**
+     * Kill all waiting packets of a flow
+     */
+    inline void flush(TCPReorderList* l);
+
+    /**
+     * Number of packets waiting in the buffers of all flows. A flow may be
+     * flushed by another thread than the one that buffered its packets, so
+     * only the sum of the threads is exact.
+     */
+    int waiting() {
+        PER_THREAD_SUM(int, total, _waiting);
+        return total;
+    }
+
+  private:
+    pool_allocator_mt<TCPReorderRun, false, 64> _pool;
+    per_thread<int> _waiting; //Negative if other threads released our packets
+    unsigned _flow_capacity;
+    unsigned _thread_capacity;
+
+    static inline Packet* trim_front(Packet* p, uint32_t n);
+    inline TCPReorderRun* new_run(Packet* p, tcp_seq_t seq, tcp_seq_t next_seq, TCPReorderRun* next);
+    inline void drop(TCPReorderList* l, TCPReorderRun** link);
+    inline void merge_next(TCPReorderList* l, TCPReorderRun* r);
+};
+
+inline TCPReorderRun*
+TCPReorderBuffer::new_run(Packet* p, tcp_seq_t seq, tcp_seq_t next_seq, TCPReorderRun* next)
+{
+    TCPReorderRun* r = _pool.allocate_uninitialized();
+    r->next = next;
+    r->head = p;
+    r->tail = p;
+    r->start = seq;
+    r->end = next_seq;
+    r->count = 1;
+    p->set_next(0);
+    return r;
+}
+
+/**
+ * Remove the first n bytes of the TCP payload of p, moving the headers
+ * forward. Returns 0 if the packet could not be made writable, it is then
+ * freed.
+ */
+inline Packet*
+TCPReorderBuffer::trim_front(Packet* p, uint32_t n)
+{
+    WritablePacket* q = p->uniqueify();
+    if (!q)
+        return 0;
+    int mac = q->has_mac_header() ? q->mac_header_offset() : -1;
+    int nh = q->network_header_offset();
+    int th = q->transport_header_offset();
+    unsigned hlen = th + (q->tcp_header()->th_off << 2);
+    memmove(q->data() + n, q->data(), hlen);
+    q->pull(n);
+    if (mac >= 0)
+        q->set_mac_header(q->data() + mac);
+    q->set_network_header(q->data() + nh, th - nh);
+
+    click_ip* iph = q->ip_header();
+    iph->ip_len = htons(ntohs(iph->ip_len) - n);
+    iph->ip_sum = 0;
+    iph->ip_sum = click_in_cksum((unsigned char*)iph, iph->ip_hl << 2);
+    click_tcp* tcph = q->tcp_header();
+    tcph->th_seq = htonl(ntohl(tcph->th_seq) + n);
+    TCPHelper::computeTCPChecksum(q);
+    return q;
+}
+
+/**
+ * Kill the packets of the run at *link and unlink it
+ */
+inline void
+TCPReorderBuffer::drop(TCPReorderList* l, TCPReorderRun** link)
+{
+    TCPReorderRun* r = *link;
+    *link = r->next;
+    SFCB_STACK( //Packets in the buffer have no reference
+        FOR_EACH_PACKET_LL_SAFE(r->head, p) {
+            p->kill();
+        }
+    );
+    l->count -= r->count;
+    *_waiting -= r->count;
+    _pool.release(r);
+}
+
+/**
+ * Merge r with the next run if they are now contiguous
+ */
+inline void
+TCPReorderBuffer::merge_next(TCPReorderList* l, TCPReorderRun* r)
+{
+    //Runs overlapping r were split differently, drop them
+    while (r->next && SEQ_GT(r->end, r->next->start))
+        drop(l, &r->next);
+    TCPReorderRun* n = r->next;
+    if (!n || r->end != n->start)
+        return;
+    r->tail->set_next(n->head);
+    r->tail = n->tail;
+    r->end = n->end;
+    r->count += n->count;
+    r->next = n->next;
+    _pool.release(n);
+}
+
+inline TCPReorderBuffer::Result
+TCPReorderBuffer::insert(TCPReorderList* l, Packet*& p, tcp_seq_t seq, tcp_seq_t next_seq, bool fills_hole)
+{
+    if (unlikely((l->count >= _flow_capacity || *_waiting >= (int)_thread_capacity) && !fills_hole))
+        return FULL;
+
+    TCPReorderRun** link = &l->runs;
+    TCPReorderRun* r;
+    while ((r = *link) != 0) {
+        if (SEQ_LT(seq, r->start)) {
+            if (next_seq == r->start) { //Just before r
+                p->set_next(r->head);
+                r->head = p;
+                r->start = seq;
+                r->count++;
+            } else {
+                *link = new_run(p, seq, next_seq, r);
+                merge_next(l, *link);
+            }
+            goto inserted;
+        }
+        if (SEQ_LT(seq, r->end)) {
+            //Overlapping the end of r, keep what is after it
+            if (!SEQ_GT(next_seq, r->end) || (p->tcp_header()->th_flags & TH_SYN))
+                return DUPLICATE;
+            uint32_t overlap = r->end - seq;
+            if (overlap > TCPHelper::getPayloadLength(p))
+                return DUPLICATE;
+            if (!(p = trim_front(p, overlap)))
+                return KILLED;
+            seq = r->end;
+        }
+        if (seq == r->end) { //Just after r
+            r->tail->set_next(p);
+            p->set_next(0);
+            r->tail = p;
+            r->end = next_seq;
+            r->count++;
+            merge_next(l, r);
+            goto inserted;
+        }
+        link = &r->next;
+    }
+    *link = new_run(p, seq, next_seq, 0);
+
+  inserted:
+    l->count++;
+    (*_waiting)++;
+    return INSERTED;
+}
+
+inline PacketBatch*
+TCPReorderBuffer::pop(TCPReorderList* l, tcp_seq_t& expected)
+{
+    TCPReorderRun* r = l->runs;
+    if (!r || r->start != expected)
+        return 0;
+    PacketBatch* batch = PacketBatch::make_from_simple_list(r->head, r->tail, r->count);
+    expected = r->end;
+    l->runs = r->next;
+    l->count -= r->count;
+    *_waiting -= r->count;
+    _pool.release(r);
+    return batch;
+}
+
+inline void
+TCPReorderBuffer::flush(TCPReorderList* l)
+{
+    while (l->runs)
+        drop(l, &l->runs);
+}
+
+CLICK_ENDDECLS
+
+#endif
@@ -36,6 +36,9 @@
 #include <click/error.hh>
 #include <click/algorithm.hh>
 #include <click/heap.hh>
+#if CLICK_USERLEVEL
+# include <click/flowsnapshot.hh>
+#endif
 
 #ifdef CLICK_LINUXMODULE
 #include <click/cxxprotect.h>
@@ -50,6 +53,25 @@ CLICK_CXX_UNPROTECT
 
 CLICK_DECLS
 
+#if CLICK_USERLEVEL
+namespace {
+struct IPRewriterSnapshot {
+    IPFlowID flowid;
+    IPFlowID rewritten_flowid;
+    uint8_t ip_p;
+    uint8_t input;
+    uint8_t guaranteed;
+};
+
+struct IPRewriterRestore {
+    IPRewriterBase *rw;
+    Vector<IPRewriterSnapshot> flows;
+    Vector<uint32_t> expiry_msec;
+    atomic_uint32_t pending;
+};
+}
+#endif
+
 //
 // IPMapper
 //
@@ -66,12 +88,39 @@ IPMapper::rewrite_flowid(IPRewriterInput *, const IPFlowID &, IPFlowID &,
     return IPRewriterBase::rw_drop;
 }
 
+//
+// IPRewriterHeap
+//
+
+void
+IPRewriterHeap::set_wheel(int order, int far_order, click_jiffies_t tick_j)
+{
+    assert(size() == 0);
+    _wheel_shift = 1;
+    while (((click_jiffies_t) 1 << _wheel_shift) < tick_j)
+	++_wheel_shift;
+    _wheel_span_shift = _wheel_shift + order;
+    // The slot index must fit in the 32 bits of IPRewriterFlow::_place
+    assert(_wheel_span_shift + far_order <= 32);
+    _wheel.assign(1 << order, 0);
+    _wheel_last.resize(_wheel.size());
+    for (int i = 0; i < _wheel.size(); i++)
+	_wheel_last[i] = &_wheel[i];
+    _wheel_far.assign(1 << far_order, 0);
+    _wheel_far_last.resize(_wheel_far.size());
+    for (int i = 0; i < _wheel_far.size(); i++)
+	_wheel_far_last[i] = &_wheel_far[i];
+    _wheel_overflow_last = &_wheel_overflow;
+    _wheel_now_j = click_jiffies() & ~(wheel_tick() - 1);
+    _wheel_evict_j = _wheel_now_j;
+}
+
 //
 // IPRewriterBase
 //
 
 IPRewriterBase::IPRewriterBase()
-    : _state(), _set_aggregate(false), _handle_migration(false)
+    : _timer_wheel(false), _state(), _set_aggregate(false), _handle_migration(false)
 {
     _gc_interval_sec = default_gc_interval;
 
@@ -191,6 +240,7 @@ IPRewriterBase::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("USE_CACHE", use_cache)
 	.read("SET_AGGREGATE", set_aggregate)
 	.read("HANDLE_MIGRATION", _handle_migration)
+	.read("TIMER_WHEEL", _timer_wheel)
 	.consume() < 0)
 	return -1;
 
@@ -223,6 +273,12 @@ IPRewriterBase::configure(Vector<String> &conf, ErrorHandler *errh)
             return errh->error("bad MAPPING_CAPACITY");
     }
 
+    // Elements sharing a capacity share the expiry order too
+    if (_timer_wheel)
+        for (unsigned i = 0; i < _mem_units_no; i++)
+            if (!_heap[i]->wheel())
+                _heap[i]->set_wheel(wheel_order, wheel_far_order, CLICK_HZ);
+
 
 
     if (conf.size() != ninputs())
@@ -259,7 +315,10 @@ IPRewriterBase::initialize(ErrorHandler *errh)
         new(&gc_timer) Timer(gc_timer_hook, this); //Reconstruct as Timer does not allow assignment
         gc_timer.initialize(this);
         gc_timer.move_thread(_state.get_mapping(i));
-        if (_gc_interval_sec)
+        IPRewriterHeap *heap = _heap[_state.get_mapping(i)];
+        if (heap->wheel())
+            gc_timer.schedule_after(Timestamp::make_jiffies(heap->wheel_tick()));
+        else if (_gc_interval_sec)
             gc_timer.schedule_after_sec(_gc_interval_sec);
     }
     return errh->nerrors() ? -1 : 0;
@@ -268,6 +327,14 @@ IPRewriterBase::initialize(ErrorHandler *errh)
 void
 IPRewriterBase::cleanup(CleanupStage)
 {
+#if CLICK_USERLEVEL
+    for (int i = 0; i < _restore_tasks.size(); i++)
+	if (_restore_tasks[i]) {
+	    delete static_cast<IPRewriterRestore *>(_restore_tasks[i]->user_data());
+	    delete _restore_tasks[i];
+	}
+    _restore_tasks.clear();
+#endif
     for (int i = 0; i < _mem_units_no; i++)
         shrink_heap(true, i);
     for (int i = 0; i < _input_specs.size(); ++i)
@@ -338,10 +405,14 @@ IPRewriterBase::store_flow(IPRewriterFlow *flow, int input,
 		old->flow()->destroy(heap);
     }
 
-    Vector<IPRewriterFlow *> &myheap = heap->_heaps[flow->guaranteed()];
-    myheap.push_back(flow);
-    push_heap(myheap.begin(), myheap.end(),
-	      IPRewriterFlow::heap_less(), IPRewriterFlow::heap_place());
+    if (heap->wheel())
+	heap->wheel_insert(flow);
+    else {
+	Vector<IPRewriterFlow *> &myheap = heap->_heaps[flow->guaranteed()];
+	myheap.push_back(flow);
+	push_heap(myheap.begin(), myheap.end(),
+		  IPRewriterFlow::heap_less(), IPRewriterFlow::heap_place());
+    }
     ++_input_specs[input].count;
 
     if (unlikely(heap->size() > heap->capacity())) {
@@ -398,6 +469,11 @@ bool
 IPRewriterBase::shrink_heap_for_new_flow(IPRewriterFlow *flow,
 					 click_jiffies_t now_j)
 {
+    IPRewriterHeap *heap = _heap[click_current_cpu_id()];
+    if (heap->wheel()) {
+	advance_wheel(heap, now_j);
+	return shrink_wheel(heap, heap->_capacity, now_j, flow);
+    }
     shift_heap_best_effort(now_j);
     // At this point, all flows in the guarantee heap expire in the future.
     // So remove the next-to-expire best-effort flow, unless there are none.
@@ -413,10 +489,176 @@ IPRewriterBase::shrink_heap_for_new_flow(IPRewriterFlow *flow,
     return deadf == flow;
 }
 
+/**
+ * Reclaim the wheel slots that ended before @a now_j. Flows refreshed since
+ * they were inserted move to the slot of their new expiry time, and flows
+ * whose guarantee ended become best-effort. When a revolution starts, its
+ * slot of the second level and the overflow list are moved to the wheel.
+ */
+void
+IPRewriterBase::advance_wheel(IPRewriterHeap *heap, click_jiffies_t now_j)
+{
+    click_jiffies_t tick = heap->wheel_tick();
+    for (int i = 0; !click_jiffies_less(now_j, heap->_wheel_now_j + tick); i++) {
+	if (i == heap->_wheel.size()) {
+	    // Every slot was visited, the next ones are empty until now, but
+	    // the revolutions skipped may have far flows due
+	    heap->_wheel_now_j = now_j & ~(tick - 1);
+	    for (int k = 0; k < heap->_wheel_far.size(); k++)
+		wheel_requeue(heap, heap->wheel_detach(heap->_wheel_far[k],
+						       heap->_wheel_far_last[k]), now_j);
+	    wheel_requeue(heap, heap->wheel_detach(heap->_wheel_overflow,
+						   heap->_wheel_overflow_last), now_j);
+	    break;
+	}
+	if ((heap->_wheel_now_j & (heap->wheel_span() - 1)) == 0) {
+	    int k = heap->wheel_far_index(heap->_wheel_now_j);
+	    wheel_requeue(heap, heap->wheel_detach(heap->_wheel_far[k],
+						   heap->_wheel_far_last[k]), now_j);
+	    wheel_requeue(heap, heap->wheel_detach(heap->_wheel_overflow,
+						   heap->_wheel_overflow_last), now_j);
+	}
+	int k = heap->wheel_index(heap->_wheel_now_j);
+	IPRewriterFlow *mf = heap->wheel_detach(heap->_wheel[k], heap->_wheel_last[k]);
+	heap->_wheel_now_j += tick;
+	wheel_requeue(heap, mf, now_j);
+    }
+}
+
+/**
+ * Insert again the flows of the detached @a list, destroying the expired ones.
+ */
+void
+IPRewriterBase::wheel_requeue(IPRewriterHeap *heap, IPRewriterFlow *list,
+			      click_jiffies_t now_j)
+{
+    IPRewriterFlow *mf = list;
+    while (mf) {
+	IPRewriterFlow *next = mf->_wheel_next;
+	mf->_wheel_pprev = 0;
+	--heap->_wheel_count;
+	if (mf->guaranteed() && mf->expired(now_j)) {
+	    mf->_expiry_j = mf->owner()->owner->best_effort_expiry(mf);
+	    mf->_guaranteed = false;
+	}
+	if (mf->expired(now_j))
+	    mf->destroy(heap);
+	else
+	    heap->wheel_insert(mf);
+	mf = next;
+    }
+}
+
+/**
+ * Return the first flow of @a slot, in insertion order, only looking at
+ * best-effort flows unless @a guaranteed is true. Flows refreshed to @a end_j
+ * or later, or whose guarantee ended, are moved to the slot of their current
+ * expiry time on the way, so each refresh costs one move. Guaranteed flows
+ * are skipped in place.
+ */
+IPRewriterFlow *
+IPRewriterBase::wheel_victim(IPRewriterHeap *heap, IPRewriterFlow *&slot,
+			     click_jiffies_t end_j, click_jiffies_t now_j,
+			     bool guaranteed)
+{
+    IPRewriterFlow **pprev = &slot;
+    while (IPRewriterFlow *mf = *pprev) {
+	bool moved = false;
+	if (mf->guaranteed() && mf->expired(now_j)) {
+	    mf->_expiry_j = mf->owner()->owner->best_effort_expiry(mf);
+	    mf->_guaranteed = false;
+	    moved = true;
+	}
+	if (moved || !click_jiffies_less(mf->expiry(), end_j)) {
+	    // *pprev is now the next flow. A flow put back in this slot is
+	    // appended, and found again at the end of the walk.
+	    heap->wheel_unlink(mf);
+	    heap->wheel_insert(mf);
+	    continue;
+	}
+	if (guaranteed || !mf->guaranteed())
+	    return mf;
+	pprev = &mf->_wheel_next;
+    }
+    return 0;
+}
+
+/**
+ * Destroy flows until at most @a capacity are left, best-effort flows
+ * first. If @a flow is given, it is a new flow that is destroyed instead of
+ * guaranteed flows, and true is returned if it was destroyed.
+ *
+ * The current slot of the wheel is walked first, then the slots from the
+ * first one that may hold a best-effort flow, then the revolutions of the
+ * second level, then the overflow list.
+ */
+bool
+IPRewriterBase::shrink_wheel(IPRewriterHeap *heap, int32_t capacity,
+			     click_jiffies_t now_j, IPRewriterFlow *flow)
+{
+    bool destroyed = false;
+    click_jiffies_t tick = heap->wheel_tick();
+    click_jiffies_t span = heap->wheel_span();
+    for (int pass = 0; pass < 2; pass++) {
+	bool guaranteed = pass == 1;
+	click_jiffies_t j = heap->_wheel_now_j;
+	click_jiffies_t wheel_end_j = heap->_wheel_now_j + span;
+	click_jiffies_t far_j = (heap->_wheel_now_j & ~(span - 1)) + span;
+	int far = 1;
+	while (heap->size() > capacity) {
+	    IPRewriterFlow *victim;
+	    if (click_jiffies_less(j, wheel_end_j)) {
+		victim = wheel_victim(heap, heap->_wheel[heap->wheel_index(j)], j + tick, now_j, guaranteed);
+		if (!victim) {
+		    // Guarantees may only have ended in the current slot, the
+		    // cursor holds for the next ones
+		    j += tick;
+		    if (guaranteed)
+			continue;
+		    if (click_jiffies_less(j, heap->_wheel_evict_j))
+			j = heap->_wheel_evict_j;
+		    else
+			heap->_wheel_evict_j = j;
+		    continue;
+		}
+	    } else if (far < heap->_wheel_far.size()) {
+		victim = wheel_victim(heap, heap->_wheel_far[heap->wheel_far_index(far_j)],
+				      far_j + span, now_j, guaranteed);
+		if (!victim) {
+		    far++;
+		    far_j += span;
+		    continue;
+		}
+	    } else {
+		victim = heap->_wheel_overflow;
+		while (victim && !guaranteed && victim->guaranteed())
+		    victim = victim->_wheel_next;
+		if (!victim)
+		    break;
+	    }
+	    destroyed |= (victim == flow);
+	    victim->destroy(heap);
+	}
+	if (heap->size() <= capacity)
+	    break;
+	if (flow) {
+	    // Only guaranteed flows are left, honor their guarantee
+	    flow->destroy(heap);
+	    return true;
+	}
+    }
+    return destroyed;
+}
+
 void
 IPRewriterBase::shrink_heap(bool clear_all, int thid)
 {
     click_jiffies_t now_j = click_jiffies();
+    if (_heap[thid]->wheel()) {
+	advance_wheel(_heap[thid], now_j);
+	shrink_wheel(_heap[thid], clear_all ? 0 : _heap[thid]->_capacity, now_j);
+	return;
+    }
     shift_heap_best_effort(now_j);
     Vector<IPRewriterFlow *> &best_effort_heap = _heap[thid]->_heaps[0];
     while (best_effort_heap.size() && best_effort_heap[0]->expired(now_j))
@@ -434,7 +676,10 @@ IPRewriterBase::gc_timer_hook(Timer *t, void *user_data)
 {
     IPRewriterBase *rw = static_cast<IPRewriterBase *>(user_data);
     rw->shrink_heap(false, click_current_cpu_id());
-    if (rw->_gc_interval_sec)
+    IPRewriterHeap *heap = rw->_heap[click_current_cpu_id()];
+    if (heap->wheel())
+        t->reschedule_after(Timestamp::make_jiffies(heap->wheel_tick()));
+    else if (rw->_gc_interval_sec)
         t->reschedule_after_sec(rw->_gc_interval_sec);
 }
 
@@ -513,6 +758,18 @@ IPRewriterBase::write_handler(const String &str, Element *e, void *user_data, Er
     } else if (what == h_clear) {
 	rw->shrink_heap(true, click_current_cpu_id());
 	return 0;
+#if CLICK_USERLEVEL
+    } else if (what == h_snapshot || what == h_restore) {
+	String path;
+	if (Args(e, errh).push_back_words(str)
+	    .read_mp("FILE", FilenameArg(), path)
+	    .complete() < 0)
+	    return -1;
+	if (what == h_snapshot)
+	    return rw->snapshot(path, errh);
+	else
+	    return rw->restore(path, errh);
+#endif
     } else
 	return -1;
 }
@@ -530,6 +787,22 @@ IPRewriterBase::pattern_write_handler(const String &str, Element *e, void *user_
     assert(click_current_cpu_id() == 0); //MT to be reviewed
 
 	// remove all existing flows created by this input
+	IPRewriterHeap *heap = rw->_heap[click_current_cpu_id()];
+	for (int i = 0; i < heap->_wheel.size() + heap->_wheel_far.size() + 1; i++) {
+	    IPRewriterFlow *mf;
+	    if (i < heap->_wheel.size())
+		mf = heap->_wheel[i];
+	    else if (i - heap->_wheel.size() < heap->_wheel_far.size())
+		mf = heap->_wheel_far[i - heap->_wheel.size()];
+	    else
+		mf = heap->_wheel_overflow;
+	    while (mf) {
+		IPRewriterFlow *next = mf->_wheel_next;
+		if (mf->owner() == spec)
+		    mf->destroy(heap);
+		mf = next;
+	    }
+	}
 	for (int which_heap = 0; which_heap < 2; ++which_heap) {
 	    Vector<IPRewriterFlow *> &myheap = rw->_heap[click_current_cpu_id()]->_heaps[which_heap]; //TODO : Same comment about MT
 	    for (int i = myheap.size() - 1; i >= 0; --i)
@@ -548,6 +821,139 @@ IPRewriterBase::pattern_write_handler(const String &str, Element *e, void *user_
     return 0;
 }
 
+#if CLICK_USERLEVEL
+
+static uint32_t
+snapshot_layout(IPRewriterBase *rw)
+{
+    uint32_t h = flow_snapshot_layout(FLOW_SNAPSHOT_LAYOUT_INIT, rw->class_name());
+    return flow_snapshot_layout(h, (uint32_t) rw->ninputs());
+}
+
+/**
+ * Save the flows created by this element, that is the forward entries of
+ * all thread-local maps. TCP sequence number translations are not saved.
+ */
+int
+IPRewriterBase::snapshot(const String &path, ErrorHandler *errh)
+{
+    FlowSnapshotWriter w;
+    if (w.open(path, class_name(), sizeof(FlowSnapshotRecord) + sizeof(IPRewriterSnapshot), snapshot_layout(this), errh) < 0)
+	return -1;
+
+    click_jiffies_t now_j = click_jiffies();
+    for (unsigned i = 0; i < _state.weight(); i++) {
+	int thread = _state.get_mapping(i);
+	Vector<IPRewriterMapState *> states;
+	flow_states(thread, states);
+	for (int j = 0; j < states.size(); j++) {
+	    IPRewriterMapState *state = states[j];
+	    state->map_lock.read_begin();
+	    for (Map::iterator it = state->map.begin(); it != state->map.end(); ++it) {
+		IPRewriterFlow *mf = it->flow();
+		if (it->direction() || mf->owner()->owner != this || mf->expired(now_j))
+		    continue;
+		FlowSnapshotRecord *r = w.append();
+		r->expiry_msec = (uint64_t) (mf->expiry() - now_j) * 1000 / CLICK_HZ;
+		r->thread = thread;
+		IPRewriterSnapshot s;
+		s.flowid = it->flowid();
+		s.rewritten_flowid = it->rewritten_flowid();
+		s.ip_p = mf->ip_p();
+		s.input = mf->input();
+		s.guaranteed = mf->guaranteed();
+		memcpy(r->data(), &s, sizeof(s));
+	    }
+	    state->map_lock.read_end();
+	}
+    }
+    return w.commit(errh);
+}
+
+/**
+ * Load a snapshot. Flows are added back by the thread that owned them, or
+ * spread among our threads if it is not one of them anymore.
+ */
+int
+IPRewriterBase::restore(const String &path, ErrorHandler *errh)
+{
+    FlowSnapshotReader r;
+    if (r.open(path, class_name(), sizeof(FlowSnapshotRecord) + sizeof(IPRewriterSnapshot), snapshot_layout(this), errh) < 0)
+	return -1;
+
+    //One task per thread, reused by later restores
+    if (_restore_tasks.size() != (int) _state.weight())
+	_restore_tasks.resize(_state.weight(), 0);
+    for (int i = 0; i < _restore_tasks.size(); i++)
+	if (_restore_tasks[i] && static_cast<IPRewriterRestore *>(_restore_tasks[i]->user_data())->pending)
+	    return errh->error("a restore is still in progress");
+    for (int i = 0; i < _restore_tasks.size(); i++)
+	if (!_restore_tasks[i]) {
+	    IPRewriterRestore *restore = new IPRewriterRestore();
+	    restore->rw = this;
+	    restore->pending = 0;
+	    _restore_tasks[i] = new Task(restore_hook, restore, _state.get_mapping(i));
+	    ScheduleInfo::initialize_task(this, _restore_tasks[i], false, errh);
+	}
+
+    for (uint64_t i = 0; i < r.count(); i++) {
+	const FlowSnapshotRecord *rec = r.record(i);
+	uint32_t left = r.remaining_msec(rec);
+	if (left == 0)
+	    continue;
+	IPRewriterSnapshot s;
+	memcpy(&s, rec->data(), sizeof(s));
+	if (s.input >= _input_specs.size())
+	    continue;
+	int idx = -1;
+	for (unsigned j = 0; j < _state.weight(); j++)
+	    if (_state.get_mapping(j) == rec->thread)
+		idx = j;
+	if (idx < 0)
+	    idx = s.flowid.hashcode() % _state.weight();
+	IPRewriterRestore *restore = static_cast<IPRewriterRestore *>(_restore_tasks[idx]->user_data());
+	restore->flows.push_back(s);
+	restore->expiry_msec.push_back(left);
+    }
+
+    for (int i = 0; i < _restore_tasks.size(); i++) {
+	IPRewriterRestore *restore = static_cast<IPRewriterRestore *>(_restore_tasks[i]->user_data());
+	if (restore->flows.size()) {
+	    restore->pending = 1;
+	    _restore_tasks[i]->reschedule();
+	}
+    }
+    return 0;
+}
+
+bool
+IPRewriterBase::restore_hook(Task *, void *user_data)
+{
+    IPRewriterRestore *r = static_cast<IPRewriterRestore *>(user_data);
+    IPRewriterBase *rw = r->rw;
+    Vector<IPRewriterMapState *> states;
+    rw->flow_states(click_current_cpu_id(), states);
+    click_jiffies_t now_j = click_jiffies();
+    for (int i = 0; i < r->flows.size(); i++) {
+	const IPRewriterSnapshot &s = r->flows[i];
+	bool exists = false;
+	for (int j = 0; j < states.size() && !exists; j++)
+	    exists = states[j]->map.get(s.flowid);
+	if (exists) //The flow came back before the snapshot was restored
+	    continue;
+	IPRewriterEntry *m = rw->add_flow(s.ip_p, s.flowid, s.rewritten_flowid, s.input);
+	if (!m)
+	    continue;
+	click_jiffies_t expiry_j = now_j + (click_jiffies_t) ((uint64_t) r->expiry_msec[i] * CLICK_HZ / 1000);
+	m->flow()->change_expiry(rw->_heap[click_current_cpu_id()], s.guaranteed, expiry_j);
+    }
+    r->flows.clear();
+    r->expiry_msec.clear();
+    r->pending = 0;
+    return true;
+}
+#endif
+
 void
 IPRewriterBase::add_rewriter_handlers(bool writable_patterns)
 {
@@ -559,6 +965,10 @@ IPRewriterBase::add_rewriter_handlers(bool writable_patterns)
     add_read_handler("capacity", read_handler, h_capacity);
     add_write_handler("capacity", write_handler, h_capacity);
     add_write_handler("clear", write_handler, h_clear);
+#if CLICK_USERLEVEL
+    add_write_handler("snapshot", write_handler, h_snapshot);
+    add_write_handler("restore", write_handler, h_restore);
+#endif
     for (int i = 0; i < ninputs(); ++i) {
 	String name = "pattern" + String(i);
 	add_read_handler(name, read_handler, i);
@@ -44,10 +44,26 @@ class IPRewriterInput { public:
 			      Packet *p, int mapid = mapid_default);
 };
 
+/**
+ * Expiry order of the flows of a rewriter
+ *
+ * By default flows are kept in two binary heaps, one for guaranteed and one
+ * for best-effort flows. With a timer wheel, flows are instead linked in the
+ * slot of their expiry time. Inserting a flow and refreshing its timeout are
+ * O(1): a refreshed flow stays in its slot and is moved forward when the slot
+ * is reached, so slots are reclaimed as time passes, one list at a time.
+ * Expiry times beyond the span of the wheel go to a second level with one
+ * slot per revolution, moved down to the wheel when their revolution starts,
+ * and times beyond that to an overflow list sorted out at each revolution.
+ * When the table is full, the victim is the first best-effort flow of the
+ * earliest slot that has one, which is only approximately the next one to
+ * expire. The wheel links cost two pointers per flow, also with heaps.
+ */
 class IPRewriterHeap { public:
 
     IPRewriterHeap()
-	: _capacity(0x7FFFFFFF), _use_count(1) {
+	: _capacity(0x7FFFFFFF), _use_count(1), _wheel_overflow(0), _wheel_shift(0),
+	  _wheel_span_shift(0), _wheel_count(0), _wheel_now_j(0), _wheel_evict_j(0) {
     }
     ~IPRewriterHeap() {
 	assert(size() == 0);
@@ -63,12 +79,34 @@ class IPRewriterHeap { public:
     }
 
     Vector<IPRewriterFlow *>::size_type size() const {
-	    return _heaps[0].size() + _heaps[1].size();
+	    return _heaps[0].size() + _heaps[1].size() + _wheel_count;
     }
     int32_t capacity() const {
 	return _capacity;
     }
 
+    /** @brief Use a timer wheel of 2^@a order slots of about @a tick_j
+     * jiffies instead of the heaps, and a second level of 2^@a far_order
+     * revolutions. Must be called while empty. */
+    void set_wheel(int order, int far_order, click_jiffies_t tick_j);
+
+    bool wheel() const {
+	return _wheel_shift != 0;
+    }
+
+    /** @brief Length of a wheel slot in jiffies */
+    click_jiffies_t wheel_tick() const {
+	return (click_jiffies_t) 1 << _wheel_shift;
+    }
+
+    /** @brief Length of a revolution of the wheel in jiffies */
+    click_jiffies_t wheel_span() const {
+	return (click_jiffies_t) 1 << _wheel_span_shift;
+    }
+
+    inline void wheel_insert(IPRewriterFlow *flow);
+    inline void wheel_unlink(IPRewriterFlow *flow);
+
   private:
 
     enum {
@@ -78,18 +116,104 @@ class IPRewriterHeap { public:
     int32_t _capacity;
     uint32_t _use_count;
 
+    enum {
+	wheel_near = 0, wheel_far = 1, wheel_overflow = 2
+    };
+    // Slots are FIFO lists, with the address of the last next pointer
+    Vector<IPRewriterFlow *> _wheel;
+    Vector<IPRewriterFlow **> _wheel_last;
+    Vector<IPRewriterFlow *> _wheel_far; // One slot per revolution of _wheel
+    Vector<IPRewriterFlow **> _wheel_far_last;
+    IPRewriterFlow *_wheel_overflow;	 // Beyond the revolutions of _wheel_far
+    IPRewriterFlow **_wheel_overflow_last;
+    int _wheel_shift;
+    int _wheel_span_shift;
+    uint32_t _wheel_count;
+    click_jiffies_t _wheel_now_j; // Start of the first slot not reclaimed
+    click_jiffies_t _wheel_evict_j; // No best-effort flow in the next slots before
+
+    int wheel_index(click_jiffies_t j) const {
+	return (j >> _wheel_shift) & (_wheel.size() - 1);
+    }
+    int wheel_far_index(click_jiffies_t j) const {
+	return (j >> _wheel_span_shift) & (_wheel_far.size() - 1);
+    }
+    IPRewriterFlow **&wheel_last(IPRewriterFlow *flow) {
+	// _place holds the low 32 bits of the slot start, enough for the index
+	if (flow->_wheel_level == wheel_near)
+	    return _wheel_last.unchecked_at(wheel_index(flow->_place));
+	else if (flow->_wheel_level == wheel_far)
+	    return _wheel_far_last.unchecked_at(wheel_far_index(flow->_place));
+	else
+	    return _wheel_overflow_last;
+    }
+    inline IPRewriterFlow *wheel_detach(IPRewriterFlow *&slot, IPRewriterFlow **&last);
+
     friend class IPRewriterBase;
     friend class IPRewriterFlow;
 
 };
 
+inline void
+IPRewriterHeap::wheel_insert(IPRewriterFlow *flow)
+{
+    click_jiffies_t j = flow->_expiry_j;
+    if (click_jiffies_less(j, _wheel_now_j))
+	j = _wheel_now_j;
+    if (j - _wheel_now_j < wheel_span()) {
+	flow->_wheel_level = wheel_near;
+	flow->_place = j & ~(wheel_tick() - 1);
+	if (!flow->_guaranteed && click_jiffies_less(j, _wheel_evict_j))
+	    _wheel_evict_j = j & ~(wheel_tick() - 1);
+    } else {
+	click_jiffies_t rev_j = _wheel_now_j & ~(wheel_span() - 1);
+	if (((j - rev_j) >> _wheel_span_shift) < (click_jiffies_t) _wheel_far.size()) {
+	    flow->_wheel_level = wheel_far;
+	    flow->_place = j & ~(wheel_span() - 1);
+	} else {
+	    flow->_wheel_level = wheel_overflow;
+	    flow->_place = rev_j + (_wheel_far.size() << _wheel_span_shift);
+	}
+    }
+    IPRewriterFlow **&tail = wheel_last(flow);
+    flow->_wheel_next = 0;
+    flow->_wheel_pprev = tail;
+    *tail = flow;
+    tail = &flow->_wheel_next;
+    ++_wheel_count;
+}
+
+inline void
+IPRewriterHeap::wheel_unlink(IPRewriterFlow *flow)
+{
+    if (!flow->_wheel_pprev)
+	return;
+    *flow->_wheel_pprev = flow->_wheel_next;
+    if (flow->_wheel_next)
+	flow->_wheel_next->_wheel_pprev = flow->_wheel_pprev;
+    else
+	wheel_last(flow) = flow->_wheel_pprev;
+    flow->_wheel_pprev = 0;
+    --_wheel_count;
+}
+
+/** @brief Empty a slot and return its flows, still linked to each other */
+inline IPRewriterFlow *
+IPRewriterHeap::wheel_detach(IPRewriterFlow *&slot, IPRewriterFlow **&last)
+{
+    IPRewriterFlow *list = slot;
+    slot = 0;
+    last = &slot;
+    return list;
+}
+
 #define THREAD_MIGRATION_TIMEOUT 10000
 
 /**
  * Base for Rewriter elements
  *
  * Flows are kept in a Map, implemented by y a hashtable. That is for efficient flow lookup.
- * For expiration, flows are kept in a heap.
+ * For expiration, flows are kept in a heap, or a timer wheel with TIMER_WHEEL.
  */
 class IPRewriterBase : public BatchElement { public:
 
@@ -170,15 +294,28 @@ class IPRewriterBase : public BatchElement { public:
 	    Timer gc_timer;
     };
 
+    /**
+     * Thread-local states holding flows of thread @a thread. Rewriters with
+     * their own maps, like IPRewriter for UDP, add them here so they are
+     * part of snapshots.
+     */
+    virtual void flow_states(int thread, Vector<IPRewriterMapState *> &states) {
+	states.push_back(&_state.get_value_for_thread(thread));
+    }
+
     template<class T = IPRewriterState> static inline IPRewriterEntry *search_migrate_entry(const IPFlowID &flowid, per_thread<T> &vstate);
 
     template <class T = IPRewriterState> inline void set_migration(const bool &up, const Bitvector& threads, per_thread<T> &vstate);
 
     Vector<IPRewriterInput> _input_specs;
     IPRewriterHeap **_heap;
+#if CLICK_USERLEVEL
+    Vector<Task *> _restore_tasks;
+#endif
     uint32_t **_timeouts;
 
     uint32_t _gc_interval_sec;
+    bool _timer_wheel;
     per_thread<IPRewriterState> _state;
 
     bool _set_aggregate;
@@ -188,7 +325,9 @@ class IPRewriterBase : public BatchElement { public:
     enum {
 	default_timeout = 300,	   // 5 minutes
 	default_guarantee = 5,	   // 5 seconds
-	default_gc_interval = 60 * 15 // 15 minutes
+	default_gc_interval = 60 * 15, // 15 minutes
+	wheel_order = 12,	   // 4096 slots of about a second
+	wheel_far_order = 6	   // then 64 revolutions, about 3 days
     };
 
     static uint32_t relevant_timeout(const uint32_t timeouts[2]) {
@@ -207,11 +346,17 @@ class IPRewriterBase : public BatchElement { public:
 
     enum {			// < 0 because individual patterns are >= 0
 	h_nmappings = -1, h_mapping_failures = -2, h_patterns = -3,
-	h_size = -4, h_capacity = -5, h_clear = -6
+	h_size = -4, h_capacity = -5, h_clear = -6,
+	h_snapshot = -7, h_restore = -8
     };
     static String read_handler(Element *e, void *user_data) CLICK_COLD;
     static int write_handler(const String &str, Element *e, void *user_data, ErrorHandler *errh) CLICK_COLD;
     static int pattern_write_handler(const String &str, Element *e, void *user_data, ErrorHandler *errh) CLICK_COLD;
+#if CLICK_USERLEVEL
+    int snapshot(const String &path, ErrorHandler *errh) CLICK_COLD;
+    int restore(const String &path, ErrorHandler *errh) CLICK_COLD;
+    static bool restore_hook(Task *t, void *user_data) CLICK_COLD;
+#endif
 
     friend int IPRewriterInput::rewrite_flowid(const IPFlowID &flowid,
 			IPFlowID &rewritten_flowid, Packet *p, int mapid);
@@ -221,6 +366,14 @@ class IPRewriterBase : public BatchElement { public:
     void shift_heap_best_effort(click_jiffies_t now_j);
     bool shrink_heap_for_new_flow(IPRewriterFlow *flow, click_jiffies_t now_j);
     void shrink_heap(bool clear_all, int thid);
+    void advance_wheel(IPRewriterHeap *heap, click_jiffies_t now_j);
+    void wheel_requeue(IPRewriterHeap *heap, IPRewriterFlow *list,
+		       click_jiffies_t now_j);
+    IPRewriterFlow *wheel_victim(IPRewriterHeap *heap, IPRewriterFlow *&slot,
+				 click_jiffies_t end_j, click_jiffies_t now_j,
+				 bool guaranteed);
+    bool shrink_wheel(IPRewriterHeap *heap, int32_t capacity, click_jiffies_t now_j,
+		      IPRewriterFlow *flow = 0);
 
     friend class IPRewriterFlow;
 
@@ -39,7 +39,7 @@ IPRewriterFlow::IPRewriterFlow(IPRewriterInput *owner, const IPFlowID &flowid,
 				   uint8_t input)
     : _expiry_j(expiry_j), _ip_p(ip_p), _tflags(0),
       _guaranteed(guaranteed), _reply_anno(0),
-      _owner(owner), _input(input)
+      _owner(owner), _input(input), _wheel_level(0), _wheel_next(0), _wheel_pprev(0)
 {
     _e[0].initialize(flowid, owner->foutput, false);
     _e[1].initialize(rewritten_flowid.reverse(), owner->routput, true);
@@ -96,6 +96,18 @@ void
 IPRewriterFlow::change_expiry(IPRewriterHeap *h, bool guaranteed,
 			      click_jiffies_t expiry_j)
 {
+    if (h->wheel()) {
+	// A flow losing its guarantee is moved so the eviction walk sees it
+	bool lost_guarantee = _guaranteed && !guaranteed;
+	_expiry_j = expiry_j;
+	_guaranteed = guaranteed;
+	// _place holds the low 32 bits of the slot start
+	if (lost_guarantee || (int32_t) ((uint32_t) expiry_j - (uint32_t) _place) < 0) {
+	    h->wheel_unlink(this);
+	    h->wheel_insert(this);
+	}
+	return;
+    }
     Vector<IPRewriterFlow *> &current_heap = h->_heaps[_guaranteed];
     assert(current_heap[_place] == this);
     _expiry_j = expiry_j;
@@ -118,6 +130,12 @@ IPRewriterFlow::change_expiry(IPRewriterHeap *h, bool guaranteed,
 void
 IPRewriterFlow::destroy(IPRewriterHeap *heap)
 {
+    if (heap->wheel()) {
+	heap->wheel_unlink(this);
+	--_owner->count;
+	_owner->owner->destroy_flow(this);
+	return;
+    }
     Vector<IPRewriterFlow *> &myheap = heap->_heaps[_guaranteed];
     remove_heap(myheap.begin(), myheap.end(), myheap.begin() + _place,
 		heap_less(), heap_place());
@@ -97,6 +97,10 @@ class IPRewriterFlow { public:
 
     /** @brief Set expiration time to @a expiry_j.
      * @param h heap containing this flow
+     *
+     * With a timer wheel, the flow only moves if it now expires before its
+     * slot or loses its guarantee, later expiry times are found when the
+     * slot is reached.
      * @param guaranteed whether the flow is guaranteed
      * @param expiry_j expiration time in absolute jiffies */
     void change_expiry(IPRewriterHeap *h, bool guaranteed,
@@ -165,17 +169,21 @@ class IPRewriterFlow { public:
     uint16_t _ip_csum_delta;
     uint16_t _udp_csum_delta;
     click_jiffies_t _expiry_j;
-    size_t _place : 32;
+    size_t _place : 32; // Heap index, or start of the wheel slot
     uint8_t _ip_p;
     uint8_t _tflags;
     bool _guaranteed;
     uint8_t _reply_anno;
     uint8_t _input;
+    uint8_t _wheel_level; // Level of the timer wheel holding the flow
     IPRewriterInput *_owner;
     uint32_t _agg;
+    IPRewriterFlow *_wheel_next; // Timer wheel links, unused with heaps
+    IPRewriterFlow **_wheel_pprev;
 
     friend class IPRewriterBase;
     friend class IPRewriterEntry;
+    friend class IPRewriterHeap;
 
   private:
 
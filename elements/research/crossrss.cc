@@ -96,6 +96,8 @@ int CrossRSS::initialize(ErrorHandler *errh)
 bool CrossRSS::new_flow(CrossRSSEntry* flowdata, Packet* p)
 {
     int server = pick_server(p);
+    if (unlikely(server == no_server))
+        return false;
 /*
     auto & wh = _weights_helper.read_begin();
     int hash = hash_4tuple(p, wh.size());
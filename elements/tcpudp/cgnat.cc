@@ -0,0 +1,461 @@
+/*
+ * cgnat.{cc,hh} -- carrier-grade NAT with endpoint-independent mappings
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "cgnat.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/packetbatch.hh>
+#include <clicknet/ip.h>
+#include <clicknet/tcp.h>
+#include <clicknet/udp.h>
+CLICK_DECLS
+
+CGNAT::CGNAT() : _block_size(256), _max_blocks(4), _blocks_per_addr(0), _port_min(1024),
+    _tcp_timeout(7440), _udp_timeout(300), _gc_interval(60), _log(false),
+    _deterministic(false)
+{
+}
+
+CGNAT::~CGNAT()
+{
+}
+
+int
+CGNAT::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    if (Args(conf, this, errh)
+        .read_all("ADDR", Args::mandatory | Args::positional, DefaultArg<Vector<IPAddress>>(), _addrs)
+        .read("BLOCK_SIZE", _block_size)
+        .read("MAX_BLOCKS", _max_blocks)
+        .read("SUBSCRIBERS", IPPrefixArg(true), _subscribers, _subscribers_mask)
+            .read_status(_deterministic)
+        .read("PORT_MIN", _port_min)
+        .read("TCP_TIMEOUT", _tcp_timeout)
+        .read("UDP_TIMEOUT", _udp_timeout)
+        .read("GC_INTERVAL", _gc_interval)
+        .read("LOG", _log)
+        .complete() < 0)
+        return -1;
+
+    if (_port_min == 0)
+        return errh->error("PORT_MIN must be positive");
+    if (_block_size == 0 || _block_size > 65536U - _port_min)
+        return errh->error("BLOCK_SIZE must be between 1 and %d", 65536 - _port_min);
+    if (_max_blocks == 0)
+        return errh->error("MAX_BLOCKS must be positive");
+
+    _blocks_per_addr = (65536 - _port_min) / _block_size;
+    for (int i = 0; i < _addrs.size(); i++) {
+        if (_addr_index.find(_addrs[i]) != _addr_index.end())
+            return errh->error("address %s given twice", _addrs[i].unparse().c_str());
+        _addr_index[_addrs[i]] = i;
+    }
+
+    if (_deterministic) {
+        int len = _subscribers_mask.mask_to_prefix_len();
+        if (len < 0)
+            return errh->error("SUBSCRIBERS must be a prefix");
+        uint64_t nsub = (uint64_t) 1 << (32 - len);
+        uint64_t capacity = (uint64_t) _blocks_per_addr * _addrs.size() / _max_blocks;
+        if (nsub > capacity)
+            return errh->error("SUBSCRIBERS has %llu addresses, but ADDR only has blocks for %llu subscribers",
+                               (unsigned long long) nsub, (unsigned long long) capacity);
+        _subscribers &= _subscribers_mask;
+    }
+
+    _tcp_timeout *= CLICK_HZ;
+    _udp_timeout *= CLICK_HZ;
+    return 0;
+}
+
+int
+CGNAT::initialize(ErrorHandler *errh)
+{
+    Bitvector passing = get_passing_threads();
+    if (passing.weight() == 0)
+        return errh->warning("No thread passing by, element will not work if it's not indeed idle");
+
+    Vector<int> threads;
+    for (int i = 0; i < passing.size(); i++)
+        if (passing[i])
+            threads.push_back(i);
+
+    _blocks.resize(_addrs.size() * _blocks_per_addr);
+    for (int i = 0; i < _blocks.size(); i++) {
+        CGNATBlock &b = _blocks[i];
+        b.addr = _addrs[i / _blocks_per_addr];
+        b.first_port = _port_min + (i % _blocks_per_addr) * _block_size;
+        b.thread = threads[i % threads.size()];
+        b.used = 0;
+        b.hint = 0;
+        b.subscriber = 0;
+        b.mappings = new CGNATMapping[_block_size];
+        memset(b.mappings, 0, sizeof(CGNATMapping) * _block_size);
+    }
+
+    //Pools are filled backward so blocks are given in order. A deterministic
+    //allocation has no pool, the blocks are found from the subscriber.
+    for (int i = _deterministic ? -1 : _blocks.size() - 1; i >= 0; i--) {
+        CGNATState &s = _state.get_value_for_thread(_blocks[i].thread);
+        _blocks[i].next_free = s.free_blocks;
+        s.free_blocks = &_blocks[i];
+    }
+
+    for (int i = 0; i < threads.size(); i++) {
+        Timer &t = _state.get_value_for_thread(threads[i]).gc_timer;
+        new(&t) Timer(gc_timer_hook, this); //Reconstruct as Timer does not allow assignment
+        t.initialize(this);
+        t.move_thread(threads[i]);
+        if (_gc_interval)
+            t.schedule_after_sec(_gc_interval);
+    }
+    return 0;
+}
+
+void
+CGNAT::cleanup(CleanupStage)
+{
+    for (unsigned i = 0; i < _state.weight(); i++) {
+        CGNATState &s = _state.get_value(i);
+        for (auto it = s.subscribers.begin(); it != s.subscribers.end(); ++it)
+            delete it.value();
+        s.subscribers.clear();
+    }
+    for (int i = 0; i < _blocks.size(); i++)
+        delete[] _blocks[i].mappings;
+    _blocks.clear();
+}
+
+inline uint32_t
+CGNAT::timeout(uint8_t proto) const
+{
+    return proto == IP_PROTO_TCP ? _tcp_timeout : _udp_timeout;
+}
+
+/**
+ * Give a free block of the thread to a subscriber, or with a deterministic
+ * allocation the first block of the subscriber it does not have yet
+ */
+CGNATBlock*
+CGNAT::new_block(CGNATState &state, CGNATSubscriber *sub)
+{
+    CGNATBlock* b = 0;
+    if (_deterministic) {
+        if ((sub->addr & _subscribers_mask) != _subscribers)
+            return 0;
+        uint32_t n = ntohl(sub->addr.addr()) - ntohl(_subscribers.addr());
+        for (unsigned i = 0; i < _max_blocks; i++)
+            if (!_blocks[n * _max_blocks + i].subscriber) {
+                b = &_blocks[n * _max_blocks + i];
+                break;
+            }
+        if (!b)
+            return 0;
+    } else {
+        b = state.free_blocks;
+        if (!b)
+            return 0;
+        state.free_blocks = b->next_free;
+    }
+    b->next_free = 0;
+    b->subscriber = sub;
+    b->used = 0;
+    b->hint = 0;
+    sub->blocks.push_back(b);
+    state.nblocks++;
+    if (_log)
+        click_chatter("%p{element}: %s %s %s:%d-%d allocated", this,
+                      Timestamp::now().unparse().c_str(), sub->addr.unparse().c_str(),
+                      b->addr.unparse().c_str(), b->first_port, b->first_port + _block_size - 1);
+    return b;
+}
+
+/**
+ * Return an unused block to the pool of its thread
+ */
+void
+CGNAT::release_block(CGNATState &state, CGNATBlock *b)
+{
+    CGNATSubscriber* sub = b->subscriber;
+    if (_log)
+        click_chatter("%p{element}: %s %s %s:%d-%d released", this,
+                      Timestamp::now().unparse().c_str(), sub->addr.unparse().c_str(),
+                      b->addr.unparse().c_str(), b->first_port, b->first_port + _block_size - 1);
+    for (int i = 0; i < sub->blocks.size(); i++)
+        if (sub->blocks[i] == b) {
+            sub->blocks[i] = sub->blocks.back();
+            sub->blocks.pop_back();
+            break;
+        }
+    b->subscriber = 0;
+    if (!_deterministic) {
+        b->next_free = state.free_blocks;
+        state.free_blocks = b;
+    }
+    state.nblocks--;
+    if (sub->blocks.empty()) {
+        state.subscribers.erase(sub->addr);
+        delete sub;
+    }
+}
+
+/**
+ * Map an internal endpoint to a port of its subscriber. Return the index of
+ * the external port, or -1.
+ */
+int
+CGNAT::new_mapping(CGNATState &state, IPAddress src, uint16_t sport, uint8_t proto, click_jiffies_t now)
+{
+    CGNATSubscriber* sub = state.subscribers.get(src);
+    if (!sub) {
+        sub = new CGNATSubscriber();
+        sub->addr = src;
+        state.subscribers.set(src, sub);
+    }
+
+    CGNATBlock* block = 0;
+    int offset = -1;
+    for (int i = 0; i < sub->blocks.size() && offset < 0; i++) {
+        CGNATBlock* b = sub->blocks[i];
+        if (b->used == _block_size)
+            continue;
+        for (unsigned n = 0; n < _block_size; n++) {
+            unsigned o = b->hint + n;
+            if (o >= _block_size)
+                o -= _block_size;
+            if (!b->mappings[o].endpoint) {
+                block = b;
+                offset = o;
+                break;
+            }
+        }
+    }
+
+    if (offset < 0 && (unsigned)sub->blocks.size() < _max_blocks) {
+        block = new_block(state, sub);
+        if (block)
+            offset = 0;
+    }
+
+    //Take over an expired mapping that was not collected yet
+    for (int i = 0; i < sub->blocks.size() && offset < 0; i++) {
+        CGNATBlock* b = sub->blocks[i];
+        for (unsigned o = 0; o < _block_size; o++) {
+            CGNATMapping &m = b->mappings[o];
+            if (m.endpoint && click_jiffies_less(m.expiry, now)) {
+                state.mappings.erase(m.endpoint);
+                m.endpoint = 0;
+                b->used--;
+                block = b;
+                offset = o;
+                break;
+            }
+        }
+    }
+
+    if (offset < 0) {
+        if (sub->blocks.empty()) {
+            state.subscribers.erase(src);
+            delete sub;
+        }
+        return -1;
+    }
+
+    CGNATMapping &m = block->mappings[offset];
+    uint64_t endpoint = endpoint_key(src.addr(), sport, proto);
+    m.expiry = now + timeout(proto);
+    m.endpoint = endpoint;
+    block->used++;
+    block->hint = offset + 1 == _block_size ? 0 : offset + 1;
+    uint32_t index = (block - _blocks.begin()) * _block_size + offset;
+    state.mappings[endpoint] = index;
+    return index;
+}
+
+inline Packet*
+CGNAT::process_out(Packet *p)
+{
+    const click_ip* iph = p->ip_header();
+    if ((iph->ip_p != IP_PROTO_TCP && iph->ip_p != IP_PROTO_UDP)
+        || !IP_FIRSTFRAG(iph) || p->transport_length() < (iph->ip_p == IP_PROTO_TCP ? 18 : 8) || !iph->ip_src.s_addr) {
+        p->kill();
+        return 0;
+    }
+
+    CGNATState &state = *_state;
+    uint16_t sport = p->udp_header()->uh_sport;
+    uint64_t endpoint = endpoint_key(iph->ip_src.s_addr, sport, iph->ip_p);
+    click_jiffies_t now = click_jiffies();
+    int index;
+    auto it = state.mappings.find(endpoint);
+    if (it != state.mappings.end()) {
+        index = it.value();
+        _blocks[index / _block_size].mappings[index % _block_size].expiry = now + timeout(iph->ip_p);
+    } else {
+        index = new_mapping(state, iph->ip_src, sport, iph->ip_p, now);
+        if (index < 0) {
+            state.failures++;
+            p->kill();
+            return 0;
+        }
+    }
+
+    WritablePacket* q = p->uniqueify();
+    if (!q)
+        return 0;
+    const CGNATBlock &b = _blocks[index / _block_size];
+    bool tcp = q->ip_header()->ip_p == IP_PROTO_TCP;
+    bool nocsum = !tcp && q->udp_header()->uh_sum == 0;
+    q->rewrite_ipport(b.addr, htons(b.first_port + index % _block_size), 0, tcp);
+    if (nocsum)
+        q->udp_header()->uh_sum = 0;
+    return q;
+}
+
+inline Packet*
+CGNAT::process_in(Packet *p)
+{
+    const click_ip* iph = p->ip_header();
+    int* addr;
+    if ((iph->ip_p != IP_PROTO_TCP && iph->ip_p != IP_PROTO_UDP)
+        || !IP_FIRSTFRAG(iph) || p->transport_length() < (iph->ip_p == IP_PROTO_TCP ? 18 : 8)
+        || !(addr = _addr_index.get_pointer(IPAddress(iph->ip_dst)))) {
+        p->kill();
+        return 0;
+    }
+
+    uint16_t dport = ntohs(p->udp_header()->uh_dport);
+    if (dport < _port_min || (unsigned)(dport - _port_min) >= _blocks_per_addr * _block_size) {
+        p->kill();
+        return 0;
+    }
+    unsigned i = dport - _port_min;
+    CGNATMapping &m = _blocks[*addr * _blocks_per_addr + i / _block_size].mappings[i % _block_size];
+
+    //Endpoint-independent filtering: any source may use the mapping
+    uint64_t endpoint = *(volatile uint64_t*)&m.endpoint;
+    click_jiffies_t now = click_jiffies();
+    if (!endpoint || (uint8_t)endpoint != iph->ip_p || click_jiffies_less(m.expiry, now)) {
+        p->kill();
+        return 0;
+    }
+    m.expiry = now + timeout(iph->ip_p);
+
+    WritablePacket* q = p->uniqueify();
+    if (!q)
+        return 0;
+    bool tcp = q->ip_header()->ip_p == IP_PROTO_TCP;
+    bool nocsum = !tcp && q->udp_header()->uh_sum == 0;
+    q->rewrite_ipport(IPAddress((uint32_t)(endpoint >> 32)), (uint16_t)(endpoint >> 8), 1, tcp);
+    if (nocsum)
+        q->udp_header()->uh_sum = 0;
+    q->set_dst_ip_anno(q->ip_header()->ip_dst);
+    return q;
+}
+
+void
+CGNAT::push(int port, Packet *p)
+{
+    Packet* q = port == 0 ? process_out(p) : process_in(p);
+    if (q)
+        output_push(port, q);
+}
+
+#if HAVE_BATCH
+void
+CGNAT::push_batch(int port, PacketBatch *batch)
+{
+    if (port == 0) {
+        EXECUTE_FOR_EACH_PACKET_DROPPABLE([this](Packet* p) { return process_out(p); }, batch, [](Packet*){});
+    } else {
+        EXECUTE_FOR_EACH_PACKET_DROPPABLE([this](Packet* p) { return process_in(p); }, batch, [](Packet*){});
+    }
+    if (batch)
+        output_push_batch(port, batch);
+}
+#endif
+
+/**
+ * Remove the expired mappings of the thread, and return the blocks left
+ * without mappings
+ */
+void
+CGNAT::gc(CGNATState &state)
+{
+    click_jiffies_t now = click_jiffies();
+    for (auto it = state.mappings.begin(); it != state.mappings.end(); ) {
+        uint32_t index = it.value();
+        CGNATBlock* b = &_blocks[index / _block_size];
+        CGNATMapping &m = b->mappings[index % _block_size];
+        if (!click_jiffies_less(m.expiry, now)) {
+            ++it;
+            continue;
+        }
+        it = state.mappings.erase(it);
+        m.endpoint = 0;
+        if (--b->used == 0)
+            release_block(state, b);
+    }
+}
+
+void
+CGNAT::gc_timer_hook(Timer *t, void *user_data)
+{
+    CGNAT* nat = static_cast<CGNAT*>(user_data);
+    nat->gc(*nat->_state);
+    t->reschedule_after_sec(nat->_gc_interval);
+}
+
+enum {
+    h_subscribers, h_mappings, h_blocks, h_failures
+};
+
+String
+CGNAT::read_handler(Element *e, void *user_data)
+{
+    CGNAT* nat = static_cast<CGNAT*>(e);
+    uint64_t n = 0;
+    for (unsigned i = 0; i < nat->_state.weight(); i++) {
+        const CGNATState &s = nat->_state.get_value(i);
+        switch ((intptr_t)user_data) {
+        case h_subscribers:
+            n += s.subscribers.size();
+            break;
+        case h_mappings:
+            n += s.mappings.size();
+            break;
+        case h_blocks:
+            n += s.nblocks;
+            break;
+        case h_failures:
+            n += s.failures;
+            break;
+        }
+    }
+    return String(n);
+}
+
+void
+CGNAT::add_handlers()
+{
+    add_read_handler("subscribers", read_handler, h_subscribers);
+    add_read_handler("mappings", read_handler, h_mappings);
+    add_read_handler("blocks", read_handler, h_blocks);
+    add_read_handler("failures", read_handler, h_failures);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(CGNAT)
+ELEMENT_MT_SAFE(CGNAT)
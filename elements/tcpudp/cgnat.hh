@@ -0,0 +1,226 @@
+#ifndef CLICK_CGNAT_HH
+#define CLICK_CGNAT_HH
+#include <click/batchelement.hh>
+#include <click/multithread.hh>
+#include <click/hashtable.hh>
+#include <click/ipaddress.hh>
+#include <click/timer.hh>
+#include <click/vector.hh>
+CLICK_DECLS
+
+/*
+=c
+
+CGNAT(ADDR, [I<keywords> BLOCK_SIZE, MAX_BLOCKS, SUBSCRIBERS, PORT_MIN, TCP_TIMEOUT, UDP_TIMEOUT, GC_INTERVAL, LOG])
+
+=s tcpudp
+
+carrier-grade NAT with endpoint-independent mappings and port blocks
+
+=d
+
+Translates TCP and UDP packets of subscribers to the external addresses ADDR
+with an endpoint-independent mapping and endpoint-independent filtering
+(RFC 4787 "full cone"): all the packets sent from an internal address and
+port use the same external address and port, whatever their destination,
+and any external host can send packets to the mapping once it exists.
+
+Packets from the subscribers arrive on input 0 and leave translated on
+output 0. Packets from outside arrive on input 1 and leave on output 1,
+translated back to the internal endpoint. Packets that are not TCP or UDP,
+packets too short for their TCP or UDP header, packets from outside that
+match no mapping, and packets of subscribers that have no port left are
+dropped.
+
+External ports are handed to subscribers in blocks of BLOCK_SIZE consecutive
+ports of one external address. A subscriber gets a new block when all the
+ports of its blocks are used, up to MAX_BLOCKS. A block is returned when all
+its mappings expired. With LOG, one line is printed when a block is given to
+a subscriber and when it is returned, which is enough to find the
+subscriber using any external address and port at any time, instead of one
+line per flow.
+
+With SUBSCRIBERS, the allocation is deterministic (RFC 7422) and needs no
+log at all. The blocks of all the ADDR are numbered in order, the first
+address of SUBSCRIBERS being subscriber 0, subscriber I<n> may only use the
+blocks I<n>*MAX_BLOCKS to (I<n>+1)*MAX_BLOCKS-1. Packets of subscribers out
+of SUBSCRIBERS are dropped. The blocks of the ADDR must be enough for
+MAX_BLOCKS blocks per address of SUBSCRIBERS.
+
+The blocks are split between the threads passing by the element at
+initialization, and each thread keeps its own subscribers and mappings, so
+the traffic from the subscribers should be dispatched to the threads by
+subscriber address. The packets from outside may be received by any thread,
+their port tells which block and mapping they go to.
+
+Only one mapping per internal endpoint is kept, instead of one per flow.
+
+Keyword arguments are:
+
+=over 8
+
+=item ADDR
+
+IP address. External address, can be given multiple times.
+
+=item BLOCK_SIZE
+
+Integer. Number of ports of a block. Default is 256.
+
+=item MAX_BLOCKS
+
+Integer. Maximal number of blocks of a subscriber. Default is 4.
+
+=item SUBSCRIBERS
+
+IP prefix. Addresses of the subscribers, for a deterministic allocation.
+Default is none, the blocks are given in the order subscribers need them.
+
+=item PORT_MIN
+
+Integer. Ports of the external addresses below PORT_MIN are not used.
+Default is 1024.
+
+=item TCP_TIMEOUT
+
+Integer. Seconds after which an idle TCP mapping expires. Default is 7440.
+
+=item UDP_TIMEOUT
+
+Integer. Seconds after which an idle UDP mapping expires. Default is 300.
+
+=item GC_INTERVAL
+
+Integer. Seconds between the removals of the expired mappings. Default is 60.
+
+=item LOG
+
+Boolean. Print a line for each block given or returned. Default is false.
+
+=back
+
+=h subscribers read-only
+
+Number of subscribers having at least one block.
+
+=h mappings read-only
+
+Number of mappings.
+
+=h blocks read-only
+
+Number of blocks in use.
+
+=h failures read-only
+
+Number of packets dropped because their subscriber had no port left.
+
+=e
+
+    nat :: CGNAT(ADDR 198.51.100.1, ADDR 198.51.100.2, BLOCK_SIZE 512, LOG true);
+    FromDevice(inside) -> Strip(14) -> CheckIPHeader -> [0]nat;
+    FromDevice(outside) -> Strip(14) -> CheckIPHeader -> [1]nat;
+
+=a
+
+IPRewriter, FlowIPNAT */
+
+/**
+ * One external port, with the internal endpoint it is mapped to. The endpoint
+ * is a single word, as given by CGNAT::endpoint_key(), so the side from
+ * outside can read it atomically from any thread.
+ */
+struct CGNATMapping {
+    uint64_t endpoint; // 0 if the port is free
+    click_jiffies_t expiry;
+};
+
+struct CGNATSubscriber;
+
+struct CGNATBlock {
+    IPAddress addr; // External address
+    uint16_t first_port; // First port, in host order
+    int thread; // Thread owning the block
+    unsigned used; // Number of mappings
+    unsigned hint; // Next port to look at
+    CGNATSubscriber* subscriber; // 0 if the block is free
+    CGNATBlock* next_free;
+    CGNATMapping* mappings;
+};
+
+struct CGNATSubscriber {
+    IPAddress addr;
+    Vector<CGNATBlock*> blocks;
+};
+
+class CGNAT : public BatchElement { public:
+
+    CGNAT() CLICK_COLD;
+    ~CGNAT() CLICK_COLD;
+
+    const char *class_name() const override	{ return "CGNAT"; }
+    const char *port_count() const override	{ return "2/2"; }
+    const char *processing() const override	{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) override CLICK_COLD;
+    int initialize(ErrorHandler *) override CLICK_COLD;
+    void cleanup(CleanupStage) override CLICK_COLD;
+    void add_handlers() override CLICK_COLD;
+
+    void push(int, Packet *) override;
+#if HAVE_BATCH
+    void push_batch(int, PacketBatch *) override;
+#endif
+
+    /**
+     * Key of an internal endpoint in the mapping table
+     */
+    static inline uint64_t endpoint_key(uint32_t ip, uint16_t port, uint8_t proto) {
+        return ((uint64_t) ip << 32) | ((uint32_t) port << 8) | proto;
+    }
+
+  private:
+
+    struct CGNATState {
+        CGNATState() : free_blocks(0), nblocks(0), failures(0) {
+        }
+        HashTable<IPAddress, CGNATSubscriber*> subscribers;
+        HashTable<uint64_t, uint32_t> mappings; // Endpoint to index of the external port
+        CGNATBlock* free_blocks;
+        unsigned nblocks; // Blocks given to subscribers
+        uint64_t failures;
+        Timer gc_timer;
+    };
+
+    Vector<IPAddress> _addrs;
+    HashTable<IPAddress, int> _addr_index;
+    IPAddress _subscribers; // First subscriber address of a deterministic allocation
+    IPAddress _subscribers_mask;
+    Vector<CGNATBlock> _blocks;
+    per_thread<CGNATState> _state;
+    unsigned _block_size;
+    unsigned _max_blocks;
+    unsigned _blocks_per_addr;
+    uint16_t _port_min;
+    uint32_t _tcp_timeout;
+    uint32_t _udp_timeout;
+    uint32_t _gc_interval;
+    bool _log;
+    bool _deterministic;
+
+    inline Packet* process_out(Packet *);
+    inline Packet* process_in(Packet *);
+    CGNATBlock* new_block(CGNATState &state, CGNATSubscriber *sub);
+    int new_mapping(CGNATState &state, IPAddress src, uint16_t sport, uint8_t proto, click_jiffies_t now);
+    void release_block(CGNATState &state, CGNATBlock *block);
+    void gc(CGNATState &state);
+
+    inline uint32_t timeout(uint8_t proto) const;
+
+    static void gc_timer_hook(Timer *, void *);
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,255 @@
+/*
+ * cookieloadbalancer.{cc,hh} -- stateless TCP load-balancer using cookies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "cookieloadbalancer.hh"
+#include <click/glue.hh>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <clicknet/udp.h>
+#include <click/packetbatch.hh>
+
+CLICK_DECLS
+
+CookieLoadBalancer::CookieLoadBalancer() : _cookie_mask(1)
+{
+    for (unsigned i = 0; i < _stats.weight(); i++)
+        _stats.set_value(i, CookieStats{0, 0});
+}
+
+CookieLoadBalancer::~CookieLoadBalancer()
+{
+}
+
+int
+CookieLoadBalancer::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    if (Args(this, errh).bind(conf)
+               .read_all("DST", Args::mandatory | Args::positional, DefaultArg<Vector<IPAddress>>(), _dsts)
+               .read_mp("VIP", _vip)
+               .consume() < 0)
+        return -1;
+
+    if (parseLb(conf, this, errh) < 0)
+        return -1;
+
+    if (Args(this, errh).bind(conf).complete() < 0)
+        return -1;
+
+    int bits = 1;
+    while ((1 << bits) < _dsts.size())
+        bits++;
+    _cookie_mask = (1 << bits) - 1;
+
+    for (int i = 0; i < _dsts.size(); i++)
+        _dst_index[_dsts[i]] = i;
+
+    return 0;
+}
+
+/**
+ * Rewrite the addresses of p and fix its checksums
+ */
+static inline void
+rewrite_address(WritablePacket* q, struct in_addr &addr, IPAddress to)
+{
+    click_ip* iph = q->ip_header();
+    uint32_t old = addr.s_addr;
+    addr = to;
+    CookieLoadBalancer::update_cksum32(&iph->ip_sum, old, to.addr());
+    if (!IP_FIRSTFRAG(iph))
+        return;
+    if (iph->ip_p == IP_PROTO_TCP && q->transport_length() >= (int) sizeof(click_tcp)) {
+        CookieLoadBalancer::update_cksum32(&q->tcp_header()->th_sum, old, to.addr());
+    } else if (iph->ip_p == IP_PROTO_UDP && q->transport_length() >= (int) sizeof(click_udp)) {
+        click_udp* udph = q->udp_header();
+        if (udph->uh_sum) // 0 checksum is no checksum
+            CookieLoadBalancer::update_cksum32(&udph->uh_sum, old, to.addr());
+    }
+}
+
+inline Packet*
+CookieLoadBalancer::process(Packet* p)
+{
+    WritablePacket* q = p->uniqueify();
+    if (unlikely(!q))
+        return 0;
+    click_ip* iph = q->ip_header();
+
+    int server = -1;
+    if (iph->ip_p == IP_PROTO_TCP && IP_FIRSTFRAG(iph)
+        && q->transport_length() >= (int) sizeof(click_tcp)) {
+        click_tcp* th = q->tcp_header();
+        if (!(th->th_flags & TH_SYN)) {
+            unsigned char* ts = find_timestamp(q);
+            if (ts) {
+                uint32_t ecr;
+                memcpy(&ecr, ts + 6, 4);
+                uint32_t h = cookie_hash(iph->ip_src, ntohs(th->th_sport), ntohs(th->th_dport));
+                server = (ntohl(ecr) ^ h) & _cookie_mask;
+                if (server >= _dsts.size())
+                    server = -1;
+            }
+            if (server >= 0)
+                _stats->hits++;
+            else
+                _stats->misses++;
+        }
+    }
+    if (server < 0)
+        server = pick_server(q);
+    if (unlikely(server == no_server)) {
+        q->kill();
+        return 0;
+    }
+
+    IPAddress srv = _dsts.unchecked_at(server);
+    track_load(q, server);
+    rewrite_address(q, iph->ip_dst, srv);
+    q->set_dst_ip_anno(srv);
+    return q;
+}
+
+#if HAVE_BATCH
+void
+CookieLoadBalancer::push_batch(int, PacketBatch* batch)
+{
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE([this](Packet* p) { return process(p); }, batch, [](Packet*){});
+    if (batch)
+        checked_output_push_batch(0, batch);
+}
+#endif
+
+void
+CookieLoadBalancer::push(int, Packet* p)
+{
+    if (Packet* q = process(p))
+        output_push(0, q);
+}
+
+int
+CookieLoadBalancer::handler(int op, String& s, Element* e, const Handler* h, ErrorHandler* errh)
+{
+    CookieLoadBalancer *cs = static_cast<CookieLoadBalancer *>(e);
+    return cs->lb_handler(op, s, h->read_user_data(), h->write_user_data(), errh);
+}
+
+int
+CookieLoadBalancer::write_handler(const String &input, Element *e, void *thunk, ErrorHandler *errh)
+{
+    CookieLoadBalancer *cs = static_cast<CookieLoadBalancer *>(e);
+    return cs->lb_write_handler(input, thunk, errh);
+}
+
+String
+CookieLoadBalancer::read_handler(Element *e, void *thunk)
+{
+    CookieLoadBalancer *cs = static_cast<CookieLoadBalancer *>(e);
+    switch ((uintptr_t) thunk) {
+        case h_cookie_hits: {
+            PER_THREAD_MEMBER_SUM(uint64_t, hits, cs->_stats, hits);
+            return String(hits);
+        }
+        case h_cookie_misses: {
+            PER_THREAD_MEMBER_SUM(uint64_t, misses, cs->_stats, misses);
+            return String(misses);
+        }
+    }
+    return cs->lb_read_handler(thunk);
+}
+
+void
+CookieLoadBalancer::add_handlers()
+{
+    add_lb_handlers<CookieLoadBalancer>(this);
+    add_read_handler("cookie_hits", read_handler, h_cookie_hits);
+    add_read_handler("cookie_misses", read_handler, h_cookie_misses);
+}
+
+
+CookieLoadBalancerReverse::CookieLoadBalancerReverse()
+{
+}
+
+CookieLoadBalancerReverse::~CookieLoadBalancerReverse()
+{
+}
+
+int
+CookieLoadBalancerReverse::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    Element* e;
+    if (Args(conf, this, errh)
+               .read_mp("LB", e)
+               .complete() < 0)
+        return -1;
+    _lb = static_cast<CookieLoadBalancer*>(e->cast("CookieLoadBalancer"));
+    if (!_lb)
+        return errh->error("LB must be a CookieLoadBalancer");
+    _lb->add_remote_element(this);
+    return 0;
+}
+
+inline Packet*
+CookieLoadBalancerReverse::process(Packet* p)
+{
+    WritablePacket* q = p->uniqueify();
+    if (unlikely(!q))
+        return 0;
+    click_ip* iph = q->ip_header();
+
+    if (iph->ip_p == IP_PROTO_TCP && IP_FIRSTFRAG(iph)
+        && q->transport_length() >= (int) sizeof(click_tcp)) {
+        _lb->track_latency(q);
+        click_tcp* th = q->tcp_header();
+        unsigned char* ts = CookieLoadBalancer::find_timestamp(q);
+        int* server = _lb->_dst_index.get_pointer(IPAddress(iph->ip_src));
+        if (ts && server) {
+            uint32_t val;
+            memcpy(&val, ts + 2, 4);
+            uint32_t h = CookieLoadBalancer::cookie_hash(iph->ip_dst, ntohs(th->th_dport), ntohs(th->th_sport));
+            uint32_t mask = _lb->_cookie_mask;
+            uint32_t cookie = htonl((ntohl(val) & ~mask) | ((*server ^ h) & mask));
+            bool odd = (ts + 2 - reinterpret_cast<unsigned char*>(th)) & 1;
+            CookieLoadBalancer::update_cksum32(&th->th_sum, val, cookie, odd);
+            memcpy(ts + 2, &cookie, 4);
+        }
+    }
+    rewrite_address(q, iph->ip_src, _lb->_vip);
+    return q;
+}
+
+#if HAVE_BATCH
+void
+CookieLoadBalancerReverse::push_batch(int, PacketBatch* batch)
+{
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE([this](Packet* p) { return process(p); }, batch, [](Packet*){});
+    if (batch)
+        checked_output_push_batch(0, batch);
+}
+#endif
+
+void
+CookieLoadBalancerReverse::push(int, Packet* p)
+{
+    if (Packet* q = process(p))
+        output_push(0, q);
+}
+
+CLICK_ENDDECLS
+
+EXPORT_ELEMENT(CookieLoadBalancerReverse)
+ELEMENT_MT_SAFE(CookieLoadBalancerReverse)
+EXPORT_ELEMENT(CookieLoadBalancer)
+ELEMENT_MT_SAFE(CookieLoadBalancer)
@@ -0,0 +1,231 @@
+#ifndef CLICK_COOKIELOADBALANCER_HH
+#define CLICK_COOKIELOADBALANCER_HH
+#include <click/config.h>
+#include <click/tcphelper.hh>
+#include <click/multithread.hh>
+#include <click/glue.hh>
+#include <click/batchelement.hh>
+#include <click/loadbalancer.hh>
+#include <click/hashtable.hh>
+#include <click/vector.hh>
+#include <clicknet/ip.h>
+#include <clicknet/tcp.h>
+
+CLICK_DECLS
+
+class CookieLoadBalancerReverse;
+
+/**
+=c
+
+CookieLoadBalancer([I<KEYWORDS>])
+
+=s flow
+
+stateless TCP load-balancer keeping the backend in the TCP timestamps
+
+=d
+
+Load-balancer that only rewrites the destination, without any per-flow
+state. The index of the chosen destination is encoded in the low bits of the
+TCP timestamp value of the packets sent by the servers, by
+CookieLoadBalancerReverse. As clients echo it, every packet of an established
+connection carries a cookie telling to which destination it belongs, so
+connections keep their destination when destinations are added or removed,
+or when another instance handles the packets.
+
+The cookie is the destination index XORed with a hash of the client address,
+client port and server port, on as few bits as there are destinations.
+Servers see the echoed timestamps with these bits changed, which only skews
+their RTT estimation by a few timestamp ticks.
+
+SYN packets, non-TCP packets and TCP packets without a valid cookie (e.g.
+connections without timestamps) use the LB_MODE decision. Use a hash-based
+mode such as maglev for them to be consistent.
+
+Checksums are updated incrementally.
+
+Keyword arguments are:
+
+=over 8
+
+=item DST
+
+IP Address. Can be repeated multiple times, once per destination.
+
+=item VIP
+
+IP Address of this load-balancer.
+
+=item LB_MODE, LST_MODE, ...
+
+Load balancing mode and various parameters for new connections. See
+FlowIPLoadBalancer.
+
+=back
+
+=h cookie_hits read-only
+
+Number of packets sent to the destination of their cookie.
+
+=h cookie_misses read-only
+
+Number of packets that used LB_MODE although they were not SYN packets.
+
+=e
+    lb :: CookieLoadBalancer(VIP 10.220.0.1, DST 10.221.0.1, DST 10.221.0.2, DST 10.221.0.3);
+    rev :: CookieLoadBalancerReverse(lb);
+
+=a
+
+CookieLoadBalancerReverse, IPLoadBalancer, FlowIPLoadBalancer */
+
+class CookieLoadBalancer : public BatchElement, public TCPHelper, public LoadBalancer<IPAddress> {
+
+public:
+
+    CookieLoadBalancer() CLICK_COLD;
+    ~CookieLoadBalancer() CLICK_COLD;
+
+    const char *class_name() const override		{ return "CookieLoadBalancer"; }
+    const char *port_count() const override		{ return "1/1"; }
+    const char *processing() const override		{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) override CLICK_COLD;
+
+#if HAVE_BATCH
+    void push_batch(int, PacketBatch *) override;
+#endif
+    void push(int, Packet *) override;
+
+    void add_handlers() override CLICK_COLD;
+
+    /**
+     * Return a pointer to the 10-byte timestamp option of p, or 0
+     */
+    static inline unsigned char* find_timestamp(WritablePacket* p);
+
+    /**
+     * Hash of the connection shared by both directions
+     */
+    static inline uint32_t cookie_hash(IPAddress client, uint16_t cport, uint16_t sport) {
+        uint32_t h = client.addr() ^ (((uint32_t) cport << 16) | sport);
+        h ^= h >> 16;
+        h *= 0x85ebca6b;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35;
+        h ^= h >> 16;
+        return h;
+    }
+
+    /**
+     * Update @a csum for a 32-bit field changing from @a old_n to @a new_n.
+     * A field at an @a odd offset from the start of the checksummed data
+     * straddles its 16-bit words, so its halves count byte-swapped.
+     */
+    static inline void update_cksum32(uint16_t* csum, uint32_t old_n, uint32_t new_n, bool odd = false) {
+        uint16_t o[2], n[2];
+        memcpy(o, &old_n, 4);
+        memcpy(n, &new_n, 4);
+        for (int i = 0; i < 2; i++) {
+            if (odd)
+                click_update_in_cksum(csum, (uint16_t) (o[i] << 8 | o[i] >> 8), (uint16_t) (n[i] << 8 | n[i] >> 8));
+            else
+                click_update_in_cksum(csum, o[i], n[i]);
+        }
+    }
+
+private:
+    struct CookieStats {
+        uint64_t hits;
+        uint64_t misses;
+    };
+
+    enum {
+        h_cookie_hits = h_lb_max, h_cookie_misses
+    };
+
+    inline Packet* process(Packet* p);
+
+    static int handler(int op, String& s, Element* e, const Handler* h, ErrorHandler* errh);
+    static String read_handler(Element *handler, void *user_data);
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+    IPAddress _vip;
+    uint32_t _cookie_mask;
+    HashTable<IPAddress, int> _dst_index;
+    per_thread<CookieStats> _stats;
+
+    friend class LoadBalancer;
+    friend class CookieLoadBalancerReverse;
+};
+
+/**
+=c
+
+CookieLoadBalancerReverse(LB)
+
+=s flow
+
+reverse side of CookieLoadBalancer
+
+=d
+
+Rewrites the source of packets coming from the destinations of the
+CookieLoadBalancer LB to its VIP, and encodes the index of the destination
+in the TCP timestamp value so the client echoes it back.
+
+=a
+
+CookieLoadBalancer */
+
+class CookieLoadBalancerReverse : public BatchElement {
+
+public:
+
+    CookieLoadBalancerReverse() CLICK_COLD;
+    ~CookieLoadBalancerReverse() CLICK_COLD;
+
+    const char *class_name() const override      { return "CookieLoadBalancerReverse"; }
+    const char *port_count() const override      { return "1/1"; }
+    const char *processing() const override      { return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) override CLICK_COLD;
+
+#if HAVE_BATCH
+    void push_batch(int, PacketBatch *) override;
+#endif
+    void push(int, Packet *) override;
+
+private:
+    inline Packet* process(Packet* p);
+
+    CookieLoadBalancer* _lb;
+};
+
+inline unsigned char*
+CookieLoadBalancer::find_timestamp(WritablePacket* p)
+{
+    click_tcp* th = p->tcp_header();
+    unsigned char* opt = reinterpret_cast<unsigned char*>(th + 1);
+    unsigned char* end = reinterpret_cast<unsigned char*>(th) + (th->th_off << 2);
+    if (end > p->end_data())
+        return 0;
+    while (opt < end) {
+        if (*opt == TCPOPT_EOL)
+            return 0;
+        if (*opt == TCPOPT_NOP) {
+            opt++;
+            continue;
+        }
+        if (opt + 1 >= end || opt[1] < 2 || opt + opt[1] > end)
+            return 0;
+        if (*opt == TCPOPT_TIMESTAMP)
+            return opt[1] == TCPOLEN_TIMESTAMP ? opt : 0;
+        opt += opt[1];
+    }
+    return 0;
+}
+
+CLICK_ENDDECLS
+#endif
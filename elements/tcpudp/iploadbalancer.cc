@@ -67,10 +67,16 @@ int IPLoadBalancer::initialize(ErrorHandler *errh) {
 #if HAVE_BATCH
 void IPLoadBalancer::push_batch(int, PacketBatch* batch) {
 
-    auto fnt = [this](Packet*&p) {
+    auto fnt = [this](Packet* p) -> Packet* {
         WritablePacket* q =p->uniqueify();
+        if (unlikely(!q))
+            return 0;
 
-        unsigned hash = pick_server(q);
+        int hash = pick_server(q);
+        if (unlikely(hash == no_server)) {
+            q->kill();
+            return 0;
+        }
         IPAddress srv = _dsts.unchecked_at(hash);
 	track_load(q, hash);
 
@@ -78,7 +84,7 @@ void IPLoadBalancer::push_batch(int, PacketBatch* batch) {
         q->set_dst_ip_anno(srv);
         return q;
     };
-    EXECUTE_FOR_EACH_PACKET(fnt, batch);
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(fnt, batch, [](Packet*){});
 
     if (batch)
         checked_output_push_batch(0, batch);
@@ -92,7 +98,11 @@ void IPLoadBalancer::push(int, Packet* p) {
             return;
         }
 
-        unsigned hash = pick_server(q);
+        int hash = pick_server(q);
+        if (unlikely(hash == no_server)) {
+            q->kill();
+            return;
+        }
         IPAddress srv = _dsts.unchecked_at(hash);
 	track_load(q, hash);
 
@@ -160,6 +170,7 @@ void IPLoadBalancerReverse::push_batch(int, PacketBatch* batch) {
     auto fnt = [this](Packet* &p)  {
         WritablePacket* q =p->uniqueify();
         p = q;
+        _lb->track_latency(q);
 	q->ip_header()->ip_src = _lb->_vip;
         return q;
     };
@@ -177,6 +188,7 @@ void IPLoadBalancerReverse::push(int, Packet* p) {
         if (unlikely(!q)) {
             return;
         }
+        _lb->track_latency(q);
 	    q->ip_header()->ip_src = _lb->_vip;
 
         output_push(0, q);
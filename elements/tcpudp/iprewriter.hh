@@ -158,6 +158,15 @@ UDP connection mappings are guaranteed to exist for I<time> seconds after each s
 
 Reap timed-out connections every I<time> seconds. Default is 15 minutes.
 
+=item TIMER_WHEEL
+
+Boolean. If true, expire connections with a timer wheel of one-second slots
+instead of heaps. Adding a connection and refreshing its timeout are then
+constant time, and timed-out connections are reaped every second, so
+REAP_INTERVAL is ignored. When the table is full, the evicted connection is
+only approximately the next one to expire. Rewriters sharing a
+MAPPING_CAPACITY share this setting. Default is false.
+
 =item MAPPING_CAPACITY I<capacity>
 
 Set the maximum number of mappings this rewriter can hold to I<capacity>.
@@ -213,6 +222,19 @@ Takes a TCP flow as a space-separated
 and attempts to find a forward mapping for that flow. If found, rewrites the
 flow and returns in the same format.  Otherwise, returns nothing.
 
+=h snapshot write-only
+
+Takes a file name and writes all the mappings created by this element, with
+their remaining timeouts, to that file. TCP sequence number translations are
+not saved.
+
+=h restore write-only
+
+Takes a file name and loads back the mappings of a snapshot taken by an
+element of the same class with the same number of inputs, for instance before
+restarting Click. Flows that expired since the snapshot are skipped.  Mappings
+are restored asynchronously by the threads that owned them.
+
 =a TCPRewriter, IPAddrRewriter, IPAddrPairRewriter, IPRewriterPatterns,
 RoundRobinIPMapper, FTPPortMapper, ICMPRewriter, ICMPPingRewriter */
 
@@ -258,6 +280,12 @@ class IPRewriter : public TCPRewriter { public:
 
     void add_handlers() CLICK_COLD;
 
+  protected:
+    void flow_states(int thread, Vector<IPRewriterMapState *> &states) override {
+	TCPRewriter::flow_states(thread, states);
+	states.push_back(&_ipstate.get_value_for_thread(thread));
+    }
+
   private:
     class IPState : public IPRewriterMapState { public:
         IPState() : IPRewriterMapState() {
@@ -144,6 +144,15 @@ dropped if a UDPRewriter's mapping table is full of guaranteed flows.
 
 Reap timed-out connections every I<time> seconds. Default is 15 minutes.
 
+=item TIMER_WHEEL
+
+Boolean. If true, expire connections with a timer wheel of one-second slots
+instead of heaps. Adding a connection and refreshing its timeout are then
+constant time, and timed-out connections are reaped every second, so
+REAP_INTERVAL is ignored. When the table is full, the evicted connection is
+only approximately the next one to expire. Rewriters sharing a
+MAPPING_CAPACITY share this setting. Default is false.
+
 =item MAPPING_CAPACITY I<capacity>
 
 Set the maximum number of mappings this rewriter can hold to I<capacity>.
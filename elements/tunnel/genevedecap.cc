@@ -0,0 +1,67 @@
+/*
+ * genevedecap.{cc,hh} -- decapsulates Geneve packets
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <clicknet/geneve.h>
+#include "genevedecap.hh"
+CLICK_DECLS
+
+GeneveDecap::GeneveDecap() : _vni_anno(true)
+{
+}
+
+GeneveDecap::~GeneveDecap()
+{
+}
+
+int
+GeneveDecap::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    Vector<uint32_t> vnis;
+
+    if (Args(conf, this, errh)
+        .read_all("VNI", vnis)
+        .read("VNI_ANNO", _vni_anno)
+        .complete() < 0)
+        return -1;
+
+    return _demux.configure(vnis, this, errh);
+}
+
+inline int
+GeneveDecap::classify(Packet *p)
+{
+    const click_geneve *gn = reinterpret_cast<const click_geneve *>(p->data());
+    if (unlikely(p->length() < sizeof(click_geneve)))
+        return noutputs();
+    unsigned hlen = sizeof(click_geneve) + GENEVE_OPTLEN(gn);
+    if (unlikely(GENEVE_VERSION(gn) != 0
+                 || (gn->gn_flags & (GENEVE_FLAG_O | GENEVE_FLAG_C))
+                 || gn->gn_proto != htons(GENEVE_PROTO_ETHER)
+                 || p->length() < hlen))
+        return noutputs();
+
+    uint32_t vni = ntohl(gn->gn_vni) >> 8;
+    if (_vni_anno)
+        SET_AGGREGATE_ANNO(p, vni);
+    p->pull(hlen);
+    return _demux.output(vni);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(UDPTunnel)
+EXPORT_ELEMENT(GeneveDecap)
+ELEMENT_MT_SAFE(GeneveDecap)
@@ -0,0 +1,67 @@
+#ifndef CLICK_GENEVEDECAP_HH
+#define CLICK_GENEVEDECAP_HH
+#include "udptunnel.hh"
+CLICK_DECLS
+
+/*
+=c
+
+GeneveDecap([I<keywords> VNI, VNI_ANNO])
+
+=s tunnel
+
+decapsulates Geneve packets and demultiplexes them by VNI
+
+=d
+
+Removes the Geneve header and its options from packets starting with it,
+such as Geneve packets after StripIPHeader and Strip(8). The inner Ethernet
+frames are sent to an output chosen by their network identifier (VNI).
+
+VNI can be given multiple times: packets with the i-th VNI go to output i.
+Packets with any other VNI go to the next output if there is one, and are
+dropped otherwise. Without VNI, GeneveDecap has one output and all the
+packets go to it. The outputs of the VNIs are found in a small hash table.
+
+Options are skipped. Packets that are too short, of another version, that do
+not carry Ethernet frames, control packets and packets with critical options
+are dropped.
+
+Keyword arguments are:
+
+=over 8
+
+=item VNI
+
+Integer. Network identifier of the next output, can be given multiple times.
+
+=item VNI_ANNO
+
+Boolean. Set the aggregate annotation to the VNI. Default is true.
+
+=back
+
+=a GeneveEncap, VXLANDecap */
+
+class GeneveDecap : public ClassifyElement<GeneveDecap> { public:
+
+    GeneveDecap() CLICK_COLD;
+    ~GeneveDecap() CLICK_COLD;
+
+    const char *class_name() const override	{ return "GeneveDecap"; }
+    const char *port_count() const override	{ return "1/1-"; }
+    const char *processing() const override	{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) override CLICK_COLD;
+
+    inline int classify(Packet *);
+
+  private:
+
+    VNIDemux _demux;
+    bool _vni_anno;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,46 @@
+/*
+ * geneveencap.{cc,hh} -- encapsulates Ethernet frames in Geneve
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <clicknet/geneve.h>
+#include "geneveencap.hh"
+CLICK_DECLS
+
+GeneveEncap::GeneveEncap()
+{
+}
+
+GeneveEncap::~GeneveEncap()
+{
+}
+
+uint16_t
+GeneveEncap::default_dport() const
+{
+    return GENEVE_PORT;
+}
+
+void
+GeneveEncap::write_tunnel_header(uint32_t *h, uint32_t vni) const
+{
+    click_geneve *gn = reinterpret_cast<click_geneve *>(h);
+    memset(gn, 0, sizeof(click_geneve));
+    gn->gn_proto = htons(GENEVE_PROTO_ETHER);
+    gn->gn_vni = htonl(vni << 8);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(UDPTunnel)
+EXPORT_ELEMENT(GeneveEncap)
+ELEMENT_MT_SAFE(GeneveEncap)
@@ -0,0 +1,83 @@
+#ifndef CLICK_GENEVEENCAP_HH
+#define CLICK_GENEVEENCAP_HH
+#include "udptunnel.hh"
+CLICK_DECLS
+
+/*
+=c
+
+GeneveEncap(VNI, SRC, DST [, I<keywords> DPORT, SPORT_MIN, SPORT_MAX, TTL, CHECKSUM])
+
+=s tunnel
+
+encapsulates Ethernet frames in Geneve
+
+=d
+
+Encapsulates each Ethernet frame in Geneve (RFC 8926) with the network
+identifier VNI and no option, and in UDP and IP headers from SRC to DST. The
+result is an IP packet, add an Ethernet header with EtherEncap or
+ARPQuerier. The IP header annotation is set, and the destination IP address
+annotation is set to DST.
+
+The outer header is built once, each packet only gets a copy of it with its
+lengths and an incrementally updated IP checksum. The IP header has the DF
+flag and an ID of 0. The UDP source port is taken from a hash of the inner
+flow, so routers using ECMP spread the traffic of the tunnel over their links
+while keeping the packets of a flow on the same path.
+
+Keyword arguments are:
+
+=over 8
+
+=item DPORT
+
+Integer. UDP destination port. Default is 6081.
+
+=item SPORT_MIN, SPORT_MAX
+
+Integers. Range of the UDP source ports. Default is 49152 to 65535.
+
+=item TTL
+
+Integer. TTL of the outer IP header. Default is 64.
+
+=item CHECKSUM
+
+Boolean. Compute the UDP checksum. Default is false, the checksum is zero.
+
+=back
+
+=h vni read/write
+
+=h src read/write
+
+=h dst read/write
+
+=h dport read-only
+
+=e
+
+    FromDevice(tap0)
+    -> GeneveEncap(VNI 42, SRC 10.0.0.1, DST 10.0.0.2)
+    -> EtherEncap(0x0800, 00:00:00:00:00:01, 00:00:00:00:00:02)
+    -> ToDevice(eth0);
+
+=a GeneveDecap, VXLANEncap, UDPIPEncap */
+
+class GeneveEncap : public UDPTunnelEncap { public:
+
+    GeneveEncap() CLICK_COLD;
+    ~GeneveEncap() CLICK_COLD;
+
+    const char *class_name() const override	{ return "GeneveEncap"; }
+
+  protected:
+
+    uint16_t default_dport() const override;
+    void write_tunnel_header(uint32_t *, uint32_t) const override;
+
+};
+
+CLICK_ENDDECLS
+#endif
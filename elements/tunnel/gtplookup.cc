@@ -23,17 +23,24 @@
 #include <click/args.hh>
 #include <click/error.hh>
 #include <click/glue.hh>
+#include <click/algorithm.hh>
 #include "gtplookup.hh"
 #include "gtptable.hh"
 
 CLICK_DECLS
 
-GTPLookup::GTPLookup() : _checksum(true)
+GTPLookup::GTPLookup() : _checksum(true), _cache_size(4096)
 {
+    for (unsigned i = 0; i < _id.weight(); i++) {
+        _id.set_value(i, i << 12);
+        _cache.set_value(i, 0);
+    }
 }
 
 GTPLookup::~GTPLookup()
 {
+    for (unsigned i = 0; i < _cache.weight(); i++)
+        delete[] _cache.get_value(i);
 }
 
 int
@@ -43,6 +50,7 @@ GTPLookup::configure(Vector<String> &conf, ErrorHandler *errh)
     if (Args(conf, this, errh)
             .read_mp("TABLE",e)
             .read("CHECKSUM", _checksum)
+            .read("CACHE", _cache_size)
 	.complete() < 0)
 	return -1;
 
@@ -50,6 +58,26 @@ GTPLookup::configure(Vector<String> &conf, ErrorHandler *errh)
         return errh->error("Unknown GTPTable");
     _table = static_cast<GTPTable*>(e);
 
+    if (_cache_size)
+        _cache_size = next_pow2(_cache_size);
+
+    return 0;
+}
+
+int
+GTPLookup::initialize(ErrorHandler *errh)
+{
+    if (!_cache_size)
+        return 0;
+    Bitvector passing = get_passing_threads();
+    for (int i = 0; i < passing.size(); i++) {
+        if (!passing[i])
+            continue;
+        CacheEntry* cache = new CacheEntry[_cache_size];
+        for (unsigned j = 0; j < _cache_size; j++)
+            cache[j].valid = false;
+        _cache.set_value_for_thread(i, cache);
+    }
     return 0;
 }
 
@@ -66,6 +94,57 @@ GTPLookup::run_task(Task* t) {
     return true;
 }
 
+void
+GTPHeaderTemplate::build(const GTPFlowID &tunnel)
+{
+    memset(this, 0, sizeof(*this));
+    gtp.gtp_v = 1;
+    gtp.gtp_pt = 1;
+    gtp.gtp_msg_type = 0xff;
+    gtp.gtp_teid = htonl(tunnel.gtp_id);
+
+    ip.ip_v = 4;
+    ip.ip_hl = sizeof(click_ip) >> 2;
+    ip.ip_p = IP_PROTO_UDP;
+    ip.ip_src = tunnel.ip_id.saddr();
+    ip.ip_dst = tunnel.ip_id.daddr();
+    ip.ip_ttl = 250;
+    //Length and ID are 0 and added for each packet
+    ip_sum = (uint16_t) ~click_in_cksum((unsigned char *)&ip, sizeof(click_ip));
+
+    udp.uh_sport = tunnel.ip_id.sport();
+    udp.uh_dport = tunnel.ip_id.dport();
+}
+
+inline void
+GTPLookup::encap(WritablePacket *p, const GTPHeaderTemplate &header)
+{
+    memcpy(p->data(), &header, sizeof(click_ip) + sizeof(click_udp) + sizeof(click_gtp));
+    click_ip *ip = reinterpret_cast<click_ip *>(p->data());
+    click_udp *udp = reinterpret_cast<click_udp *>(ip + 1);
+    click_gtp *gtp = reinterpret_cast<click_gtp *>(udp + 1);
+
+    //Length of what follows the mandatory GTP header, without the outer IP
+    //and UDP headers that were counted before
+    gtp->gtp_msg_len = htons(p->length() - sizeof(click_ip) - sizeof(click_udp) - sizeof(click_gtp));
+
+    ip->ip_len = htons(p->length());
+    ip->ip_id = htons(_id.get()++);
+    uint32_t sum = header.ip_sum + ip->ip_len + ip->ip_id;
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum += sum >> 16;
+    ip->ip_sum = ~sum;
+    p->set_ip_header(ip, sizeof(click_ip));
+    p->set_dst_ip_anno(ip->ip_dst);
+
+    uint16_t len = p->length() - sizeof(click_ip);
+    udp->uh_ulen = htons(len);
+    if (_checksum) {
+        unsigned csum = click_in_cksum((unsigned char *)udp, len);
+        udp->uh_sum = click_in_cksum_pseudohdr(csum, ip, len);
+    }
+}
+
 int
 GTPLookup::process(int port, Packet* p_in) {
     //click_jiffies_t now = click_jiffies();
@@ -74,7 +153,19 @@ GTPLookup::process(int port, Packet* p_in) {
         inner.set_dport(0);
         inner.set_sport(0);
     }
-    auto gtp_tunnel = _table->_inmap.find(inner);
+
+    CacheEntry* cache = _cache.get();
+    CacheEntry* entry = 0;
+    if (cache) {
+        entry = &cache[inner.hashcode() & (_cache_size - 1)];
+        if (entry->valid && entry->inner == inner) {
+            WritablePacket *p = p_in->push(sizeof(click_gtp) + sizeof(click_udp) + sizeof(click_ip));
+            encap(p, entry->header);
+            return 0;
+        }
+    }
+
+    auto gtp_tunnel = _table->inmap(inner).find(inner);
     if (!gtp_tunnel) {
         click_chatter("UNKNOWN PACKETS FROM TOF !!?");
         click_chatter("%s",inner.unparse().c_str());
@@ -84,7 +175,7 @@ GTPLookup::process(int port, Packet* p_in) {
         if (likely(gtp_tunnel->known)) { //This is the GTP_OUT directly
 
         } else { //This is the GTP_IN, we must resolve and update
-            auto gtp_out = _table->_gtpmap.find(*gtp_tunnel);
+            auto gtp_out = _table->gtpmap(*gtp_tunnel).find(*gtp_tunnel);
             if (!gtp_out) {
                 click_chatter("Mapping is still unknown ! Queuing packets. Choose a closer ping server...");
 
@@ -93,62 +184,18 @@ GTPLookup::process(int port, Packet* p_in) {
             *gtp_tunnel = *gtp_out;
             gtp_tunnel->known = true;
         }
-        WritablePacket *p = p_in->push(sizeof(click_gtp) + sizeof(click_udp) + sizeof(click_ip));
 
-        click_gtp *gtp = reinterpret_cast<click_gtp *>(p->data() + sizeof(click_udp) + sizeof(click_ip));
-        gtp->gtp_v = 1;
-        gtp->gtp_pt = 1;
-        gtp->gtp_reserved = 0;
-        gtp->gtp_flags = 0;
-        gtp->gtp_msg_type = 0xff;
-        gtp->gtp_msg_len = htons(p->length() - sizeof(click_gtp));
-        gtp->gtp_teid = htonl(gtp_tunnel->gtp_id);
-
-        click_ip *ip = reinterpret_cast<click_ip *>(p->data());
-        click_udp *udp = reinterpret_cast<click_udp *>(ip + 1);
-
-          // set up IP header
-          ip->ip_v = 4;
-          ip->ip_hl = sizeof(click_ip) >> 2;
-          ip->ip_len = htons(p->length());
-          ip->ip_id = htons(_id.fetch_and_add(1));
-          ip->ip_p = IP_PROTO_UDP;
-          ip->ip_src = gtp_tunnel->ip_id.saddr();
-
-          ip->ip_dst = gtp_tunnel->ip_id.daddr();
-          p->set_dst_ip_anno(gtp_tunnel->ip_id.daddr());
-
-          ip->ip_tos = 0;
-          ip->ip_off = 0;
-          ip->ip_ttl = 250;
-
-          ip->ip_sum = 0;
-        #if HAVE_FAST_CHECKSUM && FAST_CHECKSUM_ALIGNED
-          if (_aligned)
-            ip->ip_sum = ip_fast_csum((unsigned char *)ip, sizeof(click_ip) >> 2);
-          else
-            ip->ip_sum = click_in_cksum((unsigned char *)ip, sizeof(click_ip));
-        #elif HAVE_FAST_CHECKSUM
-          ip->ip_sum = ip_fast_csum((unsigned char *)ip, sizeof(click_ip) >> 2);
-        #else
-          ip->ip_sum = click_in_cksum((unsigned char *)ip, sizeof(click_ip));
-        #endif
-
-          p->set_ip_header(ip, sizeof(click_ip));
-
-          // set up UDP header
-          udp->uh_sport = gtp_tunnel->ip_id.sport();
-          udp->uh_dport = gtp_tunnel->ip_id.dport();
-          uint16_t len = p->length() - sizeof(click_ip);
-          udp->uh_ulen = htons(len);
-          udp->uh_sum = 0;
-          if (_checksum) {
-              unsigned csum = click_in_cksum((unsigned char *)udp, len);
-              udp->uh_sum = click_in_cksum_pseudohdr(csum, ip, len);
-          } else {
-              udp->uh_sum = 0;
-          }
-          return 0;
+        GTPHeaderTemplate header;
+        header.build(*gtp_tunnel);
+        if (entry) {
+            entry->inner = inner;
+            entry->header = header;
+            entry->valid = true;
+        }
+
+        WritablePacket *p = p_in->push(sizeof(click_gtp) + sizeof(click_udp) + sizeof(click_ip));
+        encap(p, header);
+        return 0;
     }
 }
 
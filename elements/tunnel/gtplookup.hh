@@ -3,8 +3,26 @@
 #include <click/batchelement.hh>
 #include <click/ipflowid.hh>
 #include <click/hashtablemp.hh>
+#include <clicknet/ip.h>
+#include <clicknet/udp.h>
+#include <clicknet/gtp.h>
 CLICK_DECLS
 
+class GTPFlowID;
+
+/**
+ * Outer headers of a tunnel, built once. Only the lengths, the IP ID and
+ * the checksums change from packet to packet.
+ */
+struct GTPHeaderTemplate {
+    click_ip ip;
+    click_udp udp;
+    click_gtp gtp;
+    uint32_t ip_sum; // Sum of the IP header without length and ID
+
+    void build(const GTPFlowID &tunnel);
+};
+
 
 /*
 =c
@@ -20,7 +38,26 @@ Encapsulates packets in their intended GTP return id.
 Finds from the 5 tuple of a packet returning from the MEC the right
 GTP return ID.
 
-=a GTPEncap
+Once the tunnel of an inner flow is resolved, its outer headers are kept in a
+per-thread cache of CACHE entries, indexed by the hash of the inner flow.
+Packets hitting the cache are encapsulated by copying the headers without
+looking at the GTPTable, nor taking any lock. Resolved mappings never change,
+so the cache does not need to be invalidated.
+
+=item TABLE
+
+The GTPTable element.
+
+=item CHECKSUM
+
+Boolean. Compute the UDP checksum. Default is true.
+
+=item CACHE
+
+Integer. Number of entries of the cache of each thread, rounded up to a power
+of 2. 0 disables the cache. Default is 4096.
+
+=a GTPEncap, GTPTable
 */
 
 class GTPTable;
@@ -36,6 +73,7 @@ class GTPLookup : public BatchElement { public:
     const char *flags() const		{ return PUSH; }
 
     int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
     bool can_live_reconfigure() const	{ return true; }
 
     bool run_task(Task*) override;
@@ -46,9 +84,19 @@ class GTPLookup : public BatchElement { public:
 	void push_batch(int port, PacketBatch *) override;
 #endif
   private:
+    struct CacheEntry {
+        IPFlowID inner;
+        bool valid;
+        GTPHeaderTemplate header;
+    };
+
+    inline void encap(WritablePacket *p, const GTPHeaderTemplate &header);
+
 	GTPTable *_table;
     bool _checksum;
-    atomic_uint32_t _id;
+    unsigned _cache_size;
+    per_thread<uint16_t> _id;
+    per_thread<CacheEntry*> _cache;
     per_thread<Packet*> _queue;
 
 
@@ -27,23 +27,48 @@
 
 CLICK_DECLS
 
-GTPTable::GTPTable() : _verbose(true)
+GTPTable::GTPTable() : _shards(0), _nshards(0), _verbose(true)
 {
 }
 
 GTPTable::~GTPTable()
 {
+    delete[] _shards;
 }
 
 int
 GTPTable::configure(Vector<String> &conf, ErrorHandler *errh)
 {
+    unsigned nshards = 0;
+    IPAddress ping_dst;
+    bool verbose = _verbose;
     if (Args(conf, this, errh)
-            .read_mp("PING_DST",_ping_dst)
-            .read("VERBOSE", _verbose)
+            .read_mp("PING_DST",ping_dst)
+            .read("VERBOSE", verbose)
+            .read("SHARDS", nshards)
 	.complete() < 0)
 	return -1;
 
+    //The shards are in use on live reconfiguration, their number is fixed
+    if (_shards) {
+        if (nshards && nshards != _nshards)
+            return errh->error("SHARDS cannot be changed at runtime");
+    } else
+        _nshards = nshards;
+    _ping_dst = ping_dst;
+    _verbose = verbose;
+
+    return 0;
+}
+
+int
+GTPTable::initialize(ErrorHandler *errh)
+{
+    if (_nshards == 0)
+        _nshards = get_passing_threads().weight();
+    if (_nshards == 0)
+        _nshards = 1;
+    _shards = new Shard[_nshards];
     return 0;
 }
 
@@ -65,7 +90,7 @@ GTPTable::process(int port, Packet* p) {
         sz+= hlen + sizeof(click_udp);
         bool known;
         {//Block to protect hashtable pointer scope
-            GTPFlowTable::write_ptr gtp_out = _gtpmap.find_write(gtp_in);
+            GTPFlowTable::write_ptr gtp_out = gtpmap(gtp_in).find_write(gtp_in);
 
             if (!gtp_out) {
                 known = false;
@@ -127,7 +152,7 @@ GTPTable::process(int port, Packet* p) {
                                icmpflowid.id(),
                                icmpflowid.seq(),gtp_in.gtp_id);
 
-                    _icmp_map.find_insert(icmpflowid,gtp_in);
+                    icmp_map(icmpflowid).find_insert(icmpflowid,gtp_in);
 
                     q = q->push(sz);
 
@@ -169,12 +194,12 @@ GTPTable::process(int port, Packet* p) {
 	            click_chatter("Setting INNER mapping for TEID %u",gtp_in.gtp_id);
 	            click_chatter("%s",inner.unparse().c_str());
 	    }
-            INMap::ptr gtp_ptr = _inmap.find_insert(inner,GTPFlowIDMAP(gtp_in));
+            INMap::ptr gtp_ptr = inmap(inner).find_insert(inner,GTPFlowIDMAP(gtp_in));
             gtp_ptr->last_seen = now;
             /*if (known && !gtp_ptr->known) {
                 if (_verbose)
                     click_chatter("Inner mapping is now known !");
-                *gtp_ptr = *_gtpmap.find(gtp_in);
+                *gtp_ptr = *gtpmap(gtp_in).find(gtp_in);
                 gtp_ptr->known = true; //Inner mapping is now mapping the OUT directly !
             }*/
             gtp_ptr.release();
@@ -196,7 +221,7 @@ GTPTable::process(int port, Packet* p) {
                    icmpflowid.daddr().unparse().c_str(),
                    icmpflowid.id(),
                    icmpflowid.seq(),gtp_out.gtp_id);
-        if (!_icmp_map.find_erase(icmpflowid,gtp_in)) {
+        if (!icmp_map(icmpflowid).find_erase(icmpflowid,gtp_in)) {
             click_chatter("Unknown FLOW ! Dropping packet");
             return -1;
         }
@@ -205,9 +230,9 @@ GTPTable::process(int port, Packet* p) {
 	        click_chatter("PING RECEIVED, ADDING MAP TEID %u->%u",gtp_in.gtp_id, gtp_out.gtp_id);
 	}
 
-        _gtpmap.insert(gtp_in,gtp_out);
+        gtpmap(gtp_in).insert(gtp_in,gtp_out);
 
-        assert(*_gtpmap.find(gtp_in) == gtp_out);
+        assert(*gtpmap(gtp_in).find(gtp_in) == gtp_out);
 
         //Delete the packet
         return -1;
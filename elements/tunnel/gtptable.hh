@@ -53,7 +53,7 @@ class GTPFlowIDMAP : public GTPFlowID{public:
 /*
 =c
 
-GTPTable()
+GTPTable(PING_DST [, I<keywords> VERBOSE, SHARDS])
 
 Find mapping of the GTP tunnel id return side
 
@@ -66,7 +66,21 @@ crafts a PING packet to some server. When the ping is received, the mapping
 is updated so packets from the TOF can be encapsulated with the right
 "return side" GTP ID.
 
-=a GTPEncap
+The tables are split in SHARDS independent tables, by TEID for the tunnel
+mappings and by the hash of the inner flow for the inner mappings, so
+threads working on different tunnels do not share locks. By default there
+is one shard per thread passing by the element.
+
+=item VERBOSE
+
+Boolean. Print the mappings learned. Default is true.
+
+=item SHARDS
+
+Integer. Number of shards of the tables. Default is 0, for one per thread.
+It cannot be changed by a live reconfiguration.
+
+=a GTPEncap, GTPLookup
 */
 
 class GTPLookup;
@@ -82,6 +96,7 @@ class GTPTable : public BatchElement { public:
     const char *flags() const		{ return PUSH; }
 
     int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
     bool can_live_reconfigure() const	{ return true; }
 
     int process(int, Packet*);
@@ -93,14 +108,31 @@ class GTPTable : public BatchElement { public:
 
 	//Map from GTP_IN to GTP_OUT.
 	typedef HashTableMP<GTPFlowID,GTPFlowIDMAP> GTPFlowTable;
-	GTPFlowTable _gtpmap;
 
 	//Map of Inner IP to GTP_IN, or GTP_OUT if known is set
 	typedef HashTableMP<IPFlowID,GTPFlowIDMAP> INMap;
-	INMap _inmap;
 
 	typedef HashTableMP<ICMPFlowID,GTPFlowID> ResolvMap;
-	ResolvMap _icmp_map;
+
+	struct Shard {
+	    GTPFlowTable gtpmap;
+	    INMap inmap;
+	    ResolvMap icmp_map;
+	} CLICK_CACHE_ALIGN;
+	Shard* _shards;
+	unsigned _nshards;
+
+	inline GTPFlowTable& gtpmap(const GTPFlowID &id) {
+	    return _shards[id.gtp_id % _nshards].gtpmap;
+	}
+
+	inline INMap& inmap(const IPFlowID &inner) {
+	    return _shards[inner.hashcode() % _nshards].inmap;
+	}
+
+	inline ResolvMap& icmp_map(const ICMPFlowID &id) {
+	    return _shards[id.hashcode() % _nshards].icmp_map;
+	}
 
 	bool _verbose;
 	IPAddress _ping_dst;
@@ -0,0 +1,195 @@
+/*
+ * udptunnel.{cc,hh} -- common code of the VXLAN and Geneve elements
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/args.hh>
+#include <click/error.hh>
+#include "udptunnel.hh"
+CLICK_DECLS
+
+UDPTunnelEncap::UDPTunnelEncap()
+    : _vni(0), _dport(0)
+{
+}
+
+UDPTunnelEncap::~UDPTunnelEncap()
+{
+}
+
+int
+UDPTunnelEncap::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    uint32_t vni;
+    IPAddress saddr, daddr;
+    uint16_t dport = default_dport();
+    uint16_t sport_min = 49152, sport_max = 65535;
+    uint8_t ttl = 64;
+    bool cksum = false;
+
+    if (Args(conf, this, errh)
+        .read_mp("VNI", vni)
+        .read_mp("SRC", saddr)
+        .read_mp("DST", daddr)
+        .read("DPORT", IPPortArg(IP_PROTO_UDP), dport)
+        .read("SPORT_MIN", IPPortArg(IP_PROTO_UDP), sport_min)
+        .read("SPORT_MAX", IPPortArg(IP_PROTO_UDP), sport_max)
+        .read("TTL", ttl)
+        .read("CHECKSUM", cksum)
+        .complete() < 0)
+        return -1;
+
+    if (vni > 0xFFFFFF)
+        return errh->error("VNI must be less than 2^24");
+    if (sport_min > sport_max)
+        return errh->error("SPORT_MIN must not be greater than SPORT_MAX");
+
+    Template t;
+    UDPTunnelHeader &h = t.header;
+    memset(&h, 0, sizeof(h));
+    h.ip.ip_v = 4;
+    h.ip.ip_hl = sizeof(click_ip) >> 2;
+    h.ip.ip_off = htons(IP_DF);
+    h.ip.ip_ttl = ttl;
+    h.ip.ip_p = IP_PROTO_UDP;
+    h.ip.ip_src = saddr.in_addr();
+    h.ip.ip_dst = daddr.in_addr();
+    // Checksum with a zero length, updated for each packet
+    h.ip.ip_sum = click_in_cksum((const unsigned char *) &h.ip, sizeof(click_ip));
+    h.udp.uh_dport = htons(dport);
+    write_tunnel_header(h.tunnel, vni);
+    t.daddr = daddr;
+    t.sport_min = sport_min;
+    t.sport_range = (uint32_t) sport_max - sport_min + 1;
+    t.cksum = cksum;
+
+    int flags;
+    _template.write_begin(flags) = t;
+    _template.write_commit(flags);
+
+    _vni = vni;
+    _saddr = saddr;
+    _daddr = daddr;
+    _dport = dport;
+    return 0;
+}
+
+inline Packet *
+UDPTunnelEncap::encap(Packet *p_in, const Template &t)
+{
+    uint32_t hash = inner_flow_hash(p_in);
+    WritablePacket *p = p_in->push(sizeof(UDPTunnelHeader));
+    if (!p)
+        return 0;
+
+    UDPTunnelHeader *h = reinterpret_cast<UDPTunnelHeader *>(p->data());
+    memcpy(h, &t.header, sizeof(UDPTunnelHeader));
+
+    h->ip.ip_len = htons(p->length());
+    click_update_in_cksum(&h->ip.ip_sum, 0, h->ip.ip_len);
+
+    uint16_t ulen = p->length() - sizeof(click_ip);
+    h->udp.uh_sport = htons(t.sport_min + (((uint64_t) hash * t.sport_range) >> 32));
+    h->udp.uh_ulen = htons(ulen);
+    if (t.cksum) {
+        unsigned csum = click_in_cksum((const unsigned char *) &h->udp, ulen);
+        h->udp.uh_sum = click_in_cksum_pseudohdr(csum, &h->ip, ulen);
+    }
+
+    p->set_ip_header(&h->ip, sizeof(click_ip));
+    p->set_dst_ip_anno(t.daddr);
+    return p;
+}
+
+Packet *
+UDPTunnelEncap::simple_action(Packet *p)
+{
+    int flags;
+    const Template &t = _template.read_begin(flags);
+    Packet *q = encap(p, t);
+    _template.read_end(flags);
+    return q;
+}
+
+#if HAVE_BATCH
+PacketBatch *
+UDPTunnelEncap::simple_action_batch(PacketBatch *batch)
+{
+    int flags;
+    const Template &t = _template.read_begin(flags);
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE([&t](Packet *p) { return encap(p, t); }, batch, [](Packet *){});
+    _template.read_end(flags);
+    return batch;
+}
+#endif
+
+String
+UDPTunnelEncap::read_handler(Element *e, void *thunk)
+{
+    UDPTunnelEncap *u = static_cast<UDPTunnelEncap *>(e);
+    switch ((uintptr_t) thunk) {
+      case h_vni:
+        return String(u->_vni);
+      case h_src:
+        return u->_saddr.unparse();
+      case h_dst:
+        return u->_daddr.unparse();
+      case h_dport:
+        return String(u->_dport);
+      default:
+        return String();
+    }
+}
+
+void
+UDPTunnelEncap::add_handlers()
+{
+    add_read_handler("vni", read_handler, h_vni);
+    add_write_handler("vni", reconfigure_keyword_handler, "0 VNI");
+    add_read_handler("src", read_handler, h_src);
+    add_write_handler("src", reconfigure_keyword_handler, "1 SRC");
+    add_read_handler("dst", read_handler, h_dst);
+    add_write_handler("dst", reconfigure_keyword_handler, "2 DST");
+    add_read_handler("dport", read_handler, h_dport);
+}
+
+
+int
+VNIDemux::configure(const Vector<uint32_t> &vnis, Element *e, ErrorHandler *errh)
+{
+    int n = vnis.size();
+    if (n == 0) {
+        if (e->noutputs() != 1)
+            return errh->error("%d outputs but no VNI", e->noutputs());
+        _any = true;
+        return 0;
+    }
+    if (e->noutputs() != n && e->noutputs() != n + 1)
+        return errh->error("%d VNIs need %d or %d outputs", n, n, n + 1);
+
+    // Unknown VNIs go to output n, if there is one
+    HashTable<uint32_t, int> outputs(n);
+    for (int i = 0; i < n; i++) {
+        if (vnis[i] > 0xFFFFFF)
+            return errh->error("VNI %u must be less than 2^24", vnis[i]);
+        if (outputs.find(vnis[i]) != outputs.end())
+            return errh->error("VNI %u given twice", vnis[i]);
+        outputs.set(vnis[i], i);
+    }
+    _outputs.swap(outputs);
+    _any = false;
+    return 0;
+}
+
+CLICK_ENDDECLS
+ELEMENT_PROVIDES(UDPTunnel)
@@ -0,0 +1,149 @@
+#ifndef CLICK_UDPTUNNEL_HH
+#define CLICK_UDPTUNNEL_HH
+#include <click/batchelement.hh>
+#include <click/glue.hh>
+#include <click/hashtable.hh>
+#include <click/ipaddress.hh>
+#include <click/multithread.hh>
+#include <clicknet/ip.h>
+#include <clicknet/udp.h>
+CLICK_DECLS
+
+/**
+ * Outer IP and UDP headers, followed by the 8 bytes of a VXLAN or Geneve
+ * header without options
+ */
+struct UDPTunnelHeader {
+    click_ip ip;
+    click_udp udp;
+    uint32_t tunnel[2];
+};
+
+/**
+ * Base of VXLANEncap and GeneveEncap.
+ *
+ * The whole outer header is built at configuration time, with a zero IP
+ * length and the IP checksum of that header. Each packet gets a copy of it,
+ * its lengths, and the IP checksum updated incrementally for the length.
+ * The UDP source port is chosen from a hash of the inner flow, so routers
+ * doing ECMP on the outer header spread the tunnel without reordering flows.
+ * A live reconfiguration builds the new header aside and switches to it
+ * through RCU, so packets never get a half-written header.
+ */
+class UDPTunnelEncap : public BatchElement { public:
+
+    UDPTunnelEncap() CLICK_COLD;
+    ~UDPTunnelEncap() CLICK_COLD;
+
+    const char *port_count() const override	{ return PORTS_1_1; }
+    const char *flags() const		{ return "A"; }
+
+    int configure(Vector<String> &, ErrorHandler *) override CLICK_COLD;
+    bool can_live_reconfigure() const override	{ return true; }
+    void add_handlers() override CLICK_COLD;
+
+    Packet *simple_action(Packet *) override;
+#if HAVE_BATCH
+    PacketBatch *simple_action_batch(PacketBatch *) override;
+#endif
+
+    /**
+     * Hash of the inner Ethernet frame p, on the IPv4 5-tuple if there is
+     * one, on the Ethernet addresses and type otherwise
+     */
+    static inline uint32_t inner_flow_hash(Packet *p);
+
+  protected:
+
+    /**
+     * Default UDP destination port
+     */
+    virtual uint16_t default_dport() const = 0;
+
+    /**
+     * Write the 8-byte tunnel header for VNI vni at h
+     */
+    virtual void write_tunnel_header(uint32_t *h, uint32_t vni) const = 0;
+
+  private:
+
+    /**
+     * What the data path needs to encapsulate a packet
+     */
+    struct Template {
+        UDPTunnelHeader header;
+        IPAddress daddr;
+        uint16_t sport_min;
+        uint32_t sport_range;
+        bool cksum;
+    };
+
+    fast_rcu<Template> _template;
+    IPAddress _saddr;
+    IPAddress _daddr;
+    uint32_t _vni;
+    uint16_t _dport;
+
+    static inline Packet *encap(Packet *p, const Template &t);
+
+    enum { h_vni, h_src, h_dst, h_dport };
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+/**
+ * Map of VNIs to the outputs of VXLANDecap and GeneveDecap
+ */
+class VNIDemux { public:
+
+    VNIDemux() : _outputs(0), _any(true) {
+    }
+
+    /**
+     * Send the i-th VNI of vnis to output i of e. Packets with other VNIs
+     * go to the next output if e has one, and are dropped otherwise. With no
+     * VNI, all the packets go to output 0.
+     */
+    int configure(const Vector<uint32_t> &vnis, Element *e, ErrorHandler *errh) CLICK_COLD;
+
+    inline int output(uint32_t vni) const {
+        if (_any)
+            return 0;
+        return _outputs.get(vni);
+    }
+
+  private:
+
+    HashTable<uint32_t, int> _outputs;
+    bool _any;
+
+};
+
+inline uint32_t
+UDPTunnelEncap::inner_flow_hash(Packet *p)
+{
+    const unsigned char *d = p->data();
+    uint32_t h;
+    if (likely(p->length() >= 14 + sizeof(click_ip))
+        && d[12] == 0x08 && d[13] == 0x00) {
+        const click_ip *iph = reinterpret_cast<const click_ip *>(d + 14);
+        h = iph->ip_src.s_addr ^ (iph->ip_dst.s_addr * 0x9E3779B1) ^ iph->ip_p;
+        unsigned hl = iph->ip_hl << 2;
+        if ((iph->ip_p == IP_PROTO_TCP || iph->ip_p == IP_PROTO_UDP)
+            && !IP_ISFRAG(iph) && p->length() >= 14 + hl + 4)
+            h ^= *reinterpret_cast<const uint32_t *>(d + 14 + hl) * 0x85EBCA6B;
+    } else if (p->length() >= 14) {
+        const uint32_t *w = reinterpret_cast<const uint32_t *>(d);
+        h = w[0] ^ (w[1] * 0x9E3779B1) ^ (w[2] * 0x85EBCA6B) ^ *reinterpret_cast<const uint16_t *>(d + 12);
+    } else
+        return 0;
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+    return h;
+}
+
+CLICK_ENDDECLS
+#endif
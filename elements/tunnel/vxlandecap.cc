@@ -0,0 +1,61 @@
+/*
+ * vxlandecap.{cc,hh} -- decapsulates VXLAN packets
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <clicknet/vxlan.h>
+#include "vxlandecap.hh"
+CLICK_DECLS
+
+VXLANDecap::VXLANDecap() : _vni_anno(true)
+{
+}
+
+VXLANDecap::~VXLANDecap()
+{
+}
+
+int
+VXLANDecap::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    Vector<uint32_t> vnis;
+
+    if (Args(conf, this, errh)
+        .read_all("VNI", vnis)
+        .read("VNI_ANNO", _vni_anno)
+        .complete() < 0)
+        return -1;
+
+    return _demux.configure(vnis, this, errh);
+}
+
+inline int
+VXLANDecap::classify(Packet *p)
+{
+    const click_vxlan *vx = reinterpret_cast<const click_vxlan *>(p->data());
+    if (unlikely(p->length() < sizeof(click_vxlan) || !(vx->vx_flags & VXLAN_FLAG_I)))
+        return noutputs();
+
+    uint32_t vni = ntohl(vx->vx_vni) >> 8;
+    if (_vni_anno)
+        SET_AGGREGATE_ANNO(p, vni);
+    p->pull(sizeof(click_vxlan));
+    return _demux.output(vni);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(UDPTunnel)
+EXPORT_ELEMENT(VXLANDecap)
+ELEMENT_MT_SAFE(VXLANDecap)
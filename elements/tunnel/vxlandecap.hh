@@ -0,0 +1,71 @@
+#ifndef CLICK_VXLANDECAP_HH
+#define CLICK_VXLANDECAP_HH
+#include "udptunnel.hh"
+CLICK_DECLS
+
+/*
+=c
+
+VXLANDecap([I<keywords> VNI, VNI_ANNO])
+
+=s tunnel
+
+decapsulates VXLAN packets and demultiplexes them by VNI
+
+=d
+
+Removes the VXLAN header of packets starting with it, such as VXLAN packets
+after StripIPHeader and Strip(8). The inner Ethernet frames are sent to an
+output chosen by their network identifier (VNI).
+
+VNI can be given multiple times: packets with the i-th VNI go to output i.
+Packets with any other VNI go to the next output if there is one, and are
+dropped otherwise. Without VNI, VXLANDecap has one output and all the packets
+go to it. The outputs of the VNIs are found in a small hash table. Packets
+too short or without the I flag are dropped.
+
+Keyword arguments are:
+
+=over 8
+
+=item VNI
+
+Integer. Network identifier of the next output, can be given multiple times.
+
+=item VNI_ANNO
+
+Boolean. Set the aggregate annotation to the VNI. Default is true.
+
+=back
+
+=e
+
+    FromDevice(eth0) -> Strip(14) -> CheckIPHeader -> StripIPHeader -> Strip(8)
+    -> dec :: VXLANDecap(VNI 42, VNI 43);
+    dec[0] -> ToDevice(tap42);
+    dec[1] -> ToDevice(tap43);
+
+=a VXLANEncap, GeneveDecap */
+
+class VXLANDecap : public ClassifyElement<VXLANDecap> { public:
+
+    VXLANDecap() CLICK_COLD;
+    ~VXLANDecap() CLICK_COLD;
+
+    const char *class_name() const override	{ return "VXLANDecap"; }
+    const char *port_count() const override	{ return "1/1-"; }
+    const char *processing() const override	{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) override CLICK_COLD;
+
+    inline int classify(Packet *);
+
+  private:
+
+    VNIDemux _demux;
+    bool _vni_anno;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,46 @@
+/*
+ * vxlanencap.{cc,hh} -- encapsulates Ethernet frames in VXLAN
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <clicknet/vxlan.h>
+#include "vxlanencap.hh"
+CLICK_DECLS
+
+VXLANEncap::VXLANEncap()
+{
+}
+
+VXLANEncap::~VXLANEncap()
+{
+}
+
+uint16_t
+VXLANEncap::default_dport() const
+{
+    return VXLAN_PORT;
+}
+
+void
+VXLANEncap::write_tunnel_header(uint32_t *h, uint32_t vni) const
+{
+    click_vxlan *vx = reinterpret_cast<click_vxlan *>(h);
+    memset(vx, 0, sizeof(click_vxlan));
+    vx->vx_flags = VXLAN_FLAG_I;
+    vx->vx_vni = htonl(vni << 8);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(UDPTunnel)
+EXPORT_ELEMENT(VXLANEncap)
+ELEMENT_MT_SAFE(VXLANEncap)
@@ -3,8 +3,8 @@
  * (bytes removed or inserted) as well as information such as the MSS, ports, ips, last
  * ack received, last ack sent, ...
  *
- * This file also contains the declaration and definition of RBTManager
- * which is the RBTManager used by ByteStreamMaintainer to store the modifications in the flow.
+ * This file also contains the declaration and definition of ByteStreamMap
+ * which is used by ByteStreamMaintainer to store the modifications in the flow.
  *
  * Romain Gaillard.
  */
@@ -15,11 +15,152 @@
 
 #include <click/config.h>
 #include <click/glue.hh>
+#include <click/atomic.hh>
+#include <click/machine.hh>
+#include <click/vector.hh>
 #include <clicknet/tcp.h>
-#include "rbt.hh"
 
 CLICK_DECLS
 
+#define BS_MAP_INLINE_SIZE 8
+
+/** @class ByteStreamMap
+ * @brief Sorted array mapping positions in a flow to the offset to apply from
+ * that position.
+ *
+ * Entries are sorted by position, in sequence number order. Most flows only
+ * have a handful of live modifications, which fit in the inline storage.
+ * New modifications are mostly appended, and pruning acknowledged entries
+ * only moves the start of the array.
+ *
+ * The map has a single writer. Another thread may read it without locking
+ * if the writer protects its updates with a SeqLock : arrays replaced when
+ * the map grows are kept until it is cleared, so a reader never reads freed
+ * memory.
+ */
+class ByteStreamMap
+{
+    public:
+        struct Entry {
+            uint32_t position;
+            int offset;
+        };
+
+        ByteStreamMap();
+        ~ByteStreamMap();
+
+        /** @brief Remove all entries and release the memory
+         */
+        void clear();
+
+        /** @brief Set the offset of a position, replacing any existing one
+         * @param position Position of the modification in the flow
+         * @param offset Offset to apply from that position
+         */
+        void insert(uint32_t position, int offset);
+
+        /** @brief Remove entries that are not needed to map positions after
+         * the given one
+         * @param position Position acknowledged by the destination
+         */
+        void prune(uint32_t position);
+
+        /** @brief Map a position using the entry with the greatest position
+         * less or equal to seek
+         * @param seek Position to look for
+         * @param position Position to map
+         * @param hint Index of the entry found by the previous call, to map
+         * the increasing positions of a batch without searching
+         * @return The mapped position
+         */
+        inline uint32_t map(uint32_t seek, uint32_t position, unsigned &hint) const;
+
+        /** @brief Return the offset of the entry with the greatest position
+         * @return The offset or 0 if the map is empty
+         */
+        inline int lastOffset() const;
+
+        inline unsigned size() const {
+            return _end - _first;
+        }
+
+        void print() const;
+
+    private:
+        inline const Entry* find(uint32_t seek, unsigned &hint, const Entry* &pred) const;
+        void reserve();
+
+        Entry* _entries;
+        unsigned _capacity;
+        unsigned _first;
+        unsigned _end;
+        Entry _inline[BS_MAP_INLINE_SIZE];
+        Vector<Entry*> _retired;
+};
+
+inline const ByteStreamMap::Entry*
+ByteStreamMap::find(uint32_t seek, unsigned &hint, const Entry* &pred) const
+{
+    // The capacity is published after the array, so the indexes we use are
+    // always in the array we read even if the writer grows it meanwhile
+    unsigned capacity = _capacity;
+    click_read_fence();
+    const Entry* e = _entries;
+    unsigned first = _first;
+    unsigned end = _end;
+    if (end > capacity)
+        end = capacity;
+    if (first >= end || SEQ_GT(e[first].position, seek))
+        return 0;
+
+    unsigned i = hint;
+    if (i < first || i >= end || SEQ_GT(e[i].position, seek)
+        || (i + 1 < end && !SEQ_GT(e[i + 1].position, seek))) {
+        // Greatest entry less or equal to seek, in [first, end)
+        unsigned lo = first, hi = end;
+        while (hi - lo > 1) {
+            unsigned mid = (lo + hi) / 2;
+            if (SEQ_GT(e[mid].position, seek))
+                hi = mid;
+            else
+                lo = mid;
+        }
+        i = lo;
+        hint = i;
+    }
+    pred = i > first ? &e[i - 1] : 0;
+    return &e[i];
+}
+
+inline uint32_t
+ByteStreamMap::map(uint32_t seek, uint32_t position, unsigned &hint) const
+{
+    const Entry* pred;
+    const Entry* e = find(seek, hint, pred);
+
+    // If no entry found, no mapping to perform
+    if (!e)
+        return position;
+
+    uint32_t newPosition = position + e->offset;
+
+    // We check that the value we computed is not below the greatest value we could have
+    // obtained via the predecessor
+    uint32_t predBound = e->position + (pred ? pred->offset : 0);
+    if (SEQ_LT(newPosition, predBound))
+        newPosition = predBound;
+
+    return newPosition;
+}
+
+inline int
+ByteStreamMap::lastOffset() const
+{
+    if (_end == _first)
+        return 0;
+    return _entries[_end - 1].offset;
+}
+
 /** @class ByteStreamMaintainer
  * @brief Class used to manage a flow. Stores the modifications in the flow
  * (bytes removed or inserted) as well as information such as the MSS, ports, ips, last
@@ -29,7 +170,7 @@ CLICK_DECLS
  */
 class ByteStreamMaintainer
 {
-    // ModificationList is the only one allowed to add nodes in the trees
+    // ModificationList is the only one allowed to add entries in the maps
     friend class ModificationList;
 
     public:
@@ -46,34 +187,54 @@ class ByteStreamMaintainer
 		new (this) ByteStreamMaintainer();
         }
 
+        /** @brief Indicate whether the ByteStreamMaintainer has been initialized
+         * @return True if the ByteStreamMaintainer has been initialized
+         */
+        inline bool isInitialized() {
+            return initialized;
+        }
+
         /** @brief Map an ack number
          * @param position Initial ack value
          * @return New value, taking into account the modifications in the flow
          */
-        uint32_t mapAck(uint32_t position);
+        inline uint32_t mapAck(uint32_t position);
+
+        /** @brief Map an ack number, for the increasing acks of a batch
+         * @param position Initial ack value
+         * @param hint Hint kept between the calls for a batch, starting at 0
+         * @return New value, taking into account the modifications in the flow
+         */
+        inline uint32_t mapAck(uint32_t position, unsigned &hint);
 
         /** @brief Map a sequence number
          * @param position Initial seq value
          * @return New value, taking into account the modifications in the flow
          */
-        uint32_t mapSeq(uint32_t position);
+        inline uint32_t mapSeq(uint32_t position);
 
-        /** @brief Return the offset corresponding to the last modification in the ack tree
-         * @return The offset with the greatest key in the ack tree or 0 if the tree is empty
+        /** @brief Map a sequence number, for the increasing sequence numbers of a batch
+         * @param position Initial seq value
+         * @param hint Hint kept between the calls for a batch, starting at 0
+         * @return New value, taking into account the modifications in the flow
          */
-        int lastOffsetInAckTree();
+        inline uint32_t mapSeq(uint32_t position, unsigned &hint);
 
-        /** @brief Print the ACK and SEQ trees in the console
+        /** @brief Return the offset corresponding to the last modification in the ack map
+         * @return The offset with the greatest position in the ack map or 0 if the map is empty
          */
-        void printTrees();
+        inline int lastOffsetInAckMap();
+
+        /** @brief Print the ACK and SEQ maps in the console
+         */
+        void printMaps();
 
         /** @brief Initialize the ByteStreamMaintainer (required before beging use)
-         * @param rbtManager The RBTManager used to manage the trees
          * @param flowStart The first sequence number in the flow
          */
-        void initialize(RBTManager *rbtManager, uint32_t flowStart);
+        void initialize(uint32_t flowStart);
 
-        /** @brief Prune the trees
+        /** @brief Prune the maps
          * @param position Value of the last ACK sent by the destination
          */
         void prune(uint32_t position);
@@ -228,29 +389,20 @@ class ByteStreamMaintainer
         inline uint16_t getPortDst();
 
     private:
-        /** @brief Insert a node in the ACK tree
-         * @param position Position of the modification in the flow (key)
-         * @param offset Offset of the modification in the flow (info)
-         */
-        void insertInAckTree(uint32_t position, int offset);
-
-        /** @brief Insert a node in the SEQ tree
-         * @param position Position of the modification in the flow (key)
-         * @param offset Offset of the modification in the flow (info)
+        /** @brief Insert an entry in the ACK map
+         * @param position Position of the modification in the flow
+         * @param offset Offset of the modification in the flow
          */
-        void insertInSeqTree(uint32_t position, int offset);
+        void insertInAckMap(uint32_t position, int offset);
 
-        /** @brief Insert a node in the given tree
-         * @param tree The tree in which the node will be added
+        /** @brief Insert an entry in the SEQ map
          * @param position Position of the modification in the flow
          * @param offset Offset of the modification in the flow
          */
-        void insertInTree(rb_red_blk_tree* tree, uint32_t position, int offset);
+        void insertInSeqMap(uint32_t position, int offset);
 
-        rb_red_blk_tree* treeAck; // Tree used to map the ack numbers
-        rb_red_blk_tree* treeSeq; // Tree used to map the sequence numbers
-        RBTManager* rbtManager; // Manager of the trees (used to allocate memory among others)
-        uint32_t pruneCounter; // Used to avoid pruning for each ack received
+        ByteStreamMap mapAckPositions; // Map used to map the ack numbers
+        ByteStreamMap mapSeqPositions; // Map used to map the sequence numbers
         bool initialized;
         bool lastAckSentSet; // Indicates whether the value lastAckSent is meaningful
         bool lastSeqSentSet; // Indicates whether the value lastSeqSent is meaningful
@@ -273,6 +425,49 @@ class ByteStreamMaintainer
         uint16_t portDst;
 };
 
+uint32_t ByteStreamMaintainer::mapAck(uint32_t position)
+{
+    unsigned hint = 0;
+    return mapAck(position, hint);
+}
+
+uint32_t ByteStreamMaintainer::mapAck(uint32_t position, unsigned &hint)
+{
+    return mapAckPositions.map(position, position, hint);
+}
+
+uint32_t ByteStreamMaintainer::mapSeq(uint32_t position)
+{
+    unsigned hint = 0;
+    return mapSeq(position, hint);
+}
+
+uint32_t ByteStreamMaintainer::mapSeq(uint32_t position, unsigned &hint)
+{
+    // We do not search the requested position but the position just before it
+    // as we do not want to take into account the modifications done at the position itself
+    // but the modifications before it for the mapping of the sequence number.
+    // For instance, if we send a packet with a sequence number equal to 1, containing
+    // a b c d e
+    // and then we add "y y y" at the beginning of the next packet (with sequence number equal
+    // to 6) containing
+    // f g h i j
+    // we thus send the packet "y y y f g h i j" and we add to the seq map the modification
+    // 6: 3
+    // If we receive a retransmission for the second packet because it was lost, we will map
+    // its sequence number (6) and thus have a mapped sequence number equal to 9 (6 + 3).
+    // We will therefore not retransmit the added data and the destination will see a gap
+    // (it will receive a packet with a sequence number equal to 9 instead of 6).
+    // This does not occur if we search the position just before the given one (therefore 5 instead
+    // of 6), we will not take into account the modifications in the packet itself.
+    return mapSeqPositions.map(position - 1, position, hint);
+}
+
+int ByteStreamMaintainer::lastOffsetInAckMap()
+{
+    return mapAckPositions.lastOffset();
+}
+
 void ByteStreamMaintainer::setLastAckSent(uint32_t ackNumber)
 {
     // As the sequence and ack numbers may wrap, we cannot just set a default value (for instance
@@ -5,9 +5,16 @@
 extern "C" {
 #endif
 
+/* CRC-32 with the Ethernet polynomial, most significant bit first. Start
+   with 0xffffffff and feed blocks incrementally. */
 uint32_t update_crc(uint32_t crc_accum, const char *data_blk_ptr,
 		    int data_blk_size);
 
+/* CRC-32C (Castagnoli), least significant bit first, as used by iSCSI and
+   SCTP. Start with 0xffffffff and invert the result. */
+uint32_t update_crc32c(uint32_t crc, const char *data_blk_ptr,
+		       int data_blk_size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -271,6 +271,7 @@ extern __thread FlowTableHolder* fcb_table;
 
 #define SFCB_POOL_COUNT 32
 #define SFCB_POOL_SIZE 2048
+#define FCB_ARENA_SLAB_SIZE (2 * 1024 * 1024)
 class FCBPool {
 private:
     class SFCBList {
@@ -330,8 +331,51 @@ private:
     };
 
 
+    /**
+     * Header of an arena slab. Slabs are carved into FCBs by the thread
+     * that mapped them, so they are local to that thread's NUMA node, and
+     * are only given back to the system when the pool is destroyed.
+     */
+    struct FCBSlab {
+        FCBSlab* next;
+        size_t size;
+        bool huge;
+    };
+
+    struct ArenaState {
+        ArenaState() : cur(0), left(0), slabs(0), n_slabs(0), n_huge(0),
+            reserved(0), allocated(0), released(0), node(-1) {
+        }
+        uint8_t* cur;
+        size_t left;
+        FCBSlab* slabs;
+        unsigned n_slabs;
+        unsigned n_huge;
+        uint64_t reserved;
+        uint64_t allocated;
+        uint64_t released;
+        int node;
+    };
+
+    bool arena_grow(ArenaState &s);
+
+    inline FlowControlBlock* arena_alloc() {
+        ArenaState &s = *_state;
+        if (unlikely(s.left < _fcb_size) && !arena_grow(s))
+            return 0;
+        FlowControlBlock* fcb = (FlowControlBlock*)s.cur;
+        s.cur += _fcb_size;
+        s.left -= _fcb_size;
+        s.reserved++;
+        return fcb;
+    }
+
 	inline FlowControlBlock* alloc_new() {
-		FlowControlBlock* fcb = (FlowControlBlock*)CLICK_LALLOC(sizeof(FlowControlBlock) + _data_size);
+		FlowControlBlock* fcb = 0;
+		if (_arena)
+		    fcb = arena_alloc();
+		if (!fcb)
+		    fcb = (FlowControlBlock*)CLICK_LALLOC(sizeof(FlowControlBlock) + _data_size);
 		flow_assert(fcb);
 /*#if HAVE_DYNAMIC_FLOW_RELEASE_FNT
 		fcb->release_fnt = &pool_release_fnt;
@@ -347,7 +391,11 @@ private:
 
 
 	size_t _data_size;
+	size_t _fcb_size;
+	bool _arena;
+	size_t _arena_page;
 	per_thread_oread<SFCBList> lists;
+	per_thread<ArenaState> _state;
 public:
     static FCBPool* biggest_pool;
     static int initialized;
@@ -358,34 +406,37 @@ public:
     static FlowControlBlock* init_allocate();
     static void init_release(FlowControlBlock*);
 
-	FCBPool() : _data_size(0), lists() {
+	FCBPool() : _data_size(0), _fcb_size(0), _arena(false), _arena_page(0), lists(), _state() {
 	}
 
 	~FCBPool() {
-	    //TODO
-	    /*
-		//Free all per-thread caches
-		for (unsigned i = 0; i < lists.weight(); i++) {
-			SFCBList &list = lists.get_value(i);
-			FlowControlBlock* fcb;
-			while (list.count > 0 && (fcb = list.get()) != NULL) {
-				CLICK_LFREE(fcb,sizeof(FlowControlBlock) + _data_size);
-			}
-		}
+	    release_free_lists();
+	    release_arena();
+	}
 
-		//Free the caches inside the global ring
-		SFCBList list;
-		while ((list = global_fcb_list_ring.extract()) != 0) {
-			FlowControlBlock* fcb;
-			while (list.count > 0 && (fcb = list.get()) != NULL) {
-				CLICK_LFREE(fcb,sizeof(FlowControlBlock) + _data_size);
-			}
-		}*/
+	/**
+	 * Take FCBs from per-thread slabs instead of the general allocator.
+	 * @param page_size Size of the pages backing the slabs : 2MB or 1GB to
+	 *  ask for explicit huge pages, 0 to use normal pages (and transparent
+	 *  huge pages if the system allows it).
+	 * Must be called before initialize().
+	 */
+	void set_arena(bool arena, size_t page_size = 0) {
+	    _arena = arena;
+	    _arena_page = page_size;
 	}
 
+	bool arena() const {
+	    return _arena;
+	}
+
+	void release_arena();
+	void release_free_lists();
+	bool in_arena(const FlowControlBlock* fcb) const;
 
 	void initialize(size_t data_size, FlowTableHolder* table) {
 		_data_size = data_size;
+		_fcb_size = (sizeof(FlowControlBlock) + _data_size + 15) & ~(size_t)15;
 		if (!biggest_pool || biggest_pool->data_size() < data_size) {
 		    biggest_pool = this;
 		    fcb_table = table;
@@ -396,6 +447,8 @@ public:
 	void compress(Bitvector threads);
 
 	inline FlowControlBlock* allocate() {
+		if (_arena)
+		    _state->allocated++;
 		if (lists->count() > 0)
 			return lists->get();
 
@@ -420,6 +473,8 @@ public:
     }
 
 	inline void release(FlowControlBlock* fcb) {
+		if (_arena)
+		    _state->released++;
 		if (lists->count() >= SFCB_POOL_SIZE) {
 			global_fcb_list_ring.insert(lists.get());
 			lists->reset();
@@ -434,6 +489,19 @@ public:
 	size_t data_size() {
 		return _data_size;
 	}
+
+	/**
+	 * Occupancy statistics, summed over all threads. Only meant for handlers.
+	 */
+	struct Stats {
+	    uint64_t in_use;
+	    uint64_t reserved;
+	    size_t slabs;
+	    size_t huge_slabs;
+	    size_t memory;
+	};
+	Stats stats() const;
+	String thread_stats() const;
 };
 
 class FlowTableHolder {
@@ -64,7 +64,11 @@ public:
         int output;
         bool is_default;
     } Rule;
-    static Rule parse(Element* owner, String s, bool verbose = false, bool add_leaf=true);
+    /**
+     * Parse a rule into a chain of nodes. If sort_fields is true, the fields
+     * are tested by increasing offset instead of the order of the rule.
+     */
+    static Rule parse(Element* owner, String s, bool verbose = false, bool add_leaf=true, bool sort_fields=false);
     static Rule make_drop_rule(bool ed = false) {
         Rule r = parse(0, "- drop");
         if (ed)
@@ -102,6 +102,18 @@ public:
         fcb_stack->flags = (nmsec << FLOW_TIMEOUT_SHIFT) | FLOW_TIMEOUT | ((fcb_stack->flags & FLOW_TIMEOUT_INLIST) ? FLOW_TIMEOUT_INLIST : 0);
     }
 
+    /**
+     * Change the timeout of a flow that already acquired one. Unlike
+     * fcb_acquire_timeout, it may lower the timeout, so elements tracking
+     * the state of a flow can move it between timeout classes.
+     */
+    inline void fcb_set_timeout(int nmsec) {
+#if DEBUG_CLASSIFIER_TIMEOUT > 1
+        click_chatter("Setting timeout of %p to %d, flag %d",this,nmsec,fcb_stack->flags);
+#endif
+        fcb_stack->flags = (nmsec << FLOW_TIMEOUT_SHIFT) | FLOW_TIMEOUT | (fcb_stack->flags & (FLOW_TIMEOUT_INLIST | FLOW_EARLY_DROP));
+    }
+
     inline void fcb_release_timeout() {
 #if DEBUG_CLASSIFIER_TIMEOUT > 1
         click_chatter("Releasing timeout of %p",this);
@@ -120,6 +132,11 @@ public:
         fcb_acquire();
     }
 
+    inline void fcb_set_timeout(int nmsec) {
+        //The flow is kept by the reference of fcb_acquire_timeout
+        (void)nmsec;
+    }
+
     inline void fcb_release_timeout() {
         fcb_release();
     }
@@ -180,6 +197,34 @@ public:
 	//The element itself is automatically posted by build_fcb via  fcb_builded_init_future
 	return 0;
     }
+
+    /**
+     * Serializer of the FCB space for flow table snapshots. Snapshots are
+     * opt-in : an element returns true from flow_snapshot_supported() and
+     * overrides the others, e.g. with a copy if its space is plain data.
+     * Managers refuse to save or load a table if an element with FCB space
+     * does not support them. @a remaining_msec is what was left of the
+     * lifetime of the flow, to be used instead of a full timeout.
+     */
+    virtual bool flow_snapshot_supported() const {
+        return false;
+    }
+
+    virtual size_t flow_snapshot_size() const {
+        return 0;
+    }
+
+    virtual void flow_snapshot(FlowControlBlock*, uint8_t*) {
+    }
+
+    virtual void flow_restore(FlowControlBlock*, const uint8_t*, uint32_t) {
+    }
+
+    /**
+     * Called once all flows of a snapshot have been restored
+     */
+    virtual void flow_restore_done() {
+    }
 protected:
 
     int _flow_data_offset;
@@ -237,6 +282,19 @@ protected:
 
     }
 
+    /**
+     * Snapshot of the FCB space of all reachable elements, in the order of
+     * _reachable_list. The layout signature changes if the elements, their
+     * names or their serialized size change. fcb_snapshot_check() fails if
+     * an element with FCB space does not support snapshots.
+     */
+    int fcb_snapshot_check(ErrorHandler* errh);
+    size_t fcb_snapshot_size();
+    uint32_t fcb_snapshot_layout();
+    void fcb_snapshot(FlowControlBlock* fcb, uint8_t* out);
+    void fcb_restore(FlowControlBlock* fcb, const uint8_t* in, uint32_t remaining_msec);
+    void fcb_restore_done();
+
     bool stopClassifier() { return true; };
 
     friend class CTXElement;
@@ -284,6 +342,11 @@ public :
  * void push_batch(int port, T*, Packet*);
  * void release_flow(T*);
  *
+ * To be saved in flow table snapshots, it must also define
+ * static const bool snapshot_supported = true;
+ * And may implement state_snapshot_size(), snapshot_state() and
+ * restore_state() if T cannot be saved by a plain copy.
+ *
  * close_flow() can be called to release the flow now, remove timer etc It will not call your release_flow(); automatically, do it before. A packet coming for the same flow after close_flow() is called will be considered from a new flow (seen flag is reset).
  */
 template<class Derived, typename T> class FlowStateElement : public VirtualFlowSpaceElement {
@@ -306,6 +369,72 @@ public :
         return true;
     }
 
+    /**
+     * CRTP virtual, true if the state can be saved in flow table snapshots
+     */
+    static const bool snapshot_supported = false;
+
+    /**
+     * CRTP virtual, serialization of the state for flow table snapshots.
+     * The default copies T as is. restore_state() may return false to
+     * consider the flow as not seen.
+     */
+    inline size_t state_snapshot_size() const {
+        return sizeof(T);
+    }
+
+    inline void snapshot_state(T* state, uint8_t* out) {
+        memcpy(out, state, sizeof(T));
+    }
+
+    inline bool restore_state(T* state, const uint8_t* in) {
+        memcpy(state, in, sizeof(T));
+        return true;
+    }
+
+    virtual bool flow_snapshot_supported() const override {
+        return Derived::snapshot_supported;
+    }
+
+    virtual size_t flow_snapshot_size() const override {
+        if (!Derived::snapshot_supported)
+            return 0;
+        return 1 + static_cast<const Derived*>(this)->state_snapshot_size();
+    }
+
+    virtual void flow_snapshot(FlowControlBlock* fcb, uint8_t* out) override {
+        if (!Derived::snapshot_supported)
+            return;
+        AT* my_fcb = reinterpret_cast<AT*>(&fcb->data[_flow_data_offset]);
+        out[0] = my_fcb->seen;
+        if (my_fcb->seen)
+            static_cast<Derived*>(this)->snapshot_state(&my_fcb->v, out + 1);
+    }
+
+    virtual void flow_restore(FlowControlBlock* fcb, const uint8_t* in, uint32_t remaining_msec) override {
+        if (!Derived::snapshot_supported)
+            return;
+        AT* my_fcb = reinterpret_cast<AT*>(&fcb->data[_flow_data_offset]);
+        if (!in[0] || !static_cast<Derived*>(this)->restore_state(&my_fcb->v, in + 1))
+            return;
+        my_fcb->seen = true;
+        FlowControlBlock* fcb_save = fcb_stack;
+        fcb_stack = fcb;
+        if (Derived::timeout > 0) {
+            this->fcb_acquire_timeout(Derived::timeout);
+#if HAVE_FLOW_RELEASE_SLOPPY_TIMEOUT
+            //Age the flow so it expires when it would have without the restart
+            uint32_t t = fcb->flags >> FLOW_TIMEOUT_SHIFT;
+            if (remaining_msec < t)
+                fcb->lastseen = Timestamp::recent_steady() - Timestamp::make_msec(t - remaining_msec);
+#endif
+        }
+#if HAVE_DYNAMIC_FLOW_RELEASE_FNT
+        this->fcb_set_release_fnt(my_fcb, &release_fnt);
+#endif
+        fcb_stack = fcb_save;
+    }
+
 
 
     /**
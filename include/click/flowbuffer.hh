@@ -15,6 +15,12 @@
 
 CLICK_DECLS
 
+/**
+ * Longest pattern searched with FlowBuffer::searchSSE(), the carry buffer
+ * keeps up to this many bytes of the previous packets
+ */
+#define FLOW_BUFFER_SEARCH_CARRY 64
+
 class CTXElement;
 
 struct flowBufferEntry
@@ -150,6 +156,11 @@ public:
      */
     FlowBufferContentIter search(FlowBufferContentIter start, const char* pattern, int *feedback);
     FlowBufferContentIter isearch(FlowBufferContentIter start, const char* pattern, int *feedback);
+    /** @brief Same as search, but each packet is searched with SIMD instructions
+     * and only the occurrences spanning packets are checked byte per byte, in a
+     * small carry buffer. Patterns longer than FLOW_BUFFER_SEARCH_CARRY are
+     * searched with search().
+     */
     FlowBufferContentIter searchSSE(FlowBufferContentIter start, const char* pattern, const int pattern_length, int *feedback);
 
     /** @brief Remove data in the flow (across the packets)
@@ -487,7 +498,7 @@ inline FlowBufferContentIter& FlowBufferContentIter::operator+=(int p)
     assert(entry != NULL);
 
     while (entry->getContentOffset() + offsetInPacket + p >= entry->length()) {
-        p -= entry->length() - entry->getContentOffset() + offsetInPacket; //Remove from p what was left in packet
+        p -= entry->length() - (entry->getContentOffset() + offsetInPacket); //Remove from p what was left in packet
         offsetInPacket = 0;
         entry = entry->next();
         if (!entry)
@@ -0,0 +1,154 @@
+// -*- c-basic-offset: 4; related-file-name: "../../lib/flowsnapshot.cc" -*-
+#ifndef CLICK_FLOWSNAPSHOT_HH
+#define CLICK_FLOWSNAPSHOT_HH
+#include <click/string.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <stdio.h>
+CLICK_DECLS
+
+/**
+ * On-disk flow table snapshots, used to warm-restart stateful elements.
+ *
+ * A snapshot is a fixed-size header followed by @a count records of
+ * @a record_size bytes each, so it can be mmap'ed and indexed directly. Every
+ * record starts with a FlowSnapshotRecord giving the remaining lifetime of
+ * the flow and the thread that owned it; the rest of the record is defined by
+ * the element that wrote it, which is checked against the @a owner class name
+ * and the @a layout signature when the snapshot is loaded back.
+ *
+ * Records are written in host byte order: snapshots are meant to be reloaded
+ * on the same machine, by a possibly different binary.
+ */
+
+#define FLOW_SNAPSHOT_MAGIC "CLKFSNAP"
+#define FLOW_SNAPSHOT_VERSION 1
+
+struct FlowSnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t record_size;
+    uint32_t layout;
+    uint64_t count;
+    int64_t timestamp_msec;
+    char owner[64];
+};
+
+struct FlowSnapshotRecord {
+    uint32_t expiry_msec; //Remaining lifetime when the snapshot was taken
+    uint16_t thread;
+    uint16_t flags;
+
+    /**
+     * Element-defined part of the record, right after this header.
+     */
+    inline uint8_t *data() {
+        return reinterpret_cast<uint8_t *>(this + 1);
+    }
+    inline const uint8_t *data() const {
+        return reinterpret_cast<const uint8_t *>(this + 1);
+    }
+};
+
+class FlowSnapshotWriter { public:
+
+    FlowSnapshotWriter();
+    ~FlowSnapshotWriter();
+
+    /**
+     * Start a new snapshot. Records are written to a temporary file that
+     * replaces @a path only when commit() succeeds.
+     */
+    int open(const String &path, const String &owner, uint32_t record_size,
+             uint32_t layout, ErrorHandler *errh);
+
+    /**
+     * Return a zeroed record to fill, valid until the next call.
+     */
+    FlowSnapshotRecord *append();
+
+    int commit(ErrorHandler *errh);
+
+    uint64_t count() const {
+        return _count;
+    }
+
+  private:
+
+    int flush(ErrorHandler *errh);
+
+    String _path;
+    String _tmp_path;
+    FILE *_f;
+    StringAccum _buf;
+    FlowSnapshotHeader _header;
+    uint64_t _count;
+    bool _failed;
+};
+
+class FlowSnapshotReader { public:
+
+    FlowSnapshotReader();
+    ~FlowSnapshotReader();
+
+    /**
+     * Map a snapshot, checking it was written by @a owner with the same
+     * record layout.
+     */
+    int open(const String &path, const String &owner, uint32_t record_size,
+             uint32_t layout, ErrorHandler *errh);
+    void close();
+
+    uint64_t count() const {
+        return _header ? _header->count : 0;
+    }
+
+    inline const FlowSnapshotRecord *record(uint64_t i) const {
+        return reinterpret_cast<const FlowSnapshotRecord *>(_records + i * _header->record_size);
+    }
+
+    /**
+     * Remaining lifetime of the record now, taking into account the time
+     * elapsed since the snapshot was taken. 0 if the flow already expired.
+     */
+    inline uint32_t remaining_msec(const FlowSnapshotRecord *r) const {
+        return r->expiry_msec > _age_msec ? r->expiry_msec - _age_msec : 0;
+    }
+
+  private:
+
+    const FlowSnapshotHeader *_header;
+    const uint8_t *_records;
+    size_t _len;
+    uint32_t _age_msec;
+};
+
+/**
+ * Fowler-Noll-Vo hash, used to sign record layouts.
+ */
+inline uint32_t
+flow_snapshot_layout(uint32_t h, const void *data, size_t len)
+{
+    const uint8_t *d = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ d[i]) * 16777619;
+    return h;
+}
+
+inline uint32_t
+flow_snapshot_layout(uint32_t h, const String &s)
+{
+    return flow_snapshot_layout(h, s.data(), s.length());
+}
+
+inline uint32_t
+flow_snapshot_layout(uint32_t h, uint32_t v)
+{
+    return flow_snapshot_layout(h, &v, sizeof(v));
+}
+
+#define FLOW_SNAPSHOT_LAYOUT_INIT 2166136261U
+
+CLICK_ENDDECLS
+#endif
@@ -12,13 +12,34 @@
 #include <click/tcphelper.hh>
 #include <click/straccum.hh>
 #include <click/args.hh>
+#include <click/error.hh>
 #include <click/timer.hh>
 #include <click/algorithm.hh>
+#include <clicknet/ip.h>
+#include <clicknet/tcp.h>
+
+/**
+ * Number of SYNs waiting for their SYN-ACK to measure the latency of the
+ * servers, must be a power of 2
+ */
+#define LB_LATENCY_PROBES 4096
+
+/**
+ * Time after which a SYN without SYN-ACK counts as a sample of its elapsed
+ * time, in microseconds
+ */
+#define LB_LATENCY_TIMEOUT 1000000
 
 template <typename T>
 class LoadBalancer { public:
 
-    LoadBalancer() : _current(0), _dsts(), _weights_helper(), _mode_case(round_robin) {
+    /**
+     * Returned by pick_server when no destination can take the packet,
+     * which is then dropped
+     */
+    static const int no_server = -1;
+
+    LoadBalancer() : _current(0), _dsts(), _weights_helper(), _mode_case(round_robin), _maglev_size(65537) {
         modetrans.find_insert("rr",round_robin);
         modetrans.find_insert("hash",direct_hash);
         modetrans.find_insert("chash",direct_chash);
@@ -33,10 +54,12 @@ class LoadBalancer { public:
         modetrans.find_insert("least",least_load);
         modetrans.find_insert("pow2",pow2);
         modetrans.find_insert("table",table);
+        modetrans.find_insert("maglev",maglev);
         lsttrans.find_insert("conn",connections);
         lsttrans.find_insert("packets",packets);
         lsttrans.find_insert("bytes",bytes);
         lsttrans.find_insert("cpu",cpu);
+        lsttrans.find_insert("latency",latency);
     }
 
     enum LBMode {
@@ -51,8 +74,8 @@ class LoadBalancer { public:
         direct_hash_agg,
         direct_hash_ip,
         least_load,
-        table
-
+        table,
+        maglev
     };
 
     static bool isLoadBased(LBMode mode) {
@@ -64,7 +87,8 @@ class LoadBalancer { public:
         connections,
         packets,
         bytes,
-        cpu
+        cpu,
+        latency
     };
 
     typedef atomic_uint64_t load_type_t;
@@ -84,6 +108,59 @@ class LoadBalancer { public:
         uint64_t raw_cpu_load;
     } CLICK_CACHE_ALIGN;
 
+    /**
+     * Record the handshake RTT of the connection of a SYN-ACK packet coming
+     * back from a server. Reverse elements call this on every packet, it
+     * returns immediately if the metric is not latency.
+     */
+    inline void track_latency(Packet* p) {
+        if (likely(_lst_case != latency) || !p->has_network_header())
+            return;
+        const click_ip* iph = p->ip_header();
+        if (iph->ip_p != IP_PROTO_TCP || !IP_FIRSTFRAG(iph))
+            return;
+        const click_tcp* th = p->tcp_header();
+        if ((th->th_flags & (TH_SYN | TH_ACK)) != (TH_SYN | TH_ACK))
+            return;
+        LatencyState &s = *_latency;
+        LatencyProbe &probe = s.probes.unchecked_at(probe_index(iph->ip_dst.s_addr, th->th_dport));
+        if (probe.client != iph->ip_dst.s_addr || probe.port != th->th_dport || probe.server >= s.ewma.size())
+            return;
+        uint32_t sample = (uint32_t) Timestamp::now_steady().usecval() - probe.start;
+        probe.client = 0;
+        add_latency_sample(s, probe.server, sample);
+    }
+
+    /**
+     * A SYN that was sent to a server, waiting for the SYN-ACK. The probes
+     * are a lossy direct-mapped table per thread, so the SYN-ACK must come
+     * back on the thread that sent the SYN. A probe that is overwritten or
+     * older than LB_LATENCY_TIMEOUT before its SYN-ACK gives its elapsed
+     * time as a sample, if it is above the current average.
+     */
+    struct LatencyProbe {
+        uint32_t client;
+        uint16_t port;
+        uint16_t server;
+        uint32_t start;
+    };
+
+    /**
+     * Latency measures of a thread: its probes, the moving average of the
+     * handshake RTT of each server in us, 0 until measured, and the sum of
+     * the measured averages. Only the thread writes it, the handlers merge
+     * the threads.
+     */
+    struct LatencyState {
+        LatencyState() : sweep(0), sum(0), measured(0) {
+        }
+        Vector<LatencyProbe> probes;
+        unsigned sweep;
+        Vector<uint32_t> ewma;
+        uint64_t sum;
+        int measured;
+    };
+
 protected:
     HashTable<String, LBMode> modetrans;
     HashTable<String, LSTMode> lsttrans;
@@ -101,6 +178,94 @@ protected:
     int _awrr_interval;
     float _alpha;
     bool _autoscale;
+    Vector <unsigned> _backend_weights;
+    int _maglev_size;
+    unprotected_rcu_singlewriter<Vector <unsigned>,2> _maglev_table;
+    per_thread<LatencyState> _latency;
+
+    inline unsigned probe_index(uint32_t client, uint16_t port) {
+        uint32_t h = client ^ port;
+        h ^= h >> 16;
+        h *= 0x85ebca6b;
+        h ^= h >> 13;
+        return h & (LB_LATENCY_PROBES - 1);
+    }
+
+    /**
+     * Add a handshake RTT sample to the moving average of server b
+     */
+    inline void add_latency_sample(LatencyState &s, int b, uint32_t sample) {
+        uint32_t old = s.ewma.unchecked_at(b);
+        uint32_t v = old ? old - (old >> 3) + (sample >> 3) : sample;
+        if (!v)
+            v = 1;
+        if (!old)
+            s.measured++;
+        s.sum += v;
+        s.sum -= old;
+        s.ewma.unchecked_at(b) = v;
+    }
+
+    /**
+     * A SYN sent to the server of probe did not get its SYN-ACK yet. It
+     * lasted at least the elapsed time, which only tells something when it
+     * is above the average.
+     */
+    inline void expire_latency_probe(LatencyState &s, LatencyProbe &probe, uint32_t now) {
+        uint32_t elapsed = now - probe.start;
+        probe.client = 0;
+        if ((int)probe.server < s.ewma.size() && elapsed > s.ewma.unchecked_at(probe.server))
+            add_latency_sample(s, probe.server, elapsed);
+    }
+
+    inline void track_latency_start(Packet* p, int b) {
+        if (!p->has_network_header())
+            return;
+        const click_ip* iph = p->ip_header();
+        uint32_t now = (uint32_t) Timestamp::now_steady().usecval();
+        LatencyState &s = *_latency;
+        // Look at one more probe per SYN, so unanswered ones are accounted
+        // even when they are never overwritten
+        LatencyProbe &old = s.probes.unchecked_at(s.sweep++ & (LB_LATENCY_PROBES - 1));
+        if (old.client && now - old.start > LB_LATENCY_TIMEOUT)
+            expire_latency_probe(s, old, now);
+        LatencyProbe &probe = s.probes.unchecked_at(probe_index(iph->ip_src.s_addr, p->tcp_header()->th_sport));
+        if (probe.client)
+            expire_latency_probe(s, probe, now);
+        probe.client = iph->ip_src.s_addr;
+        probe.port = p->tcp_header()->th_sport;
+        probe.server = b;
+        probe.start = now;
+    }
+
+    /**
+     * Latency of server idx as measured by the current thread, or the
+     * average of the servers it measured if it did not measure this one
+     * yet, so it is neither preferred nor avoided
+     */
+    inline uint64_t get_latency(int idx) {
+        const LatencyState &s = *_latency;
+        uint32_t l = s.ewma.unchecked_at(idx);
+        if (l)
+            return l;
+        return s.measured ? s.sum / s.measured : 0;
+    }
+
+    /**
+     * Latency of server idx, averaged over the threads that measured it
+     */
+    uint64_t merged_latency(int idx) {
+        uint64_t tot = 0;
+        int n = 0;
+        for (unsigned i = 0; i < _latency.weight(); i++) {
+            const LatencyState &s = _latency.get_value(i);
+            if (idx < s.ewma.size() && s.ewma[idx]) {
+                tot += s.ewma[idx];
+                n++;
+            }
+        }
+        return n ? tot / n : 0;
+    }
 
     uint64_t get_load_metric(int idx) {
         return get_load_metric(idx, _lst_case);
@@ -121,6 +286,9 @@ protected:
             case cpu: {
                 return l.cpu_load;
             }
+            case latency: {
+                return get_latency(idx);
+            }
             default:
                 assert(false);
         }
@@ -146,8 +314,11 @@ protected:
 
     inline void track_load(Packet*p, int b) {
         if (_track_load) {
-            if (TCPHelper::isSyn(p))
+            if (TCPHelper::isSyn(p)) {
                      _loads[b].connection_load++;
+                     if (_lst_case == latency)
+                         track_latency_start(p, b);
+            }
             else if (TCPHelper::isFin(p) || TCPHelper::isRst(p))
                      _loads[b].connection_load--;
 
@@ -179,6 +350,94 @@ protected:
         _cst_hash.swap(new_hash);
     }
 
+    static inline uint32_t maglev_mix(uint32_t h) {
+        h ^= h >> 16;
+        h *= 0x85ebca6b;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35;
+        h ^= h >> 16;
+        return h;
+    }
+
+    static bool is_prime(int n) {
+        if (n < 2)
+            return false;
+        for (int d = 2; d * d <= n; d++)
+            if (n % d == 0)
+                return false;
+        return true;
+    }
+
+    /* Builds the Maglev lookup table of the active servers
+     *
+     * Each server fills the entries of the table in the order of its own
+     * permutation, which only depends on the server id, taking as many turns
+     * per round as its weight. Removing or adding a server therefore only
+     * moves the entries it loses or takes. The new table is swapped in
+     * atomically, packets never see a partial table.
+     */
+    void build_maglev() {
+        const unsigned m = _maglev_size;
+        const int n = _selector.size();
+        if (_backend_weights.size() < _dsts.size())
+            _backend_weights.resize(_dsts.size(), 1);
+        Vector<unsigned> entries;
+        uint64_t total = 0;
+        for (int i = 0; i < n; i++)
+            total += _backend_weights[_selector[i]];
+        if (total == 0) {
+            //No server can take the flows, an empty table picks none
+            _maglev_table.write_begin().swap(entries);
+            _maglev_table.write_commit();
+            return;
+        }
+        entries.resize(m, (unsigned)-1);
+        Vector<unsigned> offset(n, 0), skip(n, 0), next(n, 0);
+        for (int i = 0; i < n; i++) {
+            offset[i] = maglev_mix(_selector[i] * 2 + 1) % m;
+            skip[i] = maglev_mix(_selector[i] * 2 + 2) % (m - 1) + 1;
+        }
+        unsigned filled = 0;
+        while (filled < m) {
+            for (int i = 0; i < n && filled < m; i++) {
+                unsigned turns = _backend_weights[_selector[i]];
+                for (unsigned t = 0; t < turns && filled < m; t++) {
+                    unsigned c;
+                    do {
+                        c = (offset[i] + (uint64_t)next[i] * skip[i]) % m;
+                        next[i]++;
+                    } while (entries[c] != (unsigned)-1);
+                    entries[c] = _selector[i];
+                    filled++;
+                }
+            }
+        }
+        _maglev_table.write_begin().swap(entries);
+        _maglev_table.write_commit();
+    }
+
+    /* Set the weight of each destination, from a space-separated list
+     */
+    int parse_weights(const String &s, ErrorHandler* errh) {
+        Vector<String> words;
+        cp_spacevec(s, words);
+        if (words.size() != _dsts.size())
+            return errh->error("WEIGHTS must have one weight per destination");
+        Vector<unsigned> weights;
+        uint64_t total = 0;
+        for (int i = 0; i < words.size(); i++) {
+            unsigned w;
+            if (!IntArg().parse(words[i], w))
+                return errh->error("Invalid weight %s", words[i].c_str());
+            weights.push_back(w);
+            total += w;
+        }
+        if (total == 0)
+            return errh->error("WEIGHTS must not be all zero");
+        _backend_weights.swap(weights);
+        return 0;
+    }
+
     static void atc(Timer *timer, void *user_data) {
         LoadBalancer* lb = (LoadBalancer*)user_data;
         uint64_t metric_tot = 0;
@@ -245,6 +504,7 @@ protected:
         int cst_buckets;
         int nserver;
         bool force_track_load;
+        String weights;
         int ret = Args(lb, errh).bind(conf)
             .read_or_set("LB_MODE", lb_mode,"rr")
             .read_or_set("LST_MODE",lst_mode,"conn")
@@ -253,11 +513,19 @@ protected:
             .read_or_set("FORCE_TRACK_LOAD", force_track_load, false)
             .read_or_set("NSERVER", nserver, 0)
             .read("CST_BUCKETS", cst_buckets).read_status(has_cst_buckets)
+            .read_or_set("MAGLEV_SIZE", _maglev_size, 65537)
+            .read("WEIGHTS", AnyArg(), weights)
             .read_or_set("AWRR_ALPHA", alpha, 0).consume();
 
         if (ret < 0)
             return -1;
 
+        if (!is_prime(_maglev_size))
+            return errh->error("MAGLEV_SIZE must be a prime number");
+        _backend_weights.resize(_dsts.size(), 1);
+        if (weights && parse_weights(weights, errh) < 0)
+            return -1;
+
         _alpha = alpha;
         _autoscale = autoscale;
 	_force_track_load = force_track_load;
@@ -290,6 +558,8 @@ protected:
         _selector.swap(news);
         if (_mode_case == constant_hash_agg) {
             build_hash_ring();
+        } else if (_mode_case == maglev) {
+            build_maglev();
         }
     }
 
@@ -313,11 +583,13 @@ protected:
         _selector.swap(news);
         if (_mode_case == constant_hash_agg) {
             build_hash_ring();
+        } else if (_mode_case == maglev) {
+            build_maglev();
         }
     }
 
     enum {
-            h_load,h_load_raw,h_nb_total_servers,h_nb_active_servers,h_load_conn,h_load_packets,h_load_bytes,h_add_server,h_remove_server,h_lb_max
+            h_load,h_load_raw,h_nb_total_servers,h_nb_active_servers,h_load_conn,h_load_packets,h_load_bytes,h_add_server,h_remove_server,h_weights,h_load_latency,h_lb_max
     };
 
 
@@ -400,6 +672,13 @@ protected:
                 remove_server();
                 break;
             }
+            case h_weights: {
+                if (parse_weights(input, errh) < 0)
+                    return -1;
+                if (_mode_case == maglev)
+                    build_maglev();
+                return 0;
+            }
         }
         return -1;
     }
@@ -434,6 +713,12 @@ protected:
                     acc << cs->get_load_metric(i,bytes) << (i == cs->_dsts.size() -1?"":" ");
                 }
                 return acc.take_string();}
+            case h_load_latency:{
+                StringAccum acc;
+                for (int i = 0; i < cs->_dsts.size(); i ++) {
+                    acc << cs->merged_latency(i) << (i == cs->_dsts.size() -1?"":" ");
+                }
+                return acc.take_string();}
             default:
                 return "<none>";
         }
@@ -465,8 +750,10 @@ protected:
         e->add_read_handler("load_conn", e->read_handler, h_load_conn);
         e->add_read_handler("load_bytes", e->read_handler, h_load_bytes);
         e->add_read_handler("load_packets", e->read_handler, h_load_packets);
+        e->add_read_handler("load_latency", e->read_handler, h_load_latency);
         e->add_write_handler("remove_server", e->write_handler, h_remove_server);
         e->add_write_handler("add_server", e->write_handler, h_add_server);
+        e->add_write_handler("weights", e->write_handler, h_weights);
     }
 
     void set_mode(String mode, String metric="cpu", Element* owner=0,int awrr_timer_interval = -1, int nserver = 0) {
@@ -518,10 +805,20 @@ protected:
             if (_cst_hash.size() == 0)
                 _cst_hash.resize(_dsts.size() * 100);
             build_hash_ring();
+        } else if (_mode_case == maglev) {
+            build_maglev();
         }
 
         _loads.resize(_dsts.size());
         CLICK_ASSERT_ALIGNED(_loads.data());
+        if (_lst_case == latency) {
+            LatencyProbe empty = {0, 0, 0, 0};
+            for (unsigned i = 0; i < _latency.weight(); i++) {
+                LatencyState &s = _latency.get_value(i);
+                s.probes.resize(LB_LATENCY_PROBES, empty);
+                s.ewma.resize(_dsts.size(), 0);
+            }
+        }
 
     }
 
@@ -605,6 +902,19 @@ protected:
                         comp = [&](MachineLoad m,MachineLoad n)-> bool {return m.packets_load<n.packets_load;};
                         break;
                     }
+                    case latency: {
+                        //Unmeasured servers count as the average
+                        int sid = 0;
+                        uint64_t best = get_latency(0);
+                        for (int i = 1; i < _loads.size(); i++) {
+                            uint64_t l = get_latency(i);
+                            if (l < best) {
+                                best = l;
+                                sid = i;
+                            }
+                        }
+                        return sid;
+                    }
                     case cpu: {
                         comp = [&](MachineLoad m,MachineLoad n)-> bool {return m.cpu_load<n.cpu_load;};
                         break;
@@ -621,8 +931,8 @@ protected:
                         assert(false);
                         break;
                 }
-                auto result = std::min_element(std::begin(_loads), std::end(_loads),comp);
-                int sid = std::distance(std::begin(_loads), result);
+                auto result = std::min_element(_loads.begin(), _loads.end(), comp);
+                int sid = result - _loads.begin();
                 //click_chatter("%s\n--> %d",a.c_str(), sid);
                 return sid;
             }
@@ -640,6 +950,9 @@ protected:
                     case packets: {
                         return (_loads[a].packets_load > _loads[b].packets_load?b:a);
                     }
+                    case latency: {
+                        return (get_latency(a) > get_latency(b)?b:a);
+                    }
                     case cpu: {
                         int ret = (_loads[a].cpu_load > _loads[b].cpu_load?b:a);
                         //click_chatter("A %d B %d -> %d",a ,b, ret);
@@ -653,6 +966,16 @@ protected:
             case direct_chash: {
                 return hash_4tuple(p, _selector.size());
             }
+            case maglev: {
+                const Vector<unsigned> &t = _maglev_table.read_begin();
+                int server = no_server;
+                if (likely(t.size())) {
+                    uint32_t h = maglev_mix(IPFlowID(p, false).hashcode());
+                    server = t.unchecked_at(((uint64_t)h * t.size()) >> 32);
+                }
+                _maglev_table.read_end();
+                return server;
+            }
             case table: {
 
                 auto & wh = _weights_helper.read_begin();
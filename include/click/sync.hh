@@ -943,6 +943,49 @@ ReadWriteLock::release_write()
 #endif
 }
 
+/** @class SeqLock
+ * @brief A sequence lock, for data written by one thread and read by others.
+ *
+ * The writer surrounds its updates with write_begin() and write_end(), which
+ * never wait. Readers get a version with read_begin(), read the data, then
+ * call read_retry() : if it returns true the writer changed the data in the
+ * meantime and the read must be done again. Readers must not act on what
+ * they read before read_retry() returned false.
+ *
+ * Concurrent writers must be serialized by other means.
+ */
+class SeqLock { public:
+
+    SeqLock() : _version(0) {
+    }
+
+    inline void write_begin() {
+        _version = _version + 1;
+        click_write_fence();
+    }
+
+    inline void write_end() {
+        click_write_fence();
+        _version = _version + 1;
+    }
+
+    inline uint32_t read_begin() const {
+        uint32_t v;
+        while ((v = _version) & 1)
+            click_relax_fence();
+        click_read_fence();
+        return v;
+    }
+
+    inline bool read_retry(uint32_t v) const {
+        click_read_fence();
+        return _version != v;
+    }
+
+  private:
+    volatile uint32_t _version;
+};
+
 /**
  * Fake lock
  *
@@ -0,0 +1,23 @@
+/* -*- mode: c; c-basic-offset: 4 -*- */
+#ifndef CLICKNET_GENEVE_H
+#define CLICKNET_GENEVE_H
+
+/*
+ * <clicknet/geneve.h> -- Geneve header, RFC 8926
+ */
+
+struct click_geneve {
+    uint8_t	gn_ver_optlen;		/* 0     version, options length     */
+#define GENEVE_VERSION(g)	((g)->gn_ver_optlen >> 6)
+#define GENEVE_OPTLEN(g)	(((g)->gn_ver_optlen & 0x3F) << 2) /* bytes */
+    uint8_t	gn_flags;		/* 1     flags			     */
+#define GENEVE_FLAG_O		0x80	/*       control packet		     */
+#define GENEVE_FLAG_C		0x40	/*       critical options present    */
+    uint16_t	gn_proto;		/* 2-3   protocol of the payload     */
+#define GENEVE_PROTO_ETHER	0x6558	/*       transparent Ethernet	     */
+    uint32_t	gn_vni;			/* 4-7   VNI in the 24 high bits     */
+};
+
+#define GENEVE_PORT		6081
+
+#endif
@@ -0,0 +1,18 @@
+/* -*- mode: c; c-basic-offset: 4 -*- */
+#ifndef CLICKNET_VXLAN_H
+#define CLICKNET_VXLAN_H
+
+/*
+ * <clicknet/vxlan.h> -- VXLAN header, RFC 7348
+ */
+
+struct click_vxlan {
+    uint8_t	vx_flags;		/* 0     flags			     */
+#define VXLAN_FLAG_I		0x08	/*       VNI is valid		     */
+    uint8_t	vx_reserved1[3];	/* 1-3   reserved		     */
+    uint32_t	vx_vni;			/* 4-7   VNI in the 24 high bits     */
+};
+
+#define VXLAN_PORT		4789
+
+#endif
@@ -9,23 +9,118 @@
 #include <click/config.h>
 #include <click/glue.hh>
 #include <clicknet/tcp.h>
-#include <click/rbt.hh>
 #include <click/bytestreammaintainer.hh>
-#include <click/memorypool.hh>
 
 CLICK_DECLS
 
+ByteStreamMap::ByteStreamMap() : _entries(_inline), _capacity(BS_MAP_INLINE_SIZE), _first(0), _end(0)
+{
+}
+
+ByteStreamMap::~ByteStreamMap()
+{
+    clear();
+}
+
+void ByteStreamMap::clear()
+{
+    if (_entries != _inline)
+        delete[] _entries;
+    for (int i = 0; i < _retired.size(); i++)
+        delete[] _retired[i];
+    _retired.clear();
+    _entries = _inline;
+    _capacity = BS_MAP_INLINE_SIZE;
+    _first = 0;
+    _end = 0;
+}
+
+/**
+ * Make room for one more entry at the end of the array
+ */
+void ByteStreamMap::reserve()
+{
+    unsigned n = _end - _first;
+
+    // Reuse the space left by pruned entries if it is worth it
+    if (_first >= _capacity / 4) {
+        memmove(_entries, _entries + _first, n * sizeof(Entry));
+        _first = 0;
+        _end = n;
+        return;
+    }
+
+    unsigned capacity = _capacity * 2;
+    Entry* entries = new Entry[capacity];
+    memcpy(entries, _entries + _first, n * sizeof(Entry));
+    // A reader of the other direction may still use the old array
+    if (_entries != _inline)
+        _retired.push_back(_entries);
+    _first = 0;
+    _end = n;
+    _entries = entries;
+    click_write_fence();
+    _capacity = capacity;
+}
+
+void ByteStreamMap::insert(uint32_t position, int offset)
+{
+    // Modifications are mostly made after the previous ones
+    unsigned i = _end;
+    while (i > _first && SEQ_GT(_entries[i - 1].position, position))
+        i--;
+
+    // Entry already exists, replace the old value
+    if (i > _first && _entries[i - 1].position == position) {
+        _entries[i - 1].offset = offset;
+        return;
+    }
+
+    if (_end == _capacity) {
+        unsigned first = _first;
+        reserve();
+        i -= first - _first;
+    }
+
+    memmove(_entries + i + 1, _entries + i, (_end - i) * sizeof(Entry));
+    _entries[i].position = position;
+    _entries[i].offset = offset;
+    click_write_fence();
+    _end++;
+}
+
+void ByteStreamMap::prune(uint32_t position)
+{
+    unsigned hint = 0;
+    const Entry* pred;
+    const Entry* e = find(position, hint, pred);
+    if (!e)
+        return;
+
+    // We will not prune until the entry retrieved, but instead, until
+    // the predecessor of the predecessor of the entry retrieved.
+    // The first predecessor is used because in order to map a sequence number,
+    // we need to map it using the position just before it
+    // The predecessor of the predecessor is used because to perform
+    // a mapping, we look at the predecessor of the entry obtained to have a bound
+    unsigned i = e - _entries;
+    if (i >= _first + 2)
+        _first = i - 2;
+}
+
+void ByteStreamMap::print() const
+{
+    for (unsigned i = _first; i < _end; i++)
+        click_chatter("%u: %d", _entries[i].position, _entries[i].offset);
+}
+
 ByteStreamMaintainer::ByteStreamMaintainer()
 {
-    rbtManager = NULL;
     lastAckSent = 0;
     lastPayloadLength = 0;
     lastAckReceived = 0;
     lastSeqSent = 0;
-    pruneCounter = 0;
     initialized = false;
-    treeAck = NULL;
-    treeSeq = NULL;
     windowSize = 32120;
     windowScale = 1;
     useWindowScale = false;
@@ -38,7 +133,7 @@ ByteStreamMaintainer::ByteStreamMaintainer()
     dupAcks = 0;
 }
 
-void ByteStreamMaintainer::initialize(RBTManager *rbtManager, uint32_t flowStart)
+void ByteStreamMaintainer::initialize(uint32_t flowStart)
 {
     if(initialized)
     {
@@ -46,138 +141,41 @@ void ByteStreamMaintainer::initialize(RBTManager *rbtManager, uint32_t flowStart
         return;
     }
 
-    this->rbtManager = rbtManager;
-    treeAck = RBTreeCreate(rbtManager); // Create the RBT for ACK
-    treeSeq = RBTreeCreate(rbtManager); // Create the RBT for Seq
-
     initialized = true;
 
     // Insert a key indicating the beginning of the flow. It will be used
     // as a guard
-    insertInAckTree(flowStart, 0);
-    insertInSeqTree(flowStart, 0);
+    insertInAckMap(flowStart, 0);
+    insertInSeqMap(flowStart, 0);
 }
 
-uint32_t ByteStreamMaintainer::mapAck(uint32_t position)
+void ByteStreamMaintainer::printMaps()
 {
-    if(!initialized)
-    {
-        click_chatter("Error: ByteStreamMaintainer is not initialized");
-        assert(false);
-        return 0;
-    }
-
-    uint32_t positionSeek = position;
-
-    // Find the element with the greatest key that is less or equal to the given position
-    rb_red_blk_node* node = RBFindElementGreatestBelow(treeAck, &positionSeek);
-    rb_red_blk_node* pred = treeAck->nil;
-    uint32_t nodeKey = 0;
-    int nodeInfo = 0;
-    uint32_t newPosition = position;
-
-    // If no node found, no mapping to perform
-    if(node == treeAck->nil)
-        return position;
-
-    // Compute the new position if a node has been found
-    nodeKey = *((uint32_t*)node->key);
-    nodeInfo = *((int*)node->info);
-
-    newPosition += nodeInfo;
-
-    // Search the predecessor of the node
-    pred = TreePredecessor(treeAck, node);
-
-    int predOffset = 0;
-    // If the node has a predecessor
-    if(pred != treeAck->nil)
-    {
-        uint32_t predKey = *((uint32_t*)pred->key);
-        predOffset = *((int*)pred->info);
-    }
-
-    // We check that the value we computed is not below the greatest value we could have
-    // obtained via the predecessor
-    uint32_t predBound = nodeKey + predOffset;
-    if(SEQ_LT(newPosition, predBound))
-        newPosition = predBound;
+    click_chatter("Ack map:");
+    mapAckPositions.print();
 
-    return newPosition;
+    click_chatter("Seq map:");
+    mapSeqPositions.print();
 }
 
-uint32_t ByteStreamMaintainer::mapSeq(uint32_t position)
+void ByteStreamMaintainer::prune(uint32_t position)
 {
     if(!initialized)
     {
         click_chatter("Error: ByteStreamMaintainer is not initialized");
         assert(false);
-        return 0;
-    }
-
-    // We do not search the requested position but the position just before it
-    // as we do not want to take into account the modifications done at the position itself
-    // but the modifications before it for the mapping of the sequence number.
-    // For instance, if we send a packet with a sequence number equal to 1, containing
-    // a b c d e
-    // and then we add "y y y" at the beginning of the next packet (with sequence number equal
-    // to 6) containing
-    // f g h i j
-    // we thus send the packet "y y y f g h i j" and we add to the seq tree the modification
-    // 6: 3
-    // If we receive a retransmission for the second packet because it was lost, we will map
-    // its sequence number (6) and thus have a mapped sequence number equal to 9 (6 + 3).
-    // We will therefore not retransmit the added data and the destination will see a gap
-    // (it will receive a packet with a sequence number equal to 9 instead of 6).
-    // This does not occur if we search the position just before the given one (therefore 5 instead
-    // of 6), we will not take into account the modifications in the packet itself.
-    uint32_t positionSeek = position - 1;
-
-    // Find the element with the greatest key that is less or equal to the given position
-    rb_red_blk_node* node = RBFindElementGreatestBelow(treeSeq, &positionSeek);
-    rb_red_blk_node* pred = treeSeq->nil;
-    uint32_t newPosition = position;
-
-    // If no node found, no mapping to perform
-    if(node == treeSeq->nil)
-        return position;
-
-    // Compute the new position
-    uint32_t nodeKey = *((uint32_t*)node->key);
-    int nodeInfo = *((int*)node->info);
-
-    newPosition += nodeInfo;
-
-    // Search the predecessor of the node
-    pred = TreePredecessor(treeSeq, node);
-
-    int predOffset = 0;
-    // If the node has a predecessor
-    if(pred != treeSeq->nil)
-    {
-        uint32_t predKey = *((uint32_t*)pred->key);
-        predOffset = *((int*)pred->info);
+        return;
     }
 
-    // We check that the value we computed is not below the greatest value we could have
-    // obtained via the predecessor
-    uint32_t predBound = nodeKey + predOffset;
-    if(SEQ_LT(newPosition, predBound))
-        newPosition = predBound;
-
-    return newPosition;
-}
-
-void ByteStreamMaintainer::printTrees()
-{
-    click_chatter("Ack tree:");
-    RBTreePrint(treeAck);
+    // Remove the entries before position that are not needed anymore
+    mapAckPositions.prune(position);
 
-    click_chatter("Seq tree:");
-    RBTreePrint(treeSeq);
+    // Map the value to have a valid seq number
+    uint32_t positionSeq = mapAck(position);
+    mapSeqPositions.prune(positionSeq);
 }
 
-void ByteStreamMaintainer::prune(uint32_t position)
+void ByteStreamMaintainer::insertInAckMap(uint32_t position, int offset)
 {
     if(!initialized)
     {
@@ -186,35 +184,10 @@ void ByteStreamMaintainer::prune(uint32_t position)
         return;
     }
 
-    pruneCounter++;
-
-    // We only prune the trees every time we receive BS_PRUNE_THRESHOLD ACKs
-    if(pruneCounter < BS_PRUNE_THRESHOLD)
-        return;
-
-    pruneCounter = 0;
-
-    // Remove every element in the tree with a key < position
-    RBPrune(treeAck, &position);
-
-    // Map the value to have a valid seq number
-    uint32_t positionSeq = mapAck(position);
-    // Remove every element in the tree with a key < position
-    RBPrune(treeSeq, &positionSeq);
-
-}
-
-void ByteStreamMaintainer::insertInAckTree(uint32_t position, int offset)
-{
-    insertInTree(treeAck, position, offset);
-}
-
-void ByteStreamMaintainer::insertInSeqTree(uint32_t position, int offset)
-{
-    insertInTree(treeSeq, position, offset);
+    mapAckPositions.insert(position, offset);
 }
 
-void ByteStreamMaintainer::insertInTree(rb_red_blk_tree* tree, uint32_t position, int offset)
+void ByteStreamMaintainer::insertInSeqMap(uint32_t position, int offset)
 {
     if(!initialized)
     {
@@ -223,50 +196,14 @@ void ByteStreamMaintainer::insertInTree(rb_red_blk_tree* tree, uint32_t position
         return;
     }
 
-    rb_red_blk_node* currentNode = RBExactQuery(tree, &position);
-    if(currentNode == tree->nil || currentNode == NULL)
-    {
-        // Node did not already exist, insert
-        uint32_t *newKey = ((RBTManager*)tree->manager)->allocateKey();
-        *newKey = position;
-        int *newInfo = ((RBTManager*)tree->manager)->allocateInfo();
-        *newInfo = offset;
-
-        RBTreeInsert(tree, newKey, newInfo);
-    }
-    else
-    {
-        // Node already exists, replace the old value
-        *((int*)currentNode->info) = offset;
-    }
-}
-
-int ByteStreamMaintainer::lastOffsetInAckTree()
-{
-    // Return the offset with the greatest key in the ack tree or 0 if the tree is empty
-    rb_red_blk_node* current = RBMax(treeAck);
-
-    if(current == treeAck->nil)
-        return 0;
-    else
-        return *((int*)current->info);
+    mapSeqPositions.insert(position, offset);
 }
 
 ByteStreamMaintainer::~ByteStreamMaintainer()
 {
-    if(initialized)
-    {
-        if (treeAck)
-            RBTreeDestroy(treeAck);
-        treeAck = 0;
-        if (treeSeq)
-            RBTreeDestroy(treeSeq);
-        treeSeq = 0;
-        initialized = false;
-    }
+    initialized = false;
 }
 
 CLICK_ENDDECLS
-ELEMENT_REQUIRES(RBT)
 ELEMENT_REQUIRES(ModificationList)
 ELEMENT_PROVIDES(ByteStreamMaintainer)
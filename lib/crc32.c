@@ -39,8 +39,29 @@
 /* taken from one of the BSDs, I believe */
 
 #define POLYNOMIAL 0x04c11db7L
+/* Reflected Castagnoli polynomial, for CRC-32C */
+#define POLYNOMIAL_C 0x82f63b78L
 
-static uint32_t crc_table[256];
+#if CLICK_USERLEVEL && defined(__x86_64__) && defined(__GNUC__)
+# define CRC_X86 1
+# include <immintrin.h>
+# include <string.h>
+#endif
+
+/* crc_table[k][i] is the CRC of byte i followed by k zero bytes, so eight
+   bytes can be processed with one lookup each (slice-by-8) */
+static uint32_t crc_table[8][256];
+static uint32_t crc_c_table[8][256];
+static volatile int initialized = 0;
+
+#if CRC_X86
+static uint32_t (*update_crc_fn)(uint32_t, const unsigned char *, int);
+static uint32_t (*update_crc32c_fn)(uint32_t, const unsigned char *, int);
+/* x^n mod P for the folding distances of update_crc_clmul */
+static uint32_t fold_k[4];
+#endif
+
+static void crc_init(void);
 
 static void
 gen_crc_table(void)
@@ -55,28 +76,188 @@ gen_crc_table(void)
                 else
                    crc_accum =
                      ( crc_accum << 1 ); }
-         crc_table[i] = crc_accum; }
+         crc_table[0][i] = crc_accum; }
+   for ( i = 0;  i < 256;  i++ )
+       { crc_accum = i;
+         for ( j = 0;  j < 8;  j++ )
+              crc_accum = ( crc_accum >> 1 ) ^ ( ( crc_accum & 1 ) ? POLYNOMIAL_C : 0 );
+         crc_c_table[0][i] = crc_accum; }
+   for ( j = 1;  j < 8;  j++ )
+       for ( i = 0;  i < 256;  i++ )
+           { crc_accum = crc_table[j - 1][i];
+             crc_table[j][i] = ( crc_accum << 8 ) ^ crc_table[0][crc_accum >> 24];
+             crc_accum = crc_c_table[j - 1][i];
+             crc_c_table[j][i] = ( crc_accum >> 8 ) ^ crc_c_table[0][crc_accum & 0xff]; }
    return; }
 
+static uint32_t
+update_crc_sw(uint32_t crc_accum, const unsigned char *p, int size)
+{
+  for (; size >= 8; size -= 8, p += 8) {
+    uint32_t a = crc_accum ^ (((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16)
+			      | ((uint32_t) p[2] << 8) | p[3]);
+    crc_accum = crc_table[7][a >> 24] ^ crc_table[6][(a >> 16) & 0xff]
+      ^ crc_table[5][(a >> 8) & 0xff] ^ crc_table[4][a & 0xff]
+      ^ crc_table[3][p[4]] ^ crc_table[2][p[5]]
+      ^ crc_table[1][p[6]] ^ crc_table[0][p[7]];
+  }
+  while (size-- > 0)
+    crc_accum = ( crc_accum << 8 ) ^ crc_table[0][( crc_accum >> 24 ) ^ *p++];
+  return crc_accum;
+}
+
+static uint32_t
+update_crc32c_sw(uint32_t crc, const unsigned char *p, int size)
+{
+  for (; size >= 8; size -= 8, p += 8) {
+    uint32_t lo = crc ^ ((uint32_t) p[0] | ((uint32_t) p[1] << 8)
+			 | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24));
+    crc = crc_c_table[7][lo & 0xff] ^ crc_c_table[6][(lo >> 8) & 0xff]
+      ^ crc_c_table[5][(lo >> 16) & 0xff] ^ crc_c_table[4][lo >> 24]
+      ^ crc_c_table[3][p[4]] ^ crc_c_table[2][p[5]]
+      ^ crc_c_table[1][p[6]] ^ crc_c_table[0][p[7]];
+  }
+  while (size-- > 0)
+    crc = ( crc >> 8 ) ^ crc_c_table[0][( crc ^ *p++ ) & 0xff];
+  return crc;
+}
+
+#if CRC_X86
+/* x^n mod P */
+static uint32_t
+xpow_mod(int n)
+{
+  uint32_t r = 1;
+  while (n-- > 0)
+    r = ( r & 0x80000000L ) ? ( r << 1 ) ^ POLYNOMIAL : ( r << 1 );
+  return r;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t
+update_crc32c_sse42(uint32_t crc, const unsigned char *p, int size)
+{
+  uint64_t c = crc;
+  for (; size >= 8; size -= 8, p += 8) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    c = _mm_crc32_u64(c, v);
+  }
+  crc = (uint32_t) c;
+  while (size-- > 0)
+    crc = _mm_crc32_u8(crc, *p++);
+  return crc;
+}
+
+/*
+ * Fold the data 64 bytes at a time in four 128-bit accumulators with
+ * carry-less multiplications, as described in Intel's "Fast CRC Computation
+ * for Generic Polynomials Using PCLMULQDQ Instruction". Each accumulator
+ * holds 16 bytes in big-endian order, so that bit i is the coefficient of
+ * x^i. The remaining 128-bit value and the tail are reduced by the table.
+ */
+__attribute__((target("pclmul,ssse3")))
+static uint32_t
+update_crc_clmul(uint32_t crc_accum, const unsigned char *p, int size)
+{
+  const __m128i swap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+				    8, 9, 10, 11, 12, 13, 14, 15);
+  const __m128i k4 = _mm_set_epi64x(fold_k[3], fold_k[2]); /* 512 bits */
+  const __m128i k1 = _mm_set_epi64x(fold_k[1], fold_k[0]); /* 128 bits */
+  __m128i x[4];
+  unsigned char last[16];
+  int i;
+
+  if (size < 128)
+    return update_crc_sw(crc_accum, p, size);
+
+  for (i = 0; i < 4; i++)
+    x[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (p + 16 * i)), swap);
+  /* The CRC so far is added to the first 32 bits of the data */
+  x[0] = _mm_xor_si128(x[0], _mm_set_epi32(crc_accum, 0, 0, 0));
+  p += 64;
+  size -= 64;
+
+  for (; size >= 64; size -= 64, p += 64)
+    for (i = 0; i < 4; i++) {
+      __m128i d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (p + 16 * i)), swap);
+      x[i] = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x[i], k4, 0x11),
+					 _mm_clmulepi64_si128(x[i], k4, 0x00)), d);
+    }
+
+  for (i = 1; i < 4; i++)
+    x[0] = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x[0], k1, 0x11),
+				       _mm_clmulepi64_si128(x[0], k1, 0x00)), x[i]);
+
+  for (; size >= 16; size -= 16, p += 16) {
+    __m128i d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) p), swap);
+    x[0] = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x[0], k1, 0x11),
+				       _mm_clmulepi64_si128(x[0], k1, 0x00)), d);
+  }
+
+  _mm_storeu_si128((__m128i *) last, _mm_shuffle_epi8(x[0], swap));
+  crc_accum = update_crc_sw(0, last, 16);
+  return update_crc_sw(crc_accum, p, size);
+}
+#endif
+
+static void
+crc_init(void)
+{
+  if (initialized)
+    return;
+  gen_crc_table();
+#if CRC_X86
+  fold_k[0] = xpow_mod(128);
+  fold_k[1] = xpow_mod(192);
+  fold_k[2] = xpow_mod(512);
+  fold_k[3] = xpow_mod(576);
+  __builtin_cpu_init();
+  update_crc_fn = (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3"))
+    ? update_crc_clmul : update_crc_sw;
+  update_crc32c_fn = __builtin_cpu_supports("sse4.2")
+    ? update_crc32c_sse42 : update_crc32c_sw;
+#endif
+  initialized = 1;
+}
+
+#if CLICK_USERLEVEL && defined(__GNUC__)
+/* Build the tables before threads may race to do it */
+__attribute__((constructor))
+static void
+crc_init_constructor(void)
+{
+  crc_init();
+}
+#endif
+
 /*
- * update the CRC on the data block one byte at a time
+ * update the CRC on the data block
  */
 uint32_t
 update_crc(uint32_t crc_accum,
            const char *data_blk_ptr,
            int data_blk_size)
 {
-  int i, j;
-  static int initialized = 0;
-
-  if(initialized == 0){
-    initialized = 1;
-    gen_crc_table();
-  }
+  if (!initialized)
+    crc_init();
+#if CRC_X86
+  return update_crc_fn(crc_accum, (const unsigned char *) data_blk_ptr, data_blk_size);
+#else
+  return update_crc_sw(crc_accum, (const unsigned char *) data_blk_ptr, data_blk_size);
+#endif
+}
 
-  for ( j = 0;  j < data_blk_size;  j++ ){
-    i = ( (uint32_t) ( crc_accum >> 24) ^ *data_blk_ptr++ ) & 0xff;
-    crc_accum = ( crc_accum << 8 ) ^ crc_table[i];
-  }
-  return crc_accum;
+uint32_t
+update_crc32c(uint32_t crc,
+	      const char *data_blk_ptr,
+	      int data_blk_size)
+{
+  if (!initialized)
+    crc_init();
+#if CRC_X86
+  return update_crc32c_fn(crc, (const unsigned char *) data_blk_ptr, data_blk_size);
+#else
+  return update_crc32c_sw(crc, (const unsigned char *) data_blk_ptr, data_blk_size);
+#endif
 }
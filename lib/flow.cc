@@ -22,7 +22,19 @@
 #include <click/glue.hh>
 #include <stdlib.h>
 #include <regex>
+#include <algorithm>
+#include <vector>
 #include <click/flow/flow.hh>
+#include <click/straccum.hh>
+#if CLICK_USERLEVEL
+# include <sys/mman.h>
+# include <sched.h>
+# include <errno.h>
+# include <string.h>
+#endif
+#if HAVE_NUMA
+# include <click/numa.hh>
+#endif
 
 CLICK_DECLS
 
@@ -138,7 +150,60 @@ FlowClassificationTable::Rule FlowClassificationTable::make_ip_mask(IPAddress ds
 
 }
 
-FlowClassificationTable::Rule FlowClassificationTable::parse(Element* owner, String s, bool verbose, bool add_leaf) {
+/**
+ * Offset of the header field matched by a token of a rule, or -1 for
+ * tokens that do not read the packet
+ */
+static int rule_field_offset(const std::smatch& m)
+{
+    if (m.str(1) == "ip")
+        return 9;
+    if (m.str(4) != "") {
+        bool src = (m.str(4)[0] | 0x20) == 's';
+        if (m.str(7) != "")
+            return src ? 20 : 22;
+        return src ? 12 : 16;
+    }
+    if (m.str(12) != "")
+        return std::stoi(m.str(12));
+    return -1;
+}
+
+/**
+ * True for tokens matching every packet, like "src net 0.0.0.0/0", which
+ * would otherwise give a level with an empty mask
+ */
+static bool rule_field_is_wildcard(const std::smatch& m)
+{
+    if (m.str(9) == "")
+        return false;
+    std::string net = m.str(10);
+    return atoi(net.c_str() + net.find('/') + 1) == 0;
+}
+
+/**
+ * Order the tokens of a conjunctive rule by the offset of their field. Rules
+ * then test fields in the same order whatever the way they are written, so
+ * when the rules are combined they share nodes instead of stacking new levels
+ * in the default paths. Rules using agg or thread are left untouched.
+ */
+static void sort_rule_fields(std::vector<std::smatch>& fields)
+{
+    std::vector<std::pair<int, unsigned> > keys;
+    for (unsigned i = 0; i < fields.size(); i++) {
+        int offset = rule_field_offset(fields[i]);
+        if (offset < 0)
+            return;
+        keys.push_back(std::make_pair(offset, i));
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<std::smatch> sorted;
+    for (unsigned i = 0; i < keys.size(); i++)
+        sorted.push_back(fields[keys[i].second]);
+    fields.swap(sorted);
+}
+
+FlowClassificationTable::Rule FlowClassificationTable::parse(Element* owner, String s, bool verbose, bool add_leaf, bool sort_fields) {
     String REG_IPV4 = "[0-9]{1,3}(?:[.][0-9]{1,3}){3}";
     String REG_NET = REG_IPV4 + "/[0-9]+";
     String REG_AL = "(?:[a-z]+|[0-9]+)";
@@ -175,14 +240,19 @@ FlowClassificationTable::Rule FlowClassificationTable::parse(Element* owner, Str
 
 
         FlowNode* parent = 0;
+        std::vector<std::smatch> fields;
         if (classs != "-") {
+            for (std::sregex_iterator fit(classs.begin(), classs.end(), classreg), fend; fit != fend; ++fit)
+                if (!rule_field_is_wildcard(*fit))
+                    fields.push_back(*fit);
+        }
+        if (!fields.empty()) {
+            if (sort_fields)
+                sort_rule_fields(fields);
 
-
-            std::regex_iterator<std::string::iterator> it (classs.begin(), classs.end(), classreg);
-            std::regex_iterator<std::string::iterator> end;
-
-            while (it != end)
+            for (unsigned fi = 0; fi < fields.size(); fi++)
             {
+                const std::smatch* it = &fields[fi];
                 if (verbose)
                     click_chatter("Class : %s",it->str(0).c_str());
 
@@ -266,8 +336,16 @@ FlowClassificationTable::Rule FlowClassificationTable::parse(Element* owner, Str
                         } else if (it->str(7) == "port") {
                             valuev = htons(atoi(it->str(8).c_str()));
                         } else {
-                            click_chatter("UNIMPLEMENTED net");
-                            abort();
+                            //A prefix is a masked value, so the level only reads the bytes it covers
+                            std::string net = it->str(10);
+                            size_t slash = net.find('/');
+                            int prefix = atoi(net.c_str() + slash + 1);
+                            if (prefix > 32) {
+                                click_chatter("Invalid prefix length in %s", net.c_str());
+                                abort();
+                            }
+                            maskv = IPAddress::make_prefix(prefix).addr();
+                            valuev = IPAddress(String(net.c_str(), slash)).addr() & maskv;
                         }
 
                     } else {
@@ -365,7 +443,6 @@ FlowClassificationTable::Rule FlowClassificationTable::parse(Element* owner, Str
                     parent_ptr = node->find(lastvalue, need_grow);
                 }
 
-                ++it;
             }
             if (parent_ptr != parent->default_ptr())
                 parent->inc_num();
@@ -1688,7 +1765,9 @@ FlowControlBlock* FlowControlBlock::duplicate(unsigned use_count) {
     fcb = FCBPool::init_allocate();
     //fcb->release_ptr = release_ptr;
     //fcb->release_fnt = release_fnt;
-    memcpy(fcb, this ,sizeof(FlowControlBlock) + (get_pool()->data_size() * 2));
+    //Initialization FCBs hold the data, then as much again for the "is set"
+    //markers of FlowSpaceElement::fcb_set_init_data, used by combine_data
+    memcpy(fcb, this ,sizeof(FlowControlBlock) + (FCBPool::init_data_size() * 2));
 #if HAVE_FLOW_DYNAMIC
     fcb->use_count = use_count;
 #endif
@@ -1697,6 +1776,11 @@ FlowControlBlock* FlowControlBlock::duplicate(unsigned use_count) {
 
 void FCBPool::compress(Bitvector threads) {
     lists.compress(threads);
+    //Arena slabs are mapped by the thread using them on first allocation, so
+    //the memory lands on its own NUMA node. Pre-allocating here would place
+    //everything on the node of the main thread.
+    if (_arena)
+        return;
     for (unsigned i = 0; i < lists.weight(); i++) {
         SFCBList &list = lists.get_value(i);
         for (int j = 0; j < SFCB_POOL_SIZE; j++) {
@@ -1706,6 +1790,157 @@ void FCBPool::compress(Bitvector threads) {
     }
 }
 
+/**
+ * Map a new slab for the calling thread. Explicit huge pages are tried first
+ * if a huge page size was given, then normal pages with a transparent huge
+ * page hint. With libnuma the slab is bound to the node of the current CPU
+ * before being touched.
+ */
+bool
+FCBPool::arena_grow(ArenaState &s) {
+    size_t size = _arena_page > FCB_ARENA_SLAB_SIZE ? _arena_page : FCB_ARENA_SLAB_SIZE;
+    void* mem = 0;
+    bool huge = false;
+#if CLICK_USERLEVEL
+    if (_arena_page) {
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+# ifdef MAP_HUGE_SHIFT
+        flags |= (_arena_page >= (1UL << 30) ? 30 : 21) << MAP_HUGE_SHIFT;
+# endif
+        mem = mmap(0, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (mem == MAP_FAILED) {
+            mem = 0;
+            if (s.n_slabs == 0)
+                click_chatter("Warning: could not map %luKB huge pages for the FCB arena of thread %d (%s), using normal pages.", _arena_page / 1024, click_current_cpu_id(), strerror(errno));
+        } else
+            huge = true;
+    }
+    if (!mem) {
+        mem = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+            return false;
+# ifdef MADV_HUGEPAGE
+        (void) madvise(mem, size, MADV_HUGEPAGE);
+# endif
+    }
+# if HAVE_NUMA
+    if (numa_available() != -1) {
+        s.node = numa_node_of_cpu(sched_getcpu());
+        if (s.node >= 0)
+            numa_tonode_memory(mem, size, s.node);
+    }
+# endif
+#else
+    mem = CLICK_LALLOC(size);
+    if (!mem)
+        return false;
+#endif
+    FCBSlab* slab = (FCBSlab*)mem;
+    slab->size = size;
+    slab->huge = huge;
+    slab->next = s.slabs;
+    s.slabs = slab;
+    s.n_slabs++;
+    if (huge)
+        s.n_huge++;
+    size_t header = (sizeof(FCBSlab) + CLICK_CACHE_LINE_SIZE - 1) & ~(size_t)(CLICK_CACHE_LINE_SIZE - 1);
+    s.cur = (uint8_t*)mem + header;
+    s.left = size - header;
+    return true;
+}
+
+void
+FCBPool::release_arena() {
+    for (unsigned i = 0; i < _state.weight(); i++) {
+        ArenaState &s = _state.get_value(i);
+        while (s.slabs) {
+            FCBSlab* next = s.slabs->next;
+#if CLICK_USERLEVEL
+            munmap(s.slabs, s.slabs->size);
+#else
+            CLICK_LFREE(s.slabs, s.slabs->size);
+#endif
+            s.slabs = next;
+        }
+        s = ArenaState();
+    }
+}
+
+bool
+FCBPool::in_arena(const FlowControlBlock* fcb) const {
+    for (unsigned i = 0; i < _state.weight(); i++)
+        for (FCBSlab* slab = _state.get_value(i).slabs; slab; slab = slab->next)
+            if ((const uint8_t*)fcb >= (const uint8_t*)slab
+                && (const uint8_t*)fcb < (const uint8_t*)slab + slab->size)
+                return true;
+    return false;
+}
+
+/**
+ * Free the FCBs of the per-thread caches and of the global ring that were
+ * not carved from an arena slab. FCBs still used by a table are not seen.
+ * Must be called before release_arena().
+ */
+void
+FCBPool::release_free_lists() {
+    if (lists.initialized()) {
+        for (unsigned i = 0; i < lists.weight(); i++) {
+            SFCBList &list = lists.get_value(i);
+            while (list.count() > 0) {
+                FlowControlBlock* fcb = list.get();
+                if (!in_arena(fcb))
+                    CLICK_LFREE(fcb, sizeof(FlowControlBlock) + _data_size);
+            }
+        }
+    }
+
+    SFCBList list;
+    while ((list = global_fcb_list_ring.extract()).count() > 0) {
+        while (list.count() > 0) {
+            FlowControlBlock* fcb = list.get();
+            if (!in_arena(fcb))
+                CLICK_LFREE(fcb, sizeof(FlowControlBlock) + _data_size);
+        }
+    }
+}
+
+FCBPool::Stats
+FCBPool::stats() const {
+    Stats st;
+    uint64_t allocated = 0;
+    uint64_t released = 0;
+    st.reserved = 0;
+    st.slabs = 0;
+    st.huge_slabs = 0;
+    st.memory = 0;
+    for (unsigned i = 0; i < _state.weight(); i++) {
+        const ArenaState &s = _state.get_value(i);
+        allocated += s.allocated;
+        released += s.released;
+        st.reserved += s.reserved;
+        st.slabs += s.n_slabs;
+        st.huge_slabs += s.n_huge;
+        for (FCBSlab* slab = s.slabs; slab; slab = slab->next)
+            st.memory += slab->size;
+    }
+    st.in_use = allocated > released ? allocated - released : 0;
+    return st;
+}
+
+String
+FCBPool::thread_stats() const {
+    StringAccum acc;
+    for (unsigned i = 0; i < _state.weight(); i++) {
+        const ArenaState &s = _state.get_value(i);
+        if (s.allocated == 0 && s.released == 0 && s.n_slabs == 0)
+            continue;
+        acc << i << " node " << s.node << " slabs " << s.n_slabs << " huge " << s.n_huge
+            << " reserved " << s.reserved << " allocated " << s.allocated
+            << " released " << s.released << "\n";
+    }
+    return acc.take_string();
+}
+
 FlowControlBlock*
 FCBPool::init_allocate() {
        FlowControlBlock* initfcb = (FlowControlBlock*)CLICK_LALLOC(sizeof(FlowControlBlock) + (init_data_size() * 2));
@@ -169,85 +169,136 @@ FlowBufferIter FlowBuffer::end()
     return FlowBufferIter(this, NULL);
 }
 
-FlowBufferContentIter FlowBuffer::searchSSE(FlowBufferContentIter start, const char* needle, const int pattern_length, int *feedback) {
+/**
+ * Find the first occurrence of needle fully inside s[0, n), or return -1.
+ * Positions where both the first and the last byte of the needle match are
+ * found 32 (or 16) at a time, and only those are compared.
+ */
+static inline int
+chunk_find(const unsigned char* s, int n, const char* needle, int pattern_length)
+{
+    int i = 0;
 #if HAVE_AVX2
-    int n = start.leftInChunk();
-    //If the first chunk is small, don't bother SSE
-    if (n < 32)
-        return search(start,needle,feedback);
-
     const __m256i first = _mm256_set1_epi8(needle[0]);
     const __m256i last  = _mm256_set1_epi8(needle[pattern_length - 1]);
-    unsigned char* s = start.get_ptr();
-    int i = 0;
-    *feedback = -1;
-    FlowBufferContentIter next = start;
-    next.moveToNextChunk();
-    __m256i eq_first;
-
-    while (true) {
+    for (; i + pattern_length - 1 + 32 <= n; i += 32) {
         const __m256i block_first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
         const __m256i block_last  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i + pattern_length - 1));
-
-        eq_first = _mm256_cmpeq_epi8(first, block_first);
-        const __m256i eq_last  = _mm256_cmpeq_epi8(last, block_last);
-
-        uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(eq_first, eq_last));
-
+        uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, block_first),
+                                                              _mm256_cmpeq_epi8(last, block_last)));
         while (mask != 0) {
-
-            const auto bitpos = __builtin_ctz(mask);
-
-            if (memcmp(s + i + bitpos + 1, needle + 1, pattern_length - 2) == 0) {
-                start += (i + bitpos);
-                *feedback = 1;
-                return start;
-            }
-
+            const int bitpos = __builtin_ctz(mask);
+            if (memcmp(s + i + bitpos + 1, needle + 1, pattern_length - 2) == 0)
+                return i + bitpos;
             mask = mask & (mask - 1);
         }
-        i += 32;
-        if (i + 32 + pattern_length >= n) {
-            if (start.lastChunk() || next == 0) {
-                //We have to check if a pattern could start in the last part
-                uint32_t z = _mm256_movemask_epi8(eq_first);
-                if (z != 0) {
-                    start += min(n - pattern_length, i - pattern_length);
-                } else {
-                    start += i - pattern_length;
-                }
+    }
+#elif defined(__SSE2__)
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last  = _mm_set1_epi8(needle[pattern_length - 1]);
+    for (; i + pattern_length - 1 + 16 <= n; i += 16) {
+        const __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        const __m128i block_last  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i + pattern_length - 1));
+        uint32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                                                        _mm_cmpeq_epi8(last, block_last)));
+        while (mask != 0) {
+            const int bitpos = __builtin_ctz(mask);
+            if (memcmp(s + i + bitpos + 1, needle + 1, pattern_length - 2) == 0)
+                return i + bitpos;
+            mask = mask & (mask - 1);
+        }
+    }
+#endif
+    while (i + pattern_length <= n) {
+        const unsigned char* c = (const unsigned char*)memchr(s + i, needle[0], n - pattern_length + 1 - i);
+        if (!c)
+            return -1;
+        i = c - s;
+        if (memcmp(c + 1, needle + 1, pattern_length - 1) == 0)
+            return i;
+        i++;
+    }
+    return -1;
+}
 
-                //click_chatter("searching now!");
-                return search(start,needle,feedback);
-            } else {
-                if (i + pattern_length >= n) {
-                    //click_chatter("Next chunk");
-                    start = next;
-                    //int am = i+pattern_length-n;
-                    i = 0;
-                    s = start.get_ptr();
-                    n = start.leftInChunk();
-                } else {
-                    //click_chatter("InterChunk prep!");
-                    int am = i+32+pattern_length-n;
-                    next = start;
-                    next.moveToNextChunk();
-                    //click_chatter("Copy %s at the end of %s, %d",(char*)next.get_ptr(),(char*)s+n,am);
-                    strncpy((char*)s+n,(char*)next.get_ptr(),am);
-                    //click_chatter("Result (am is %d): %s",am,s);
-                    next += am;
+/**
+ * Search each packet in place, without copying it. Only the occurrences
+ * straddling packets are looked for in a small carry buffer holding the
+ * last pattern_length - 1 bytes seen, followed by the start of the next
+ * packet.
+ */
+FlowBufferContentIter FlowBuffer::searchSSE(FlowBufferContentIter start, const char* needle, const int pattern_length, int *feedback) {
+    if (pattern_length < 2 || pattern_length > FLOW_BUFFER_SEARCH_CARRY)
+        return search(start, needle, feedback);
+
+    //Last bytes of the previous packets, then the start of the current one
+    unsigned char window[2 * FLOW_BUFFER_SEARCH_CARRY];
+    int carried = 0;
+    //Position of the first carried byte
+    FlowBufferContentIter carry_start = start;
+
+    Packet* entry = start.entry;
+    int offset = start.offsetInPacket;
+    while (entry) {
+        int n = entry->length() - (entry->getContentOffset() + offset);
+        if (n <= 0) {
+            entry = entry->next();
+            offset = 0;
+            continue;
+        }
+        const unsigned char* s = entry->getPacketContent() + offset;
+
+        if (carried) {
+            int add = min(n, pattern_length - 1);
+            memcpy(window + carried, s, add);
+            for (int i = 0; i < carried && i + pattern_length <= carried + add; i++) {
+                if (window[i] == (unsigned char)needle[0] && memcmp(window + i, needle, pattern_length) == 0) {
+                    *feedback = 1;
+                    while (i--)
+                        ++carry_start;
+                    return carry_start;
                 }
             }
         }
+
+        int pos = chunk_find(s, n, needle, pattern_length);
+        if (pos >= 0) {
+            *feedback = 1;
+            return FlowBufferContentIter(this, entry, offset + pos);
+        }
+
+        //Keep the last pattern_length - 1 bytes
+        if (n >= pattern_length - 1) {
+            carried = pattern_length - 1;
+            memcpy(window, s + n - carried, carried);
+            carry_start = FlowBufferContentIter(this, entry, offset + n - carried);
+        } else {
+            int total = carried + n;
+            int drop = total > pattern_length - 1 ? total - (pattern_length - 1) : 0;
+            if (carried == 0)
+                carry_start = FlowBufferContentIter(this, entry, offset);
+            memcpy(window + carried, s, n);
+            memmove(window, window + drop, total - drop);
+            for (int i = 0; i < drop; i++)
+                ++carry_start;
+            carried = total - drop;
+        }
+        entry = entry->next();
+        offset = 0;
+    }
+
+    //The start of the pattern may be at the end of the last packet
+    for (int i = 0; i < carried; i++) {
+        if (memcmp(window + i, needle, carried - i) == 0) {
+            *feedback = 0;
+            while (i--)
+                ++carry_start;
+            return carry_start;
+        }
     }
-    //Should be unreachable
-    assert(false);
 
     *feedback = -1;
     return contentEnd();
-#else
-    return search(start,needle,feedback);
-#endif
 }
 
 FlowBufferContentIter FlowBuffer::isearch(FlowBufferContentIter start, const char* pattern,
@@ -19,6 +19,7 @@
 #include <click/glue.hh>
 #include <click/hashtable.hh>
 #include <click/flow/flowelement.hh>
+#include <click/flowsnapshot.hh>
 #include <algorithm>
 #include <set>
 #if HAVE_CTX
@@ -409,6 +410,64 @@ void VirtualFlowManager::_build_fcb(int verbose, bool _ordered) {
     }
 }
 
+int VirtualFlowManager::fcb_snapshot_check(ErrorHandler* errh)
+{
+    for (int j = 0; j < _reachable_list.size(); j++) {
+        VirtualFlowSpaceElement* vfe = dynamic_cast<VirtualFlowSpaceElement*>(_reachable_list[j].first);
+        if (vfe->flow_data_size() > 0 && !vfe->flow_snapshot_supported())
+            return errh->error("%s does not support flow table snapshots", vfe->name().c_str());
+    }
+    return 0;
+}
+
+size_t VirtualFlowManager::fcb_snapshot_size()
+{
+    size_t size = 0;
+    for (int j = 0; j < _reachable_list.size(); j++) {
+        VirtualFlowSpaceElement* vfe = dynamic_cast<VirtualFlowSpaceElement*>(_reachable_list[j].first);
+        size += vfe->flow_snapshot_size();
+    }
+    return size;
+}
+
+uint32_t VirtualFlowManager::fcb_snapshot_layout()
+{
+    uint32_t h = FLOW_SNAPSHOT_LAYOUT_INIT;
+    for (int j = 0; j < _reachable_list.size(); j++) {
+        VirtualFlowSpaceElement* vfe = dynamic_cast<VirtualFlowSpaceElement*>(_reachable_list[j].first);
+        h = flow_snapshot_layout(h, vfe->class_name());
+        h = flow_snapshot_layout(h, vfe->name());
+        h = flow_snapshot_layout(h, (uint32_t)vfe->flow_snapshot_size());
+    }
+    return h;
+}
+
+void VirtualFlowManager::fcb_snapshot(FlowControlBlock* fcb, uint8_t* out)
+{
+    for (int j = 0; j < _reachable_list.size(); j++) {
+        VirtualFlowSpaceElement* vfe = dynamic_cast<VirtualFlowSpaceElement*>(_reachable_list[j].first);
+        vfe->flow_snapshot(fcb, out);
+        out += vfe->flow_snapshot_size();
+    }
+}
+
+void VirtualFlowManager::fcb_restore(FlowControlBlock* fcb, const uint8_t* in, uint32_t remaining_msec)
+{
+    for (int j = 0; j < _reachable_list.size(); j++) {
+        VirtualFlowSpaceElement* vfe = dynamic_cast<VirtualFlowSpaceElement*>(_reachable_list[j].first);
+        vfe->flow_restore(fcb, in, remaining_msec);
+        in += vfe->flow_snapshot_size();
+    }
+}
+
+void VirtualFlowManager::fcb_restore_done()
+{
+    for (int j = 0; j < _reachable_list.size(); j++) {
+        VirtualFlowSpaceElement* vfe = dynamic_cast<VirtualFlowSpaceElement*>(_reachable_list[j].first);
+        vfe->flow_restore_done();
+    }
+}
+
 
 CounterInitFuture::CounterInitFuture(String name, std::function<int(ErrorHandler*)> on_reached) : _n(0), _name(name), _on_reached(on_reached) {
 
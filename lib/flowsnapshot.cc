@@ -0,0 +1,196 @@
+// -*- c-basic-offset: 4; related-file-name: "../include/click/flowsnapshot.hh" -*-
+/*
+ * flowsnapshot.{cc,hh} -- on-disk flow table snapshots for warm restarts
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/glue.hh>
+#include <click/flowsnapshot.hh>
+#include <click/timestamp.hh>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+CLICK_DECLS
+
+#define FLOW_SNAPSHOT_FLUSH (1 << 20)
+
+FlowSnapshotWriter::FlowSnapshotWriter()
+    : _f(0), _count(0), _failed(false)
+{
+    memset(&_header, 0, sizeof(_header));
+}
+
+FlowSnapshotWriter::~FlowSnapshotWriter()
+{
+    if (_f) {
+        fclose(_f);
+        unlink(_tmp_path.c_str());
+    }
+}
+
+int
+FlowSnapshotWriter::open(const String &path, const String &owner,
+                         uint32_t record_size, uint32_t layout,
+                         ErrorHandler *errh)
+{
+    if (record_size < sizeof(FlowSnapshotRecord))
+        return errh->error("snapshot record too small");
+    _path = path;
+    _tmp_path = path + ".tmp";
+    _f = fopen(_tmp_path.c_str(), "w");
+    if (!_f)
+        return errh->error("%s: %s", _tmp_path.c_str(), strerror(errno));
+
+    memcpy(_header.magic, FLOW_SNAPSHOT_MAGIC, sizeof(_header.magic));
+    _header.version = FLOW_SNAPSHOT_VERSION;
+    _header.header_size = sizeof(FlowSnapshotHeader);
+    _header.record_size = record_size;
+    _header.layout = layout;
+    strncpy(_header.owner, owner.c_str(), sizeof(_header.owner) - 1);
+    _count = 0;
+    _failed = false;
+
+    //The header is rewritten with the right count and time on commit
+    if (fwrite(&_header, sizeof(_header), 1, _f) != 1) {
+        _failed = true;
+        return errh->error("%s: %s", _tmp_path.c_str(), strerror(errno));
+    }
+    return 0;
+}
+
+FlowSnapshotRecord *
+FlowSnapshotWriter::append()
+{
+    if (_buf.length() >= FLOW_SNAPSHOT_FLUSH && flush(ErrorHandler::silent_handler()) < 0)
+        _failed = true;
+    char *r = _buf.extend(_header.record_size);
+    if (!r) {
+        _failed = true;
+        _buf.clear();
+        r = _buf.extend(_header.record_size);
+    }
+    memset(r, 0, _header.record_size);
+    _count++;
+    return reinterpret_cast<FlowSnapshotRecord *>(r);
+}
+
+int
+FlowSnapshotWriter::flush(ErrorHandler *errh)
+{
+    if (_buf.length() && fwrite(_buf.data(), _buf.length(), 1, _f) != 1)
+        return errh->error("%s: %s", _tmp_path.c_str(), strerror(errno));
+    _buf.clear();
+    return 0;
+}
+
+int
+FlowSnapshotWriter::commit(ErrorHandler *errh)
+{
+    if (!_f)
+        return errh->error("snapshot not opened");
+    if (flush(errh) < 0)
+        _failed = true;
+    _header.count = _count;
+    _header.timestamp_msec = Timestamp::now().msecval();
+    if (!_failed && (fseek(_f, 0, SEEK_SET) != 0
+                     || fwrite(&_header, sizeof(_header), 1, _f) != 1))
+        _failed = true;
+    if (fclose(_f) != 0)
+        _failed = true;
+    _f = 0;
+    if (_failed) {
+        unlink(_tmp_path.c_str());
+        return errh->error("%s: could not write snapshot", _path.c_str());
+    }
+    if (rename(_tmp_path.c_str(), _path.c_str()) != 0) {
+        unlink(_tmp_path.c_str());
+        return errh->error("%s: %s", _path.c_str(), strerror(errno));
+    }
+    return 0;
+}
+
+
+FlowSnapshotReader::FlowSnapshotReader()
+    : _header(0), _records(0), _len(0), _age_msec(0)
+{
+}
+
+FlowSnapshotReader::~FlowSnapshotReader()
+{
+    close();
+}
+
+int
+FlowSnapshotReader::open(const String &path, const String &owner,
+                         uint32_t record_size, uint32_t layout,
+                         ErrorHandler *errh)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return errh->error("%s: %s", path.c_str(), strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        ::close(fd);
+        return errh->error("%s: %s", path.c_str(), strerror(errno));
+    }
+    if ((size_t) st.st_size < sizeof(FlowSnapshotHeader)) {
+        ::close(fd);
+        return errh->error("%s: not a flow snapshot", path.c_str());
+    }
+    void *mem = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED)
+        return errh->error("%s: %s", path.c_str(), strerror(errno));
+    (void) madvise(mem, st.st_size, MADV_SEQUENTIAL);
+    _header = static_cast<const FlowSnapshotHeader *>(mem);
+    _len = st.st_size;
+
+    String h_owner(_header->owner, strnlen(_header->owner, sizeof(_header->owner)));
+    const char *error = 0;
+    if (memcmp(_header->magic, FLOW_SNAPSHOT_MAGIC, sizeof(_header->magic)) != 0)
+        error = "not a flow snapshot";
+    else if (_header->version != FLOW_SNAPSHOT_VERSION)
+        error = "unsupported snapshot version";
+    else if (h_owner != owner)
+        error = "snapshot was taken by another element class";
+    else if (_header->record_size != record_size || _header->layout != layout)
+        error = "snapshot record layout does not match the configuration";
+    else if (_header->header_size + _header->count * (uint64_t) _header->record_size > _len)
+        error = "truncated snapshot";
+    if (error) {
+        close();
+        return errh->error("%s: %s", path.c_str(), error);
+    }
+
+    _records = reinterpret_cast<const uint8_t *>(mem) + _header->header_size;
+    int64_t age = Timestamp::now().msecval() - _header->timestamp_msec;
+    _age_msec = age < 0 ? 0 : (age > UINT32_MAX ? UINT32_MAX : age);
+    return 0;
+}
+
+void
+FlowSnapshotReader::close()
+{
+    if (_header)
+        munmap(const_cast<FlowSnapshotHeader *>(_header), _len);
+    _header = 0;
+    _records = 0;
+    _len = 0;
+}
+
+CLICK_ENDDECLS
@@ -203,11 +203,11 @@ void ModificationList::commit(ByteStreamMaintainer &maintainer)
 {
     struct ModificationNode* node = head;
 
-    // Get the last value in the tree to obtain the effects of
+    // Get the last value in the ack map to obtain the effects of
     // the modifications in the previous packets
-    // Offsets in the ack tree have the opposite sign with respect to the elements in
+    // Offsets in the ack map have the opposite sign with respect to the elements in
     // the modification list
-    int offsetTotal = -(maintainer.lastOffsetInAckTree());
+    int offsetTotal = -(maintainer.lastOffsetInAckMap());
 
     while(node != NULL)
     {
@@ -229,10 +229,10 @@ void ModificationList::commit(ByteStreamMaintainer &maintainer)
 
 //        click_chatter("Commit %lu %lu %lu %lu",newPositionAck, newPositionSeq, newOffsetAck, newOffsetSeq);
 
-        // Insert the node in the tree. In case of duplicates, keep only the
+        // Insert the entry in the maps. In case of duplicates, keep only the
         // new value
-        maintainer.insertInAckTree(newPositionAck, newOffsetAck);
-        maintainer.insertInSeqTree(newPositionSeq, newOffsetSeq);
+        maintainer.insertInAckMap(newPositionAck, newOffsetAck);
+        maintainer.insertInSeqMap(newPositionSeq, newOffsetSeq);
 
         struct ModificationNode* next = node->next;
 